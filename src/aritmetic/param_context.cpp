@@ -0,0 +1,106 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "param_context.h"
+#include "polynomial.h"
+
+typedef std::tuple<int, ZZ, ZZ> param_key_t;
+
+static std::mutex contexts_mutex;
+static std::map<param_key_t, param_context_t*> contexts;
+static param_context_t *current = NULL;
+
+/**
+ * Builds a context from the globals written by gen_crt_primes() and
+ * CUDAFunctions::init(). The context takes over their buffers, so a later
+ * call to either of them allocates new ones.
+ */
+static param_context_t* param_context_build(int nphi, ZZ q, ZZ t){
+	// The twiddles are only built by init(), for the new degree
+	CUDAFunctions::N = 0;
+	gen_crt_primes(q, nphi);
+	CUDAFunctions::init(nphi);
+
+	param_context_t *ctx = new param_context_t;
+	ctx->nphi = nphi;
+	ctx->q = q;
+	ctx->t = t;
+	ctx->CRTPrimes = CRTPrimes;
+	ctx->CRTProduct = CRTProduct;
+	ctx->CRTMpi = CRTMpi;
+	ctx->CRTInvMpi = CRTInvMpi;
+	ctx->CRTRoots = CRTRoots;
+	ctx->tables = CUDAFunctions::export_tables();
+	ctx->fixed = bn_fixed_params;
+	ctx->d_garner_inv = d_garner_inv;
+	ctx->d_garner_inv_shoup = d_garner_inv_shoup;
+	garner_borrowed = true;
+	reciprocal_table_init(&ctx->reciprocals, q, CRTProduct);
+	return ctx;
+}
+
+/**
+ * param_context_switch() with contexts_mutex held
+ */
+static void param_context_switch_locked(param_context_t *ctx){
+	current = ctx;
+	if(ctx == NULL)
+		return;
+
+	CRTPrimes = ctx->CRTPrimes;
+	CRTProduct = ctx->CRTProduct;
+	CRTMpi = ctx->CRTMpi;
+	CRTInvMpi = ctx->CRTInvMpi;
+	CRTRoots = ctx->CRTRoots;
+	CUDAFunctions::import_tables(ctx->tables);
+	bn_fixed_params = ctx->fixed;
+	bn_fixed_write_params();
+	d_garner_inv = ctx->d_garner_inv;
+	d_garner_inv_shoup = ctx->d_garner_inv_shoup;
+	garner_borrowed = true;
+	OP_DEGREE = ctx->nphi;
+}
+
+param_context_t* param_context_get(int nphi, ZZ q, ZZ t){
+	std::lock_guard<std::mutex> lock(contexts_mutex);
+	const param_key_t key(nphi, q, t);
+	std::map<param_key_t, param_context_t*>::iterator it = contexts.find(key);
+	if(it != contexts.end()){
+		param_context_switch_locked(it->second);
+		return it->second;
+	}
+
+	param_context_t *ctx = param_context_build(nphi, q, t);
+	contexts[key] = ctx;
+	current = ctx;
+	OP_DEGREE = nphi;
+	return ctx;
+}
+
+void param_context_switch(param_context_t *ctx){
+	std::lock_guard<std::mutex> lock(contexts_mutex);
+	param_context_switch_locked(ctx);
+}
+
+param_context_t* param_context_current(){
+	std::lock_guard<std::mutex> lock(contexts_mutex);
+	return current;
+}
@@ -0,0 +1,83 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARAM_CONTEXT_H
+#define PARAM_CONTEXT_H
+
+#include <vector>
+#include <NTL/ZZ.h>
+#include "../settings.h"
+#include "../cuda/operators.h"
+#include "../cuda/cuda_bn.h"
+#include "polynomial.h"
+
+/**
+ * Everything derived from a parameter set (nphi, q, t).
+ *
+ * gen_crt_primes() and CUDAFunctions::init() write their output to process
+ * globals. A ParamContext runs them once and keeps a copy of that output,
+ * i.e., the CRT primes and constants, the twiddles, the scratch buffers of
+ * the transform and the reciprocals of q and M. Switching to a cached
+ * context only writes the copy back, so nothing is recomputed.
+ *
+ * The round(t*x/q) constants are not kept, since they belong to the Yashe
+ * keys and are rebuilt with them by Yashe::generate_keys().
+ *
+ * The cache is guarded by a mutex, but the globals are shared by every
+ * thread, so contexts must not be switched while other threads compute.
+ */
+struct param_context {
+	int nphi;
+	ZZ q;
+	ZZ t;
+
+	std::vector<cuyasheint_t> CRTPrimes;
+	ZZ CRTProduct;
+	std::vector<ZZ> CRTMpi;
+	std::vector<cuyasheint_t> CRTInvMpi;
+	std::vector<cuyasheint_t> CRTRoots;
+	crt_tables_t *tables; // backend constants and buffers
+	bn_fixed_params_t fixed;
+	cuyasheint_t *d_garner_inv;
+	cuyasheint_t *d_garner_inv_shoup;
+	reciprocal_table_t reciprocals; // read only, shared by every thread
+} typedef param_context_t;
+
+/**
+ * Returns the context of (nphi, q, t) and makes it the current one. It is
+ * built on the first call with these parameters.
+ * @param  nphi [input] degree of the cyclotomic polynomial
+ * @param  q    [input]
+ * @param  t    [input]
+ * @return      the context, owned by the cache
+ */
+param_context_t* param_context_get(int nphi, ZZ q, ZZ t);
+
+/**
+ * Makes ctx the current context. If ctx is NULL, no context is current any
+ * more and the globals are left as they are.
+ * @param ctx [input]
+ */
+void param_context_switch(param_context_t *ctx);
+
+/**
+ * @return the current context, or NULL if there is none
+ */
+param_context_t* param_context_current();
+
+#endif
@@ -16,6 +16,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
 #include "polynomial.h"
 
 int OP_DEGREE = 4096;
@@ -24,11 +25,21 @@ std::vector<cuyasheint_t> CRTPrimes;
 ZZ CRTProduct;
 std::vector<ZZ> CRTMpi;
 std::vector<cuyasheint_t> CRTInvMpi;
+std::vector<cuyasheint_t> CRTRoots;
 extern __host__ void callMersenneMod(bn_t *g, bn_t q,int nq, int N, cudaStream_t stream);
+extern __host__ void callMersenneModMatrix(bn_matrix_t *g, int nq, cudaStream_t stream);
+extern __host__ void callModQMatrix(bn_matrix_t *g, cudaStream_t stream);
 
 
 
-std::map<ZZ, std::pair<cuyasheint_t*,int>> reciprocals;
+// Append-only list of reciprocals. Entries are never changed nor released
+// once published, so readers just follow the pointers.
+struct reciprocal_entry {
+	ZZ q;
+	bn_t u;
+	const reciprocal_entry *next;
+};
+static std::atomic<const reciprocal_entry*> reciprocals(NULL);
 
 /** 
  * polynomial initialization
@@ -37,27 +48,24 @@ std::map<ZZ, std::pair<cuyasheint_t*,int>> reciprocals;
 void poly_init(poly_t *a){
 	assert(CUDAFunctions::N);
 
-	// Memory allocation on the GPU is synchronous. So, first we allocate all memory that 
-	// we need and then call asynchronous functions.
-	cudaError_t result = cudaMalloc((void**)&a->d_coefs,CUDAFunctions::N*CRTPrimes.size()*sizeof(cuyasheint_t));
-	assert( result == cudaSuccess);
+	// Every buffer is drawn from the pool, so a steady-state loop that
+	// creates and frees polynomials doesn't allocate memory.
+	a->d_coefs = (cuyasheint_t*)pool_malloc(CUDAFunctions::N*CRTPrimes.size()*sizeof(cuyasheint_t));
 	
 	// Big-number array
 	bn_t *h_bn_coefs;
 	h_bn_coefs = (bn_t*)malloc(CUDAFunctions::N*sizeof(bn_t));
+	assert(h_bn_coefs);
 	cuyasheint_t *d_bn_coefs_dp;
-	result = cudaMalloc((void**)&d_bn_coefs_dp,CUDAFunctions::N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
-	assert( result == cudaSuccess);
+	d_bn_coefs_dp = (cuyasheint_t*)pool_malloc(CUDAFunctions::N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
 	
 
 	// CRT-NTT array
-	result = cudaMalloc((void**)&a->d_bn_coefs,CUDAFunctions::N*sizeof(bn_t));
-	assert( result == cudaSuccess);
+	a->d_bn_coefs = (bn_t*)pool_malloc(CUDAFunctions::N*sizeof(bn_t));
 	
 	#ifdef CUFFTMUL_TRANSFORM
 	// If CUFFTMUL mode
-	result = cudaMalloc((void**)&a->d_coefs_transf,CUDAFunctions::N*CRTPrimes.size()*sizeof(Complex));
-	assert( result == cudaSuccess);
+	a->d_coefs_transf = (Complex*)pool_malloc(CUDAFunctions::N*CRTPrimes.size()*sizeof(Complex));
 	#endif
 
 	// Host vector
@@ -72,12 +80,13 @@ void poly_init(poly_t *a){
 	}
 
 	// Copy to device	
+	cudaError_t result;
 	result = cudaMemsetAsync(a->d_coefs,0,CUDAFunctions::N*CRTPrimes.size()*sizeof(cuyasheint_t));
 	assert( result == cudaSuccess);
-	result = cudaMemcpyAsync(a->d_bn_coefs,h_bn_coefs,CUDAFunctions::N*sizeof(bn_t),cudaMemcpyHostToDevice);
+	result = cudaMemcpy(a->d_bn_coefs,h_bn_coefs,CUDAFunctions::N*sizeof(bn_t),cudaMemcpyHostToDevice);
 	assert( result == cudaSuccess);
 
-
+	free(h_bn_coefs);
 }
 
 /**
@@ -89,22 +98,21 @@ void poly_free(poly_t *a){
 	// CRT residues
 	cudaError_t result;
 	a->coefs.clear();
-	result = cudaFree(a->d_coefs);
-	assert(result == cudaSuccess);
+	pool_free(a->d_coefs);
+	a->d_coefs = NULL;
 
 	// BN_T
 	bn_t d_first;
 	result = cudaMemcpy(&d_first,a->d_bn_coefs,sizeof(bn_t),cudaMemcpyDeviceToHost);
 	assert(result == cudaSuccess);
-	result = cudaFree(d_first.dp);
-	assert(result == cudaSuccess);
-	result = cudaFree(a->d_bn_coefs);
-	assert(result == cudaSuccess);
+	pool_free(d_first.dp);
+	pool_free(a->d_bn_coefs);
+	a->d_bn_coefs = NULL;
 
 	// FFT residues
 	#ifdef CUFFTMUL_TRANSFORM
-	result = cudaFree(a->d_coefs_transf);
-	assert(result == cudaSuccess);
+	pool_free(a->d_coefs_transf);
+	a->d_coefs_transf = NULL;
 	#endif
 
 }
@@ -151,22 +159,77 @@ int poly_get_deg(poly_t *a){
 }
 
 /**
- * polynomial addition
- * @param c [output]
- * @param a [input]
- * @param b [input]
+ * Returns the cheapest domain in which a linear operation (add/sub) over
+ * operands on states sa and sb can be computed.
+ *
+ * Addition is linear, so it may be done either over the CRT residues or over
+ * the transformed residues. The domain that requires fewer conversions is
+ * selected, so only the operand in the minority state is converted. HOSTSTATE
+ * operands must be taken at least to CRTSTATE. On a tie, the domain of the
+ * operand that is also the output is kept (e.g. an accumulator). Otherwise
+ * TRANSSTATE is preferred, since the result is likely to be multiplied.
+ * @param  sa [input] state of the first operand
+ * @param  sb [input] state of the second operand
+ * @param  sc [input] state of the operand that is also the output, or -1
+ * @return    CRTSTATE or TRANSSTATE
  */
-void poly_add(poly_t *c, poly_t *a, poly_t *b){
-	while(a->status != TRANSSTATE)
+static int linear_domain(int sa, int sb, int sc){
+	#ifdef NTTMUL_TRANSFORM
+	// Number of elevate/demote steps required to reach each domain
+	const int crt_cost = abs(sa - CRTSTATE) + abs(sb - CRTSTATE);
+	const int trans_cost = abs(sa - TRANSSTATE) + abs(sb - TRANSSTATE);
+
+	if(crt_cost < trans_cost)
+		return CRTSTATE;
+	else if(trans_cost < crt_cost)
+		return TRANSSTATE;
+	else if(sc == CRTSTATE || sc == TRANSSTATE)
+		return sc;
+	return TRANSSTATE;
+	#else
+	// The cuFFT residues can only be added on the transform domain
+	return TRANSSTATE;
+	#endif
+}
+
+static int poly_linear_domain(poly_t *c, poly_t *a, poly_t *b){
+	return linear_domain(	a->status,
+							b->status,
+							(c == a? a->status : (c == b? b->status : -1)));
+}
+
+/**
+ * Elevates or demotes a until it reaches state
+ * @param a     [input]
+ * @param state [input] CRTSTATE or TRANSSTATE
+ */
+static void poly_to_state(poly_t *a, int state){
+	assert(state == CRTSTATE || state == TRANSSTATE);
+	while(a->status < state)
 		poly_elevate(a);
-	while(b->status != TRANSSTATE)
-		poly_elevate(b);
+	while(a->status > state)
+		poly_demote(a);
+}
+
+/**
+ * Computes c = a OP b on the cheapest common domain of a and b
+ * @param c  [output]
+ * @param a  [input]
+ * @param b  [input]
+ * @param OP [input] ADD or SUB
+ */
+static void poly_addsub(poly_t *c, poly_t *a, poly_t *b, int OP){
+	const int state = poly_linear_domain(c,a,b);
+	poly_to_state(a,state);
+	poly_to_state(b,state);
 
 	#ifdef NTTMUL_TRANSFORM
+	// Both domains keep the residues on d_coefs
 	CUDAFunctions::callPolynomialAddSub(	c->d_coefs,
 											a->d_coefs,
 											b->d_coefs,
 											CUDAFunctions::N*CRTPrimes.size(),
+											OP,
 											NULL);
 
 	#else
@@ -174,11 +237,31 @@ void poly_add(poly_t *c, poly_t *a, poly_t *b){
 												a->d_coefs_transf,
 												b->d_coefs_transf,
 												CUDAFunctions::N*CRTPrimes.size(),
-												ADD,
+												OP,
 												NULL);
 	#endif
 
-	c->status = TRANSSTATE;
+	c->status = state;
+}
+
+/**
+ * polynomial addition
+ * @param c [output]
+ * @param a [input]
+ * @param b [input]
+ */
+void poly_add(poly_t *c, poly_t *a, poly_t *b){
+	poly_addsub(c,a,b,ADD);
+}
+
+/**
+ * polynomial subtraction
+ * @param c [output]
+ * @param a [input]
+ * @param b [input]
+ */
+void poly_sub(poly_t *c, poly_t *a, poly_t *b){
+	poly_addsub(c,a,b,SUB);
 }
 /**
  * polynomial multiplication
@@ -210,6 +293,66 @@ void poly_mul(poly_t *c, poly_t *a, poly_t *b){
 	c->status = TRANSSTATE;
 }
 
+/**
+ * Computes c = (accumulate? c : 0) + sum_{i<k} a[i]*b[i]
+ * @param c          [output]
+ * @param a          [input]
+ * @param b          [input]
+ * @param k          [input]
+ * @param accumulate [input]
+ */
+static void poly_mul_acc_aux(poly_t *c, poly_t *a, poly_t *b, int k, bool accumulate){
+	for(int i = 0; i < k; i++){
+		while(a[i].status != TRANSSTATE)
+			poly_elevate(&a[i]);
+		while(b[i].status != TRANSSTATE)
+			poly_elevate(&b[i]);
+	}
+	if(accumulate)
+		while(c->status != TRANSSTATE)
+			poly_elevate(c);
+
+	#ifdef HOST_BACKEND
+	std::vector<cuyasheint_t*> A(k), B(k);
+	for(int i = 0; i < k; i++){
+		A[i] = a[i].d_coefs;
+		B[i] = b[i].d_coefs;
+	}
+	CUDAFunctions::callPolynomialMulAcc(	c->d_coefs,
+											&A[0],
+											&B[0],
+											k,
+											CUDAFunctions::N*CRTPrimes.size(),
+											accumulate,
+											NULL);
+	#else
+	// There is no fused kernel on the GPU, so it falls back to one product
+	// at a time
+	poly_t aux;
+	poly_init(&aux);
+	if(!accumulate){
+		// Zero is the same on every domain
+		poly_clear(c);
+		c->status = TRANSSTATE;
+	}
+	for(int i = 0; i < k; i++){
+		poly_mul(&aux,&a[i],&b[i]);
+		poly_add(c,c,&aux);
+	}
+	poly_free(&aux);
+	#endif
+
+	c->status = TRANSSTATE;
+}
+
+void poly_mul_acc(poly_t *c, poly_t *a, poly_t *b, int k){
+	poly_mul_acc_aux(c,a,b,k,true);
+}
+
+void poly_dot(poly_t *c, poly_t *a, poly_t *b, int k){
+	poly_mul_acc_aux(c,a,b,k,false);
+}
+
 /**
  * polynomial addition with an integer
  * @param c [output]
@@ -217,6 +360,8 @@ void poly_mul(poly_t *c, poly_t *a, poly_t *b){
  * @param b [input]
  */
 void poly_integer_add(poly_t *c, poly_t *a, cuyasheint_t b){
+	// A constant is the same at every evaluation point, so this is done on
+	// TRANSSTATE. On CRTSTATE only the 0-degree coefficient would be affected.
 	while(a->status != TRANSSTATE)
 		poly_elevate(a);
 
@@ -253,8 +398,14 @@ void poly_integer_add(poly_t *c, poly_t *a, cuyasheint_t b){
  */
 
 void poly_integer_mul(poly_t *c, poly_t *a, cuyasheint_t b){
+	// Scaling is linear, so CRTSTATE operands don't need to be transformed
+	#ifdef NTTMUL_TRANSFORM
+	if(a->status == HOSTSTATE)
+		poly_elevate(a);
+	#else
 	while(a->status != TRANSSTATE)
 		poly_elevate(a);
+	#endif
 
   	#ifdef NTTMUL_TRANSFORM
 	CUDAFunctions::callPolynomialOPInteger (
@@ -278,7 +429,7 @@ void poly_integer_mul(poly_t *c, poly_t *a, cuyasheint_t b){
                                           );
 	#endif
 
-	c->status = TRANSSTATE;
+	c->status = a->status;
 }
 
 /**
@@ -337,7 +488,8 @@ void poly_biginteger_mul(poly_t *c, poly_t *a, ZZ b){
  * @param a    [description]
  * @param nphi [description]
  * @param q    [description]
- * @param nq   [description]
+ * @param nq   bits of q. If bn_fixed_setup() was called for a q of nq
+ *             bits, that is the q a is reduced by. Otherwise q = 2^nq - 1.
  */
 void poly_reduce(poly_t *a, int nphi, bn_t q, int nq){
 	const unsigned int half = nphi-1;     
@@ -360,29 +512,60 @@ void poly_reduce(poly_t *a, int nphi, bn_t q, int nq){
 	// poly_elevate(a);
 	// poly_elevate(a);
 	
+	// The negacyclic transform reduces by x^nphi + 1 on the way, so a
+	// TRANSSTATE input needs no fold. Any other one is folded as on the
+	// cyclic transform, rather than transformed back and forth.
+	const bool negacyclic = (CUDAFunctions::transform == NEGACYCLIC_NTTMUL);
+	assert(!negacyclic || nphi == CUDAFunctions::N/2);
+	const bool folded = (negacyclic && a->status == TRANSSTATE);
+	// The q of bn_fixed_setup() is picked by its size alone, so q itself is
+	// never read back from the device
+	const bool fixed_q = (bn_fixed_params.nq == nq);
+
 	// log_notice("reducing on GPU/COEFS")
-	if(a->status == TRANSSTATE){
-		poly_demote(a);
-		callICRT(a->d_bn_coefs,
-		      a->d_coefs,
-		      CUDAFunctions::N,
-		      CRTPrimes.size(),
-		      NULL
-	    );
-	}else if(a->status == HOSTSTATE)
-		poly_elevate(a);
+	// The coefficients are reduced on a limb matrix and only the residues are
+	// written back. d_bn_coefs is left stale, as any other CRTSTATE result.
+	if(a->status != HOSTSTATE &&
+		fixed_q &&
+		CUDAFunctions::N == 2*nphi){
+		// Residues in, residues out: a single pass with no limb matrix
+		if(a->status == TRANSSTATE)
+			poly_demote(a);
+		callPolynomialReduceFused(	a->d_coefs,
+									(folded? 0 : nphi),
+									CUDAFunctions::N,
+									CRTPrimes.size(),
+									nq,
+									NULL);
+		a->status = CRTSTATE;
+		return;
+	}
 
-	CUDAFunctions::callPolynomialReductionCoefs(a->d_bn_coefs, half, CUDAFunctions::N);
-	callMersenneMod(a->d_bn_coefs , q, nq, CUDAFunctions::N, NULL);
-    
-    callCRT(a->d_bn_coefs,
-          CUDAFunctions::N,
-          a->d_coefs,
-          CUDAFunctions::N,
-          CRTPrimes.size(),
-          0x0
-    );
+	bn_matrix_t g;
+	bn_matrix_init(&g, CUDAFunctions::N);
+	if(a->status == HOSTSTATE){
+		// The coefficients may not fit on (-M/2, M/2], so they are folded on
+		// the limb matrix
+		poly_elevate(a);
+		callBNToMatrix(&g, a->d_bn_coefs, CUDAFunctions::N, NULL);
+		CUDAFunctions::callPolynomialReductionCoefsMatrix(&g, half, CUDAFunctions::N);
+	}else{
+		if(a->status == TRANSSTATE)
+			poly_demote(a);
+		// Linear operations may update the residues on CRTSTATE, so the
+		// coefficients are always recomputed. The difference is taken on the
+		// residues and the balanced ICRT gives its sign back.
+		if(!folded)
+			CUDAFunctions::callPolynomialReductionCRT(a->d_coefs, half, CUDAFunctions::N, CUDAFunctions::N, CRTPrimes.size());
+		callICRTMatrix(&g, a->d_coefs, CRTPrimes.size(), NULL);
+	}
 
+	if(fixed_q)
+		callModQMatrix(&g, NULL);
+	else
+		callMersenneModMatrix(&g, nq, NULL);
+	callCRTMatrix(&g, a->d_coefs, CRTPrimes.size(), NULL);
+	bn_matrix_free(&g);
 
 	// poly_mersenne_reduction(a,q,nq);
   	a->status = CRTSTATE;
@@ -395,18 +578,37 @@ void poly_reduce(poly_t *a, int nphi, bn_t q, int nq){
  */
 void poly_cyclotomic_reduction(poly_t *a, int nphi){
 	const unsigned int half = nphi-1;     
-	if(a->status == TRANSSTATE){
-		poly_demote(a);
-		callICRT(a->d_bn_coefs,
-		      a->d_coefs,
-		      CUDAFunctions::N,
-		      CRTPrimes.size(),
-		      NULL
-	    );
-	}else if(a->status == HOSTSTATE)
+	// The negacyclic transform reduces by x^nphi + 1 on the way
+	const bool negacyclic = (CUDAFunctions::transform == NEGACYCLIC_NTTMUL);
+	assert(!negacyclic || nphi == CUDAFunctions::N/2);
+	const bool folded = (negacyclic && a->status == TRANSSTATE);
+
+	if(a->status == HOSTSTATE){
+		// The coefficients may not fit on (-M/2, M/2], so they are folded on
+		// the limb matrix, as on poly_reduce()
 		poly_elevate(a);
+		bn_matrix_t g;
+		bn_matrix_init(&g, CUDAFunctions::N);
+		callBNToMatrix(&g, a->d_bn_coefs, CUDAFunctions::N, NULL);
+		CUDAFunctions::callPolynomialReductionCoefsMatrix(&g, half, CUDAFunctions::N);
+		callMatrixToBN(a->d_bn_coefs, &g, CUDAFunctions::N, NULL);
+		callCRTMatrix(&g, a->d_coefs, CRTPrimes.size(), NULL);
+		bn_matrix_free(&g);
+		return;
+	}
+	if(a->status == TRANSSTATE)
+		poly_demote(a);
 
-	CUDAFunctions::callPolynomialReductionCoefs(a->d_bn_coefs, half, CUDAFunctions::N);
+	// a[i] - a[i+half+1] is taken on the residues, and the balanced ICRT
+	// writes it back with its sign
+	if(!folded)
+		CUDAFunctions::callPolynomialReductionCRT(a->d_coefs, half, CUDAFunctions::N, CUDAFunctions::N, CRTPrimes.size());
+	callICRT(a->d_bn_coefs,
+	      a->d_coefs,
+	      CUDAFunctions::N,
+	      CRTPrimes.size(),
+	      NULL
+    );
 
    //  callCRT(a->d_bn_coefs,
    //        CUDAFunctions::N,
@@ -426,26 +628,22 @@ void poly_cyclotomic_reduction(poly_t *a, int nphi){
  * @param nq [description]
  */
 void poly_mersenne_reduction(poly_t *a, bn_t q, int nq){
-	if(a->status == TRANSSTATE){
-		poly_demote(a);
-		callICRT(a->d_bn_coefs,
-		      a->d_coefs,
-		      CUDAFunctions::N,
-		      CRTPrimes.size(),
-		      NULL
-	    );
-	}else if(a->status == HOSTSTATE)
+	bn_matrix_t g;
+	bn_matrix_init(&g, CUDAFunctions::N);
+	if(a->status == HOSTSTATE){
 		poly_elevate(a);
+		callBNToMatrix(&g, a->d_bn_coefs, CUDAFunctions::N, NULL);
+	}else{
+		if(a->status == TRANSSTATE)
+			poly_demote(a);
+		// Linear operations may update the residues on CRTSTATE, so the
+		// coefficients are always recomputed
+		callICRTMatrix(&g, a->d_coefs, CRTPrimes.size(), NULL);
+	}
 
-	callMersenneMod(a->d_bn_coefs , q, nq, CUDAFunctions::N, NULL);
-
-    callCRT(a->d_bn_coefs,
-          CUDAFunctions::N,
-          a->d_coefs,
-          CUDAFunctions::N,
-          CRTPrimes.size(),
-          0x0
-    );
+	callMersenneModMatrix(&g, nq, NULL);
+	callCRTMatrix(&g, a->d_coefs, CRTPrimes.size(), NULL);
+	bn_matrix_free(&g);
 
   	a->status = CRTSTATE;
 }
@@ -482,7 +680,7 @@ void poly_invmod(poly_t *fInv, poly_t *f, int nphi, int nq){
 		else
 			ntl_value = conv<ZZ>(NTL::rep(NTL::coeff(inv_f_ntl,i))[0]);
 
-			poly_set_coeff(fInv,i,ntl_value);
+		poly_set_coeff(fInv,i,ntl_value);
 	}
 
 	fInv->status = HOSTSTATE;
@@ -611,7 +809,7 @@ std::string poly_print(poly_t *a){
 		poly_demote(a);
 
 	std::ostringstream oss;
-	for(int i = 0; i < a->coefs.size(); i++)
+	for(int i = 0; i < (int)a->coefs.size(); i++)
 		oss << a->coefs[i] << ", ";
 	return oss.str();
 	// for(int i = 0; i < a->coefs.size(); i++)
@@ -745,7 +943,7 @@ ZZ get_ZZ(bn_t *a){
   ZZ b = conv<ZZ>(0);
   for(int i = a->used-1; i >= 0;i--)
       b = (b<<WORD) | to_ZZ(a->dp[i]);
-  return b;
+  return (a->sign == BN_NEG? -b : b);
 }
 
 void poly_copy_to_device(poly_t *a){
@@ -755,22 +953,23 @@ void poly_copy_to_device(poly_t *a){
 	cudaError_t result;
 
 	// Alloc memory
-	if(!a->d_coefs){
-		result = cudaMalloc((void**)&a->d_coefs,CUDAFunctions::N*CRTPrimes.size()*sizeof(cuyasheint_t));
-		assert(result == cudaSuccess);
-	}
-	if(!a->d_bn_coefs){
-		result = cudaMalloc((void**)&a->d_bn_coefs,CUDAFunctions::N*sizeof(bn_t));
+	cuyasheint_t *d_dp = NULL;
+	if(!a->d_coefs)
+		a->d_coefs = (cuyasheint_t*)pool_malloc(CUDAFunctions::N*CRTPrimes.size()*sizeof(cuyasheint_t));
+	if(!a->d_bn_coefs)
+		a->d_bn_coefs = (bn_t*)pool_malloc(CUDAFunctions::N*sizeof(bn_t));
+	else{
+		// Reuses the limbs block
+		bn_t d_first;
+		result = cudaMemcpy(&d_first,a->d_bn_coefs,sizeof(bn_t),cudaMemcpyDeviceToHost);
 		assert(result == cudaSuccess);
+		d_dp = d_first.dp;
 	}
+	if(!d_dp)
+		d_dp = (cuyasheint_t*)pool_malloc(CUDAFunctions::N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
 
 	bn_t *h_bn_coefs = (bn_t*)malloc(CUDAFunctions::N*sizeof(bn_t));
 	assert(h_bn_coefs);
-
-	// Allocate all memory all at once
-	cuyasheint_t *d_dp;
-	result = cudaMalloc((void**)&d_dp,CUDAFunctions::N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
-	assert(result == cudaSuccess);
 	cuyasheint_t *h_dp = (cuyasheint_t*)calloc(CUDAFunctions::N*STD_BNT_WORDS_ALLOC,sizeof(cuyasheint_t));
 	assert(h_dp);
 
@@ -785,6 +984,7 @@ void poly_copy_to_device(poly_t *a){
 	assert(result == cudaSuccess);
 
 	free(h_bn_coefs);
+	free(h_dp);
 }
 
 void poly_copy_to_host(poly_t *a){
@@ -822,37 +1022,53 @@ void poly_copy_to_host(poly_t *a){
       // Build the ZZ
       ZZ coef = get_ZZ(&bn_coef);
       
-      // Inserts
-      a->coefs.insert(a->coefs.begin()+i,coef);		
+      a->coefs[i] = coef;
+      free(bn_coef.dp);
 	}
+	free(h_bn_coefs);
 
 	a->status = HOSTSTATE;
 }
 
 
+/**
+ * Copies the words of x to the device
+ */
+static bn_t reciprocal_to_device(ZZ x){
+	bn_t h_u;
+	h_u.alloc = 0;
+	get_words_host(&h_u,x);
+
+	bn_t d_u = h_u;
+	cudaError_t result = cudaMalloc((void**)&d_u.dp,h_u.alloc*sizeof(cuyasheint_t));
+	assert(result == cudaSuccess);
+	result = cudaMemcpy(d_u.dp,h_u.dp,h_u.alloc*sizeof(cuyasheint_t),cudaMemcpyHostToDevice);
+	assert(result == cudaSuccess);
+	d_u.sign = BN_POS;
+
+	free(h_u.dp);
+	return d_u;
+}
+
+static const reciprocal_entry* find_reciprocal(ZZ q){
+	for(const reciprocal_entry *e = reciprocals.load(std::memory_order_acquire); e != NULL; e = e->next)
+		if(e->q == q)
+			return e;
+	return NULL;
+}
+
 bn_t get_reciprocal(ZZ q){
-      std::pair<cuyasheint_t*,int> pair = reciprocals[q];
-      cuyasheint_t *reciprocal = std::get<0>(pair);
-      int su = std::get<1>(pair);
-
-      if( reciprocal == NULL){
-        /** 
-         * Not computed yet
-         */
-        compute_reciprocal(q);
-        pair = reciprocals[q];
-        reciprocal = std::get<0>(pair);
-        su = std::get<1>(pair);
-      }
-
-      bn_t result;
-      result.used = su;
-      result.alloc = su;
-      result.sign = BN_POS;
-      result.dp = reciprocal;
-
-      return result;
-    }
+	const reciprocal_entry *e = find_reciprocal(q);
+	if(e == NULL){
+		/** 
+		 * Not computed yet
+		 */
+		compute_reciprocal(q);
+		e = find_reciprocal(q);
+	}
+	return e->u;
+}
+
 bn_t get_reciprocal(bn_t q){
 	/**
 	 * The reciprocal is computed on the first time this function() is called.
@@ -860,52 +1076,59 @@ bn_t get_reciprocal(bn_t q){
  	*/
 	ZZ q_ZZ = get_ZZ(&q);
 	return get_reciprocal(q_ZZ);
-    }
-void compute_reciprocal(ZZ q){
-      ZZ u_ZZ;
-
-      int nwords = NTL::NumBits(q)/WORD + (NTL::NumBits(q)%WORD != 0);
-
-      ZZ x = power2_ZZ(2*WORD*nwords);
-      u_ZZ = x/q;
-      // std::cout << "The reciprocal of " << q << " is " << u_ZZ << std::endl;
-
-      bn_t *h_u;
-      h_u = (bn_t*) malloc (sizeof(bn_t));
-      h_u->alloc = 0;
+}
 
-      get_words(h_u,u_ZZ);  
+ZZ reciprocal_of(ZZ q){
+	int nwords = NTL::NumBits(q)/WORD + (NTL::NumBits(q)%WORD != 0);
+	return power2_ZZ(2*WORD*nwords)/q;
+}
 
-      //////////
-      // Copy //
-      //////////
-      cudaError_t result;
-      
-      // Copy words
-      cuyasheint_t *d_u;        
-      
-      // Copy to device
-      result = cudaMalloc((void**)&d_u,h_u->alloc*sizeof(cuyasheint_t));
-      assert(result == cudaSuccess);
-      
-      result = cudaMemcpy(d_u,h_u->dp,h_u->alloc*sizeof(cuyasheint_t),cudaMemcpyHostToDevice);
-      assert(result == cudaSuccess);
+void compute_reciprocal(ZZ q){
+	reciprocal_entry *e = new reciprocal_entry;
+	e->q = q;
+	e->u = reciprocal_to_device(reciprocal_of(q));
+
+	// Publishes e. If another thread got there first with the same q, both
+	// entries are equal and either one may be found.
+	const reciprocal_entry *head = reciprocals.load(std::memory_order_acquire);
+	do{
+		e->next = head;
+	}while(!reciprocals.compare_exchange_weak(head, e, std::memory_order_release, std::memory_order_acquire));
+}
 
-      reciprocals[q] = std::pair<cuyasheint_t*,int>(d_u,h_u->used);
-      
-      free(h_u);
-    }
+void reciprocal_table_init(reciprocal_table_t *t, ZZ q, ZZ M){
+	t->modulus[RECIPROCAL_Q] = q;
+	t->modulus[RECIPROCAL_M] = M;
+	for(int i = 0; i < RECIPROCAL_HANDLES; i++)
+		t->u[i] = reciprocal_to_device(reciprocal_of(t->modulus[i]));
+}
 
 void gen_crt_primes(ZZ q,cuyasheint_t degree){
 	ZZ M = ZZ(1);
 	std::vector<cuyasheint_t> P;
 	std::vector<ZZ> Mpi;
 	std::vector<cuyasheint_t> InvMpi;
+	std::vector<cuyasheint_t> Roots;
 
 	cuyasheint_t n;
 
 	// Get primes
 	// std::cout << "Primes: " << std::endl;
+	#ifdef CRT_NTT_PRIMES
+	// Primes are taken downwards from 2^CRTPRIMESIZE, in the progression
+	// p = 1 mod 2N, where N = 2*degree is the transform length
+	const cuyasheint_t order = 4*degree;
+	n = ((((cuyasheint_t)1) << CRTPRIMESIZE)/order)*order + 1;
+	while( (M < (2*degree)*q*q) ){
+		do{
+			n -= order;
+			assert(n > order);
+		}while(!NTL::ProbPrime(to_ZZ(n)));
+		P.push_back(n);
+		Roots.push_back(gen_primitive_root_of_unity(n,order));
+		M *= to_ZZ(n);
+	}
+	#else
 	int count = 0;
 	while( (M < (2*degree)*q*q) ){
 		n = COPRIMES_BUCKET[count];
@@ -913,6 +1136,7 @@ void gen_crt_primes(ZZ q,cuyasheint_t degree){
 		P.push_back(n);
 		M *=(n);
 	}
+	#endif
 	// std::cout << std::endl;
 	// Compute M/pi and it's inverse
 	for(unsigned int i = 0; i < P.size();i++){
@@ -921,14 +1145,11 @@ void gen_crt_primes(ZZ q,cuyasheint_t degree){
 		InvMpi.push_back(conv<cuyasheint_t>(NTL::InvMod(Mpi[i]%pi,pi)));
 	}
 
-	#ifndef CUFFTMUL_TRANSFORM
-	compute_reciprocal(M);
-	#endif
-
 	CRTProduct = M;
 	CRTPrimes = P;
 	CRTMpi = Mpi;
 	CRTInvMpi = InvMpi;
+	CRTRoots = Roots;
 
 	#ifdef VERBOSE
 	log_notice("Primes size: " << CRTPRIMESIZE);
@@ -938,6 +1159,21 @@ void gen_crt_primes(ZZ q,cuyasheint_t degree){
 
 	// Send primes to GPU
 	CUDAFunctions::write_crt_primes();
+	bn_fixed_setup(q);
+	garner_setup();
+}
+
+cuyasheint_t gen_primitive_root_of_unity(cuyasheint_t p, cuyasheint_t order){
+	const ZZ P = to_ZZ(p);
+	assert((P-1) % order == 0);
+
+	// Since order is a power of 2, x^((p-1)/order) has the desired order if,
+	// and only if, its (order/2)-th power is -1
+	for(long x = 2; ; x++){
+		ZZ g = NTL::PowerMod(to_ZZ(x),(P-1)/order,P);
+		if(NTL::PowerMod(g,(long)(order/2),P) == P-1)
+			return conv<cuyasheint_t>(g);
+	}
 }
 
 
@@ -950,7 +1186,7 @@ void gen_crt_primes(ZZ q,cuyasheint_t degree){
 void poly_set_coeff(poly_t *a, int index, ZZ c){
 	while(a->status != HOSTSTATE)
 		poly_demote(a);
-	if(a->coefs.size() <= index)
+	if((int)a->coefs.size() <= index)
 		a->coefs.resize(index+1);
 	a->coefs[index] = c;
 }
@@ -982,3 +1218,326 @@ void poly_set_nth_cyclotomic(poly_t *a, int n){
 	poly_set_coeff(a,0,to_ZZ(1));
 	poly_set_coeff(a,n/2,to_ZZ(1));
 }
+
+#ifdef NTTMUL_TRANSFORM
+/////////////
+// Batches //
+/////////////
+
+void poly_batch_init(poly_batch_t *a, int K){
+	assert(CUDAFunctions::N);
+	assert(K > 0);
+	const int N = CUDAFunctions::N;
+	a->K = K;
+	a->status = HOSTSTATE;
+
+	a->d_coefs = (cuyasheint_t*)pool_malloc(K*N*CRTPrimes.size()*sizeof(cuyasheint_t));
+	a->d_bn_coefs = (bn_t*)pool_malloc(K*N*sizeof(bn_t));
+	a->d_bn_coefs_dp = (cuyasheint_t*)pool_malloc(K*N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
+
+	bn_t *h_bn_coefs = (bn_t*)malloc(K*N*sizeof(bn_t));
+	assert(h_bn_coefs);
+	for(int i = 0; i < K*N; i++){
+		h_bn_coefs[i].alloc = STD_BNT_WORDS_ALLOC;
+		h_bn_coefs[i].used = 0;
+		h_bn_coefs[i].sign = BN_POS;
+		h_bn_coefs[i].dp = a->d_bn_coefs_dp + i*STD_BNT_WORDS_ALLOC;
+	}
+
+	cudaError_t result;
+	result = cudaMemsetAsync(a->d_coefs,0,K*N*CRTPrimes.size()*sizeof(cuyasheint_t));
+	assert(result == cudaSuccess);
+	result = cudaMemsetAsync(a->d_bn_coefs_dp,0,K*N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
+	assert(result == cudaSuccess);
+	result = cudaMemcpy(a->d_bn_coefs,h_bn_coefs,K*N*sizeof(bn_t),cudaMemcpyHostToDevice);
+	assert(result == cudaSuccess);
+
+	free(h_bn_coefs);
+}
+
+void poly_batch_free(poly_batch_t *a){
+	pool_free(a->d_coefs);
+	pool_free(a->d_bn_coefs);
+	pool_free(a->d_bn_coefs_dp);
+	a->d_coefs = NULL;
+	a->d_bn_coefs = NULL;
+	a->d_bn_coefs_dp = NULL;
+	a->K = 0;
+}
+
+void poly_batch_set(poly_batch_t *a, int k, poly_t *b){
+	assert(a->status == HOSTSTATE);
+	assert(0 <= k && k < a->K);
+	const int N = CUDAFunctions::N;
+
+	while(b->status != HOSTSTATE)
+		poly_demote(b);
+
+	bn_t *h_bn_coefs = (bn_t*)malloc(N*sizeof(bn_t));
+	assert(h_bn_coefs);
+	cuyasheint_t *h_dp = (cuyasheint_t*)calloc(N*STD_BNT_WORDS_ALLOC,sizeof(cuyasheint_t));
+	assert(h_dp);
+	cuyasheint_t *d_dp = a->d_bn_coefs_dp + k*N*STD_BNT_WORDS_ALLOC;
+
+	for(int i = 0; i < N; i++)
+		get_words_allocatted(&h_bn_coefs[i],b->coefs[i],h_dp,d_dp,i,NULL);
+
+	cudaError_t result;
+	result = cudaMemcpy(d_dp,h_dp,N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t),cudaMemcpyHostToDevice);
+	assert(result == cudaSuccess);
+	result = cudaMemcpy(a->d_bn_coefs + k*N,h_bn_coefs,N*sizeof(bn_t),cudaMemcpyHostToDevice);
+	assert(result == cudaSuccess);
+
+	free(h_bn_coefs);
+	free(h_dp);
+}
+
+void poly_batch_get(poly_t *b, poly_batch_t *a, int k){
+	assert(0 <= k && k < a->K);
+	const int N = CUDAFunctions::N;
+
+	while(a->status != HOSTSTATE)
+		poly_batch_demote(a);
+
+	bn_t *h_bn_coefs = (bn_t*)malloc(N*sizeof(bn_t));
+	assert(h_bn_coefs);
+	cuyasheint_t *h_dp = (cuyasheint_t*)malloc(N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
+	assert(h_dp);
+
+	cudaError_t result;
+	result = cudaMemcpy(h_bn_coefs,a->d_bn_coefs + k*N,N*sizeof(bn_t),cudaMemcpyDeviceToHost);
+	assert(result == cudaSuccess);
+	result = cudaMemcpy(h_dp,a->d_bn_coefs_dp + k*N*STD_BNT_WORDS_ALLOC,N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t),cudaMemcpyDeviceToHost);
+	assert(result == cudaSuccess);
+
+	b->coefs.clear();
+	b->coefs.resize(N);
+	for(int i = 0; i < N; i++){
+		bn_t bn_coef = h_bn_coefs[i];
+		if(bn_coef.used == 0)
+			continue;
+		bn_coef.dp = h_dp + i*STD_BNT_WORDS_ALLOC;
+		b->coefs[i] = get_ZZ(&bn_coef);
+	}
+	b->status = HOSTSTATE;
+
+	free(h_bn_coefs);
+	free(h_dp);
+}
+
+void poly_batch_load(poly_batch_t *a, int k, const poly_t *b){
+	assert(a->status == CRTSTATE || a->status == TRANSSTATE);
+	assert(0 <= k && k < a->K);
+	const int N = CUDAFunctions::N;
+	cudaError_t result;
+
+	// b is shared with the caller, so a b on another status is brought to
+	// the status of a on a copy
+	poly_t tmp;
+	const bool copy = (b->status != a->status);
+	if(copy){
+		poly_init(&tmp);
+		if(b->status == HOSTSTATE)
+			tmp.coefs = b->coefs;
+		else{
+			result = cudaMemcpyAsync(	tmp.d_coefs,
+										b->d_coefs,
+										N*CRTPrimes.size()*sizeof(cuyasheint_t),
+										cudaMemcpyDeviceToDevice);
+			assert(result == cudaSuccess);
+		}
+		tmp.status = b->status;
+		poly_to_state(&tmp,a->status);
+		b = &tmp;
+	}
+
+	// Residue rid of the k-th polynomial is at rid*K*N + k*N
+	for(unsigned int rid = 0; rid < CRTPrimes.size(); rid++){
+		result = cudaMemcpyAsync(	a->d_coefs + rid*a->K*N + k*N,
+									b->d_coefs + rid*N,
+									N*sizeof(cuyasheint_t),
+									cudaMemcpyDeviceToDevice);
+		assert(result == cudaSuccess);
+	}
+
+	if(copy)
+		poly_free(&tmp);
+}
+
+void poly_batch_store(poly_t *b, poly_batch_t *a, int k){
+	assert(a->status == CRTSTATE || a->status == TRANSSTATE);
+	assert(0 <= k && k < a->K);
+	const int N = CUDAFunctions::N;
+
+	for(unsigned int rid = 0; rid < CRTPrimes.size(); rid++){
+		cudaError_t result = cudaMemcpyAsync(	b->d_coefs + rid*N,
+												a->d_coefs + rid*a->K*N + k*N,
+												N*sizeof(cuyasheint_t),
+												cudaMemcpyDeviceToDevice);
+		assert(result == cudaSuccess);
+	}
+	b->status = a->status;
+}
+
+void poly_batch_elevate(poly_batch_t *a){
+	const int N = CUDAFunctions::N;
+
+	if(a->status == HOSTSTATE){
+		log_notice("Elevating batch from HOST to CRT.");
+		callCRT(a->d_bn_coefs,
+		        a->K*N,
+		        a->d_coefs,
+		        a->K*N,
+		        CRTPrimes.size(),
+		        0x0
+		);
+		a->status = CRTSTATE;
+	}else if(a->status == CRTSTATE){
+		log_notice("Elevating batch from CRT to TRANS.");
+		CUDAFunctions::applyNTTBatch(a->d_coefs, N, CRTPrimes.size(), a->K, FORWARD, NULL);
+		a->status = TRANSSTATE;
+	}else if(a->status == TRANSSTATE){
+		// Do nothing
+		log_notice("There is no need to elevate the batch.");
+	}else{
+		log_error("Inconsistent state!");
+	}
+}
+
+void poly_batch_demote(poly_batch_t *a){
+	const int N = CUDAFunctions::N;
+
+	if(a->status == HOSTSTATE){
+		// Do nothing
+		log_notice("There is no need to demote the batch.");
+	}else if(a->status == CRTSTATE){
+		log_notice("Demoting batch from CRT to HOST");
+		callICRT(a->d_bn_coefs,
+		        a->d_coefs,
+		        a->K*N,
+		        CRTPrimes.size(),
+		        NULL
+		);
+		a->status = HOSTSTATE;
+	}else if(a->status == TRANSSTATE){
+		log_notice("Demoting batch from TRANS to CRT");
+		CUDAFunctions::applyNTTBatch(a->d_coefs, N, CRTPrimes.size(), a->K, INVERSE, NULL);
+		a->status = CRTSTATE;
+	}else{
+		log_error("Inconsistent state!");
+	}
+}
+
+/**
+ * Elevates or demotes a until it reaches state
+ * @param a     [input]
+ * @param state [input] CRTSTATE or TRANSSTATE
+ */
+static void poly_batch_to_state(poly_batch_t *a, int state){
+	assert(state == CRTSTATE || state == TRANSSTATE);
+	while(a->status < state)
+		poly_batch_elevate(a);
+	while(a->status > state)
+		poly_batch_demote(a);
+}
+
+void poly_batch_add(poly_batch_t *c, poly_batch_t *a, poly_batch_t *b){
+	assert(a->K == b->K && c->K == a->K);
+	const int state = linear_domain(a->status,
+									b->status,
+									(c == a? a->status : (c == b? b->status : -1)));
+	poly_batch_to_state(a,state);
+	poly_batch_to_state(b,state);
+
+	CUDAFunctions::callPolynomialAddSubBatch(	c->d_coefs,
+												a->d_coefs,
+												b->d_coefs,
+												CUDAFunctions::N,
+												CRTPrimes.size(),
+												a->K,
+												ADD,
+												NULL);
+	c->status = state;
+}
+
+void poly_batch_mul(poly_batch_t *c, poly_batch_t *a, poly_batch_t *b){
+	assert(a->K == b->K && c->K == a->K);
+	poly_batch_to_state(a,TRANSSTATE);
+	poly_batch_to_state(b,TRANSSTATE);
+
+	CUDAFunctions::callPolynomialMulBatch(	c->d_coefs,
+											a->d_coefs,
+											b->d_coefs,
+											CUDAFunctions::N,
+											CRTPrimes.size(),
+											a->K,
+											NULL);
+	c->status = TRANSSTATE;
+}
+
+void poly_batch_mul_shared(poly_batch_t *c, poly_batch_t **a, poly_t **x, int n){
+	std::vector<cuyasheint_t*> A(n), X(n);
+	for(int i = 0; i < n; i++){
+		assert(a[i]->K == c->K);
+		poly_batch_to_state(a[i],TRANSSTATE);
+		while(x[i]->status != TRANSSTATE)
+			poly_elevate(x[i]);
+		A[i] = a[i]->d_coefs;
+		X[i] = x[i]->d_coefs;
+	}
+
+	CUDAFunctions::callPolynomialMulShared(	c->d_coefs,
+											&A[0],
+											&X[0],
+											n,
+											CUDAFunctions::N,
+											CRTPrimes.size(),
+											c->K,
+											NULL);
+	c->status = TRANSSTATE;
+}
+
+void poly_batch_reduce(poly_batch_t *a, int nphi, bn_t q, int nq){
+	const int N = CUDAFunctions::N;
+	const unsigned int half = nphi-1;
+
+	// The negacyclic transform reduces by x^nphi + 1 on the way, see
+	// poly_reduce()
+	const bool negacyclic = (CUDAFunctions::transform == NEGACYCLIC_NTTMUL);
+	assert(!negacyclic || nphi == N/2);
+	const bool folded = (negacyclic && a->status == TRANSSTATE);
+	const bool fixed_q = (bn_fixed_params.nq == nq);
+
+	if(a->status != HOSTSTATE &&
+		fixed_q &&
+		N == 2*nphi){
+		if(a->status == TRANSSTATE)
+			poly_batch_demote(a);
+		callPolynomialReduceFused(a->d_coefs, (folded? 0 : nphi), a->K*N, CRTPrimes.size(), nq, NULL);
+		a->status = CRTSTATE;
+		return;
+	}
+
+	bn_matrix_t g;
+	bn_matrix_init(&g, a->K*N);
+	if(a->status == HOSTSTATE){
+		callBNToMatrix(&g, a->d_bn_coefs, a->K*N, NULL);
+		CUDAFunctions::callPolynomialReductionCoefsMatrix(&g, half, N);
+	}else{
+		if(a->status == TRANSSTATE)
+			poly_batch_demote(a);
+		if(!folded)
+			CUDAFunctions::callPolynomialReductionCRT(a->d_coefs, half, N, a->K*N, CRTPrimes.size());
+		callICRTMatrix(&g, a->d_coefs, CRTPrimes.size(), NULL);
+	}
+
+	if(fixed_q)
+		callModQMatrix(&g, NULL);
+	else
+		callMersenneModMatrix(&g, nq, NULL);
+	callCRTMatrix(&g, a->d_coefs, CRTPrimes.size(), NULL);
+	bn_matrix_free(&g);
+
+	a->status = CRTSTATE;
+}
+#endif
@@ -29,6 +29,7 @@
 #include "../cuda/operators.h"
 #include "../cuda/cuda_bn.h"
 #include "../logging/logging.h"
+#include "pool.h"
 
 NTL_CLIENT
 
@@ -40,6 +41,8 @@ extern std::vector<cuyasheint_t> CRTPrimes;
 extern ZZ CRTProduct;
 extern std::vector<ZZ> CRTMpi;
 extern std::vector<cuyasheint_t> CRTInvMpi;
+// Primitive 2N-th roots of unity mod each CRT prime (CRT_NTT_PRIMES only)
+extern std::vector<cuyasheint_t> CRTRoots;
 
 // Three possible states:
 // 
@@ -58,6 +61,23 @@ struct polynomial {
 	#endif
 } typedef poly_t;
 
+#ifdef NTTMUL_TRANSFORM
+// A batch of K polynomials that share a single allocation.
+//
+// The residue rid of the k-th polynomial is stored at d_coefs + (rid*K + k)*N,
+// so each residue is a contiguous array of K*N elements mod the same prime and
+// the whole batch is handled by one call of each operator. The coefficients
+// of the k-th polynomial are stored at d_bn_coefs + k*N, which is where they
+// live on HOSTSTATE. All polynomials are on the same state.
+struct polynomial_batch {
+	int K = 0;
+	cuyasheint_t *d_coefs = NULL;
+	int status = HOSTSTATE;
+	bn_t *d_bn_coefs = NULL;
+	cuyasheint_t *d_bn_coefs_dp = NULL;
+} typedef poly_batch_t;
+#endif
+
 /**
  * [poly_init description]
  * @param a [description]
@@ -118,12 +138,25 @@ int poly_get_deg(poly_t *a);
 
 /**
  * polynomial addition
+ *
+ * It is computed on CRTSTATE or TRANSSTATE, whichever needs fewer
+ * conversions of a and b. c is left on that state.
  * @param c [output]
  * @param a [input]
  * @param b [input]
  */
 void poly_add(poly_t *c, poly_t *a, poly_t *b);
 
+/**
+ * polynomial subtraction
+ *
+ * Same domain selection as poly_add().
+ * @param c [output]
+ * @param a [input]
+ * @param b [input]
+ */
+void poly_sub(poly_t *c, poly_t *a, poly_t *b);
+
 /**
  * polynomial multiplication
  * @param c [output]
@@ -133,6 +166,27 @@ void poly_add(poly_t *c, poly_t *a, poly_t *b);
 
 void poly_mul(poly_t *c, poly_t *a, poly_t *b);
 
+/**
+ * Fused multiply-accumulate: c = c + sum_{i<k} a[i]*b[i]
+ *
+ * The products are accumulated on TRANSSTATE in a single pass, without
+ * writing intermediate polynomials.
+ * @param c [output]
+ * @param a [input] array of k polynomials
+ * @param b [input] array of k polynomials
+ * @param k [input]
+ */
+void poly_mul_acc(poly_t *c, poly_t *a, poly_t *b, int k);
+
+/**
+ * Inner product: c = sum_{i<k} a[i]*b[i]
+ * @param c [output]
+ * @param a [input] array of k polynomials
+ * @param b [input] array of k polynomials
+ * @param k [input]
+ */
+void poly_dot(poly_t *c, poly_t *a, poly_t *b, int k);
+
 /**
  * polynomial addition with an integer
  * @param c [output]
@@ -170,7 +224,8 @@ void poly_biginteger_mul(poly_t *c, poly_t *a, ZZ b);
  * [poly_reduce description]
  * @param f    [description]
  * @param nphi x^{nphi} - 1
- * @param nq   2^{nq} - 1
+ * @param nq   bits of q: the q given to bn_fixed_setup() if it has nq bits,
+ *             2^{nq} - 1 otherwise
  */
 void poly_reduce(poly_t *f, int nphi, bn_t Q, int nq);
 
@@ -198,6 +253,105 @@ void poly_mersenne_reduction(poly_t *a, bn_t q, int nq);
  */
 void poly_invmod(poly_t *fInv, poly_t *f, int nphi, int nq);
 
+#ifdef NTTMUL_TRANSFORM
+/**
+ * allocates a batch of K zeroed polynomials on HOSTSTATE
+ * @param a [output]
+ * @param K [input] number of polynomials
+ */
+void poly_batch_init(poly_batch_t *a, int K);
+
+/**
+ * [poly_batch_free description]
+ * @param a [description]
+ */
+void poly_batch_free(poly_batch_t *a);
+
+/**
+ * copies the coefficients of b to the k-th polynomial of a. a must be on
+ * HOSTSTATE.
+ * @param a [output]
+ * @param k [input]
+ * @param b [input]
+ */
+void poly_batch_set(poly_batch_t *a, int k, poly_t *b);
+
+/**
+ * copies the k-th polynomial of a to b. a is demoted to HOSTSTATE.
+ * @param b [output]
+ * @param a [input]
+ * @param k [input]
+ */
+void poly_batch_get(poly_t *b, poly_batch_t *a, int k);
+
+/**
+ * copies the residues of b to the k-th polynomial of a, with no CRT if b is
+ * already on the status of a, which must be CRTSTATE or TRANSSTATE.
+ * Otherwise a copy of b is brought there. b is left as it is.
+ * @param a [output]
+ * @param k [input]
+ * @param b [input]
+ */
+void poly_batch_load(poly_batch_t *a, int k, const poly_t *b);
+
+/**
+ * copies the residues of the k-th polynomial of a to b, with no ICRT. b
+ * takes the status of a, which must be CRTSTATE or TRANSSTATE.
+ * @param b [output]
+ * @param a [input]
+ * @param k [input]
+ */
+void poly_batch_store(poly_t *b, poly_batch_t *a, int k);
+
+/**
+ * Step to the next batch status. Every step is a single CRT or transform
+ * call over the whole batch.
+ * @param a [description]
+ */
+void poly_batch_elevate(poly_batch_t *a);
+
+/**
+ * Step back to the previous batch status
+ * @param a [description]
+ */
+void poly_batch_demote(poly_batch_t *a);
+
+/**
+ * c[k] = a[k] + b[k] for every k
+ * @param c [output]
+ * @param a [input]
+ * @param b [input]
+ */
+void poly_batch_add(poly_batch_t *c, poly_batch_t *a, poly_batch_t *b);
+
+/**
+ * c[k] = a[k] * b[k] for every k
+ * @param c [output]
+ * @param a [input]
+ * @param b [input]
+ */
+void poly_batch_mul(poly_batch_t *c, poly_batch_t *a, poly_batch_t *b);
+
+/**
+ * c[k] = sum_{i<n} a[i][k] * x[i] for every k, in a single pass. Each x[i]
+ * is a single polynomial, e.g., a key, applied to the whole batch.
+ * @param c [output]
+ * @param a [input] n batches
+ * @param x [input] n polynomials
+ * @param n [input]
+ */
+void poly_batch_mul_shared(poly_batch_t *c, poly_batch_t **a, poly_t **x, int n);
+
+/**
+ * poly_reduce() over every polynomial of the batch
+ * @param a    [input/output]
+ * @param nphi [input]
+ * @param q    [input]
+ * @param nq   [input]
+ */
+void poly_batch_reduce(poly_batch_t *a, int nphi, bn_t q, int nq);
+#endif
+
 /**
  * print a polynomial
  * @param a [description]
@@ -206,11 +360,23 @@ std::string poly_print(poly_t *a);
 
 /**
  * generates a set of primes for CRT
+ *
+ * With CRT_NTT_PRIMES the primes are CRTPRIMESIZE bits long and satisfy
+ * p = 1 mod 4*degree, so each residue may be transformed by a NTT of length
+ * 2*degree over its own prime.
  * @param q      [description]
  * @param degree [description]
  */
 void gen_crt_primes(ZZ q,cuyasheint_t degree);
 
+/**
+ * Finds a primitive root of unity of a given order
+ * @param  p     a prime
+ * @param  order a power of 2 that divides p-1
+ * @return       an element of multiplicative order "order" mod p
+ */
+cuyasheint_t gen_primitive_root_of_unity(cuyasheint_t p, cuyasheint_t order);
+
 /**
  * convert a ZZ to bn_t
  * @param b [description]
@@ -229,6 +395,9 @@ void get_words_host(bn_t *b,ZZ a);
 
 /**
  * computes the reciprocal of q
+ *
+ * Reciprocals are kept on an append-only list, so lookups don't take locks.
+ * Code that knows its moduli beforehand should prefer a reciprocal_table_t.
  * @param  q [description]
  * @return   [description]
  */
@@ -238,6 +407,41 @@ void compute_reciprocal(ZZ q);
 
 bn_t get_reciprocal(bn_t q);
 
+/**
+ * floor(2^(2*WORD*n)/q), for n the number of words of q
+ * @param  q [input]
+ * @return   the reciprocal used by bn_mod_barrt()
+ */
+ZZ reciprocal_of(ZZ q);
+
+/**
+ * Reciprocals of the moduli of a parameter set. The table is filled once by
+ * reciprocal_table_init() and never changes, so it may be read by any
+ * number of threads.
+ */
+enum reciprocal_handles {RECIPROCAL_Q, RECIPROCAL_M, RECIPROCAL_HANDLES};
+struct reciprocal_table {
+	ZZ modulus[RECIPROCAL_HANDLES];
+	bn_t u[RECIPROCAL_HANDLES]; // device words
+} typedef reciprocal_table_t;
+
+/**
+ * computes the reciprocals of q and M
+ * @param t [output]
+ * @param q [input]
+ * @param M [input] the product of the CRT primes
+ */
+void reciprocal_table_init(reciprocal_table_t *t, ZZ q, ZZ M);
+
+/**
+ * @param  t      [input]
+ * @param  handle [input] one of reciprocal_handles
+ * @return        the reciprocal of t->modulus[handle]
+ */
+inline bn_t reciprocal_get(const reciprocal_table_t *t, int handle){
+	return t->u[handle];
+}
+
 /**
  * [poly_set_coeff description]
  * @param a [description]
@@ -0,0 +1,310 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifdef HOST_BACKEND
+#include <sys/mman.h>
+#else
+#include <cuda.h>
+#endif
+#include "pool.h"
+#include "../logging/logging.h"
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+#ifdef HOST_BACKEND
+/**
+ * Header in front of every block. Device memory is host memory on this
+ * backend, so pool_free() reads the size class right before the pointer.
+ * 64 bytes keep the block as aligned as the allocation itself.
+ */
+struct pool_header {
+	size_t size;
+	bool huge;
+	char padding[64 - sizeof(size_t) - sizeof(bool)];
+};
+#define POOL_HEADER_SIZE sizeof(pool_header)
+static_assert(sizeof(pool_header) == 64, "pool_header must keep 64-byte alignment");
+#else
+// Device blocks are rounded to the cudaMalloc() granularity, so the size
+// reported by cuMemGetAddressRange() is the size class itself
+#define POOL_DEVICE_ALIGN 512UL
+#endif
+
+struct pool_entry {
+	void *ptr;
+	bool huge;
+};
+
+struct pool_counters {
+	// Only the owning thread writes these, so a relaxed load and store is
+	// enough. pool_get_stats() reads them from other threads.
+	std::atomic<uint64_t> system_allocs;
+	std::atomic<uint64_t> system_frees;
+	std::atomic<uint64_t> hits;
+	// Blocks may be freed on another thread than the one that allocated
+	// them, so a thread's share of the live and cached counts can go negative
+	std::atomic<int64_t> live_blocks;
+	std::atomic<int64_t> live_bytes;
+	std::atomic<int64_t> cached_blocks;
+	std::atomic<int64_t> cached_bytes;
+
+	pool_counters() : system_allocs(0), system_frees(0), hits(0),
+		live_blocks(0), live_bytes(0), cached_blocks(0), cached_bytes(0) {}
+};
+
+template <typename T>
+static inline void counter_add(std::atomic<T> &c, T v){
+	c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+static void add_counters(pool_stats_t *s, const pool_counters &c){
+	s->system_allocs += c.system_allocs.load(std::memory_order_relaxed);
+	s->system_frees += c.system_frees.load(std::memory_order_relaxed);
+	s->hits += c.hits.load(std::memory_order_relaxed);
+	s->live_blocks += c.live_blocks.load(std::memory_order_relaxed);
+	s->live_bytes += c.live_bytes.load(std::memory_order_relaxed);
+	s->cached_blocks += c.cached_blocks.load(std::memory_order_relaxed);
+	s->cached_bytes += c.cached_bytes.load(std::memory_order_relaxed);
+}
+
+struct pool_cache;
+
+/**
+ * Cold state, only touched when a thread starts or exits, by
+ * pool_release() and by pool_get_stats()
+ */
+static std::mutex registry_mutex;
+static std::vector<pool_cache*> registry;
+// Blocks cached by threads that have exited
+static std::map<size_t, std::vector<pool_entry>> orphans;
+// Counters of threads that have exited
+static pool_stats_t retired;
+static std::atomic<bool> huge_pages(false);
+
+/**
+ * Free lists of one thread, one per size class. pool_malloc() and
+ * pool_free() only touch the calling thread's cache, so they take no lock.
+ */
+struct pool_cache {
+	std::map<size_t, std::vector<pool_entry>> free_lists;
+	pool_counters counters;
+
+	pool_cache(){
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		registry.push_back(this);
+	}
+
+	~pool_cache(){
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		registry.erase(std::find(registry.begin(), registry.end(), this));
+		// Whatever the thread still caches is handed to the other threads
+		// through the orphan lists
+		for(std::map<size_t, std::vector<pool_entry>>::iterator it = free_lists.begin();
+			it != free_lists.end();
+			it++)
+			orphans[it->first].insert(orphans[it->first].end(), it->second.begin(), it->second.end());
+		add_counters(&retired, counters);
+	}
+};
+
+static pool_cache& local_cache(){
+	static thread_local pool_cache cache;
+	return cache;
+}
+
+/**
+ * Requests a new block from the system
+ */
+static void* system_malloc(size_t size, bool *huge){
+	*huge = false;
+	#ifdef HOST_BACKEND
+	size += POOL_HEADER_SIZE;
+	if(huge_pages.load(std::memory_order_relaxed) && size >= HUGE_PAGE_SIZE){
+		const size_t len = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+		void *ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(ptr != MAP_FAILED){
+			#ifdef MADV_HUGEPAGE
+			madvise(ptr, len, MADV_HUGEPAGE);
+			#endif
+			*huge = true;
+			return ptr;
+		}
+		// Falls back to regular pages
+	}
+	#endif
+
+	void *ptr;
+	cudaError_t result = cudaMalloc(&ptr,size);
+	assert(result == cudaSuccess);
+	return ptr;
+}
+
+static void system_free(void *ptr, size_t size, bool huge){
+	#ifdef HOST_BACKEND
+	size += POOL_HEADER_SIZE;
+	if(huge){
+		munmap(ptr, (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+		return;
+	}
+	#endif
+	cudaError_t result = cudaFree(ptr);
+	assert(result == cudaSuccess);
+}
+
+/**
+ * Pops a block of the given size class from the orphan lists. Only called
+ * when the thread's own free list is empty, i.e. on the way to the system
+ * allocator.
+ */
+static bool adopt_orphan(size_t size, pool_entry *entry){
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	std::map<size_t, std::vector<pool_entry>>::iterator it = orphans.find(size);
+	if(it == orphans.end() || it->second.empty())
+		return false;
+	*entry = it->second.back();
+	it->second.pop_back();
+	retired.cached_blocks--;
+	retired.cached_bytes -= size;
+	return true;
+}
+
+void* pool_malloc(size_t size){
+	if(size == 0)
+		return NULL;
+	#ifndef HOST_BACKEND
+	size = (size + POOL_DEVICE_ALIGN - 1) & ~(POOL_DEVICE_ALIGN - 1);
+	#endif
+	pool_cache &cache = local_cache();
+
+	pool_entry entry;
+	std::vector<pool_entry> &free_list = cache.free_lists[size];
+	if(free_list.size() > 0){
+		entry = free_list.back();
+		free_list.pop_back();
+		counter_add<uint64_t>(cache.counters.hits, 1);
+		counter_add<int64_t>(cache.counters.cached_blocks, -1);
+		counter_add<int64_t>(cache.counters.cached_bytes, -(int64_t)size);
+	}else if(adopt_orphan(size,&entry)){
+		counter_add<uint64_t>(cache.counters.hits, 1);
+	}else{
+		entry.ptr = system_malloc(size,&entry.huge);
+		counter_add<uint64_t>(cache.counters.system_allocs, 1);
+		#ifdef HOST_BACKEND
+		pool_header *header = (pool_header*)entry.ptr;
+		header->size = size;
+		header->huge = entry.huge;
+		#endif
+	}
+
+	counter_add<int64_t>(cache.counters.live_blocks, 1);
+	counter_add<int64_t>(cache.counters.live_bytes, (int64_t)size);
+	#ifdef HOST_BACKEND
+	return (char*)entry.ptr + POOL_HEADER_SIZE;
+	#else
+	return entry.ptr;
+	#endif
+}
+
+void pool_free(void *ptr){
+	if(ptr == NULL)
+		return;
+	pool_cache &cache = local_cache();
+
+	pool_entry entry;
+	size_t size;
+	#ifdef HOST_BACKEND
+	entry.ptr = (char*)ptr - POOL_HEADER_SIZE;
+	const pool_header *header = (const pool_header*)entry.ptr;
+	size = header->size;
+	entry.huge = header->huge;
+	#else
+	// The driver keeps the size of every allocation, so device blocks don't
+	// need a header
+	CUdeviceptr base;
+	CUresult result = cuMemGetAddressRange(&base, &size, (CUdeviceptr)ptr);
+	assert(result == CUDA_SUCCESS);
+	// Freeing a block that wasn't allocated by the pool is a bug
+	assert((void*)base == ptr);
+	entry.ptr = ptr;
+	entry.huge = false;
+	#endif
+
+	cache.free_lists[size].push_back(entry);
+	counter_add<int64_t>(cache.counters.live_blocks, -1);
+	counter_add<int64_t>(cache.counters.live_bytes, -(int64_t)size);
+	counter_add<int64_t>(cache.counters.cached_blocks, 1);
+	counter_add<int64_t>(cache.counters.cached_bytes, (int64_t)size);
+}
+
+/**
+ * Returns the cached blocks of a free-list map to the system
+ */
+static void release_lists(std::map<size_t, std::vector<pool_entry>> &lists, uint64_t *system_frees){
+	for(std::map<size_t, std::vector<pool_entry>>::iterator it = lists.begin();
+		it != lists.end();
+		it++){
+		for(unsigned int i = 0; i < it->second.size(); i++){
+			system_free(it->second[i].ptr, it->first, it->second[i].huge);
+			(*system_frees)++;
+		}
+		it->second.clear();
+	}
+}
+
+void pool_release(){
+	pool_cache &cache = local_cache();
+	uint64_t system_frees = 0;
+	release_lists(cache.free_lists, &system_frees);
+	counter_add<uint64_t>(cache.counters.system_frees, system_frees);
+	cache.counters.cached_blocks.store(0, std::memory_order_relaxed);
+	cache.counters.cached_bytes.store(0, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	release_lists(orphans, &retired.system_frees);
+	retired.cached_blocks = 0;
+	retired.cached_bytes = 0;
+}
+
+void pool_set_huge_pages(bool enable){
+	huge_pages.store(enable, std::memory_order_relaxed);
+}
+
+pool_stats_t pool_get_stats(){
+	// Touching the cache registers the calling thread
+	local_cache();
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	pool_stats_t s = retired;
+	for(unsigned int i = 0; i < registry.size(); i++)
+		add_counters(&s, registry[i]->counters);
+	return s;
+}
+
+int pool_report_leaks(){
+	const pool_stats_t s = pool_get_stats();
+	if(s.live_blocks > 0)
+		log_warn("pool: " + std::to_string(s.live_blocks) + " live blocks, " + std::to_string(s.live_bytes) + " bytes");
+	return s.live_blocks;
+}
@@ -0,0 +1,92 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include "../settings.h"
+
+/**
+ * Size-class pool for device buffers.
+ *
+ * poly_t, poly_batch_t and cipher_t buffers only come in a handful of sizes,
+ * all given by (N, number of CRT primes, STD_BNT_WORDS_ALLOC). So each size is
+ * its own class, and a freed block is kept on the free list of its class
+ * until a buffer of the same size is requested again. Once the working set
+ * is allocated, a steady-state loop doesn't call cudaMalloc/cudaFree at all.
+ *
+ * Each thread keeps its own free lists, so pool_malloc() and pool_free() take
+ * no lock. A block may be freed on another thread than the one that
+ * allocated it; it then goes to the free lists of the freeing thread. The
+ * blocks cached by a thread that exits are handed to the others.
+ *
+ * The size class of a block is read from a header in front of it on the host
+ * backend, and from the driver on the GPU, so there is no table of blocks.
+ */
+
+struct pool_stats {
+	uint64_t system_allocs = 0; // blocks requested from the system
+	uint64_t system_frees = 0;  // blocks returned to the system
+	uint64_t hits = 0;          // requests served from a free list
+	uint64_t live_blocks = 0;   // blocks handed out and not freed
+	uint64_t live_bytes = 0;
+	uint64_t cached_blocks = 0; // blocks on the free lists
+	uint64_t cached_bytes = 0;
+} typedef pool_stats_t;
+
+/**
+ * allocates size bytes of device memory
+ * @param  size [input]
+ * @return      the block, or NULL if size is 0
+ */
+void* pool_malloc(size_t size);
+
+/**
+ * returns a block obtained from pool_malloc() to its size class
+ * @param ptr [input]
+ */
+void pool_free(void *ptr);
+
+/**
+ * returns the blocks cached by the calling thread and by threads that have
+ * exited to the system. Blocks cached by other running threads are kept.
+ */
+void pool_release();
+
+/**
+ * enables huge-page backing for new blocks of at least 2 MB. Only the host
+ * backend, where device memory is host memory, is affected.
+ * @param enable [input]
+ */
+void pool_set_huge_pages(bool enable);
+
+/**
+ * sums the counters of every thread
+ * @return the counters
+ */
+pool_stats_t pool_get_stats();
+
+/**
+ * logs the number and size of the live blocks, if there is any
+ * @return the number of live blocks
+ */
+int pool_report_leaks();
+
+#endif
@@ -18,7 +18,9 @@
 #include <fstream>
 #include <iterator>
 #include <iomanip>
+#ifndef HOST_BACKEND
 #include <cuda_runtime_api.h>
+#endif
 #include <NTL/ZZ.h>
 #include <time.h>
 #include <unistd.h>
@@ -27,6 +29,7 @@
 #include "../aritmetic/polynomial.h"
 #include "../logging/logging.h"
 #include "../distribution/distribution.h"
+#include "../cuda/cuda_ciphertext.h"
 
 #define BILLION  1000000000L
 #define MILLION  1000000L
@@ -164,10 +167,12 @@ double runCRT(int d){
   return compute_time_ms(start,stop)/N;
  }
 
-  double runICRT(int d){
+  double runICRT(int d, int mode){
   struct timespec start, stop;
   Distribution dist;
   dist = Distribution(UNIFORMLY);
+  const int old_mode = CUDAFunctions::icrt;
+  CUDAFunctions::icrt = mode;
 
   // Init
   poly_t a,b,c;
@@ -182,9 +187,70 @@ double runCRT(int d){
     cudaDeviceSynchronize();
   }
   clock_gettime( CLOCK_REALTIME, &stop);
+  CUDAFunctions::icrt = old_mode;
   return compute_time_ms(start,stop)/N;
  }
 
+enum mersenne_modes {MERSENNE_BARRETT, MERSENNE_LANES, MERSENNE_ROUND};
+
+  double runMersenne(int d, int nq, int mode, bool generic){
+  struct timespec start, stop;
+  const int n = 2*d;
+  // Any odd q of nq bits takes the Barrett passes
+  ZZ q = NTL::power2_ZZ(nq)-1;
+  if(generic)
+    q -= 2*NTL::RandomBnd(NTL::power2_ZZ(nq-2));
+  bn_t Q;
+  get_words(&Q,q);
+  bn_t U = get_reciprocal(q);
+  const bn_fixed_params_t saved = bn_fixed_params;
+  bn_fixed_setup(q);
+
+  // Init: coefficients of the size of a product on R_q, below M
+  const ZZ bound = (q*q < CRTProduct? q*q : CRTProduct);
+  poly_t a;
+  poly_init(&a);
+  for(int i = 0; i < n; i++)
+    poly_set_coeff(&a, i, NTL::RandomBnd(bound));
+  poly_elevate(&a);
+  bn_matrix_t src,g;
+  bn_matrix_init(&src, n);
+  bn_matrix_init(&g, n);
+  callBNToMatrix(&src, a.d_bn_coefs, n, NULL);
+
+  // Exec. The input is restored before each call, so the time of the
+  // restores alone is taken out.
+  double diff = 0;
+  for(int op = 0; op <= 1; op++){
+    clock_gettime( CLOCK_REALTIME, &start);
+    for(int i = 0; i < N;i++){
+      if(mode == MERSENNE_BARRETT)
+        callMatrixToBN(a.d_bn_coefs, &src, n, NULL);
+      else
+        callBNToMatrix(&g, a.d_bn_coefs, n, NULL);
+
+      if(!op)
+        continue;
+      if(mode == MERSENNE_BARRETT)
+        callCuModN(a.d_bn_coefs, a.d_bn_coefs, n, Q.dp, Q.used, U.dp, U.used, NULL);
+      else if(mode == MERSENNE_LANES)
+        callModQMatrix(&g, NULL);
+      else
+        callCiphertextMulAuxMatrix(&g, nq, NULL);
+      cudaDeviceSynchronize();
+    }
+    cudaDeviceSynchronize();
+    clock_gettime( CLOCK_REALTIME, &stop);
+    diff += (op? 1 : -1)*compute_time_ms(start,stop);
+  }
+  bn_matrix_free(&src);
+  bn_matrix_free(&g);
+  poly_free(&a);
+  bn_fixed_params = saved;
+  bn_fixed_write_params();
+  return diff/N;
+ }
+
   double runSamplingUniform(int d){
   struct timespec start, stop;
   Distribution dist;
@@ -274,6 +340,76 @@ double runBigIntegerMulBNT(int d, float gaussian_std_deviation, int gaussian_bou
   return compute_time_ms(start,stop)/N;
  }
 
+/**
+ * Throughput of multiplication followed by reduction over K independent
+ * polynomials
+ * @param  d     degree
+ * @param  K     number of polynomials
+ * @param  batch if true, the polynomials are stored on a poly_batch_t
+ * @return       operations per second
+ */
+double runMulReduceThroughput(int d, int K, bool batch){
+  struct timespec start, stop;
+  Distribution dist;
+  dist = Distribution(UNIFORMLY);
+  ZZ q = NTL::power2_ZZ(127)-1;
+  bn_t Q;
+  get_words(&Q,q);
+  double diff = 0;
+
+  // Init
+  std::vector<poly_t> a(K), b(K);
+  for(int k = 0; k < K; k++){
+    poly_init(&a[k]);
+    poly_init(&b[k]);
+    dist.generate_sample(&a[k], 50, d);
+    dist.generate_sample(&b[k], 50, d);
+  }
+
+  if(batch){
+    #ifdef NTTMUL_TRANSFORM
+    poly_batch_t A, B;
+    poly_batch_init(&A,K);
+    poly_batch_init(&B,K);
+    for(int k = 0; k < K; k++){
+      poly_batch_set(&A,k,&a[k]);
+      poly_batch_set(&B,k,&b[k]);
+    }
+
+    // Exec
+    clock_gettime( CLOCK_REALTIME, &start);
+    for(int i = 0; i < N;i++){
+      poly_batch_mul(&A,&A,&B);
+      poly_batch_reduce(&A,d,Q,127);
+      cudaDeviceSynchronize();
+    }
+    clock_gettime( CLOCK_REALTIME, &stop);
+    diff = compute_time_ms(start,stop);
+
+    poly_batch_free(&A);
+    poly_batch_free(&B);
+    #endif
+  }else{
+    // Exec
+    clock_gettime( CLOCK_REALTIME, &start);
+    for(int i = 0; i < N;i++){
+      for(int k = 0; k < K; k++){
+        poly_mul(&a[k],&a[k],&b[k]);
+        poly_reduce(&a[k],d,Q,127);
+      }
+      cudaDeviceSynchronize();
+    }
+    clock_gettime( CLOCK_REALTIME, &stop);
+    diff = compute_time_ms(start,stop);
+  }
+
+  for(int k = 0; k < K; k++){
+    poly_free(&a[k]);
+    poly_free(&b[k]);
+  }
+  return (diff > 0? 1000.0*N*K/diff : 0);
+}
+
 int main(int argc, char* argv[]){
      // Log
     log_init("benchmark.log");
@@ -314,8 +450,22 @@ int main(int argc, char* argv[]){
       std::cout << d << " - Reduction) " << diff << " ms" << std::endl;
       diff = runCRT(d);
       std::cout << d << " - CRT) " << diff << " ms" << std::endl;
-      diff = runICRT(d);
+      diff = runICRT(d, ICRT_ACCUMULATE);
       std::cout << d << " - ICRT) " << diff << " ms" << std::endl;
+      diff = runICRT(d, ICRT_GARNER);
+      std::cout << d << " - ICRT Garner) " << diff << " ms" << std::endl;
+      diff = runMersenne(d, 127, MERSENNE_BARRETT, false);
+      std::cout << d << " - Mod q, Barrett) " << diff << " ms" << std::endl;
+      for(int nq = 127; nq <= 255; nq += 64){
+        diff = runMersenne(d, nq, MERSENNE_LANES, false);
+        std::cout << d << " - Mod q, Mersenne, nq = " << nq << ") " << diff << " ms" << std::endl;
+        diff = runMersenne(d, nq, MERSENNE_LANES, true);
+        std::cout << d << " - Mod q, generic q, nq = " << nq << ") " << diff << " ms" << std::endl;
+        diff = runMersenne(d, nq, MERSENNE_ROUND, false);
+        std::cout << d << " - Round x/q, Mersenne, nq = " << nq << ") " << diff << " ms" << std::endl;
+        diff = runMersenne(d, nq, MERSENNE_ROUND, true);
+        std::cout << d << " - Round x/q, generic q, nq = " << nq << ") " << diff << " ms" << std::endl;
+      }
       diff = runSamplingUniform(d);
       std::cout << d << " - SamplingUniform) " << diff << " ms" << std::endl;
       diff = runSamplingDiscreteGaussian(d, 8*0.4, 8*6);
@@ -324,6 +474,14 @@ int main(int argc, char* argv[]){
       std::cout << d << " - Big-Integer multiplication ZZ) " << diff << " ms" << std::endl;
       diff = runBigIntegerMulBNT(d, 8*0.4, 8*6);
       std::cout << d << " - Big-Integer multiplication BNT) " << diff << " ms" << std::endl;
+      #ifdef NTTMUL_TRANSFORM
+      for(int K = 1; K <= 64; K*=4){
+        diff = runMulReduceThroughput(d, K, false);
+        std::cout << d << " - Mul+Reduce throughput, K = " << K << ") " << diff << " ops/s" << std::endl;
+        diff = runMulReduceThroughput(d, K, true);
+        std::cout << d << " - Batched Mul+Reduce throughput, K = " << K << ") " << diff << " ops/s" << std::endl;
+      }
+      #endif
     }
 
 }
\ No newline at end of file
@@ -18,10 +18,13 @@
 #include <fstream>
 #include <iterator>
 #include <iomanip>
+#ifndef HOST_BACKEND
 #include <cuda_runtime_api.h>
+#endif
 #include <NTL/ZZ.h>
 #include <unistd.h>
 #include <iomanip>
+#include <omp.h>
 #include "../settings.h"
 #include "../yashe/yashe.h"
 #include "../yashe/ciphertext.h"
@@ -38,7 +41,7 @@ double compute_time_ms(struct timespec start,struct timespec stop){
 }
 
 
- double runEncrypt(Yashe cipher,int d){
+ double runEncrypt(Yashe &cipher,int d){
   struct timespec start, stop;
   Distribution dist;
   dist = Distribution(UNIFORMLY);
@@ -62,7 +65,40 @@ double compute_time_ms(struct timespec start,struct timespec stop){
   return compute_time_ms(start,stop)/N;
  }
 
- double runDecrypt(Yashe cipher, int d){
+ /**
+  * @return ms per message
+  */
+ double runEncryptBatch(Yashe &cipher, int d, int K){
+  struct timespec start, stop;
+  Distribution dist;
+  dist = Distribution(UNIFORMLY);
+
+  // Init
+  std::vector<poly_t> a(K);
+  std::vector<cipher_t> b(K);
+  for(int k = 0; k < K; k++){
+    poly_init(&a[k]);
+    cipher_init(&b[k]);
+    dist.generate_sample(&a[k], 50, d);
+  }
+
+  // Exec
+  const int batches = std::max(N/K, 1);
+  clock_gettime( CLOCK_REALTIME, &start);
+  for(int i = 0; i < batches;i++){
+    cipher.encrypt_batch(&b[0],&a[0],K);
+    cudaDeviceSynchronize();
+  }
+  clock_gettime( CLOCK_REALTIME, &stop);
+
+  for(int k = 0; k < K; k++){
+    poly_free(&a[k]);
+    cipher_free(&b[k]);
+  }
+  return compute_time_ms(start,stop)/(batches*K);
+ }
+
+ double runDecrypt(Yashe &cipher, int d){
   struct timespec start, stop;
   Distribution dist;
   dist = Distribution(UNIFORMLY);
@@ -89,7 +125,39 @@ double compute_time_ms(struct timespec start,struct timespec stop){
   return compute_time_ms(start,stop)/N;
  }
 
- double runAdd(Yashe cipher, int d){
+double runDecryptBatch(Yashe &cipher, int d, int K){
+  struct timespec start, stop;
+  Distribution dist;
+  dist = Distribution(UNIFORMLY);
+
+  // Init
+  std::vector<poly_t> a(K);
+  std::vector<cipher_t> b(K);
+  for(int k = 0; k < K; k++){
+    poly_init(&a[k]);
+    cipher_init(&b[k]);
+    dist.generate_sample(&a[k], 50, d);
+  }
+  cipher.encrypt_batch(&b[0],&a[0],K);
+  std::vector<cuyasheint_t> c(K*Yashe::nphi);
+
+  // Exec
+  const int batches = std::max(N/K, 1);
+  clock_gettime( CLOCK_REALTIME, &start);
+  for(int i = 0; i < batches;i++){
+    cipher.decrypt_batch(&c[0],&b[0],K);
+    cudaDeviceSynchronize();
+  }
+  clock_gettime( CLOCK_REALTIME, &stop);
+
+  for(int k = 0; k < K; k++){
+    poly_free(&a[k]);
+    cipher_free(&b[k]);
+  }
+  return compute_time_ms(start,stop)/(batches*K);
+ }
+
+ double runAdd(Yashe &cipher, int d){
   struct timespec start, stop;
   Distribution dist;
   dist = Distribution(UNIFORMLY);
@@ -122,7 +190,7 @@ double compute_time_ms(struct timespec start,struct timespec stop){
   return compute_time_ms(start,stop)/N;
  }
 
- double runMul(Yashe cipher, int d){
+ double runMul(Yashe &cipher, int d){
   struct timespec start, stop;
   Distribution dist;
   dist = Distribution(UNIFORMLY);
@@ -148,13 +216,62 @@ double compute_time_ms(struct timespec start,struct timespec stop){
   // Exec
   clock_gettime( CLOCK_REALTIME, &start);
   for(int i = 0; i < N;i++){
-    cipher_mul(&c3,&c1,&c2);
+    cipher_mul(&c3,&c1,&c2,cipher.keys.get());
     cudaDeviceSynchronize();
   }
   clock_gettime( CLOCK_REALTIME, &stop);
   return compute_time_ms(start,stop)/N;
  }
 
+/**
+ * Encrypts, multiplies and decrypts on T threads at once, one worker
+ * context per thread. OpenMP regions inside each operation run on a single
+ * thread, so the work is only split across ciphertexts.
+ * @return operations per second, over every thread
+ */
+ double runThroughput(Yashe &cipher, int T, int d){
+  struct timespec start, stop;
+
+  clock_gettime( CLOCK_REALTIME, &start);
+  #pragma omp parallel num_threads(T)
+  {
+    // Each thread takes three seeds of its own, two for the worker's
+    // samplers and one for its messages
+    const unsigned long long seed = SEED + 3*omp_get_thread_num() + 1;
+    Yashe worker(cipher, seed);
+    worker.init_workspace(1);
+    Distribution dist(UNIFORMLY);
+    dist.set_seed(seed + 2);
+
+    poly_t a,m;
+    cipher_t c1,c2,c3;
+    poly_init(&a);
+    poly_init(&m);
+    cipher_init(&c1);
+    cipher_init(&c2);
+    cipher_init(&c3);
+    dist.generate_sample(&a, 50, d);
+
+    for(int i = 0; i < N; i++){
+      worker.encrypt(&c1,a);
+      worker.encrypt(&c2,a);
+      cipher_mul(&c3,&c1,&c2,worker.keys.get());
+      worker.decrypt(&m,c3);
+    }
+    cudaDeviceSynchronize();
+
+    poly_free(&a);
+    poly_free(&m);
+    cipher_free(&c1);
+    cipher_free(&c2);
+    cipher_free(&c3);
+    if(omp_get_thread_num() != 0)
+      keyswitch_workspace_free(&Yashe::workspace);
+  }
+  clock_gettime( CLOCK_REALTIME, &stop);
+  return T*N/(compute_time_ms(start,stop)/1000);
+ }
+
 int main(int argc, char* argv[]){
      // Log
     log_init("benchmark.log");
@@ -195,18 +312,72 @@ int main(int argc, char* argv[]){
 
       poly_set_coeff(&Yashe::t,0,to_ZZ(t));
       Yashe::w = w;
-      Yashe::lwq = floor(NTL::log(q)/NTL::log(to_ZZ(w)))+1;
 
       cipher.generate_keys();
 
       diff = runEncrypt(cipher, d);
       std::cout << d << " - Encrypt) " << diff << " ms" << std::endl;
+      const int batch_sizes[] = {1, 4, 16};
+      for(int K : batch_sizes){
+        diff = runEncryptBatch(cipher, d, K);
+        std::cout << d << " - Encrypt, batch of " << K << ") " << diff << " ms per message" << std::endl;
+      }
       diff = runDecrypt(cipher, d);
       std::cout << d << " - Decrypt) " << diff << " ms" << std::endl;
+      for(int K : batch_sizes){
+        diff = runDecryptBatch(cipher, d, K);
+        std::cout << d << " - Decrypt, batch of " << K << ") " << diff << " ms per message" << std::endl;
+      }
       diff = runAdd(cipher, d);
       std::cout << d << " - Add) " << diff << " ms" << std::endl;
       diff = runMul(cipher, d);
       std::cout << d << " - Mul) " << diff << " ms" << std::endl;
+
+      // Without the keyswitch workspace, every multiplication allocates its
+      // own buffers
+      keyswitch_workspace_free(&Yashe::workspace);
+      diff = runMul(cipher, d);
+      std::cout << d << " - Mul, no workspace) " << diff << " ms" << std::endl;
+      cipher.init_workspace(1);
+
+      // The WordDecomp base trades the evk size against the number of
+      // keyswitch products
+      const int wordlengths[] = {16, 24, 32, 64};
+      for(int wl : wordlengths){
+        Yashe::w = wl;
+        cipher.generate_keys();
+        diff = runMul(cipher, d);
+        std::cout << d << " - Mul, w = " << wl << ", lwq = " << cipher.keys->lwq << ") " << diff << " ms" << std::endl;
+      }
+      Yashe::w = w;
+
+      // RNS digits skip the ICRT of the word split
+      Yashe::keyswitch = KEYSWITCH_RNS;
+      const int groups[] = {1, 2};
+      for(int group : groups){
+        Yashe::rns_group = group;
+        try{
+          cipher.generate_keys();
+        }catch(std::runtime_error &e){
+          // Digits too big to decrypt the keyswitch
+          std::cout << d << " - Mul, RNS group = " << group << ") " << e.what() << std::endl;
+          continue;
+        }
+        diff = runMul(cipher, d);
+        std::cout << d << " - Mul, RNS group = " << group << ", digits = " << cipher.keys->decomp.digits << ") " << diff << " ms" << std::endl;
+      }
+      Yashe::keyswitch = KEYSWITCH_WORDECOMP;
+      Yashe::rns_group = 1;
+      cipher.generate_keys();
+
+      // Encrypt + Mul + Decrypt on concurrent worker contexts. The sweep
+      // goes past the core count, so oversubscription is also measured.
+      const int cores = omp_get_num_procs();
+      const int max_threads = std::max(cores, 4);
+      for(int T = 1; T <= max_threads; T = (T == max_threads? T+1 : std::min(2*T, max_threads))){
+        diff = runThroughput(cipher, T, d);
+        std::cout << d << " - Encrypt+Mul+Decrypt, " << T << " threads) " << diff << " ops/s" << std::endl;
+      }
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,478 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BN_FIXED_H
+#define BN_FIXED_H
+
+#include "../settings.h"
+
+/**
+ * Fixed-width big numbers.
+ *
+ * bn_t keeps its size at runtime, so every routine loops over "used" and
+ * branches on it. Here the number of words is a template parameter: every
+ * loop has a compile-time trip count and is unrolled, and no routine
+ * branches on the value of its operands.
+ *
+ * The parameter set only needs a few widths: the words of M, the CRT
+ * product, and the words of q. Those are instantiated for every width up
+ * to STD_BNT_WORDS_ALLOC and BN_FIXED_MAX_Q_WORDS, and the launchers pick
+ * the instance once, on bn_fixed_setup().
+ */
+#define BN_FIXED_MAX_Q_WORDS 4
+
+#ifdef __CUDACC__
+#define BN_FIXED_UNROLL _Pragma("unroll")
+#else
+#define BN_FIXED_UNROLL _Pragma("GCC unroll 16")
+#endif
+
+/**
+ * Constants of the fixed-width passes, computed by bn_fixed_setup()
+ */
+struct bn_fixed_params {
+  int LM = 0; // words of M
+  int LQ = 0; // words of q
+  int nq = 0; // bits of q
+  int mersenne = 1; // q = 2^nq - 1
+  cuyasheint_t mu[STD_BNT_WORDS_ALLOC+1]; // floor(2^(128*LM)/M)
+  cuyasheint_t qinv[STD_BNT_WORDS_ALLOC]; // q^(-1) mod 2^(64*min(LM+1,STD_BNT_WORDS_ALLOC)), for odd q
+  cuyasheint_t qDiv2[BN_FIXED_MAX_Q_WORDS]; // floor(q/2)
+  cuyasheint_t q[BN_FIXED_MAX_Q_WORDS]; // q
+  cuyasheint_t qmu[STD_BNT_WORDS_ALLOC]; // floor(2^(64*STD_BNT_WORDS_ALLOC)/q)
+} typedef bn_fixed_params_t;
+
+/**
+ * Words of the coefficients on the Mersenne passes. After a cyclotomic
+ * reduction they may be up to 2*M.
+ */
+#define BN_FIXED_LIN(LM) ((LM) < STD_BNT_WORDS_ALLOC? (LM)+1 : STD_BNT_WORDS_ALLOC)
+
+template<int L>
+struct bn_fixed {
+  cuyasheint_t dp[L];
+};
+
+/**
+ * Returns a*b and stores the high word on hi
+ */
+__host__ __device__ inline cuyasheint_t bn_fixed_mul_wide(cuyasheint_t a, cuyasheint_t b, cuyasheint_t *hi){
+  #ifdef __CUDA_ARCH__
+  *hi = __umul64hi(a,b);
+  return a*b;
+  #else
+  const __uint128_t r = ((__uint128_t)a)*b;
+  *hi = (cuyasheint_t)(r >> 64);
+  return (cuyasheint_t)r;
+  #endif
+}
+
+template<int L>
+__host__ __device__ inline void bn_fixed_zero(bn_fixed<L> &a){
+  BN_FIXED_UNROLL
+  for(int i = 0; i < L; i++)
+    a.dp[i] = 0;
+}
+
+/**
+ * Copies a to c, truncating or zero-extending it
+ */
+template<int LC, int LA>
+__host__ __device__ inline void bn_fixed_resize(bn_fixed<LC> &c, const bn_fixed<LA> &a){
+  BN_FIXED_UNROLL
+  for(int i = 0; i < LC; i++)
+    c.dp[i] = (i < LA? a.dp[i < LA? i : 0] : 0);
+}
+
+/**
+ * c = a + b
+ * @return the carry
+ */
+template<int L>
+__host__ __device__ inline cuyasheint_t bn_fixed_add(bn_fixed<L> &c, const bn_fixed<L> &a, const bn_fixed<L> &b){
+  cuyasheint_t carry = 0;
+  BN_FIXED_UNROLL
+  for(int i = 0; i < L; i++){
+    const cuyasheint_t ai = a.dp[i];
+    const cuyasheint_t s = ai + b.dp[i];
+    const cuyasheint_t r = s + carry;
+    carry = (s < ai) | (r < s);
+    c.dp[i] = r;
+  }
+  return carry;
+}
+
+/**
+ * c = a + digit
+ * @return the carry
+ */
+template<int L>
+__host__ __device__ inline cuyasheint_t bn_fixed_add1(bn_fixed<L> &c, const bn_fixed<L> &a, cuyasheint_t digit){
+  cuyasheint_t carry = digit;
+  BN_FIXED_UNROLL
+  for(int i = 0; i < L; i++){
+    const cuyasheint_t r = a.dp[i] + carry;
+    carry = (r < carry);
+    c.dp[i] = r;
+  }
+  return carry;
+}
+
+/**
+ * c = a - b
+ * @return the borrow
+ */
+template<int L>
+__host__ __device__ inline cuyasheint_t bn_fixed_sub(bn_fixed<L> &c, const bn_fixed<L> &a, const bn_fixed<L> &b){
+  cuyasheint_t borrow = 0;
+  BN_FIXED_UNROLL
+  for(int i = 0; i < L; i++){
+    const cuyasheint_t ai = a.dp[i];
+    const cuyasheint_t bi = b.dp[i];
+    const cuyasheint_t d = ai - bi;
+    c.dp[i] = d - borrow;
+    borrow = (ai < bi) | (d < borrow);
+  }
+  return borrow;
+}
+
+/**
+ * acc = acc + a*digit, where a has L words
+ * @return the carry word
+ */
+template<int L>
+__host__ __device__ inline cuyasheint_t bn_fixed_mac1(bn_fixed<L> &acc, const cuyasheint_t *a, cuyasheint_t digit){
+  cuyasheint_t carry = 0;
+  BN_FIXED_UNROLL
+  for(int i = 0; i < L; i++){
+    cuyasheint_t hi;
+    const cuyasheint_t lo = bn_fixed_mul_wide(a[i],digit,&hi);
+    const cuyasheint_t s = acc.dp[i] + lo;
+    hi += (s < lo);
+    const cuyasheint_t r = s + carry;
+    hi += (r < s);
+    acc.dp[i] = r;
+    carry = hi;
+  }
+  return carry;
+}
+
+/**
+ * a = a*digit + add
+ * @return the carry word
+ */
+template<int L>
+__host__ __device__ inline cuyasheint_t bn_fixed_muladd1(bn_fixed<L> &a, cuyasheint_t digit, cuyasheint_t add){
+  cuyasheint_t carry = add;
+  BN_FIXED_UNROLL
+  for(int i = 0; i < L; i++){
+    cuyasheint_t hi;
+    const cuyasheint_t lo = bn_fixed_mul_wide(a.dp[i],digit,&hi);
+    const cuyasheint_t r = lo + carry;
+    carry = hi + (r < lo);
+    a.dp[i] = r;
+  }
+  return carry;
+}
+
+/**
+ * c = a*b
+ */
+template<int LA, int LB>
+__host__ __device__ inline void bn_fixed_mul(bn_fixed<LA+LB> &c, const bn_fixed<LA> &a, const bn_fixed<LB> &b){
+  bn_fixed_zero(c);
+  BN_FIXED_UNROLL
+  for(int j = 0; j < LB; j++){
+    bn_fixed<LA> acc;
+    BN_FIXED_UNROLL
+    for(int i = 0; i < LA; i++)
+      acc.dp[i] = c.dp[i+j];
+    const cuyasheint_t carry = bn_fixed_mac1<LA>(acc, a.dp, b.dp[j]);
+    BN_FIXED_UNROLL
+    for(int i = 0; i < LA; i++)
+      c.dp[i+j] = acc.dp[i];
+    c.dp[LA+j] = carry;
+  }
+}
+
+/**
+ * c = a*b mod 2^(64*L)
+ */
+template<int L>
+__host__ __device__ inline void bn_fixed_mullo(bn_fixed<L> &c, const bn_fixed<L> &a, const bn_fixed<L> &b){
+  cuyasheint_t r[L];
+  BN_FIXED_UNROLL
+  for(int i = 0; i < L; i++)
+    r[i] = 0;
+  BN_FIXED_UNROLL
+  for(int j = 0; j < L; j++){
+    cuyasheint_t carry = 0;
+    BN_FIXED_UNROLL
+    for(int i = 0; i + j < L; i++){
+      cuyasheint_t hi;
+      const cuyasheint_t lo = bn_fixed_mul_wide(a.dp[i],b.dp[j],&hi);
+      const cuyasheint_t s = r[i+j] + lo;
+      hi += (s < lo);
+      const cuyasheint_t t = s + carry;
+      hi += (t < s);
+      r[i+j] = t;
+      carry = hi;
+    }
+  }
+  BN_FIXED_UNROLL
+  for(int i = 0; i < L; i++)
+    c.dp[i] = r[i];
+}
+
+/**
+ * c = (mask? a : b), where mask is 0 or ~0
+ */
+template<int L>
+__host__ __device__ inline void bn_fixed_select(bn_fixed<L> &c, const bn_fixed<L> &a, const bn_fixed<L> &b, cuyasheint_t mask){
+  BN_FIXED_UNROLL
+  for(int i = 0; i < L; i++)
+    c.dp[i] = (a.dp[i] & mask) | (b.dp[i] & ~mask);
+}
+
+/**
+ * @return CMP_LT, CMP_EQ or CMP_GT
+ */
+template<int L>
+__host__ __device__ inline int bn_fixed_cmp(const bn_fixed<L> &a, const bn_fixed<L> &b){
+  int lt = 0;
+  int gt = 0;
+  BN_FIXED_UNROLL
+  for(int i = L-1; i >= 0; i--){
+    const int undecided = !(lt | gt);
+    lt |= undecided & (a.dp[i] < b.dp[i]);
+    gt |= undecided & (a.dp[i] > b.dp[i]);
+  }
+  return lt? CMP_LT : (gt? CMP_GT : CMP_EQ);
+}
+
+/**
+ * x = x - m if x >= m
+ */
+template<int L>
+__host__ __device__ inline void bn_fixed_csub(bn_fixed<L> &x, const bn_fixed<L> &m){
+  bn_fixed<L> d;
+  const cuyasheint_t borrow = bn_fixed_sub<L>(d, x, m);
+  bn_fixed_select<L>(x, d, x, borrow - 1);
+}
+
+/**
+ * Barrett reduction of a (L+1)-words x
+ *
+ * It follows HAC 14.42, with k = L, so the quotient estimate has two words.
+ * @param r  output: x mod m
+ * @param x  input
+ * @param m  input: modulus, whose highest word is not zero
+ * @param mu input: floor(2^(128*L)/m)
+ */
+template<int L>
+__host__ __device__ inline void bn_fixed_barrett(bn_fixed<L> &r, const bn_fixed<L+1> &x, const bn_fixed<L> &m, const bn_fixed<L+1> &mu){
+  // q3 = ((x >> 64*(L-1))*mu) >> 64*(L+1)
+  bn_fixed<2> q1;
+  q1.dp[0] = x.dp[L-1];
+  q1.dp[1] = x.dp[L];
+  bn_fixed<L+3> q2;
+  bn_fixed_mul<2,L+1>(q2, q1, mu);
+  bn_fixed<2> q3;
+  q3.dp[0] = q2.dp[L+1];
+  q3.dp[1] = q2.dp[L+2];
+
+  // r = x - q3*m mod 2^(64*(L+1))
+  bn_fixed<L+2> qm;
+  bn_fixed_mul<L,2>(qm, m, q3);
+  bn_fixed<L+1> qm_low;
+  bn_fixed_resize(qm_low, qm);
+  bn_fixed<L+1> t;
+  bn_fixed_sub<L+1>(t, x, qm_low);
+
+  // At most two subtractions are left
+  bn_fixed<L+1> m_ext;
+  bn_fixed_resize(m_ext, m);
+  bn_fixed_csub<L+1>(t, m_ext);
+  bn_fixed_csub<L+1>(t, m_ext);
+  bn_fixed_resize(r, t);
+}
+
+/**
+ * Returns the i-th word of a, or 0 past its end
+ */
+template<int L>
+__host__ __device__ inline cuyasheint_t bn_fixed_word(const bn_fixed<L> &a, int i){
+  return (i < L? a.dp[i < L? i : 0] : 0);
+}
+
+/**
+ * r = x mod 2^nq - 1
+ *
+ * x is split into chunks of nq bits and, since 2^nq = 1 mod q, the chunks
+ * are summed. The sum is folded once more and a single conditional
+ * subtraction is left.
+ * @param r  output: on [0,q)
+ * @param x  input
+ * @param nq input: 64*(LQ-1) < nq <= 64*LQ
+ */
+template<int LIN, int LQ>
+__host__ __device__ inline void bn_fixed_mersenne_mod(bn_fixed<LQ> &r, const bn_fixed<LIN> &x, int nq){
+  const cuyasheint_t top_mask = (nq % WORD? (((cuyasheint_t)1) << (nq % WORD)) - 1 : ~(cuyasheint_t)0);
+  const int chunks = (WORD*LIN + nq - 1) / nq;
+
+  bn_fixed<LQ+1> acc;
+  bn_fixed_zero(acc);
+  for(int k = 0; k < chunks; k++){
+    const int w = (k*nq) / WORD;
+    const int b = (k*nq) % WORD;
+    bn_fixed<LQ+1> c;
+    BN_FIXED_UNROLL
+    for(int i = 0; i < LQ; i++){
+      const cuyasheint_t lo = bn_fixed_word(x, w+i) >> b;
+      const cuyasheint_t hi = (b? bn_fixed_word(x, w+i+1) << (WORD - b) : 0);
+      c.dp[i] = lo | hi;
+    }
+    c.dp[LQ-1] &= top_mask;
+    c.dp[LQ] = 0;
+    bn_fixed_add<LQ+1>(acc, acc, c);
+  }
+
+  // acc < chunks*2^nq, so acc >> nq fits in a word
+  const int w = nq / WORD;
+  const int b = nq % WORD;
+  const cuyasheint_t hi = (bn_fixed_word(acc, w) >> b) | (b? bn_fixed_word(acc, w+1) << (WORD - b) : 0);
+
+  bn_fixed<LQ+1> q;
+  BN_FIXED_UNROLL
+  for(int i = 0; i < LQ; i++)
+    q.dp[i] = ~(cuyasheint_t)0;
+  q.dp[LQ-1] = top_mask;
+  q.dp[LQ] = 0;
+
+  bn_fixed<LQ+1> s;
+  BN_FIXED_UNROLL
+  for(int i = 0; i < LQ+1; i++)
+    s.dp[i] = acc.dp[i] & q.dp[i];
+  bn_fixed_add1<LQ+1>(s, s, hi);
+  bn_fixed_csub<LQ+1>(s, q);
+  bn_fixed_resize(r, s);
+}
+
+/**
+ * quot = round(x/q), for q = 2^nq - 1
+ *
+ * With r = x mod q, x - r is a multiple of q, so the quotient is computed
+ * exactly as (x - r)*q^(-1) mod 2^(64*LIN).
+ * @param quot  output
+ * @param x     input
+ * @param nq    input
+ * @param qinv  input: q^(-1) mod 2^(64*LIN)
+ * @param qDiv2 input: floor(q/2)
+ */
+template<int LIN, int LQ>
+__host__ __device__ inline void bn_fixed_mersenne_round(bn_fixed<LIN> &quot, const bn_fixed<LIN> &x, int nq, const bn_fixed<LIN> &qinv, const bn_fixed<LQ> &qDiv2){
+  bn_fixed<LQ> r;
+  bn_fixed_mersenne_mod<LIN,LQ>(r, x, nq);
+
+  bn_fixed<LIN> r_ext;
+  bn_fixed_resize(r_ext, r);
+  bn_fixed<LIN> y;
+  bn_fixed_sub<LIN>(y, x, r_ext);
+  bn_fixed_mullo<LIN>(quot, y, qinv);
+
+  // If x%q >= q/2, adds one
+  bn_fixed_add1<LIN>(quot, quot, bn_fixed_cmp<LQ>(r, qDiv2) != CMP_LT);
+}
+
+/**
+ * mu = floor(2^(64*LIN)/q), taken from the highest words of
+ * floor(2^(64*STD_BNT_WORDS_ALLOC)/q)
+ */
+template<int LIN>
+__host__ __device__ inline void bn_fixed_qmu(bn_fixed<LIN> &mu, const cuyasheint_t *qmu){
+  BN_FIXED_UNROLL
+  for(int i = 0; i < LIN; i++)
+    mu.dp[i] = qmu[i + STD_BNT_WORDS_ALLOC - LIN];
+}
+
+/**
+ * r = x mod q and quot = floor(x/q) for any q of LQ words
+ *
+ * It follows HAC 14.42 with k = LQ, but x may have any LIN words: with
+ * mu = floor(2^(64*LIN)/q) the quotient estimate is still at most two
+ * below floor(x/q), since x < 2^(64*LIN) and q >= 2^(64*(LQ-1)).
+ * @param r    output: on [0,q)
+ * @param quot output
+ * @param x    input
+ * @param q    input: modulus, whose highest word is not zero
+ * @param mu   input: floor(2^(64*LIN)/q), see bn_fixed_qmu()
+ */
+template<int LIN, int LQ>
+__host__ __device__ inline void bn_fixed_barrett_q(bn_fixed<LQ> &r, bn_fixed<LIN> &quot, const bn_fixed<LIN> &x, const bn_fixed<LQ> &q, const bn_fixed<LIN> &mu){
+  // quot = ((x >> 64*(LQ-1))*mu) >> 64*(LIN-LQ+1)
+  bn_fixed<LIN> q1;
+  BN_FIXED_UNROLL
+  for(int i = 0; i < LIN; i++)
+    q1.dp[i] = bn_fixed_word(x, i + LQ - 1);
+  bn_fixed<2*LIN> q2;
+  bn_fixed_mul<LIN,LIN>(q2, q1, mu);
+  BN_FIXED_UNROLL
+  for(int i = 0; i < LIN; i++){
+    const int j = i + LIN - LQ + 1;
+    quot.dp[i] = (j >= 0? bn_fixed_word(q2, j >= 0? j : 0) : 0);
+  }
+
+  // r = x - quot*q mod 2^(64*(LQ+1))
+  bn_fixed<LIN+LQ> qq;
+  bn_fixed_mul<LIN,LQ>(qq, quot, q);
+  bn_fixed<LQ+1> t;
+  bn_fixed<LQ+1> low;
+  bn_fixed_resize(t, x);
+  bn_fixed_resize(low, qq);
+  bn_fixed_sub<LQ+1>(t, t, low);
+
+  // At most two subtractions are left
+  bn_fixed<LQ+1> q_ext;
+  bn_fixed_resize(q_ext, q);
+  BN_FIXED_UNROLL
+  for(int k = 0; k < 2; k++){
+    bn_fixed<LQ+1> d;
+    const cuyasheint_t borrow = bn_fixed_sub<LQ+1>(d, t, q_ext);
+    bn_fixed_select<LQ+1>(t, d, t, borrow - 1);
+    bn_fixed_add1<LIN>(quot, quot, 1 - borrow);
+  }
+  bn_fixed_resize(r, t);
+}
+
+/**
+ * quot = round(x/q), for any q of LQ words
+ * @param quot  output
+ * @param x     input
+ * @param q     input
+ * @param mu    input: floor(2^(64*LIN)/q)
+ * @param qDiv2 input: floor(q/2)
+ */
+template<int LIN, int LQ>
+__host__ __device__ inline void bn_fixed_barrett_round(bn_fixed<LIN> &quot, const bn_fixed<LIN> &x, const bn_fixed<LQ> &q, const bn_fixed<LIN> &mu, const bn_fixed<LQ> &qDiv2){
+  bn_fixed<LQ> r;
+  bn_fixed_barrett_q<LIN,LQ>(r, quot, x, q, mu);
+
+  // If x%q >= q/2, adds one
+  bn_fixed_add1<LIN>(quot, quot, bn_fixed_cmp<LQ>(r, qDiv2) != CMP_LT);
+}
+
+#endif
@@ -16,7 +16,10 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "cuda_bn.h"
+#include "../aritmetic/pool.h"
 
+// The host backend reads these from host_crt, see host/host_tables.h
+#ifndef HOST_BACKEND
 __constant__ cuyasheint_t CRTPrimesConstant[COPRIMES_BUCKET_SIZE];
 
 __constant__ cuyasheint_t M[STD_BNT_WORDS_ALLOC];
@@ -26,6 +29,7 @@ __constant__ int u_used;
 __constant__ cuyasheint_t Mpis[STD_BNT_WORDS_ALLOC*COPRIMES_BUCKET_SIZE];
 __constant__ int Mpis_used[COPRIMES_BUCKET_SIZE];
 __constant__ cuyasheint_t invMpis[COPRIMES_BUCKET_SIZE];
+#endif
 
 ////////////////////////
 // Auxiliar functions //
@@ -72,7 +76,7 @@ __device__ void swap_d(bn_t *a,bn_t *b){
 __device__ int isZero(int x) {
     unsigned zero;
     zero = x;
-    zero = 1 ^ ((zero | -zero) >> 31) & 1;
+    zero = 1 ^ (((zero | -zero) >> 31) & 1);
     return zero;    
 }
 
@@ -119,7 +123,7 @@ __host__ __device__ uint64_t  lessThan(uint64_t x, uint64_t y) {
 __device__ unsigned isEqual(int x, int y) {    
     unsigned equal;    
     equal = x-y; // "equal" turns 0 if x = y    
-    equal = 1 ^ ((equal | -equal) >> 31) & 1; // "equal" turns 1 iff enable was 0
+    equal = 1 ^ (((equal | -equal) >> 31) & 1); // "equal" turns 1 iff enable was 0
     return equal;    
 }
 
@@ -197,6 +201,7 @@ __host__ __device__ void bn_adjust_used(bn_t *a){
 			return;
 }
 
+#ifndef HOST_BACKEND
 __global__ void bn_get_deg(int *r, bn_t *coefs, int N){
 	/**
 	 * This kernel must be executed by N threads
@@ -213,10 +218,9 @@ __host__ int callBNGetDeg(bn_t *coefs, int N){
 	/**
 	 * Alloc memory
 	 */
-	int *d_result;
+	int *d_result = (int*)pool_malloc(N*sizeof(int));
 	int *h_result;
-	cudaError_t result = cudaMalloc((void**)&d_result,N*sizeof(int));
-	assert(result == cudaSuccess);
+	cudaError_t result;
 	h_result = (int*)malloc(N*sizeof(int));
 	
 	/** 
@@ -237,11 +241,18 @@ __host__ int callBNGetDeg(bn_t *coefs, int N){
 	result = cudaMemcpy(h_result,d_result,N*sizeof(int),cudaMemcpyDeviceToHost);
 	assert(result == cudaSuccess);
 
+	pool_free(d_result);
+
+	int deg = -1;
 	for(int i = N-1; i >= 0; i--)
-		if(h_result[i] != 0)
-			return i;
-	return -1;
+		if(h_result[i] != 0){
+			deg = i;
+			break;
+		}
+	free(h_result);
+	return deg;
 }
+#endif
 
 /**
  * Set a big number to digit
@@ -647,7 +658,7 @@ __host__ __device__ uint64_t bn_mul1_low(uint64_t *c,
 		//////////
 		// host //
 		//////////
-		__uint128_t r = (((__uint128_t)(*a)) * ((__uint128_t)digit) );
+		__uint128_t r = (((__uint128_t)(*a)) * ((__uint128_t)digit) ) + carry;
 		*c = (r & 0xffffffffffffffffL);
 		carry = (r>>64);
 		#endif
@@ -1020,15 +1031,15 @@ __host__ __device__ uint32_t bn_sub1_low_32(uint32_t *c, const uint32_t *a, uint
 
 // #else
 
-// #define COMBA_STEP_BN_MUL_LOW(R2, R1, R0, A, B)														\
-// 	__uint128_t r = (__uint128_t)((uint64_t)(A))*(__uint128_t)((uint64_t)(B));						\
-// 	uint64_t rHi = (r>>64);																			\
-// 	uint64_t rLo = (r&0xffffffffffffffffL);															\
-// 	uint64_t _r = (R1);																				\
-// 	(R0) += rLo;																					\
-// 	(R1) += (R0) < rLo;																				\
-// 	(R2) += (R1) < _r;																				\
-// 	(R1) += rHi;																					\
+// #define COMBA_STEP_BN_MUL_LOW(R2, R1, R0, A, B)
+// 	__uint128_t r = (__uint128_t)((uint64_t)(A))*(__uint128_t)((uint64_t)(B));
+// 	uint64_t rHi = (r>>64);
+// 	uint64_t rLo = (r&0xffffffffffffffffL);
+// 	uint64_t _r = (R1);
+// 	(R0) += rLo;
+// 	(R1) += (R0) < rLo;
+// 	(R2) += (R1) < _r;
+// 	(R1) += rHi;
 // 	(R2) += (R1) < rHi;
 // #endif							
 
@@ -1188,7 +1199,9 @@ __device__ void bn_mod_barrt(	bn_t *C,
 		int mu;
 		cuyasheint_t q[DSTD_BNT_WORDS_ALLOC],t[DSTD_BNT_WORDS_ALLOC],carry;
 
+		#ifdef __CUDACC__
 		#pragma unroll DSTD_BNT_WORDS_ALLOC
+		#endif
 		for(int i = 0; i < DSTD_BNT_WORDS_ALLOC; i++){
 			q[i] = 0;
 			t[i] = 0;
@@ -1275,6 +1288,7 @@ __device__ void bn_mod_barrt(	bn_t *C,
 	// }
 }
 
+#ifndef HOST_BACKEND
 /**
  * [cuModN description]
  * @param c      [description]
@@ -1338,8 +1352,9 @@ __global__ void cuCRT(	cuyasheint_t *d_polyCRT,
 						const unsigned int NPolis
 						){
 	/**
-	 * This function should be executed with used_coefs*NPolis threads. 
-	 * Each thread computes one residue of one coefficient
+	 * This function should be executed with N*NPolis threads. 
+	 * Each thread computes one residue of one coefficient. Coefficients
+	 * from used_coefs on are taken as zero.
 	 *
 	 * x should be an array of N elements
 	 * d_polyCRT should be an array of N*NPolis elements
@@ -1357,15 +1372,29 @@ __global__ void cuCRT(	cuyasheint_t *d_polyCRT,
 	// x can be copied to shared memory!
 	// 
 	if(tid < N*NPolis){
-		// assert ( x[cid].sign == BN_POS );
-		// Computes x mod pi
-		d_polyCRT[cid + rid*N] = bn_mod1_low(	x[cid].dp,
-												x[cid].used,
-												CRTPrimesConstant[rid]
-												);
+		const cuyasheint_t p = CRTPrimesConstant[rid];
+		cuyasheint_t r = 0;
+		if(cid < used_coefs){
+			if(x[cid].used <= 1){
+				// Fast path: a single word
+				r = (x[cid].used == 1? x[cid].dp[0] : 0);
+				if(r >= p)
+					r %= p;
+			}else
+				// Computes x mod pi
+				r = bn_mod1_low(	x[cid].dp,
+									x[cid].used,
+									p
+									);
+			if(x[cid].sign == BN_NEG && r != 0)
+				r = p - r;
+		}
+		d_polyCRT[cid + rid*N] = r;
 	}
 
 }	
+#endif
+
 
 __device__ int get_used_index(const cuyasheint_t *u,int alloc){
 	int i = 0;
@@ -1384,6 +1413,7 @@ __device__ int get_used_index(const cuyasheint_t *u,int alloc){
 	return i;
 }
 
+#ifndef HOST_BACKEND
 __global__ void cuPreICRT(	cuyasheint_t *inner_results,
 							cuyasheint_t *inner_results_used,
 							const cuyasheint_t *d_polyCRT,
@@ -1437,7 +1467,31 @@ __global__ void cuPreICRT(	cuyasheint_t *inner_results,
 }
 
 /**
- * cuICRT computes ICRT on GPU
+ * Lifts x on [0,M) to its balanced residue on (-M/2, M/2]: if M - x < x, x
+ * is replaced by M - x and is negative
+ * @param x input/output
+ */
+__device__ void bn_icrt_center(bn_t *x){
+	for(int i = x->used; i < M_used; i++)
+		x->dp[i] = 0;
+	cuyasheint_t diff[STD_BNT_WORDS_ALLOC];
+	bn_subn_low(diff, M, x->dp, M_used);
+	int i = M_used-1;
+	while(i > 0 && diff[i] == x->dp[i])
+		i--;
+	if(diff[i] < x->dp[i]){
+		for(i = 0; i < M_used; i++)
+			x->dp[i] = diff[i];
+		x->used = M_used;
+		x->sign = BN_NEG;
+	}else
+		x->sign = BN_POS;
+	bn_adjust_used(x);
+}
+
+/**
+ * cuICRT computes ICRT on GPU. The output is the balanced residue on
+ * (-M/2, M/2].
  * @param poly      output: An array of coefficients 
  * @param d_polyCRT input: The CRT residues
  * @param N         input: Number of coefficients
@@ -1494,6 +1548,7 @@ __global__ void cuICRT(	bn_t *poly,
 						M_used,
 						u,
 						u_used);
+		bn_icrt_center(&coef);
  		poly[cid] = coef;
     	bn_zero_non_used(&poly[cid]);
     	bn_adjust_used(&poly[cid]);
@@ -1509,10 +1564,7 @@ void callCRT(bn_t *coefs,const int used_coefs,cuyasheint_t *d_polyCRT,const int
 
 	cudaError_t result;
 
-	// Set all positions to 0
-	result = cudaMemsetAsync(d_polyCRT,0,size*sizeof(cuyasheint_t),stream);
-    assert(result == cudaSuccess);
-	
+	// Every position is written by cuCRT, so there is no need for a memset
 	int blockSize;   // The launch configurator returned block size 
 	// int minGridSize; // The minimum grid size needed to achieve the 
            			 // maximum occupancy for a full device launch 
@@ -1538,10 +1590,72 @@ void callCRT(bn_t *coefs,const int used_coefs,cuyasheint_t *d_polyCRT,const int
 
 }
 
+/**
+ * ICRT by Garner's algorithm. Each thread computes one coefficient.
+ *
+ * The residues are turned into mixed-radix digits, with word-size
+ * arithmetic, and the coefficient is rebuilt by Horner's rule. It is
+ * already on [0,M), so neither d_inner_results nor a reduction by M is
+ * needed, and it is only lifted to (-M/2, M/2].
+ *
+ * The digits are kept on shared memory, NPolis words per thread, at a
+ * stride of blockDim.x so consecutive threads hit consecutive banks.
+ */
+__global__ void cuICRTGarner(	bn_t *poly,
+								const cuyasheint_t *d_polyCRT,
+								const cuyasheint_t *garner_inv,
+								const int N,
+								const int NPolis){
+	extern __shared__ cuyasheint_t s_digits[];
+	const int cid = threadIdx.x + blockIdx.x*blockDim.x;
+	cuyasheint_t *v = &s_digits[threadIdx.x];
+	const int stride = blockDim.x;
+
+	if(cid < N){
+		for(int i = 0; i < NPolis; i++){
+			const cuyasheint_t p = CRTPrimesConstant[i];
+			cuyasheint_t t = d_polyCRT[cid + i*N];
+			for(int j = 0; j < i; j++){
+				const cuyasheint_t vj = v[j*stride] % p;
+				const cuyasheint_t d = (t >= vj? t - vj : t + p - vj);
+				bn_64bits_mulmod(&t, d, garner_inv[i*NPolis + j], p);
+			}
+			v[i*stride] = t;
+		}
+
+		bn_t *x = &poly[cid];
+		bn_zero(x);
+		x->dp[0] = v[(NPolis-1)*stride];
+		x->used = 1;
+		for(int i = NPolis-2; i >= 0; i--){
+			cuyasheint_t carry = bn_mul1_low(x->dp, x->dp, CRTPrimesConstant[i], x->used);
+			if(carry)
+				x->dp[x->used++] = carry;
+			carry = bn_add1_low(x->dp, x->dp, v[i*stride], x->used);
+			if(carry)
+				x->dp[x->used++] = carry;
+		}
+		bn_adjust_used(x);
+		bn_icrt_center(x);
+	}
+}
+
 void callICRT(bn_t *coefs,cuyasheint_t *d_polyCRT,const int N, const int NPolis,cudaStream_t stream){
 
 	if(N <= 0)
 		return;
+	if(CUDAFunctions::icrt == ICRT_GARNER){
+		// The block shrinks until its digits fit on 48KB of shared memory
+		const int digits_size = NPolis*sizeof(cuyasheint_t);
+		int blockSize = 64;
+		while(blockSize > 1 && blockSize*digits_size > 48*1024)
+			blockSize >>= 1;
+		const int gridSize = (N % blockSize == 0? N/blockSize : N/blockSize + 1);
+		cuICRTGarner<<<gridSize,blockSize,blockSize*digits_size,stream>>>(coefs, d_polyCRT, d_garner_inv, N, NPolis);
+		cudaError_t result = cudaGetLastError();
+		assert(result == cudaSuccess);
+		return;
+	}
 	int blockSize;   // The launch configurator returned block size 
 	// int minGridSize; // The minimum grid size needed to achieve the 
            			 // maximum occupancy for a full device launch 
@@ -1555,11 +1669,16 @@ void callICRT(bn_t *coefs,cuyasheint_t *d_polyCRT,const int N, const int NPolis,
 	// blockSize = 256; // 0.54 ms
 	blockSize = 512; // 0.54 ms
 
+	// The partial products are drawn from the pool on each call, so
+	// concurrent ICRTs don't share them
+	cuyasheint_t *d_inner_results = (cuyasheint_t*)pool_malloc(N*NPolis*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
+	cuyasheint_t *d_inner_results_used = (cuyasheint_t*)pool_malloc(N*NPolis*sizeof(cuyasheint_t));
+
 	gridSize = ( N*NPolis % blockSize == 0? 
 						N*NPolis/blockSize : 
 						N*NPolis/blockSize + 1);
-	cuPreICRT<<<gridSize,blockSize,0,stream>>> (CUDAFunctions::d_inner_results,
-												CUDAFunctions::d_inner_results_used,
+	cuPreICRT<<<gridSize,blockSize,0,stream>>> (d_inner_results,
+												d_inner_results_used,
 												d_polyCRT,
 												N,
 												NPolis
@@ -1572,11 +1691,961 @@ void callICRT(bn_t *coefs,cuyasheint_t *d_polyCRT,const int N, const int NPolis,
 	cuICRT<<<gridSize,blockSize,0,stream>>>(coefs,
 											N,
 											NPolis,
-											CUDAFunctions::d_inner_results,
-											CUDAFunctions::d_inner_results_used);
+											d_inner_results,
+											d_inner_results_used);
 	cudaError_t result = cudaGetLastError();
 	assert(result == cudaSuccess);
+	// Blocks are only handed out again to work queued after this one
+	pool_free(d_inner_results);
+	pool_free(d_inner_results_used);
 	// cudaDeviceSynchronize();
 	// assert(result == cudaSuccess);
 
 }
+
+/**
+ * a[0..n+1] += x*b[0..n-1], the carry out of a[n+1] is dropped
+ */
+__device__ void bn_words_mac(cuyasheint_t *a, const cuyasheint_t *b, const int n, const cuyasheint_t x){
+	cuyasheint_t carry = 0;
+	for(int i = 0; i < n; i++){
+		const cuyasheint_t lo = b[i]*x;
+		cuyasheint_t hi = __umul64hi(b[i], x);
+		cuyasheint_t r = lo + a[i];
+		hi += (r < lo);
+		a[i] = r + carry;
+		hi += (a[i] < r);
+		carry = hi;
+	}
+	a[n] += carry;
+	a[n+1] += (a[n] < carry);
+}
+
+/**
+ * Computes round(t*x/q) on the residues of x. Each thread computes one
+ * coefficient. See the host version on host/host_bn.cpp.
+ */
+__global__ void cuRNSScaleRound(	cuyasheint_t *d_polyCRT,
+									const cuyasheint_t *omega,
+									const cuyasheint_t *theta,
+									const cuyasheint_t *pinv,
+									const cuyasheint_t *Omega,
+									const cuyasheint_t *Theta,
+									const cuyasheint_t *offset,
+									const int fw,
+									const int fold,
+									const bool add_offset,
+									const int N,
+									const int NPolis){
+	const int cid = threadIdx.x + blockIdx.x*blockDim.x;
+	const int n = (fold? fold : N);
+
+	if(cid < n){
+		cuyasheint_t xt[COPRIMES_BUCKET_SIZE];
+		cuyasheint_t vacc[4] = {0};
+		cuyasheint_t F[RNS_SCALE_MAX_FRAC_WORDS+2] = {0};
+
+		for(int j = 0; j < NPolis; j++){
+			const cuyasheint_t p = CRTPrimesConstant[j];
+			cuyasheint_t x = d_polyCRT[cid + j*N];
+			if(fold){
+				const cuyasheint_t y = d_polyCRT[cid + fold + j*N];
+				x = (x >= y? x - y : x + p - y);
+			}
+			bn_64bits_mulmod(&xt[j], invMpis[j], x, p);
+
+			bn_words_mac(vacc, &pinv[j*2], 2, xt[j]);
+			bn_words_mac(F, &theta[j*fw], fw, xt[j]);
+		}
+		const cuyasheint_t v = vacc[2] + (vacc[1] >> 63);
+
+		cuyasheint_t vTheta[RNS_SCALE_MAX_FRAC_WORDS+2] = {0};
+		bn_words_mac(vTheta, Theta, fw, v);
+		bn_subn_low(F, F, vTheta, fw+2);
+
+		// round(F/R) as sign and magnitude
+		cuyasheint_t rnd[2] = {F[fw], F[fw+1]};
+		const bool neg = (rnd[1] >> 63);
+		if(neg){
+			rnd[0] = ~rnd[0];
+			rnd[1] = ~rnd[1];
+			rnd[1] += ((++rnd[0]) == 0);
+		}
+		const cuyasheint_t half = (F[fw-1] >> 63);
+
+		for(int i = 0; i < NPolis; i++){
+			const cuyasheint_t p = CRTPrimesConstant[i];
+			cuyasheint_t y = 0;
+			for(int j = 0; j < NPolis; j++){
+				cuyasheint_t z;
+				bn_64bits_mulmod(&z, xt[j], omega[i*NPolis + j], p);
+				y = (y + z) % p;
+			}
+			cuyasheint_t z;
+			bn_64bits_mulmod(&z, v % p, Omega[i], p);
+			y = (y >= z? y - z : y + p - z);
+
+			// r = |round(F/R)| mod p, with 2^64 = w mod p
+			cuyasheint_t w = ((cuyasheint_t)(-p)) % p;
+			cuyasheint_t r;
+			bn_64bits_mulmod(&r, rnd[1] % p, w, p);
+			r = (r + rnd[0] % p) % p;
+			if(neg)
+				r = (p - r) % p;
+			r = (r + half) % p;
+
+			y = (y + r) % p;
+			if(add_offset)
+				y = (y + offset[i]) % p;
+			d_polyCRT[cid + i*N] = y;
+		}
+	}
+}
+
+void callRNSScaleRound(	cuyasheint_t *d_polyCRT,
+						const rns_scale_t *s,
+						const int fold,
+						const bool offset,
+						const int N,
+						const int NPolis,
+						cudaStream_t stream){
+	assert(s->NPolis == NPolis);
+	const int n = (fold? fold : N);
+	const int blockSize = 64;
+	const int gridSize = (n % blockSize == 0? n/blockSize : n/blockSize + 1);
+	cuRNSScaleRound<<<gridSize,blockSize,0,stream>>>(	d_polyCRT,
+														s->d_omega,
+														s->d_theta,
+														s->d_pinv,
+														s->d_Omega,
+														s->d_Theta,
+														s->d_offset,
+														s->frac_words,
+														fold,
+														offset,
+														N,
+														NPolis);
+	cudaError_t result = cudaGetLastError();
+	assert(result == cudaSuccess);
+
+	// The upper half is read while the lower one is rounded, by any block,
+	// so it is only zeroed once the kernel is done
+	if(fold){
+		result = cudaMemset2DAsync(	d_polyCRT + fold,
+									N*sizeof(cuyasheint_t),
+									0,
+									(N-fold)*sizeof(cuyasheint_t),
+									NPolis,
+									stream);
+		assert(result == cudaSuccess);
+	}
+}
+
+/**
+ * Computes [round(t*x/q)]_t for K polynomials. Each thread computes one
+ * coefficient of one polynomial. See the host version on host/host_bn.cpp.
+ */
+__global__ void cuRNSScaleRoundModT(cuyasheint_t *d_out,
+									const cuyasheint_t *d_polyCRT,
+									const cuyasheint_t *theta,
+									const cuyasheint_t *pinv,
+									const cuyasheint_t *Theta,
+									const cuyasheint_t *omega_t,
+									const cuyasheint_t Omega_t,
+									const uint32_t t,
+									const int fw,
+									const int fold,
+									const int n,
+									const int N,
+									const int K,
+									const int NPolis){
+	const int tid = threadIdx.x + blockIdx.x*blockDim.x;
+	const int k = tid / n;
+	const int cid = tid % n;
+
+	if(k < K){
+		const cuyasheint_t *x = &d_polyCRT[k*N + cid];
+		cuyasheint_t vacc[4] = {0};
+		cuyasheint_t F[RNS_SCALE_MAX_FRAC_WORDS+2] = {0};
+		cuyasheint_t y = 0;
+
+		for(int j = 0; j < NPolis; j++){
+			const cuyasheint_t p = CRTPrimesConstant[j];
+			cuyasheint_t xj = x[j*K*N];
+			if(fold){
+				const cuyasheint_t z = x[j*K*N + fold];
+				xj = (xj >= z? xj - z : xj + p - z);
+			}
+			cuyasheint_t xt;
+			bn_64bits_mulmod(&xt, invMpis[j], xj, p);
+
+			bn_words_mac(vacc, &pinv[j*2], 2, xt);
+			bn_words_mac(F, &theta[j*fw], fw, xt);
+
+			// The integer part is summed mod t on the way
+			cuyasheint_t z;
+			bn_64bits_mulmod(&z, xt, omega_t[j], t);
+			y = (y + z) % t;
+		}
+		const cuyasheint_t v = vacc[2] + (vacc[1] >> 63);
+
+		cuyasheint_t vTheta[RNS_SCALE_MAX_FRAC_WORDS+2] = {0};
+		bn_words_mac(vTheta, Theta, fw, v);
+		bn_subn_low(F, F, vTheta, fw+2);
+
+		cuyasheint_t z;
+		bn_64bits_mulmod(&z, v, Omega_t, t);
+		y = (y + t - z) % t;
+
+		// round(F/R) mod t, as sign and magnitude
+		cuyasheint_t rnd[2] = {F[fw], F[fw+1]};
+		const bool neg = (rnd[1] >> 63);
+		if(neg){
+			rnd[0] = ~rnd[0];
+			rnd[1] = ~rnd[1];
+			rnd[1] += ((++rnd[0]) == 0);
+		}
+		cuyasheint_t r = bn_mod1_low(rnd, 2, t);
+		r = (neg? (t - r) % t : r);
+		r = (r + (F[fw-1] >> 63)) % t;
+
+		d_out[k*n + cid] = (y + r) % t;
+	}
+}
+
+void callRNSScaleRoundModT(	cuyasheint_t *h_out,
+							cuyasheint_t *d_polyCRT,
+							const rns_scale_t *s,
+							const int fold,
+							const int n,
+							const int N,
+							const int K,
+							const int NPolis,
+							cudaStream_t stream){
+	assert(s->NPolis == NPolis);
+	// bn_mod1_low() takes a 32 bits divisor
+	assert(s->t > 0 && s->t == (uint32_t)s->t);
+	assert(n <= N && (fold == 0 || n <= fold));
+
+	cuyasheint_t *d_out = (cuyasheint_t*)pool_malloc(K*n*sizeof(cuyasheint_t));
+	const int blockSize = 64;
+	const int size = K*n;
+	const int gridSize = (size % blockSize == 0? size/blockSize : size/blockSize + 1);
+	cuRNSScaleRoundModT<<<gridSize,blockSize,0,stream>>>(	d_out,
+															d_polyCRT,
+															s->d_theta,
+															s->d_pinv,
+															s->d_Theta,
+															s->d_omega_t,
+															s->Omega_t,
+															(uint32_t)s->t,
+															s->frac_words,
+															fold,
+															n,
+															N,
+															K,
+															NPolis);
+	cudaError_t result = cudaGetLastError();
+	assert(result == cudaSuccess);
+
+	result = cudaMemcpyAsync(h_out, d_out, K*n*sizeof(cuyasheint_t), cudaMemcpyDeviceToHost, stream);
+	assert(result == cudaSuccess);
+	result = cudaStreamSynchronize(stream);
+	assert(result == cudaSuccess);
+	pool_free(d_out);
+}
+
+/**
+ * Computes the digit-th RNS digit of x on its residues. Each thread computes
+ * one coefficient. See the host version on host/host_bn.cpp.
+ */
+__global__ void cuRNSDecompDigit(	cuyasheint_t *d_digit,
+									const cuyasheint_t *d_polyCRT,
+									const cuyasheint_t *inv,
+									const cuyasheint_t *hat,
+									const cuyasheint_t *pinv,
+									const cuyasheint_t *PG0,
+									const int L,
+									const int first,
+									const int last,
+									const int N,
+									const int NPolis){
+	const int cid = threadIdx.x + blockIdx.x*blockDim.x;
+
+	if(cid < N){
+		cuyasheint_t y[COPRIMES_BUCKET_SIZE];
+		cuyasheint_t vacc[4] = {0};
+
+		// v is only needed by the first digit
+		for(int j = first; j < (first == 0? L : last); j++){
+			bn_64bits_mulmod(&y[j], inv[j], d_polyCRT[cid + j*N], CRTPrimesConstant[j]);
+			if(first == 0)
+				bn_words_mac(vacc, &pinv[j*2], 2, y[j]);
+		}
+		const cuyasheint_t v = vacc[2] + (vacc[1] >> 63);
+
+		for(int i = 0; i < NPolis; i++){
+			const cuyasheint_t p = CRTPrimesConstant[i];
+			cuyasheint_t r = 0;
+			for(int j = first; j < last; j++){
+				cuyasheint_t z;
+				bn_64bits_mulmod(&z, y[j] % p, hat[i*L + j], p);
+				r = (r + z) % p;
+			}
+			if(first == 0){
+				cuyasheint_t z;
+				bn_64bits_mulmod(&z, v, PG0[i], p);
+				r = (r >= z? r - z : r + p - z);
+			}
+			d_digit[cid + i*N] = r;
+		}
+	}
+}
+
+void callRNSDecompDigit(cuyasheint_t *d_digit,
+						const cuyasheint_t *d_polyCRT,
+						const rns_decomp_t *d,
+						const int digit,
+						const int N,
+						const int NPolis,
+						cudaStream_t stream){
+	assert(d->NPolis == NPolis);
+	assert(digit >= 0 && digit < d->digits);
+	const int blockSize = 64;
+	const int gridSize = (N % blockSize == 0? N/blockSize : N/blockSize + 1);
+	cuRNSDecompDigit<<<gridSize,blockSize,0,stream>>>(	d_digit,
+														d_polyCRT,
+														d->d_inv,
+														d->d_hat,
+														d->d_pinv,
+														d->d_PG0,
+														d->L,
+														digit*d->group,
+														min_d((digit+1)*d->group, d->L),
+														N,
+														NPolis);
+	cudaError_t result = cudaGetLastError();
+	assert(result == cudaSuccess);
+}
+#endif
+
+///////////////
+// bn_matrix //
+///////////////
+
+/**
+ * Allocates a limb matrix of N numbers, all zero
+ * @param a [output]
+ * @param N [input]
+ */
+__host__ void bn_matrix_init(bn_matrix_t *a, int N){
+	a->N = N;
+	a->d_limbs = (cuyasheint_t*)pool_malloc(N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
+	a->d_signs = (uint32_t*)pool_malloc(BN_MATRIX_SIGN_WORDS(N)*sizeof(uint32_t));
+
+	cudaError_t result = cudaMemset(a->d_limbs,0,N*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
+	assert(result == cudaSuccess);
+	result = cudaMemset(a->d_signs,0,BN_MATRIX_SIGN_WORDS(N)*sizeof(uint32_t));
+	assert(result == cudaSuccess);
+}
+
+__host__ void bn_matrix_free(bn_matrix_t *a){
+	pool_free(a->d_limbs);
+	pool_free(a->d_signs);
+	a->d_limbs = NULL;
+	a->d_signs = NULL;
+	a->N = 0;
+}
+
+///////////////
+// bn_fixed  //
+///////////////
+bn_fixed_params_t bn_fixed_params;
+
+/**
+ * Stores the lowest n words of x on dp
+ */
+static void get_words_fixed(cuyasheint_t *dp, ZZ x, int n){
+	for(int i = 0; i < n; i++){
+		dp[i] = conv<uint64_t>(x);
+		x = (x >> WORD);
+	}
+}
+
+__host__ void bn_fixed_setup(ZZ q){
+	const int nq = NumBits(q);
+	const int LM = (NumBits(CRTProduct) + WORD - 1) / WORD;
+	const int LQ = (nq + WORD - 1) / WORD;
+	if(LM < 1 || LM > STD_BNT_WORDS_ALLOC)
+		throw "bn_fixed_setup: M does not fit on STD_BNT_WORDS_ALLOC words";
+	if(LQ < 1 || LQ > BN_FIXED_MAX_Q_WORDS)
+		throw "bn_fixed_setup: q does not fit on BN_FIXED_MAX_Q_WORDS words";
+	const int LIN = BN_FIXED_LIN(LM);
+
+	const ZZ R = NTL::power2_ZZ(WORD*LIN);
+
+	bn_fixed_params.LM = LM;
+	bn_fixed_params.LQ = LQ;
+	bn_fixed_params.nq = nq;
+	bn_fixed_params.mersenne = (q == NTL::power2_ZZ(nq) - 1);
+	get_words_fixed(bn_fixed_params.mu, NTL::power2_ZZ(2*WORD*LM) / CRTProduct, LM+1);
+	get_words_fixed(bn_fixed_params.qinv, (IsOdd(q)? NTL::InvMod(q % R, R) : ZZ(0)), LIN);
+	get_words_fixed(bn_fixed_params.qDiv2, q/2, LQ);
+	get_words_fixed(bn_fixed_params.q, q, LQ);
+	get_words_fixed(bn_fixed_params.qmu, NTL::power2_ZZ(WORD*STD_BNT_WORDS_ALLOC) / q, STD_BNT_WORDS_ALLOC);
+
+	bn_fixed_write_params();
+}
+
+__host__ bool bn_fixed_has_q(ZZ q){
+	if(NumBits(q) != bn_fixed_params.nq)
+		return false;
+	for(int i = 0; i < bn_fixed_params.LQ; i++){
+		if(conv<uint64_t>(q) != bn_fixed_params.q[i])
+			return false;
+		q = (q >> WORD);
+	}
+	return true;
+}
+
+////////////
+// Garner //
+////////////
+cuyasheint_t *d_garner_inv = NULL;
+cuyasheint_t *d_garner_inv_shoup = NULL;
+bool garner_borrowed = false;
+
+__host__ void garner_setup(){
+	const int NPolis = CRTPrimes.size();
+	std::vector<cuyasheint_t> h_inv(NPolis*NPolis,0);
+	std::vector<cuyasheint_t> h_inv_shoup(NPolis*NPolis,0);
+	for(int i = 0; i < NPolis; i++){
+		const ZZ pi = to_ZZ(CRTPrimes[i]);
+		for(int j = 0; j < i; j++){
+			const ZZ inv = NTL::InvMod(to_ZZ(CRTPrimes[j]) % pi, pi);
+			h_inv[i*NPolis + j] = conv<uint64_t>(inv);
+			h_inv_shoup[i*NPolis + j] = conv<uint64_t>((inv << WORD) / pi);
+		}
+	}
+
+	if(!garner_borrowed){
+		cudaFree(d_garner_inv);
+		cudaFree(d_garner_inv_shoup);
+	}
+	garner_borrowed = false;
+	cudaError_t result = cudaMalloc((void**)&d_garner_inv, NPolis*NPolis*sizeof(cuyasheint_t));
+	assert(result == cudaSuccess);
+	result = cudaMalloc((void**)&d_garner_inv_shoup, NPolis*NPolis*sizeof(cuyasheint_t));
+	assert(result == cudaSuccess);
+	result = cudaMemcpy(d_garner_inv, &h_inv[0], NPolis*NPolis*sizeof(cuyasheint_t), cudaMemcpyHostToDevice);
+	assert(result == cudaSuccess);
+	result = cudaMemcpy(d_garner_inv_shoup, &h_inv_shoup[0], NPolis*NPolis*sizeof(cuyasheint_t), cudaMemcpyHostToDevice);
+	assert(result == cudaSuccess);
+}
+
+/////////////////////
+// Scale-and-round //
+/////////////////////
+
+/**
+ * Allocates h.size() words on the device and copies h to them
+ */
+static cuyasheint_t* copy_words_to_device(const std::vector<cuyasheint_t> &h){
+	cuyasheint_t *d;
+	cudaError_t result = cudaMalloc((void**)&d, h.size()*sizeof(cuyasheint_t));
+	assert(result == cudaSuccess);
+	result = cudaMemcpy(d, &h[0], h.size()*sizeof(cuyasheint_t), cudaMemcpyHostToDevice);
+	assert(result == cudaSuccess);
+	return d;
+}
+
+__host__ void rns_scale_setup(rns_scale_t *s, ZZ t, ZZ q, int nphi){
+	const int NPolis = CRTPrimes.size();
+	const ZZ M = CRTProduct;
+
+	// The fraction must tell apart t*x/q from the closest half, which is
+	// 1/(2q) away, after NPolis+1 truncation errors each scaled by a word
+	const int bits = NTL::NumBits(q) + 2 + WORD + NTL::NumBits(to_ZZ(NPolis+1));
+	const int fw = (bits + WORD - 1) / WORD;
+	if(fw > RNS_SCALE_MAX_FRAC_WORDS)
+		throw "rns_scale_setup: q is too big";
+
+	// |round(t*x/q)| <= t*nphi*q, so K*q lifts it to [0, M/2)
+	const ZZ K = t*nphi + 1;
+	if(2*(K + t*nphi)*q >= M)
+		throw "rns_scale_setup: M is too small";
+
+	const ZZ R = NTL::power2_ZZ(WORD*fw);
+	std::vector<cuyasheint_t> h_omega(NPolis*NPolis);
+	std::vector<cuyasheint_t> h_theta(NPolis*fw);
+	std::vector<cuyasheint_t> h_pinv(NPolis*2);
+	std::vector<cuyasheint_t> h_Omega(NPolis);
+	std::vector<cuyasheint_t> h_Theta(fw);
+	std::vector<cuyasheint_t> h_offset(NPolis);
+	for(int j = 0; j < NPolis; j++){
+		const ZZ tMpj = t*CRTMpi[j];
+		const ZZ omega = tMpj / q;
+		for(int i = 0; i < NPolis; i++)
+			h_omega[i*NPolis + j] = conv<uint64_t>(omega % CRTPrimes[i]);
+		get_words_fixed(&h_theta[j*fw], ((tMpj % q)*R) / q, fw);
+		get_words_fixed(&h_pinv[j*2], NTL::power2_ZZ(2*WORD) / CRTPrimes[j], 2);
+	}
+	const ZZ Omega = (t*M) / q;
+	for(int i = 0; i < NPolis; i++){
+		h_Omega[i] = conv<uint64_t>(Omega % CRTPrimes[i]);
+		h_offset[i] = conv<uint64_t>((K*q) % CRTPrimes[i]);
+	}
+	get_words_fixed(&h_Theta[0], (((t*M) % q)*R) / q, fw);
+
+	// The same split taken mod t, for callRNSScaleRoundModT()
+	const bool t_fits = (NTL::NumBits(t) < WORD);
+	std::vector<cuyasheint_t> h_omega_t(NPolis,0);
+	if(t_fits)
+		for(int j = 0; j < NPolis; j++)
+			h_omega_t[j] = conv<uint64_t>(((t*CRTMpi[j]) / q) % t);
+
+	rns_scale_free(s);
+	s->NPolis = NPolis;
+	s->frac_words = fw;
+	s->d_omega = copy_words_to_device(h_omega);
+	s->d_theta = copy_words_to_device(h_theta);
+	s->d_pinv = copy_words_to_device(h_pinv);
+	s->d_Omega = copy_words_to_device(h_Omega);
+	s->d_Theta = copy_words_to_device(h_Theta);
+	s->d_offset = copy_words_to_device(h_offset);
+	s->t = (t_fits? conv<uint64_t>(t) : 0);
+	s->d_omega_t = copy_words_to_device(h_omega_t);
+	s->Omega_t = (t_fits? conv<uint64_t>(Omega % t) : 0);
+}
+
+__host__ void rns_scale_free(rns_scale_t *s){
+	cudaFree(s->d_omega);
+	cudaFree(s->d_theta);
+	cudaFree(s->d_pinv);
+	cudaFree(s->d_Omega);
+	cudaFree(s->d_Theta);
+	cudaFree(s->d_offset);
+	cudaFree(s->d_omega_t);
+	*s = rns_scale_t();
+}
+
+__host__ void rns_decomp_setup(rns_decomp_t *d, ZZ q, int group){
+	const int NPolis = CRTPrimes.size();
+	if(group < 1)
+		throw "rns_decomp_setup: group must be positive";
+
+	// P > 2q keeps x/P below 1/2, so v is a rounding of sum_j y_j/pj
+	int L = 0;
+	ZZ P = to_ZZ(1);
+	while(P <= 2*q){
+		if(L == NPolis)
+			throw "rns_decomp_setup: M is too small";
+		P *= CRTPrimes[L++];
+	}
+	const int digits = (L + group - 1) / group;
+
+	std::vector<cuyasheint_t> h_inv(L);
+	std::vector<cuyasheint_t> h_hat(NPolis*L);
+	std::vector<cuyasheint_t> h_pinv(L*2);
+	std::vector<cuyasheint_t> h_PG0(NPolis);
+	for(int G = 0; G < digits; G++){
+		ZZ PG = to_ZZ(1);
+		for(int j = G*group; j < min_d((G+1)*group, L); j++)
+			PG *= CRTPrimes[j];
+		for(int j = G*group; j < min_d((G+1)*group, L); j++){
+			const ZZ pj = to_ZZ(CRTPrimes[j]);
+			h_inv[j] = conv<uint64_t>(NTL::InvMod((P/pj) % pj, pj));
+			for(int i = 0; i < NPolis; i++)
+				h_hat[i*L + j] = conv<uint64_t>((PG/pj) % CRTPrimes[i]);
+			get_words_fixed(&h_pinv[j*2], NTL::power2_ZZ(2*WORD) / pj, 2);
+		}
+		if(G == 0)
+			for(int i = 0; i < NPolis; i++)
+				h_PG0[i] = conv<uint64_t>(PG % CRTPrimes[i]);
+	}
+
+	rns_decomp_free(d);
+	d->NPolis = NPolis;
+	d->L = L;
+	d->group = group;
+	d->digits = digits;
+	d->d_inv = copy_words_to_device(h_inv);
+	d->d_hat = copy_words_to_device(h_hat);
+	d->d_pinv = copy_words_to_device(h_pinv);
+	d->d_PG0 = copy_words_to_device(h_PG0);
+}
+
+__host__ void rns_decomp_free(rns_decomp_t *d){
+	cudaFree(d->d_inv);
+	cudaFree(d->d_hat);
+	cudaFree(d->d_pinv);
+	cudaFree(d->d_PG0);
+	*d = rns_decomp_t();
+}
+
+#ifndef HOST_BACKEND
+__device__ int matrix_get_sign(const uint32_t *signs, int i){
+	return (signs[i/32] >> (i%32)) & 1;
+}
+
+/**
+ * Threads of a warp share the words of the bitmap, so bits are set with
+ * atomics
+ */
+__device__ void matrix_set_sign(uint32_t *signs, int i, int sign){
+	if(sign == BN_NEG)
+		atomicOr(&signs[i/32], 1U << (i%32));
+	else
+		atomicAnd(&signs[i/32], ~(1U << (i%32)));
+}
+
+__global__ void cuBNToMatrix(   cuyasheint_t *limbs,
+								uint32_t *signs,
+								const bn_t *coefs,
+								const int N,
+								const int spacing){
+	const int cid = threadIdx.x + blockIdx.x*blockDim.x;
+
+	if(cid < N){
+		const bn_t x = coefs[cid];
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			limbs[cid + i*spacing] = (i < x.used? x.dp[i] : 0);
+		matrix_set_sign(signs, cid, x.sign);
+	}
+}
+
+__global__ void cuMatrixToBN(   bn_t *coefs,
+								const cuyasheint_t *limbs,
+								const uint32_t *signs,
+								const int N,
+								const int spacing){
+	const int cid = threadIdx.x + blockIdx.x*blockDim.x;
+
+	if(cid < N){
+		bn_t x = coefs[cid];
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			x.dp[i] = limbs[cid + i*spacing];
+		for(int i = STD_BNT_WORDS_ALLOC; i < x.alloc; i++)
+			x.dp[i] = 0;
+		x.used = STD_BNT_WORDS_ALLOC;
+		x.sign = matrix_get_sign(signs, cid);
+		bn_adjust_used(&x);
+		coefs[cid] = x;
+	}
+}
+
+/**
+ * cuCRT over a limb matrix. Consecutive threads load consecutive words.
+ */
+__global__ void cuCRTMatrix(    cuyasheint_t *d_polyCRT,
+								const cuyasheint_t *limbs,
+								const uint32_t *signs,
+								const unsigned int N,
+								const unsigned int NPolis){
+	const unsigned int tid = threadIdx.x + blockIdx.x*blockDim.x;
+	const unsigned int cid = tid % N;
+	const unsigned int rid = tid / N;
+
+	if(tid < N*NPolis){
+		cuyasheint_t x[STD_BNT_WORDS_ALLOC];
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			x[i] = limbs[cid + i*N];
+
+		const cuyasheint_t p = CRTPrimesConstant[rid];
+		cuyasheint_t r = bn_mod1_low(   x,
+										get_used_index(x,STD_BNT_WORDS_ALLOC)+1,
+										p);
+		if(matrix_get_sign(signs, cid) == BN_NEG && r != 0)
+			r = p - r;
+		d_polyCRT[cid + rid*N] = r;
+	}
+}
+
+__constant__ cuyasheint_t bn_fixed_mu[STD_BNT_WORDS_ALLOC+1];
+__constant__ cuyasheint_t bn_fixed_qinv[STD_BNT_WORDS_ALLOC];
+__constant__ cuyasheint_t bn_fixed_qDiv2[BN_FIXED_MAX_Q_WORDS];
+__constant__ cuyasheint_t bn_fixed_q[BN_FIXED_MAX_Q_WORDS];
+__constant__ cuyasheint_t bn_fixed_qmu[STD_BNT_WORDS_ALLOC];
+
+__host__ void bn_fixed_write_params(){
+	cudaError_t result = cudaMemcpyToSymbol(bn_fixed_mu, bn_fixed_params.mu, sizeof(bn_fixed_params.mu));
+	assert(result == cudaSuccess);
+	result = cudaMemcpyToSymbol(bn_fixed_qinv, bn_fixed_params.qinv, sizeof(bn_fixed_params.qinv));
+	assert(result == cudaSuccess);
+	result = cudaMemcpyToSymbol(bn_fixed_qDiv2, bn_fixed_params.qDiv2, sizeof(bn_fixed_params.qDiv2));
+	assert(result == cudaSuccess);
+	result = cudaMemcpyToSymbol(bn_fixed_q, bn_fixed_params.q, sizeof(bn_fixed_params.q));
+	assert(result == cudaSuccess);
+	result = cudaMemcpyToSymbol(bn_fixed_qmu, bn_fixed_params.qmu, sizeof(bn_fixed_params.qmu));
+	assert(result == cudaSuccess);
+}
+
+/**
+ * ICRT of coefficient cid, for a M of LM words
+ *
+ * Each Mpi*x is below M, so the sum is below NPolis*M and fits on LM+1
+ * words. The output is the balanced residue on (-M/2, M/2].
+ *
+ * If garner_inv is set, Garner's algorithm is used instead, as by
+ * cuICRTGarner(). The coefficient is rebuilt by Horner's rule on [0,M), so
+ * there is no reduction by M. The digits are kept on local memory.
+ * @return all ones if the output is negative, and r is its magnitude
+ */
+template<int LM>
+__device__ cuyasheint_t bn_fixed_icrt(  bn_fixed<LM> &r,
+										const cuyasheint_t *d_polyCRT,
+										const cuyasheint_t *garner_inv,
+										const unsigned int cid,
+										const unsigned int N,
+										const unsigned int NPolis){
+	bn_fixed<LM> m;
+	BN_FIXED_UNROLL
+	for(int i = 0; i < LM; i++)
+		m.dp[i] = M[i];
+
+	if(garner_inv){
+		cuyasheint_t v[COPRIMES_BUCKET_SIZE];
+		for(unsigned int i = 0; i < NPolis; i++){
+			const cuyasheint_t p = CRTPrimesConstant[i];
+			cuyasheint_t t = d_polyCRT[cid + i*N];
+			for(unsigned int j = 0; j < i; j++){
+				const cuyasheint_t vj = v[j] % p;
+				const cuyasheint_t d = (t >= vj? t - vj : t + p - vj);
+				bn_64bits_mulmod(&t, d, garner_inv[i*NPolis + j], p);
+			}
+			v[i] = t;
+		}
+
+		bn_fixed_zero(r);
+		r.dp[0] = v[NPolis-1];
+		for(int i = NPolis-2; i >= 0; i--)
+			bn_fixed_muladd1<LM>(r, CRTPrimesConstant[i], v[i]);
+	}else{
+		bn_fixed<LM> acc;
+		cuyasheint_t acc_hi = 0;
+		bn_fixed_zero(acc);
+
+		for(unsigned int rid = 0; rid < NPolis; rid++){
+			cuyasheint_t x;
+			bn_64bits_mulmod(   &x,
+								invMpis[rid],
+								d_polyCRT[cid + rid*N],
+								CRTPrimesConstant[rid]);
+
+			// acc += Mpi * x
+			acc_hi += bn_fixed_mac1<LM>(acc, &Mpis[rid*STD_BNT_WORDS_ALLOC], x);
+		}
+		bn_fixed<LM+1> v;
+		bn_fixed_resize(v, acc);
+		v.dp[LM] = acc_hi;
+
+		////////////////////////////////////////////////
+		// Modular reduction by M //
+		////////////////////////////////////////////////
+		bn_fixed<LM+1> mu;
+		BN_FIXED_UNROLL
+		for(int i = 0; i <= LM; i++)
+			mu.dp[i] = bn_fixed_mu[i];
+		bn_fixed_barrett<LM>(r, v, m, mu);
+	}
+
+	bn_fixed<LM> d;
+	bn_fixed_sub<LM>(d, m, r);
+	const cuyasheint_t negative = -(cuyasheint_t)(bn_fixed_cmp<LM>(d, r) == CMP_LT);
+	bn_fixed_select<LM>(r, d, r, negative);
+	return negative;
+}
+
+/**
+ * cuICRT over a limb matrix, for a M of LM words. Each thread computes one
+ * coefficient.
+ */
+template<int LM>
+__global__ void cuICRTMatrix(   cuyasheint_t *limbs,
+								uint32_t *signs,
+								const cuyasheint_t *d_polyCRT,
+								const cuyasheint_t *garner_inv,
+								const unsigned int N,
+								const unsigned int NPolis){
+	const unsigned int cid = threadIdx.x + blockIdx.x*blockDim.x;
+
+	if(cid < N){
+		bn_fixed<LM> r;
+		const cuyasheint_t negative = bn_fixed_icrt<LM>(r, d_polyCRT, garner_inv, cid, N, NPolis);
+
+		BN_FIXED_UNROLL
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			limbs[cid + i*N] = bn_fixed_word(r, i);
+		matrix_set_sign(signs, cid, (int)(negative & BN_NEG));
+	}
+}
+
+/**
+ * callPolynomialReduceFused() for a M of LM words and a q of LQ words. Each
+ * thread carries one coefficient pair from the residues to the residues, on
+ * registers. q is reduced by Mersenne folding if mersenne is set, and by
+ * Barrett otherwise.
+ *
+ * The fold is a subtraction of residues, whose magnitude is below M/2, so
+ * the balanced ICRT gives it back with its sign.
+ */
+template<int LM, int LQ>
+__global__ void cuPolynomialReduceFused(cuyasheint_t *d_polyCRT,
+										const cuyasheint_t *garner_inv,
+										const unsigned int fold,
+										const unsigned int N,
+										const unsigned int NPolis,
+										const int nq,
+										const int mersenne){
+	const unsigned int tid = threadIdx.x + blockIdx.x*blockDim.x;
+	// Without fold every coefficient is a pair on its own
+	const unsigned int cid = (fold? (tid / fold)*2*fold + tid % fold : tid);
+
+	if((fold? tid < N/2 : tid < N)){
+		// x[cid+fold] is folded into x[cid]
+		if(fold)
+			for(unsigned int rid = 0; rid < NPolis; rid++){
+				const cuyasheint_t p = CRTPrimesConstant[rid];
+				const cuyasheint_t a = d_polyCRT[cid + rid*N];
+				const cuyasheint_t b = d_polyCRT[cid + fold + rid*N];
+				d_polyCRT[cid + rid*N] = (a - b) + (b > a)*p;
+				d_polyCRT[cid + fold + rid*N] = 0;
+			}
+
+		bn_fixed<LM> x;
+		const cuyasheint_t negative = bn_fixed_icrt<LM>(x, d_polyCRT, garner_inv, cid, N, NPolis);
+
+		bn_fixed<LQ> q;
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LQ; i++)
+			q.dp[i] = bn_fixed_q[i];
+		bn_fixed<LQ> r;
+		if(mersenne)
+			bn_fixed_mersenne_mod<LM,LQ>(r, x, nq);
+		else{
+			bn_fixed<LM> mu;
+			bn_fixed<LM> quot;
+			bn_fixed_qmu<LM>(mu, bn_fixed_qmu);
+			bn_fixed_barrett_q<LM,LQ>(r, quot, x, q, mu);
+		}
+
+		// -r mod q is q - r
+		cuyasheint_t nonzero = 0;
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LQ; i++)
+			nonzero |= r.dp[i];
+		bn_fixed<LQ> d;
+		bn_fixed_sub<LQ>(d, q, r);
+		bn_fixed_select<LQ>(r, d, r, negative & -(cuyasheint_t)(nonzero != 0));
+
+		for(unsigned int rid = 0; rid < NPolis; rid++)
+			d_polyCRT[cid + rid*N] = bn_mod1_low(r.dp, LQ, CRTPrimesConstant[rid]);
+	}
+}
+
+/**
+ * Launches the instance of cuICRTMatrix for lm words
+ */
+template<int LM>
+struct cuICRTMatrixInstance{
+	static void launch(int lm, int gridSize, int blockSize, cudaStream_t stream, bn_matrix_t *a, const cuyasheint_t *d_polyCRT, const cuyasheint_t *garner_inv, const int NPolis){
+		if(lm != LM)
+			cuICRTMatrixInstance<LM-1>::launch(lm, gridSize, blockSize, stream, a, d_polyCRT, garner_inv, NPolis);
+		else
+			cuICRTMatrix<LM><<<gridSize,blockSize,0,stream>>>(a->d_limbs, a->d_signs, d_polyCRT, garner_inv, a->N, NPolis);
+	}
+};
+template<>
+struct cuICRTMatrixInstance<0>{
+	static void launch(int lm, int gridSize, int blockSize, cudaStream_t stream, bn_matrix_t *a, const cuyasheint_t *d_polyCRT, const cuyasheint_t *garner_inv, const int NPolis){
+		throw "callICRTMatrix: bn_fixed_setup() was not called";
+	}
+};
+
+/**
+ * Launches the instance of cuPolynomialReduceFused for lm and lq words
+ */
+template<int LM, int LQ>
+struct cuPolynomialReduceFusedInstance{
+	static void launch(int lm, int lq, int gridSize, int blockSize, cudaStream_t stream, cuyasheint_t *d_polyCRT, const cuyasheint_t *garner_inv, const int fold, const int N, const int NPolis, const int nq, const int mersenne){
+		if(lm != LM)
+			cuPolynomialReduceFusedInstance<LM-1,LQ>::launch(lm, lq, gridSize, blockSize, stream, d_polyCRT, garner_inv, fold, N, NPolis, nq, mersenne);
+		else if(lq != LQ)
+			cuPolynomialReduceFusedInstance<LM,LQ-1>::launch(lm, lq, gridSize, blockSize, stream, d_polyCRT, garner_inv, fold, N, NPolis, nq, mersenne);
+		else
+			cuPolynomialReduceFused<LM,LQ><<<gridSize,blockSize,0,stream>>>(d_polyCRT, garner_inv, fold, N, NPolis, nq, mersenne);
+	}
+};
+template<int LQ>
+struct cuPolynomialReduceFusedInstance<0,LQ>{
+	static void launch(int lm, int lq, int gridSize, int blockSize, cudaStream_t stream, cuyasheint_t *d_polyCRT, const cuyasheint_t *garner_inv, const int fold, const int N, const int NPolis, const int nq, const int mersenne){
+		throw "callPolynomialReduceFused: bn_fixed_setup() was not called";
+	}
+};
+template<int LM>
+struct cuPolynomialReduceFusedInstance<LM,0>{
+	static void launch(int lm, int lq, int gridSize, int blockSize, cudaStream_t stream, cuyasheint_t *d_polyCRT, const cuyasheint_t *garner_inv, const int fold, const int N, const int NPolis, const int nq, const int mersenne){
+		throw "callPolynomialReduceFused: bn_fixed_setup() was not called";
+	}
+};
+
+void callBNToMatrix(bn_matrix_t *a, bn_t *coefs, const int N, cudaStream_t stream){
+	assert(a->N >= N);
+	const int blockSize = ADDBLOCKXDIM;
+	const int gridSize = (N % blockSize == 0? N/blockSize : N/blockSize + 1);
+
+	cuBNToMatrix<<<gridSize,blockSize,0,stream>>>(a->d_limbs, a->d_signs, coefs, N, a->N);
+	cudaError_t result = cudaGetLastError();
+	assert(result == cudaSuccess);
+}
+
+void callMatrixToBN(bn_t *coefs, bn_matrix_t *a, const int N, cudaStream_t stream){
+	assert(a->N >= N);
+	const int blockSize = ADDBLOCKXDIM;
+	const int gridSize = (N % blockSize == 0? N/blockSize : N/blockSize + 1);
+
+	cuMatrixToBN<<<gridSize,blockSize,0,stream>>>(coefs, a->d_limbs, a->d_signs, N, a->N);
+	cudaError_t result = cudaGetLastError();
+	assert(result == cudaSuccess);
+}
+
+void callCRTMatrix(bn_matrix_t *a, cuyasheint_t *d_polyCRT, const int NPolis, cudaStream_t stream){
+	const int size = a->N*NPolis;
+	if(size <= 0)
+		return;
+	const int blockSize = 512;
+	const int gridSize = (size % blockSize == 0? size/blockSize : size/blockSize + 1);
+
+	cuCRTMatrix<<<gridSize,blockSize,0,stream>>>(d_polyCRT, a->d_limbs, a->d_signs, a->N, NPolis);
+	cudaError_t result = cudaGetLastError();
+	assert(result == cudaSuccess);
+}
+
+void callICRTMatrix(bn_matrix_t *a, cuyasheint_t *d_polyCRT, const int NPolis, cudaStream_t stream){
+	const int N = a->N;
+	if(N <= 0)
+		return;
+	const int blockSize = 64;
+	const int gridSize = (N % blockSize == 0? N/blockSize : N/blockSize + 1);
+
+	const cuyasheint_t *garner_inv = (CUDAFunctions::icrt == ICRT_GARNER? d_garner_inv : NULL);
+	cuICRTMatrixInstance<STD_BNT_WORDS_ALLOC>::launch(bn_fixed_params.LM, gridSize, blockSize, stream, a, d_polyCRT, garner_inv, NPolis);
+	cudaError_t result = cudaGetLastError();
+	assert(result == cudaSuccess);
+}
+
+void callPolynomialReduceFused(cuyasheint_t *d_polyCRT, const int fold, const int N, const int NPolis, const int nq, cudaStream_t stream){
+	assert(nq == bn_fixed_params.nq);
+	const int size = (fold? N/2 : N);
+	if(size <= 0)
+		return;
+	assert(fold == 0 || N % (2*fold) == 0);
+	const int blockSize = 64;
+	const int gridSize = (size % blockSize == 0? size/blockSize : size/blockSize + 1);
+
+	const cuyasheint_t *garner_inv = (CUDAFunctions::icrt == ICRT_GARNER? d_garner_inv : NULL);
+	cuPolynomialReduceFusedInstance<STD_BNT_WORDS_ALLOC,BN_FIXED_MAX_Q_WORDS>::launch(bn_fixed_params.LM, bn_fixed_params.LQ, gridSize, blockSize, stream, d_polyCRT, garner_inv, fold, N, NPolis, nq, bn_fixed_params.mersenne);
+	cudaError_t result = cudaGetLastError();
+	assert(result == cudaSuccess);
+}
+#endif
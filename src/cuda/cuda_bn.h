@@ -19,13 +19,16 @@
 #define CUDA_BN_H
 
 #include <NTL/ZZ.h>
+#ifndef HOST_BACKEND
 #include <cuda.h>
 #include <cuda_runtime_api.h>
 #include <cuda_runtime.h>
+#endif
 #include <iostream>
 #include <stdio.h>
 #include <assert.h>
 #include "../settings.h"
+#include "bn_fixed.h"
 #include "operators.h"
 
 NTL_CLIENT 
@@ -111,9 +114,201 @@ __host__ __device__ int min_d(int a,int b);
 __host__ __device__ uint64_t lessThan(uint64_t x, uint64_t y);
 __host__ void callTestData(bn_t *coefs,int N);
 __device__ int get_used_index(const cuyasheint_t *u,int alloc);
+#ifndef HOST_BACKEND
+__device__ int matrix_get_sign(const uint32_t *signs, int i);
+__device__ void matrix_set_sign(uint32_t *signs, int i, int sign);
+#endif
 void callCRT(bn_t *coefs,const int used_coefs,cuyasheint_t *d_polyCRT,const int N, const int NPolis,cudaStream_t stream);
 void callICRT(bn_t *coefs,cuyasheint_t *d_polyCRT,const int N, const int NPolis,cudaStream_t stream);
 
+/**
+ * allocates a limb matrix of N numbers, all zero
+ * @param a [output]
+ * @param N [input]
+ */
+__host__ void bn_matrix_init(bn_matrix_t *a, int N);
+__host__ void bn_matrix_free(bn_matrix_t *a);
+void callBNToMatrix(bn_matrix_t *a, bn_t *coefs, const int N, cudaStream_t stream);
+void callMatrixToBN(bn_t *coefs, bn_matrix_t *a, const int N, cudaStream_t stream);
+/**
+ * callCRT() and callICRT() over the a->N numbers of a limb matrix
+ */
+void callCRTMatrix(bn_matrix_t *a, cuyasheint_t *d_polyCRT, const int NPolis, cudaStream_t stream);
+void callICRTMatrix(bn_matrix_t *a, cuyasheint_t *d_polyCRT, const int NPolis, cudaStream_t stream);
+/**
+ * CUDAFunctions::callPolynomialReductionCRT(), callICRTMatrix(),
+ * callModQMatrix() and callCRTMatrix() on a single pass over the residues. Each coefficient
+ * pair (cid, cid+fold) is carried from the residues of x to the residues of
+ * (x[cid] - x[cid+fold]) mod q without a limb matrix.
+ * @param d_polyCRT input/output: N*NPolis residues
+ * @param fold      input: if not zero, x is reduced by x^fold + 1 on every
+ *                  block of 2*fold coefficients, and coefficients from fold on
+ *                  are set to zero
+ * @param N         input: qty of coefficients
+ * @param NPolis    input: qty of primes
+ * @param nq        input: bits of the q given to bn_fixed_setup()
+ */
+void callPolynomialReduceFused(cuyasheint_t *d_polyCRT, const int fold, const int N, const int NPolis, const int nq, cudaStream_t stream);
+
+extern bn_fixed_params_t bn_fixed_params;
+/**
+ * Computes the constants of the fixed-width passes for the current CRT
+ * product and q, and picks the instances that fit them. The passes reduce
+ * by Mersenne folding if q = 2^nq - 1, and by Barrett otherwise.
+ * It is called by gen_crt_primes().
+ * @param q [input]
+ */
+__host__ void bn_fixed_setup(ZZ q);
+/**
+ * @return true if bn_fixed_setup() was last called for q
+ */
+__host__ bool bn_fixed_has_q(ZZ q);
+/**
+ * Backend side of bn_fixed_setup(): copies bn_fixed_params to where the
+ * launchers read it from.
+ */
+__host__ void bn_fixed_write_params();
+
+/**
+ * Garner's constants: d_garner_inv[i*NPolis + j] = pj^(-1) mod pi, for j < i,
+ * and its Shoup quotient floor(d_garner_inv*2^64/pi) on d_garner_inv_shoup.
+ * They are computed by garner_setup(), called by gen_crt_primes().
+ */
+extern cuyasheint_t *d_garner_inv;
+extern cuyasheint_t *d_garner_inv_shoup;
+extern bool garner_borrowed; // the tables are owned by a ParamContext
+__host__ void garner_setup();
+
+/**
+ * Constants of the RNS scale-and-round, round(t*x/q).
+ *
+ * x is decomposed as sum_j xt_j*(M/pj) - v*M, with xt_j = [x_j*(M/pj)^(-1)]_pj.
+ * Every t*(M/pj)/q is split as omega_j + theta_j, with omega_j integer and
+ * theta_j on [0,1), and t*M/q as Omega + Theta. So
+ *
+ * 	round(t*x/q) = sum_j xt_j*omega_j - v*Omega
+ * 	             + round(sum_j xt_j*theta_j - v*Theta),
+ *
+ * where the first line is computed modulo each pi and the second one on fixed
+ * point, with frac_words words of fraction.
+ */
+#define RNS_SCALE_MAX_FRAC_WORDS 4
+typedef struct rns_scale_st{
+	int NPolis = 0;
+	int frac_words = 0;
+	cuyasheint_t *d_omega = NULL; // [omega_j]_pi at i*NPolis + j
+	cuyasheint_t *d_theta = NULL; // theta_j*2^(64*frac_words), frac_words words each
+	cuyasheint_t *d_pinv = NULL; // floor(2^128/pj), two words each
+	cuyasheint_t *d_Omega = NULL; // [Omega]_pi
+	cuyasheint_t *d_Theta = NULL; // Theta*2^(64*frac_words)
+	cuyasheint_t *d_offset = NULL; // [K*q]_pi, see rns_scale_setup()
+	cuyasheint_t t = 0; // 0 if t does not fit on a word
+	cuyasheint_t *d_omega_t = NULL; // [omega_j]_t
+	cuyasheint_t Omega_t = 0; // [Omega]_t
+} rns_scale_t;
+
+/**
+ * Computes the constants of round(t*x/q) for the current CRT primes.
+ *
+ * The output of callRNSScaleRound() may be shifted by K*q, for a K such that
+ * it is non-negative for any |x| < nphi*q^2.
+ * @param s    output
+ * @param t    input
+ * @param q    input
+ * @param nphi input
+ */
+__host__ void rns_scale_setup(rns_scale_t *s, ZZ t, ZZ q, int nphi);
+__host__ void rns_scale_free(rns_scale_t *s);
+/**
+ * Replaces the residues of x by the residues of round(t*x/q). x is taken on
+ * (-M/2, M/2].
+ * @param d_polyCRT input/output: N*NPolis residues
+ * @param s         input: constants from rns_scale_setup()
+ * @param fold      input: if not zero, x[cid] - x[cid+fold] is rounded
+ *                  instead of x[cid] and coefficients from fold on are set to
+ *                  zero, i.e., x is reduced by x^fold + 1 first
+ * @param offset    input: adds K*q to the output
+ */
+void callRNSScaleRound(	cuyasheint_t *d_polyCRT,
+						const rns_scale_t *s,
+						const int fold,
+						const bool offset,
+						const int N,
+						const int NPolis,
+						cudaStream_t stream);
+/**
+ * Writes [round(t*x/q)]_t, on [0,t), for K polynomials at once. The integer
+ * parts of callRNSScaleRound() are taken mod t instead of mod each pi, so x
+ * doesn't need to be reduced mod q first and a single pass goes from the
+ * residues to the plaintext.
+ * @param h_out     output: n coefficients of the k-th polynomial at k*n, on
+ *                  the host
+ * @param d_polyCRT input: residue rid of the k-th polynomial at rid*K*N + k*N
+ * @param s         input: constants from rns_scale_setup(), with s->t set
+ * @param fold      input: if not zero, x[cid] - x[cid+fold] is rounded
+ * @param n         input: coefficients written per polynomial
+ */
+void callRNSScaleRoundModT(	cuyasheint_t *h_out,
+							cuyasheint_t *d_polyCRT,
+							const rns_scale_t *s,
+							const int fold,
+							const int n,
+							const int N,
+							const int K,
+							const int NPolis,
+							cudaStream_t stream);
+
+/**
+ * Constants of the RNS-digit decomposition, used by the keyswitch in place of
+ * WordDecomp.
+ *
+ * The first L CRT primes, whose product P is above 2q, are the decomposition
+ * basis. They are split in groups G of up to group consecutive primes, with
+ * product P_G, and any x on [0,q) is
+ *
+ * 	x = sum_G D_G*(P/P_G),
+ * 	D_G = sum_{j in G} y_j*(P_G/pj) - [G is the first group]*v*P_G,
+ *
+ * for y_j = [x_j*(P/pj)^(-1)]_pj and v = round(sum_j y_j/pj). So each digit
+ * is built straight from the residues of x, with no ICRT and no word split.
+ * |D_G| < L*P_G.
+ */
+typedef struct rns_decomp_st{
+	int NPolis = 0;
+	int L = 0; // primes on the decomposition basis
+	int group = 0; // primes per digit
+	int digits = 0; // ceil(L/group)
+	cuyasheint_t *d_inv = NULL; // [(P/pj)^(-1)]_pj
+	cuyasheint_t *d_hat = NULL; // [P_G/pj]_pi at i*L + j, for the group G of j
+	cuyasheint_t *d_pinv = NULL; // floor(2^128/pj), two words each
+	cuyasheint_t *d_PG0 = NULL; // [P_G]_pi for the first group
+} rns_decomp_t;
+
+/**
+ * Computes the constants of the RNS-digit decomposition for the current CRT
+ * primes
+ * @param d     output
+ * @param q     input
+ * @param group input: primes per digit. Fewer digits mean fewer keyswitch
+ *              products, but bigger digits.
+ */
+__host__ void rns_decomp_setup(rns_decomp_t *d, ZZ q, int group);
+__host__ void rns_decomp_free(rns_decomp_t *d);
+/**
+ * Writes the residues of the digit-th digit of x
+ * @param d_digit   output: N*NPolis residues
+ * @param d_polyCRT input: N*NPolis residues of x, on [0,q)
+ * @param d         input: constants from rns_decomp_setup()
+ * @param digit     input: on [0, d->digits)
+ */
+void callRNSDecompDigit(cuyasheint_t *d_digit,
+						const cuyasheint_t *d_polyCRT,
+						const rns_decomp_t *d,
+						const int digit,
+						const int N,
+						const int NPolis,
+						cudaStream_t stream);
+
 
 
 
@@ -18,20 +18,9 @@
 #include "cuda_ciphertext.h"
 
 
-template <int WORDLENGTH>
+#ifndef HOST_BACKEND
 /**
- * cuWordecomp computes de word decomposition of every coefficient in 32 bit words.
- * The coefficients are destroyed inside the kernel
- * @param P   [description]
- * @param a   [description]
- * @param lwq [description]
- * @param N   [description]
- */
-__global__ void cuWordecomp(bn_t *P,bn_t *a,int lwq, int N){
-  printf("cuWordecomp: Nothing to do");
-}
-/**
- * Computes WordDecomp for W = 2^32
+ * Computes WordDecomp for W = 2^WORDLENGTH, or for W = 2^w if WORDLENGTH == 0
  *
  * This method receives lwq arrays of coefficients concatenated and decomposes
  * each coefficient of a. Each coefficient of arrays in P stores a fraction of
@@ -39,10 +28,11 @@ __global__ void cuWordecomp(bn_t *P,bn_t *a,int lwq, int N){
  * 
  * @param P   A vector with N*(log_wq) elements
  * @param a   [description]
+ * @param w   used only if WORDLENGTH == 0
  * @param lwq [description]
  */
-template<>
-__global__ void cuWordecomp<32>(bn_t *P,bn_t *a,int lwq, int N){
+template<int WORDLENGTH>
+__global__ void cuWordecomp(bn_t *P,bn_t *a,int w,int lwq, int N){
 	/**
 	 * This kernel should be executed by N*lwq threads
 	 */
@@ -55,38 +45,11 @@ __global__ void cuWordecomp<32>(bn_t *P,bn_t *a,int lwq, int N){
 
 	if( tid < N*lwq ){
 		bn_zero(&P[cid + did*N]);
-		
-		// Selects the first or second half of a 64 bits word 
-		uint64_t half_word =  a [ cid ].dp [ did / 2 ];
-		int i = ( did % 2 ) * 32;
-		half_word >>= i;
-
-		// Shift 
-		P[cid + did*N].dp[0] = (uint32_t)( half_word );
+		P[cid + did*N].dp[0] = wordecomp_digit<WORDLENGTH>(a[cid].dp, 1, a[cid].alloc, w, did);
 		P[cid + did*N].used = 1;
 	}
 }
 
-/**
- * Computes WordDecomp for W = 2^64
- * @param P   [description]
- * @param a   [description]
- * @param lwq [description]
- */
-// template<>
-// __global__ void cuWordecomp<64>(bn_t **P,bn_t *a,int lwq, int N){	/**
-// 	 * This kernel should be executed by N*lwq thread
-// 	 */
-// 	const int tid = threadIdx.x + blockIdx.x*blockDim.x;
-// 	const int did = tid % N;// Decomposition id
-// 	const int cid = tid / N;// Coefficient id
-
-// 	if(tid < N*lwq){
-// 		P[tid].dp[cid] = (a[cid].dp[did/2] >> ((did%2)*32))&(4294967296-1); 
-// 	}
-// }
-
-
 void callCuWordecomp(	cudaStream_t stream, 
 						int WORDLENGTH, 
 						bn_t *d_P, 
@@ -98,16 +61,27 @@ void callCuWordecomp(	cudaStream_t stream,
 	const dim3 gridDim(ADDGRIDXDIM);
 	const dim3 blockDim(128);
 
-	if(WORDLENGTH == 32)
-		cuWordecomp<32><<<gridDim,blockDim,0,stream>>>(d_P,a,lwq, N);
-	// else if(WORDLENGTH == 64)
-	// 	cuWordecomp<64><<<gridDim,blockDim,0,stream>>>(d_P,a,lwq, N);
-	else
-		throw "Unknown WORDLENGTH";
+	switch(WORDLENGTH){
+	case 16:
+		cuWordecomp<16><<<gridDim,blockDim,0,stream>>>(d_P,a,WORDLENGTH,lwq, N);
+		break;
+	case 32:
+		cuWordecomp<32><<<gridDim,blockDim,0,stream>>>(d_P,a,WORDLENGTH,lwq, N);
+		break;
+	case 64:
+		cuWordecomp<64><<<gridDim,blockDim,0,stream>>>(d_P,a,WORDLENGTH,lwq, N);
+		break;
+	default:
+		if(WORDLENGTH < 1 || WORDLENGTH > 64)
+			throw "Unknown WORDLENGTH";
+		cuWordecomp<0><<<gridDim,blockDim,0,stream>>>(d_P,a,WORDLENGTH,lwq, N);
+	}
 	cudaError_t result = cudaGetLastError();
 	assert(result == cudaSuccess);
 }
 
+#endif
+
 /**
  * Computes x%q, where x is a bit integer and q is a mersenne prime
  * @param  x      [description]
@@ -263,7 +237,7 @@ __device__ void mersenneDiv(	bn_t *quot,
 		    carry = bn_addn_low(quot->dp, quot->dp, aux.dp, nwords);
 		else
 		    carry = bn_addn_low(quot->dp, aux.dp, quot->dp, nwords);
-		    quot->used = nwords;
+		quot->used = nwords;
 
 	    /* Equivalent to "If has a carry, add as last word" */
 	    quot->dp[quot->used] = carry;
@@ -342,7 +316,7 @@ __device__ void mersenneModDiv(	bn_t *quot,
 		    carry = bn_addn_low(quot->dp, quot->dp, rem->dp, nwords);
 		else
 		    carry = bn_addn_low(quot->dp, rem->dp, quot->dp, nwords);
-		    quot->used = nwords;
+		quot->used = nwords;
 
 	    /* Equivalent to "If has a carry, add as last word" */
 	    quot->dp[quot->used] = carry;
@@ -403,6 +377,7 @@ __device__ void mersenneModDiv(	bn_t *quot,
 	}
 }
 
+#ifndef HOST_BACKEND
 /**
  * Computes g/q and g%q and set "output" according the result   
  * This function works inplace.
@@ -496,3 +471,290 @@ __host__ void callMersenneMod(bn_t *g, bn_t q,int nq, int N, cudaStream_t stream
 	cuMersenneMod<<<gridDim, blockDim,0, stream>>>(g, q, nq,N);
 	assert(cudaGetLastError() == cudaSuccess);
 }
+
+extern __constant__ cuyasheint_t bn_fixed_qinv[STD_BNT_WORDS_ALLOC];
+extern __constant__ cuyasheint_t bn_fixed_qDiv2[BN_FIXED_MAX_Q_WORDS];
+extern __constant__ cuyasheint_t bn_fixed_q[BN_FIXED_MAX_Q_WORDS];
+extern __constant__ cuyasheint_t bn_fixed_qmu[STD_BNT_WORDS_ALLOC];
+
+/**
+ * Mersenne reduction over a limb matrix, for a q of LQ words. Each thread
+ * reduces one coefficient.
+ */
+template<int LQ>
+__global__ void cuMersenneModMatrix(cuyasheint_t *limbs, uint32_t *signs, int nq, int N){
+	const int cid = threadIdx.x + blockIdx.x*blockDim.x;
+
+	if(cid < N){
+		bn_fixed<STD_BNT_WORDS_ALLOC> x;
+		BN_FIXED_UNROLL
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			x.dp[i] = limbs[cid + i*N];
+		bn_fixed<LQ> r;
+		bn_fixed_mersenne_mod<STD_BNT_WORDS_ALLOC,LQ>(r, x, nq);
+
+		// -r mod q is q - r, which for 0 < r < q is r xor q
+		cuyasheint_t nonzero = 0;
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LQ; i++)
+			nonzero |= r.dp[i];
+		const cuyasheint_t negative = -(cuyasheint_t)(matrix_get_sign(signs, cid) & (nonzero != 0));
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LQ; i++)
+			r.dp[i] ^= negative & (i < LQ-1 || nq % WORD == 0? ~(cuyasheint_t)0 : MASK(nq % WORD));
+
+		BN_FIXED_UNROLL
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			limbs[cid + i*N] = bn_fixed_word(r, i);
+		matrix_set_sign(signs, cid, BN_POS);
+	}
+}
+
+/**
+ * Barrett reduction over a limb matrix, for any q of LQ words. Each thread
+ * reduces one coefficient.
+ */
+template<int LQ>
+__global__ void cuBarrettModMatrix(cuyasheint_t *limbs, uint32_t *signs, int N){
+	const int cid = threadIdx.x + blockIdx.x*blockDim.x;
+
+	if(cid < N){
+		bn_fixed<STD_BNT_WORDS_ALLOC> x;
+		bn_fixed<STD_BNT_WORDS_ALLOC> mu;
+		bn_fixed<LQ> q;
+		BN_FIXED_UNROLL
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			x.dp[i] = limbs[cid + i*N];
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LQ; i++)
+			q.dp[i] = bn_fixed_q[i];
+		bn_fixed_qmu<STD_BNT_WORDS_ALLOC>(mu, bn_fixed_qmu);
+		bn_fixed<LQ> r;
+		bn_fixed<STD_BNT_WORDS_ALLOC> quot;
+		bn_fixed_barrett_q<STD_BNT_WORDS_ALLOC,LQ>(r, quot, x, q, mu);
+
+		// -r mod q is q - r
+		cuyasheint_t nonzero = 0;
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LQ; i++)
+			nonzero |= r.dp[i];
+		const cuyasheint_t negative = -(cuyasheint_t)(matrix_get_sign(signs, cid) & (nonzero != 0));
+		bn_fixed<LQ> d;
+		bn_fixed_sub<LQ>(d, q, r);
+		bn_fixed_select<LQ>(r, d, r, negative);
+
+		BN_FIXED_UNROLL
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			limbs[cid + i*N] = bn_fixed_word(r, i);
+		matrix_set_sign(signs, cid, BN_POS);
+	}
+}
+
+/**
+ * round(g/q) over a limb matrix, for a M of LM words and any q of LQ words,
+ * by Barrett. Each thread rounds the magnitude of one coefficient.
+ */
+template<int LM, int LQ>
+__global__ void cuCiphertextMulAuxBarrettMatrix(cuyasheint_t *limbs, int N){
+	const int LIN = BN_FIXED_LIN(LM);
+	const int cid = threadIdx.x + blockIdx.x*blockDim.x;
+
+	if(cid < N){
+		bn_fixed<LIN> x;
+		bn_fixed<LIN> mu;
+		bn_fixed<LQ> q;
+		bn_fixed<LQ> qDiv2;
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LIN; i++)
+			x.dp[i] = limbs[cid + i*N];
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LQ; i++){
+			q.dp[i] = bn_fixed_q[i];
+			qDiv2.dp[i] = bn_fixed_qDiv2[i];
+		}
+		bn_fixed_qmu<LIN>(mu, bn_fixed_qmu);
+
+		bn_fixed<LIN> quot;
+		bn_fixed_barrett_round<LIN,LQ>(quot, x, q, mu, qDiv2);
+
+		BN_FIXED_UNROLL
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			limbs[cid + i*N] = bn_fixed_word(quot, i);
+	}
+}
+
+/**
+ * round(g/q) over a limb matrix, for a M of LM words and a q of LQ words.
+ * Each thread rounds the magnitude of one coefficient.
+ */
+template<int LM, int LQ>
+__global__ void cuCiphertextMulAuxMatrix(cuyasheint_t *limbs, int nq, int N){
+	const int LIN = BN_FIXED_LIN(LM);
+	const int cid = threadIdx.x + blockIdx.x*blockDim.x;
+
+	if(cid < N){
+		bn_fixed<LIN> x;
+		bn_fixed<LIN> qinv;
+		bn_fixed<LQ> qDiv2;
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LIN; i++){
+			x.dp[i] = limbs[cid + i*N];
+			qinv.dp[i] = bn_fixed_qinv[i];
+		}
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LQ; i++)
+			qDiv2.dp[i] = bn_fixed_qDiv2[i];
+
+		bn_fixed<LIN> quot;
+		bn_fixed_mersenne_round<LIN,LQ>(quot, x, nq, qinv, qDiv2);
+
+		BN_FIXED_UNROLL
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			limbs[cid + i*N] = bn_fixed_word(quot, i);
+	}
+}
+
+/**
+ * Launches the instances for lm and lq words
+ */
+template<int LQ>
+struct cuMersenneModMatrixInstance{
+	static void launch(int lq, dim3 gridDim, dim3 blockDim, cudaStream_t stream, bn_matrix_t *g, int nq){
+		if(lq != LQ)
+			cuMersenneModMatrixInstance<LQ-1>::launch(lq, gridDim, blockDim, stream, g, nq);
+		else
+			cuMersenneModMatrix<LQ><<<gridDim, blockDim, 0, stream>>>(g->d_limbs, g->d_signs, nq, g->N);
+	}
+};
+template<>
+struct cuMersenneModMatrixInstance<0>{
+	static void launch(int lq, dim3 gridDim, dim3 blockDim, cudaStream_t stream, bn_matrix_t *g, int nq){
+		throw "callMersenneModMatrix: unsupported q";
+	}
+};
+
+template<int LQ>
+struct cuBarrettModMatrixInstance{
+	static void launch(int lq, dim3 gridDim, dim3 blockDim, cudaStream_t stream, bn_matrix_t *g){
+		if(lq != LQ)
+			cuBarrettModMatrixInstance<LQ-1>::launch(lq, gridDim, blockDim, stream, g);
+		else
+			cuBarrettModMatrix<LQ><<<gridDim, blockDim, 0, stream>>>(g->d_limbs, g->d_signs, g->N);
+	}
+};
+template<>
+struct cuBarrettModMatrixInstance<0>{
+	static void launch(int lq, dim3 gridDim, dim3 blockDim, cudaStream_t stream, bn_matrix_t *g){
+		throw "callModQMatrix: bn_fixed_setup() was not called";
+	}
+};
+
+template<int LM, int LQ>
+struct cuCiphertextMulAuxMatrixInstance{
+	static void launch(int lm, int lq, dim3 gridDim, dim3 blockDim, cudaStream_t stream, bn_matrix_t *g, int nq){
+		if(lm != LM)
+			cuCiphertextMulAuxMatrixInstance<LM-1,LQ>::launch(lm, lq, gridDim, blockDim, stream, g, nq);
+		else if(lq != LQ)
+			cuCiphertextMulAuxMatrixInstance<LM,LQ-1>::launch(lm, lq, gridDim, blockDim, stream, g, nq);
+		else if(bn_fixed_params.mersenne)
+			cuCiphertextMulAuxMatrix<LM,LQ><<<gridDim, blockDim, 0, stream>>>(g->d_limbs, nq, g->N);
+		else
+			cuCiphertextMulAuxBarrettMatrix<LM,LQ><<<gridDim, blockDim, 0, stream>>>(g->d_limbs, g->N);
+	}
+};
+template<int LQ>
+struct cuCiphertextMulAuxMatrixInstance<0,LQ>{
+	static void launch(int lm, int lq, dim3 gridDim, dim3 blockDim, cudaStream_t stream, bn_matrix_t *g, int nq){
+		throw "callCiphertextMulAuxMatrix: bn_fixed_setup() was not called";
+	}
+};
+template<int LM>
+struct cuCiphertextMulAuxMatrixInstance<LM,0>{
+	static void launch(int lm, int lq, dim3 gridDim, dim3 blockDim, cudaStream_t stream, bn_matrix_t *g, int nq){
+		throw "callCiphertextMulAuxMatrix: bn_fixed_setup() was not called";
+	}
+};
+
+/**
+ * The digit-th word of WordDecomp for W = 2^WORDLENGTH, or for W = 2^w if
+ * WORDLENGTH == 0, straight into the residues
+ */
+template<int WORDLENGTH>
+__global__ void cuWordecompMatrix(  cuyasheint_t *d_polyCRT,
+									const cuyasheint_t *limbs,
+									int w,
+									int digit,
+									int N,
+									int NPolis){
+	const int tid = threadIdx.x + blockIdx.x*blockDim.x;
+	const int cid = tid % N;
+	const int rid = tid / N;
+
+	if(tid < N*NPolis)
+		d_polyCRT[cid + rid*N] = wordecomp_digit<WORDLENGTH>(&limbs[cid], N, STD_BNT_WORDS_ALLOC, w, digit) % CRTPrimesConstant[rid];
+}
+
+__host__ void callMersenneModMatrix(bn_matrix_t *g, int nq, cudaStream_t stream){
+	const int size = g->N;
+	const int ADDGRIDXDIM = (size%128 == 0? size/128 : size/128 + 1);
+	const dim3 gridDim(ADDGRIDXDIM);
+	const dim3 blockDim(128);
+
+	cuMersenneModMatrixInstance<BN_FIXED_MAX_Q_WORDS>::launch((nq + WORD - 1) / WORD, gridDim, blockDim, stream, g, nq);
+	assert(cudaGetLastError() == cudaSuccess);
+}
+
+__host__ void callModQMatrix(bn_matrix_t *g, cudaStream_t stream){
+	if(bn_fixed_params.mersenne){
+		callMersenneModMatrix(g, bn_fixed_params.nq, stream);
+		return;
+	}
+	const int size = g->N;
+	const int ADDGRIDXDIM = (size%128 == 0? size/128 : size/128 + 1);
+	const dim3 gridDim(ADDGRIDXDIM);
+	const dim3 blockDim(128);
+
+	cuBarrettModMatrixInstance<BN_FIXED_MAX_Q_WORDS>::launch(bn_fixed_params.LQ, gridDim, blockDim, stream, g);
+	assert(cudaGetLastError() == cudaSuccess);
+}
+
+__host__ void callCiphertextMulAuxMatrix(bn_matrix_t *g, int nq, cudaStream_t stream){
+	assert(nq == bn_fixed_params.nq);
+	const int size = g->N;
+	const int ADDGRIDXDIM = (size%128 == 0? size/128 : size/128 + 1);
+	const dim3 gridDim(ADDGRIDXDIM);
+	const dim3 blockDim(128);
+
+	cuCiphertextMulAuxMatrixInstance<STD_BNT_WORDS_ALLOC,BN_FIXED_MAX_Q_WORDS>::launch(bn_fixed_params.LM, bn_fixed_params.LQ, gridDim, blockDim, stream, g, nq);
+	assert(cudaGetLastError() == cudaSuccess);
+}
+
+void callCuWordecompMatrix( cudaStream_t stream,
+							int WORDLENGTH,
+							cuyasheint_t *d_polyCRT,
+							bn_matrix_t *a,
+							int digit,
+							int NPolis){
+	const int size = a->N*NPolis;
+	const int ADDGRIDXDIM = (size%128 == 0? size/128 : size/128 + 1);
+	const dim3 gridDim(ADDGRIDXDIM);
+	const dim3 blockDim(128);
+
+	switch(WORDLENGTH){
+	case 16:
+		cuWordecompMatrix<16><<<gridDim, blockDim, 0, stream>>>(d_polyCRT, a->d_limbs, WORDLENGTH, digit, a->N, NPolis);
+		break;
+	case 32:
+		cuWordecompMatrix<32><<<gridDim, blockDim, 0, stream>>>(d_polyCRT, a->d_limbs, WORDLENGTH, digit, a->N, NPolis);
+		break;
+	case 64:
+		cuWordecompMatrix<64><<<gridDim, blockDim, 0, stream>>>(d_polyCRT, a->d_limbs, WORDLENGTH, digit, a->N, NPolis);
+		break;
+	default:
+		if(WORDLENGTH < 1 || WORDLENGTH > 64)
+			throw "Unknown WORDLENGTH";
+		cuWordecompMatrix<0><<<gridDim, blockDim, 0, stream>>>(d_polyCRT, a->d_limbs, WORDLENGTH, digit, a->N, NPolis);
+	}
+	assert(cudaGetLastError() == cudaSuccess);
+}
+#endif
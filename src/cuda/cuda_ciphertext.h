@@ -18,15 +18,51 @@
 #ifndef CUDA_CIPHERTEXT_H
 #define CUDA_CIPHERTEXT_H
 #include <vector>
+#ifndef HOST_BACKEND
 #include <cuda.h>
 #include <cuda_runtime.h>
+#endif
 #include "../cuda/cuda_bn.h"
 #include "../settings.h"
 #include "../aritmetic/polynomial.h"
 #include "../yashe/yashe.h"
 
-template <int WORDLENGTH = 32>
-extern __global__ void cuWordecomp(bn_t *P,bn_t *a,int lwq, int N);
+/**
+ * Returns the digit-th word of WordDecomp for W = 2^w of a non-negative
+ * integer. Its i-th 64 bits word is at words[i*stride].
+ *
+ * WORDLENGTH fixes w at compile time, so the 16, 32 and 64 bits words are a
+ * shift and a mask on a single word. With WORDLENGTH == 0, w is taken at
+ * run time and a word may straddle two 64 bits words.
+ * @param  words  input
+ * @param  stride input
+ * @param  nwords input: qty of 64 bits words in words
+ * @param  w      input: used only if WORDLENGTH == 0
+ * @param  digit  input
+ */
+template <int WORDLENGTH>
+__host__ __device__ inline cuyasheint_t wordecomp_digit( const cuyasheint_t *words,
+                                                          const int stride,
+                                                          const int nwords,
+                                                          const int w,
+                                                          const int digit){
+  const int W = (WORDLENGTH? WORDLENGTH : w);
+  const int offset = digit*W;
+  const int i = offset / 64;
+  const int shift = offset % 64;
+  if(i >= nwords)
+    return 0;
+
+  cuyasheint_t d = words[i*stride] >> shift;
+  if(shift + W > 64 && i + 1 < nwords)
+    d |= words[(i+1)*stride] << (64 - shift);
+  return (W < 64? d & ((((cuyasheint_t)1) << W) - 1) : d);
+}
+
+#ifndef HOST_BACKEND
+template <int WORDLENGTH>
+extern __global__ void cuWordecomp(bn_t *P,bn_t *a,int w,int lwq, int N);
+#endif
 void callCuWordecomp(cudaStream_t stream, int WORDLENGTH, bn_t *d_P, bn_t *a, int lwq, int N);
 __host__ __device__ void convert_64_to_32(uint32_t *a,uint64_t *b,int n);
 __host__ __device__ void convert_32_to_64(uint64_t *a, uint32_t *b, int n);
@@ -38,6 +74,19 @@ __host__ void callCiphertextMulAux(	bn_t *g,
 									int N, 
 									cudaStream_t stream);
 __host__ void callMersenneMod(bn_t *g, bn_t q,int nq, int N, cudaStream_t stream);
+__host__ void callMersenneModMatrix(bn_matrix_t *g, int nq, cudaStream_t stream);
+/**
+ * Reduces a limb matrix by the q given to bn_fixed_setup(): by Mersenne
+ * folding if q = 2^nq - 1, and by Barrett otherwise
+ */
+__host__ void callModQMatrix(bn_matrix_t *g, cudaStream_t stream);
+__host__ void callCiphertextMulAuxMatrix(bn_matrix_t *g, int nq, cudaStream_t stream);
+void callCuWordecompMatrix(	cudaStream_t stream,
+							int WORDLENGTH,
+							cuyasheint_t *d_polyCRT,
+							bn_matrix_t *a,
+							int digit,
+							int NPolis);
 __device__  void mersenneDiv(	bn_t *x,
 								bn_t *q,
 								int q_bits);
@@ -28,10 +28,17 @@ __host__ void Distribution::call_setup_kernel(){
 	const dim3 gridDim(ADDGRIDXDIM);
 	const dim3 blockDim(ADDBLOCKXDIM);
 
-	setup_kernel<<<gridDim,blockDim,0>>>(states,SEED);
+	setup_kernel<<<gridDim,blockDim,0>>>(states,seed);
 	assert(cudaGetLastError() == cudaSuccess);
 }
 
+__host__ void Distribution::set_seed(unsigned long long seed){
+	this->seed = seed;
+	curandStatus_t resultRand = curandSetPseudoRandomGeneratorSeed(gen, seed);
+	assert(resultRand == CURAND_STATUS_SUCCESS);
+	call_setup_kernel();
+}
+
 
 __global__ void generate_narrow_random_numbers(	bn_t *coefs,
 												curandState *states,
@@ -42,7 +49,7 @@ __global__ void generate_narrow_random_numbers(	bn_t *coefs,
 
     const int tid = threadIdx.x + blockIdx.x * blockDim.x;
 
-    if (tid <= N){	
+    if (tid < N){	
     	// This is not a "narrow" distribution, as defined in [Bos et al. 2013],
     	// [-1,0,1], but a binary distribution. However, it is a pain to deal 
     	// with negative values on unsigned integers.
@@ -50,7 +57,7 @@ __global__ void generate_narrow_random_numbers(	bn_t *coefs,
     	// 
     	int value = llrintf(curand_uniform(&states[tid])); 
 		// This is our guarantee that the polynomial will assume the desired degree
-		value += (tid == N && value == 0); 
+		value += (tid == N-1 && value == 0); 
     	coefs[tid].dp[0] = value;
     	coefs[tid].used = 1;
     	bn_zero_non_used(&coefs[tid]);
@@ -59,6 +66,27 @@ __global__ void generate_narrow_random_numbers(	bn_t *coefs,
 }
 
 
+/**
+ * The "narrow" distribution of [Bos et al. 2013], [-1,0,1]. Negative values
+ * are kept as a sign and a magnitude, which callCRT() maps to p - 1.
+ */
+__global__ void generate_ternary_random_numbers(	bn_t *coefs,
+													curandState *states,
+													int N){
+
+    const int tid = threadIdx.x + blockIdx.x * blockDim.x;
+
+    if (tid < N){	
+    	int value = min_d((int)(curand_uniform(&states[tid])*3), 2) - 1;
+		// This is our guarantee that the polynomial will assume the desired degree
+		value += (tid == N-1 && value == 0); 
+    	coefs[tid].dp[0] = abs(value);
+    	coefs[tid].used = 1;
+    	coefs[tid].sign = (value < 0? BN_NEG : BN_POS);
+    	bn_zero_non_used(&coefs[tid]);
+    }
+}
+
 __global__ void generate_normal_random_numbers(	bn_t *coefs,
 												curandState *states,
 												int N,
@@ -73,13 +101,42 @@ __global__ void generate_normal_random_numbers(	bn_t *coefs,
     	int value = llrintf(curand_normal (&states[tid])*stddev + mean); 
 		// This is our guarantee that the polynomial will assume the desired degree
 		value += (tid == N && value == 0); 
-    	coefs[tid].dp[0] = value;
+    	coefs[tid].dp[0] = abs(value);
     	coefs[tid].used = 1;
+    	coefs[tid].sign = (value < 0? BN_NEG : BN_POS);
     	bn_zero_non_used(&coefs[tid]);
     }
         
 }
 
+/**
+ * Each thread draws the coefficient tid of every polynomial of the batch
+ * from its own state
+ */
+__global__ void generate_normal_random_numbers_batch(	bn_t *coefs,
+														curandState *states,
+														int N,
+														int K,
+														int spacing,
+														float mean,
+														float stddev) {
+
+    const int tid = threadIdx.x + blockIdx.x * blockDim.x;
+
+    if (tid < spacing){
+    	curandState state = states[tid];
+    	for(int k = 0; k < K; k++){
+    		const int value = (tid < N? llrintf(curand_normal(&state)*stddev + mean) : 0);
+    		bn_t *x = &coefs[tid + k*spacing];
+    		x->dp[0] = abs(value);
+    		x->used = 1;
+    		x->sign = (value < 0? BN_NEG : BN_POS);
+    		bn_zero_non_used(x);
+    	}
+    	states[tid] = state;
+    }
+}
+
 __host__  void Distribution::callCuGetUniformSample(	bn_t *coefs,
 														int N,
 														int NPrimes,
@@ -105,6 +162,18 @@ __host__  void Distribution::callCuGetUniformSample(	bn_t *coefs,
 	assert(cudaGetLastError() == cudaSuccess);
 }
 
+__host__  void Distribution::callCuGetNarrowSample(	bn_t *coefs,
+														int N,
+														int NPrimes){
+	const int ADDGRIDXDIM = (N%ADDBLOCKXDIM == 0? N/ADDBLOCKXDIM : N/ADDBLOCKXDIM + 1);
+	const dim3 gridDim(ADDGRIDXDIM);
+	const dim3 blockDim(ADDBLOCKXDIM);
+
+	assert(N <= MAX_DEGREE);
+	generate_ternary_random_numbers<<<gridDim,blockDim,0,NULL>>>(coefs, states, N);
+	assert(cudaGetLastError() == cudaSuccess);
+}
+
 __host__ void Distribution::callCuGetNormalSample(	bn_t *coefs,
 													int N,
 													float mean,
@@ -131,3 +200,24 @@ __host__ void Distribution::callCuGetNormalSample(	bn_t *coefs,
 																	NPrimes );
 	assert(cudaGetLastError() == cudaSuccess);
 }
+
+__host__ void Distribution::callCuGetNormalSampleBatch(	bn_t *coefs,
+														int N,
+														int K,
+														float mean,
+														float stddev){
+	const int spacing = CUDAFunctions::N;
+	const int ADDGRIDXDIM = (spacing%ADDBLOCKXDIM == 0? spacing/ADDBLOCKXDIM : spacing/ADDBLOCKXDIM + 1);
+	const dim3 gridDim(ADDGRIDXDIM);
+	const dim3 blockDim(ADDBLOCKXDIM);
+
+	assert(N <= spacing && spacing <= MAX_DEGREE);
+	generate_normal_random_numbers_batch<<<gridDim,blockDim,0,NULL>>>(	coefs,
+																		states,
+																		N,
+																		K,
+																		spacing,
+																		mean,
+																		stddev );
+	assert(cudaGetLastError() == cudaSuccess);
+}
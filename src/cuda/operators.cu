@@ -15,7 +15,9 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <stdexcept>
 #include "operators.h"
+#include "../aritmetic/pool.h"
 
 #define PRIMEP (uint64_t)18446744069414584321
 #define PRIMITIVE_ROOT (int)7
@@ -28,15 +30,11 @@ ZZ PZZ = to_ZZ(PRIMEP);
 #else
   int CUDAFunctions::transform = CUFFTMUL;
 #endif
+int CUDAFunctions::icrt = ICRT_ACCUMULATE;
 
 cuyasheint_t CUDAFunctions::wN = 0;
 cuyasheint_t *CUDAFunctions::d_W = NULL;//W and WInv doesn't fit constant memory
 cuyasheint_t *CUDAFunctions::d_WInv = NULL;
-cuyasheint_t *CUDAFunctions::d_inner_results = NULL;
-cuyasheint_t *CUDAFunctions::d_inner_results_used = NULL;
-cuyasheint_t *CUDAFunctions::d_mulA = NULL;
-cuyasheint_t *CUDAFunctions::d_mulB = NULL;
-cuyasheint_t *CUDAFunctions::d_mulAux = NULL;
 Complex *CUDAFunctions::d_mulComplexA = NULL;
 Complex *CUDAFunctions::d_mulComplexB = NULL;
 Complex *CUDAFunctions::d_mulComplexC = NULL;
@@ -855,14 +853,16 @@ __host__ cuyasheint_t* CUDAFunctions::applyNTT( cuyasheint_t *d_a,
                                                 const int NPolis,
                                                 int type,
                                                 cudaStream_t stream){
+  // The twiddles are only built by init(), never on the way
   if(N != CUDAFunctions::N)
-    CUDAFunctions::init(N/2);
+    throw std::runtime_error("applyNTT: no twiddles for this degree, call CUDAFunctions::init() first");
 
   cudaError_t result;
   const int size = N*NPolis;
-  // cuyasheint_t *aux = CUDAFunctions::d_mulAux;
-  cuyasheint_t *aux;
-  result = cudaMalloc((void**)&aux,size*sizeof(cuyasheint_t));
+  // The stages ping-pong between d_a and aux. aux comes from the pool, so
+  // repeated transforms of the same size don't reach cudaMalloc.
+  cuyasheint_t *input = d_a;
+  cuyasheint_t *aux = (cuyasheint_t*)pool_malloc(size*sizeof(cuyasheint_t));
 
   result = cudaMemsetAsync(aux,0,size*sizeof(cuyasheint_t),stream);
   assert(result == cudaSuccess);
@@ -911,6 +911,15 @@ __host__ cuyasheint_t* CUDAFunctions::applyNTT( cuyasheint_t *d_a,
     NTTScale<<< gridDimMul,blockDimMul,0,stream >>>(d_a,size,N);
     assert(cudaGetLastError() == cudaSuccess);
   }
+  // The output must be on the caller's buffer
+  if(d_a != input){
+    result = cudaMemcpyAsync(input,d_a,size*sizeof(cuyasheint_t),cudaMemcpyDeviceToDevice,stream);
+    assert(result == cudaSuccess);
+    std::swap(aux,d_a);
+  }
+  result = cudaStreamSynchronize(stream);
+  assert(result == cudaSuccess);
+  pool_free(aux);
   return d_a;
 }
 
@@ -1051,6 +1060,96 @@ __host__ cuyasheint_t* CUDAFunctions::callPolynomialMul(cuyasheint_t *output,
   return d_result;
 }
 
+/////////////
+// Batches //
+/////////////
+// All residues share the same NTT prime on the GPU, so a batch of K
+// polynomials is handled as a single polynomial with K*NPolis residues.
+
+__host__ cuyasheint_t* CUDAFunctions::applyNTTBatch(cuyasheint_t *d_a,
+                                                    const int N,
+                                                    const int NPolis,
+                                                    const int K,
+                                                    int type,
+                                                    cudaStream_t stream){
+  return applyNTT(d_a,N,NPolis*K,type,stream);
+}
+
+__host__ void CUDAFunctions::callPolynomialMulBatch(cuyasheint_t *c,
+                                                    cuyasheint_t *a,
+                                                    cuyasheint_t *b,
+                                                    const int N,
+                                                    const int NPolis,
+                                                    const int K,
+                                                    cudaStream_t stream){
+  callPolynomialMul(c,a,b,N*NPolis*K,stream);
+}
+
+/**
+ * c[k] = sum_{j<n} a[j][k]*x[j]. Each thread computes one point of one
+ * polynomial, so the points of x[j] are shared by the K threads that read
+ * them.
+ */
+__global__ void polynomialNTTMulShared(	cuyasheint_t *c,
+										cuyasheint_t *const *a,
+										cuyasheint_t *const *x,
+										const int n,
+										const int N,
+										const int K,
+										const int size){
+  const int tid = threadIdx.x + blockDim.x*blockIdx.x;
+
+  if(tid < size){
+    const int rid = tid / (K*N);
+    const int cid = tid % N;
+    uint64_t acc = 0;
+    for(int j = 0; j < n; j++)
+      acc = s_add(acc, s_mul(a[j][tid], x[j][cid + rid*N]));
+    c[tid] = acc;
+  }
+}
+
+__host__ void CUDAFunctions::callPolynomialMulShared(cuyasheint_t *c,
+                                                    cuyasheint_t **a,
+                                                    cuyasheint_t **x,
+                                                    const int n,
+                                                    const int N,
+                                                    const int NPolis,
+                                                    const int K,
+                                                    cudaStream_t stream){
+  const int size = N*NPolis*K;
+  const int ADDGRIDXDIM = (size%ADDBLOCKXDIM == 0? size/ADDBLOCKXDIM : size/ADDBLOCKXDIM + 1);
+  const dim3 gridDim(ADDGRIDXDIM);
+  const dim3 blockDim(ADDBLOCKXDIM);
+
+  // The operand addresses are copied to the device with the launch
+  cuyasheint_t **d_ptrs = (cuyasheint_t**)pool_malloc(2*n*sizeof(cuyasheint_t*));
+  cudaError_t result;
+  result = cudaMemcpyAsync(d_ptrs, a, n*sizeof(cuyasheint_t*), cudaMemcpyHostToDevice, stream);
+  assert(result == cudaSuccess);
+  result = cudaMemcpyAsync(d_ptrs + n, x, n*sizeof(cuyasheint_t*), cudaMemcpyHostToDevice, stream);
+  assert(result == cudaSuccess);
+
+  polynomialNTTMulShared<<<gridDim,blockDim,0,stream>>>(c, d_ptrs, d_ptrs + n, n, N, K, size);
+  result = cudaGetLastError();
+  assert(result == cudaSuccess);
+  cudaStreamSynchronize(stream);
+  pool_free(d_ptrs);
+}
+
+#ifdef NTTMUL_TRANSFORM
+__host__ void CUDAFunctions::callPolynomialAddSubBatch(cuyasheint_t *c,
+                                                      cuyasheint_t *a,
+                                                      cuyasheint_t *b,
+                                                      const int N,
+                                                      const int NPolis,
+                                                      const int K,
+                                                      int OP,
+                                                      cudaStream_t stream){
+  callPolynomialAddSub(c,a,b,N*NPolis*K,OP,stream);
+}
+#endif
+
 /**
  * [CUDAFunctions::init description]
  * @param N The target polynomial degree
@@ -1184,29 +1283,8 @@ __host__ void CUDAFunctions::init(int M){
 
   assert(fftResult == CUFFT_SUCCESS);
   std::cout << "Plan created with signal size " << N << std::endl;
-  /**
-   * Alloc memory for d_inner_results
-   */
   const unsigned int size = N*CRTPrimes.size();
 
-  result = cudaMalloc((void**)&CUDAFunctions::d_inner_results, size*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
-  assert(result == cudaSuccess);
-  result = cudaMalloc((void**)&CUDAFunctions::d_inner_results_used, size*sizeof(cuyasheint_t));
-  assert(result == cudaSuccess);
-
-
-  /**
-   * Pre-allocated arrays for NTT multiplication
-   */
-    
-  result = cudaMalloc((void**)&CUDAFunctions::d_mulA,size*sizeof(cuyasheint_t));
-  assert(result == cudaSuccess);
-  result = cudaMalloc((void**)&CUDAFunctions::d_mulB,size*sizeof(cuyasheint_t));
-  assert(result == cudaSuccess);
-  result = cudaMalloc((void**)&CUDAFunctions::d_mulAux,size*sizeof(cuyasheint_t));
-  assert(result == cudaSuccess);
-
-
   /**
    * Pre-allocated arrays for FFT multiplication
    */
@@ -1219,137 +1297,106 @@ __host__ void CUDAFunctions::init(int M){
   assert(result == cudaSuccess);
 }
 
-__global__ void cuICRTFix(bn_t *a, const int N, bn_t q,bn_t u_q,bn_t q2){
-  //////////////////////////////////////////////////////
-  // This kernel must be executed with N threads //
-  //////////////////////////////////////////////////////
+/**
+ * a[i] - a[i+half+1] on the residues. The difference stays on [0,p) and the
+ * balanced ICRT gives it back with its sign, so there is no fixup pass.
+ * This kernel must be executed with (N-half-1)*(stride/N)*NPolis threads.
+ */
+__global__ void polynomialReductionCRT( cuyasheint_t *a,
+                                        const int half,
+                                        const int N,
+                                        const int stride,
+                                        const int NPolis){
   const int tid = threadIdx.x + blockIdx.x*blockDim.x;
-
-  if(tid < N){
-    bn_t coef = a[tid];
-    coef.used = get_used_index(coef.dp,STD_BNT_WORDS_ALLOC)+1;
-
-    if(bn_cmp_abs(&coef,&q2) == CMP_GT){
-      /**
-       * If coef > q^2, it is result of an underflow on polynomial reduction 
-       * during the polynomial reduction.
-       *
-       * coef = q - (M - coef)
-       */
-      // result = M - coef
-      int carry = bn_subn_low(coef.dp, M, coef.dp, max_d(coef.used,M_used));
-      assert(carry == BN_POS);     
-      coef.used = get_used_index(coef.dp,STD_BNT_WORDS_ALLOC)+1;
-      // result = q - result
-      carry = bn_subn_low(coef.dp,q.dp,coef.dp,max_d(coef.used,q.used));
-      coef.used = get_used_index(coef.dp,STD_BNT_WORDS_ALLOC)+1;
-    }  
-    // result = result % q
-    bn_mod_barrt( &coef,
-                  coef,
-                  q.dp,
-                  q.used,
-                  u_q.dp,
-                  u_q.used); 
-    a[tid] = coef;
-    bn_zero_non_used(&a[tid]);
+  const int n = N-half-1;
+  const int per_residue = n*(stride/N);
+  const int rid = tid / per_residue;
+  const int cid = (tid % per_residue) % n + ((tid % per_residue) / n)*N;
+
+  if(tid < per_residue*NPolis){
+    const cuyasheint_t p = CRTPrimesConstant[rid];
+    const cuyasheint_t x = a[cid + rid*stride];
+    const cuyasheint_t y = a[cid + half + 1 + rid*stride];
+    a[cid + rid*stride] = (x - y) + (y > x)*p;
+    a[cid + half + 1 + rid*stride] = 0;
   }
 }
 
-// __global__ void polynomialReductionCRT( cuyasheint_t *a,
-//                                         const int half,
-//                                         const int N,
-//                                         const int NPolis){     
-//   // This kernel must have (N-half)*Npolis threads
-
-//   const int tid = threadIdx.x + blockIdx.x*blockDim.x;
-//   const int rid = tid / (N-half); 
-//   const int cid = tid % (N-half);
-
-//   if( (cid+half+1 < N) && (rid*N + cid + half + 1 < N*NPolis)){
-//     // assert(a[rid*N + cid] < CRTPrimesConstant[rid]);
-//     // assert(a[rid*N + cid + half + 1] < CRTPrimesConstant[rid]);
-//     a[rid*N + cid] %= CRTPrimesConstant[rid];
-//     a[rid*N + cid + half + 1] %= CRTPrimesConstant[rid];
-
-//     // bool is_neg = (a[rid*N + cid] < a[rid*N + cid + half + 1]);
-//     a[rid*N + cid] -= a[rid*N + cid + half + 1];
-//     // a[rid*N + cid] += is_neg*CRTPrimesConstant[rid]*CRTPrimesConstant[rid];
-//     __syncthreads();
-//     a[rid*N + cid + half + 1] = 0;
-//     a[rid*N + cid] %= CRTPrimesConstant[rid];
-//   }
-
-// }
-
-__global__ void polynomialReductionCoefs( bn_t *a,
-                                          const int half,
-                                          const int N ){     
-  ////////////////////////////////////////////////////////
-  // This kernel must be executed with (N-half) threads //
-  ////////////////////////////////////////////////////////
+__host__ void CUDAFunctions::callPolynomialReductionCRT(  cuyasheint_t *d_polyCRT,
+                                                          const int half,
+                                                          const int N,
+                                                          const int stride,
+                                                          const int NPolis){
+  assert(stride % N == 0);
+  const int size = (N-half-1)*(stride/N)*NPolis;
+
+  dim3 blockDim(ADDBLOCKXDIM);
+  dim3 gridDim(size/ADDBLOCKXDIM + (size % ADDBLOCKXDIM == 0? 0:1));
+  polynomialReductionCRT<<< gridDim,blockDim, 0, NULL>>>( d_polyCRT,
+                                                          half,
+                                                          N,
+                                                          stride,
+                                                          NPolis);
+  cudaError_t result = cudaGetLastError();
+  assert(result == cudaSuccess);
+}
 
+/**
+ * a[cid] - a[cid+half+1] over a limb matrix. Threads of the same block
+ * load consecutive words.
+ */
+__global__ void polynomialReductionCoefsMatrix( cuyasheint_t *limbs,
+                                                uint32_t *signs,
+                                                const int half,
+                                                const int N,
+                                                const int stride){
   const int tid = threadIdx.x + blockIdx.x*blockDim.x;
-  const int cid = tid % (N-half);
+  const int n = N-half-1;
+  const int cid = (tid % n) + (tid / n)*N;
+
+  if(tid < n*(stride/N)){
+    const int sign = matrix_get_sign(signs, cid);
+    const bool same = (sign == matrix_get_sign(signs, cid + half + 1));
+    cuyasheint_t flip = (same? ~(cuyasheint_t)0 : 0);
+    cuyasheint_t carry = (same? 1 : 0);
+
+    cuyasheint_t x[STD_BNT_WORDS_ALLOC];
+    for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++){
+      const cuyasheint_t a = limbs[cid + i*stride];
+      const cuyasheint_t s = a + (limbs[cid + half + 1 + i*stride] ^ flip);
+      x[i] = s + carry;
+      carry = (s < a) | (x[i] < s);
+      limbs[cid + half + 1 + i*stride] = 0;
+    }
 
-  if(tid < (N-half) && cid + half + 1 < N && a[cid+half+1].used > 0){
-    bn_adjust_used(&a[cid]);
-    bn_adjust_used(&a[cid+half+1]);
-    /////////////
-    // a % phi //
-    /////////////
-    // a[i] = a[i] - a[i+half]
-    int carry = bn_subn_low(  a[cid].dp,
-                              a[cid].dp,
-                              a[cid + half + 1].dp,
-                              max_d(a[cid].used, a[cid + half + 1].used)
-                            );
-    a[cid].used = max_d(a[cid].used, a[cid + half + 1].used);
-    bn_adjust_used(&a[cid]);
-    a[cid].sign = carry;
-
-    if(carry == BN_NEG){
-      // two's complement of a's words
-      // two's complement of x is equal to the complement of x plus 1
-      a[cid].dp[0] = (~a[cid].dp[0]) + 1;
-      for(int i = 1; i < a[cid].used; i++)
-        a[cid].dp[i] = (~a[cid].dp[i]);
+    const bool borrow = (flip != 0 && carry == 0);
+    flip = (borrow? ~(cuyasheint_t)0 : 0);
+    carry = (borrow? 1 : 0);
+    for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++){
+      const cuyasheint_t r = (x[i] ^ flip) + carry;
+      carry = (r < carry);
+      limbs[cid + i*stride] = r;
     }
-    //   // (a-b) % q
-    //   mersenneDiv(&a[cid], &q, q_bits);           
-    //   bn_adjust_used(&a[cid]);
-
-    //   // // q - ((a-b) % q)
-    //   carry = bn_subn_low(  a[cid].dp,
-    //                         q.dp,
-    //                         a[cid].dp,
-    //                         q.used );
-
-    //   assert(carry == BN_POS);
-    //   a[cid].used = q.used;
-    //   bn_adjust_used(&a[cid]);
-    // }
-    bn_zero(&a[cid + half + 1]);
+    matrix_set_sign(signs, cid, sign ^ borrow);
+    matrix_set_sign(signs, cid + half + 1, BN_POS);
   }
-
 }
 
-__host__ void CUDAFunctions::callPolynomialReductionCoefs(  bn_t *a,
-                                                            const int half,
-                                                            const int N ){  
-    const int size = (N-half);
-
-    dim3 blockDim(ADDBLOCKXDIM);
-    dim3 gridDim(size/ADDBLOCKXDIM + (size % ADDBLOCKXDIM == 0? 0:1));
-    /**
-     * Polynomial reduction
-     */
-    polynomialReductionCoefs<<< gridDim,blockDim, 0, NULL>>>( a,
-                                                              half,
-                                                              N);
-    cudaError_t result = cudaGetLastError();
-    assert(result == cudaSuccess);
-
+__host__ void CUDAFunctions::callPolynomialReductionCoefsMatrix(bn_matrix_t *a,
+                                                                const int half,
+                                                                const int N ){
+  assert(a->N % N == 0);
+  const int size = (N-half-1)*(a->N/N);
+
+  dim3 blockDim(ADDBLOCKXDIM);
+  dim3 gridDim(size/ADDBLOCKXDIM + (size % ADDBLOCKXDIM == 0? 0:1));
+  polynomialReductionCoefsMatrix<<< gridDim,blockDim, 0, NULL>>>(a->d_limbs,
+                                                                  a->d_signs,
+                                                                  half,
+                                                                  N,
+                                                                  a->N);
+  cudaError_t result = cudaGetLastError();
+  assert(result == cudaSuccess);
 }
 
 __host__ void  CUDAFunctions::write_crt_primes(){
@@ -1396,15 +1443,13 @@ __host__ void  CUDAFunctions::write_crt_primes(){
     // Copy u //
     ////////////
 
-    cuyasheint_t *h_u;
-    bn_t d_u = get_reciprocal(CRTProduct);
-    h_u = (cuyasheint_t*)malloc(d_u.alloc*sizeof(cuyasheint_t));
-    // assert(d_u.alloc >= STD_BNT_WORDS_ALLOC);
-    result = cudaMemcpy(h_u,d_u.dp,d_u.alloc*sizeof(cuyasheint_t),cudaMemcpyDeviceToHost);
+    bn_t h_u;
+    h_u.alloc = 0;
+    get_words_host(&h_u,reciprocal_of(CRTProduct));
+    assert(h_u.used <= STD_BNT_WORDS_ALLOC);
+    result = cudaMemcpyToSymbol(u,h_u.dp,STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t),0,cudaMemcpyHostToDevice);
     assert(result == cudaSuccess);
-    result = cudaMemcpyToSymbol(u,h_u,d_u.alloc*sizeof(cuyasheint_t),0,cudaMemcpyHostToDevice);
-    assert(result == cudaSuccess);
-    result = cudaMemcpyToSymbol(u_used,&d_u.used, sizeof(int),0,cudaMemcpyHostToDevice);
+    result = cudaMemcpyToSymbol(u_used,&h_u.used, sizeof(int),0,cudaMemcpyHostToDevice);
     assert(result == cudaSuccess);
     
     //////////////
@@ -1444,8 +1489,102 @@ __host__ void  CUDAFunctions::write_crt_primes(){
 
     free(h_Mpis);
     free(h_M.dp);
-    cudaFree(d_u.dp);
+    free(h_u.dp);
   }else{
     throw "Too many primes.";
   }
-}
\ No newline at end of file
+}
+/**
+ * Constants written by write_crt_primes() and buffers allocated by init()
+ */
+struct crt_tables_st{
+  int N;
+  cuyasheint_t primes[COPRIMES_BUCKET_SIZE];
+  cuyasheint_t M[STD_BNT_WORDS_ALLOC];
+  int M_used;
+  cuyasheint_t u[STD_BNT_WORDS_ALLOC];
+  int u_used;
+  cuyasheint_t Mpis[STD_BNT_WORDS_ALLOC*COPRIMES_BUCKET_SIZE];
+  int Mpis_used[COPRIMES_BUCKET_SIZE];
+  cuyasheint_t invMpis[COPRIMES_BUCKET_SIZE];
+
+  cuyasheint_t wN;
+  cuyasheint_t *d_W;
+  cuyasheint_t *d_WInv;
+  cufftHandle plan;
+  Complex *d_mulComplexA;
+  Complex *d_mulComplexB;
+  Complex *d_mulComplexC;
+};
+
+/**
+ * Copies the constant memory back to the host and keeps the device buffers
+ * of the current degree. init() never frees them, so they stay valid after
+ * the next call.
+ */
+__host__ crt_tables_t* CUDAFunctions::export_tables(){
+  crt_tables_t *tables = new crt_tables_t;
+  tables->N = CUDAFunctions::N;
+
+  cudaError_t result;
+  result = cudaMemcpyFromSymbol(tables->primes, CRTPrimesConstant, sizeof(tables->primes));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyFromSymbol(tables->M, M, sizeof(tables->M));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyFromSymbol(&tables->M_used, M_used, sizeof(int));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyFromSymbol(tables->u, u, sizeof(tables->u));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyFromSymbol(&tables->u_used, u_used, sizeof(int));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyFromSymbol(tables->Mpis, Mpis, sizeof(tables->Mpis));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyFromSymbol(tables->Mpis_used, Mpis_used, sizeof(tables->Mpis_used));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyFromSymbol(tables->invMpis, invMpis, sizeof(tables->invMpis));
+  assert(result == cudaSuccess);
+
+  tables->wN = CUDAFunctions::wN;
+  tables->d_W = CUDAFunctions::d_W;
+  tables->d_WInv = CUDAFunctions::d_WInv;
+  tables->plan = CUDAFunctions::plan;
+  tables->d_mulComplexA = CUDAFunctions::d_mulComplexA;
+  tables->d_mulComplexB = CUDAFunctions::d_mulComplexB;
+  tables->d_mulComplexC = CUDAFunctions::d_mulComplexC;
+  return tables;
+}
+
+/**
+ * Writes back a snapshot taken by export_tables(). Nothing is recomputed.
+ * The kernels read the CRT constants from constant memory, so those are
+ * the only copies; the twiddles and cuFFT buffers are taken by pointer.
+ */
+__host__ void CUDAFunctions::import_tables(const crt_tables_t *tables){
+  CUDAFunctions::N = tables->N;
+
+  cudaError_t result;
+  result = cudaMemcpyToSymbol(CRTPrimesConstant, tables->primes, sizeof(tables->primes));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyToSymbol(M, tables->M, sizeof(tables->M));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyToSymbol(M_used, &tables->M_used, sizeof(int));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyToSymbol(u, tables->u, sizeof(tables->u));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyToSymbol(u_used, &tables->u_used, sizeof(int));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyToSymbol(Mpis, tables->Mpis, sizeof(tables->Mpis));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyToSymbol(Mpis_used, tables->Mpis_used, sizeof(tables->Mpis_used));
+  assert(result == cudaSuccess);
+  result = cudaMemcpyToSymbol(invMpis, tables->invMpis, sizeof(tables->invMpis));
+  assert(result == cudaSuccess);
+
+  CUDAFunctions::wN = tables->wN;
+  CUDAFunctions::d_W = tables->d_W;
+  CUDAFunctions::d_WInv = tables->d_WInv;
+  CUDAFunctions::plan = tables->plan;
+  CUDAFunctions::d_mulComplexA = tables->d_mulComplexA;
+  CUDAFunctions::d_mulComplexB = tables->d_mulComplexB;
+  CUDAFunctions::d_mulComplexC = tables->d_mulComplexC;
+}
@@ -17,10 +17,12 @@
  */
 #ifndef CUDA_FUNCTIONS_H
 #define CUDA_FUNCTIONS_H
+#ifndef HOST_BACKEND
 #include <cuda.h>
 #include <cuda_runtime_api.h>
 #include <cuda_runtime.h>
 #include <cufft.h>
+#endif
 #include <iostream>
 #include <stdio.h>
 #include <assert.h>
@@ -35,7 +37,16 @@ NTL_CLIENT
 
 #define MAX_PRIMES_ON_C_MEMORY 4096
 typedef double2 Complex;
+#ifdef HOST_BACKEND
+typedef double2 cufftDoubleComplex;
+typedef int cufftHandle;
+#else
 extern __constant__ cuyasheint_t CRTPrimesConstant[COPRIMES_BUCKET_SIZE];
+#endif
+
+// Snapshot of the backend constants of a set of CRT primes. See
+// CUDAFunctions::export_tables()
+typedef struct crt_tables_st crt_tables_t;
 
 __host__ bool is_power_of(uint64_t a, uint64_t b);
 class CUDAFunctions{
@@ -48,11 +59,7 @@ class CUDAFunctions{
   	static int N;
     static int std_bn_t_alloc;
     static int transform;
-    //////////////////////////
-    // CRT global variables //
-    //////////////////////////
-    static cuyasheint_t *d_inner_results;
-    static cuyasheint_t *d_inner_results_used;
+    static int icrt; // icrt_modes
 
     /////////
     // NTT //
@@ -60,9 +67,6 @@ class CUDAFunctions{
     static cuyasheint_t wN;
     static cuyasheint_t *d_W;
     static cuyasheint_t *d_WInv;
-    static cuyasheint_t *d_mulA;
-    static cuyasheint_t *d_mulB;
-    static cuyasheint_t *d_mulAux;
     ///////////
     ///////////
     // cuFFT //
@@ -76,12 +80,26 @@ class CUDAFunctions{
                                     const int NPolis,
                                     int type,
                                     cudaStream_t stream);
+    static cuyasheint_t* applyNTTBatch(  cuyasheint_t *d_a,
+                                    const int N,
+                                    const int NPolis,
+                                    const int K,
+                                    int type,
+                                    cudaStream_t stream);
     static void callPolynomialAddSub(   cuyasheint_t *c,
                                             cuyasheint_t *a,
                                             cuyasheint_t *b,
                                             int size,
                                             int OP,
                                             cudaStream_t stream);
+    static void callPolynomialAddSubBatch(   cuyasheint_t *c,
+                                            cuyasheint_t *a,
+                                            cuyasheint_t *b,
+                                            const int N,
+                                            const int NPolis,
+                                            const int K,
+                                            int OP,
+                                            cudaStream_t stream);
     static void callPolynomialAddSubInPlace(cudaStream_t stream,
                                             cuyasheint_t *a,
                                             cuyasheint_t *b,
@@ -132,6 +150,30 @@ class CUDAFunctions{
                                                         cuyasheint_t *b,
                                                         const int size,
                                                         cudaStream_t stream);
+    static void callPolynomialMulBatch(cuyasheint_t *c,
+                                        cuyasheint_t *a,
+                                        cuyasheint_t *b,
+                                        const int N,
+                                        const int NPolis,
+                                        const int K,
+                                        cudaStream_t stream);
+    static void callPolynomialMulShared(cuyasheint_t *c,
+                                        cuyasheint_t **a,
+                                        cuyasheint_t **x,
+                                        const int n,
+                                        const int N,
+                                        const int NPolis,
+                                        const int K,
+                                        cudaStream_t stream);
+    #ifdef HOST_BACKEND
+    static void callPolynomialMulAcc(cuyasheint_t *c,
+                                      cuyasheint_t **a,
+                                      cuyasheint_t **b,
+                                      const int k,
+                                      const int size,
+                                      const bool accumulate,
+                                      cudaStream_t stream);
+    #endif
     static void callPolynomialOPInteger(   const int opcode,
                                                     cudaStream_t stream,
                                                     cuyasheint_t *b,
@@ -175,13 +217,23 @@ class CUDAFunctions{
     static void callNTT(const int N, const int NPolis,int RADIX, cuyasheint_t* dataI, cuyasheint_t* dataO,const int type);
     static void init(int N);
     static void write_crt_primes();
+    static crt_tables_t* export_tables();
+    static void import_tables(const crt_tables_t *tables);
     
-    static void callPolynomialReductionCoefs(   bn_t *a,
-                                                const int half,
-                                                const int N);
+    static void callPolynomialReductionCRT( cuyasheint_t *d_polyCRT,
+                                            const int half,
+                                            const int N,
+                                            const int stride,
+                                            const int NPolis);
+    static void callPolynomialReductionCoefsMatrix(   bn_matrix_t *a,
+                                                      const int half,
+                                                      const int N);
   private:
 };
+#ifndef HOST_BACKEND
+// The host reduces by the modulus of each residue instead, see host_arithmetic.h
 __device__ __host__ inline uint64_t s_rem (uint64_t a);
 __device__ __host__  uint64_t s_mul(uint64_t a,
                                     uint64_t b);
+#endif
 #endif
\ No newline at end of file
@@ -37,8 +37,9 @@ void Distribution::generate_sample(poly_t *p,int mod,int degree){
                             degree,
                             CRTPrimes.size(), 
                             mod);
+   // Only the sampled coefficients are decomposed
    callCRT(p->d_bn_coefs,
-       CUDAFunctions::N,
+       degree,
        p->d_coefs,
        CUDAFunctions::N,
        CRTPrimes.size(),
@@ -48,6 +49,29 @@ void Distribution::generate_sample(poly_t *p,int mod,int degree){
    //ntl_random(p,mod,degree);
 }
 
+#ifdef NTTMUL_TRANSFORM
+void Distribution::get_batch_sample(poly_batch_t *p, int degree){
+  if(this->kind != DISCRETE_GAUSSIAN)
+    throw "get_batch_sample: only DISCRETE_GAUSSIAN is supported";
+
+  // Coefficients above degree are written as zeros, so the whole batch is
+  // decomposed at once
+  callCuGetNormalSampleBatch( p->d_bn_coefs,
+                              degree,
+                              p->K,
+                              0,
+                              gaussian_std_deviation);
+  callCRT(p->d_bn_coefs,
+      p->K*CUDAFunctions::N,
+      p->d_coefs,
+      p->K*CUDAFunctions::N,
+      CRTPrimes.size(),
+      0x0
+    );
+  p->status = CRTSTATE;
+}
+#endif
+
 void Distribution::get_sample(poly_t *p, int degree){
   
   int mod;
@@ -55,13 +79,14 @@ void Distribution::get_sample(poly_t *p, int degree){
     case DISCRETE_GAUSSIAN:
       // ntl_random(p,7,degree);
 	//return;
+       // The samples are centered on zero and keep their sign
        callCuGetNormalSample( p->d_bn_coefs,
                               degree,
-                              gaussian_bound,
+                              0,
                               gaussian_std_deviation,
                               CRTPrimes.size());
        callCRT(p->d_bn_coefs,
-           CUDAFunctions::N,
+           degree,
            p->d_coefs,
            CUDAFunctions::N,
            CRTPrimes.size(),
@@ -75,8 +100,19 @@ void Distribution::get_sample(poly_t *p, int degree){
       mod = 2;
     break;
     case NARROW:
-      mod = 2;
-    break;
+      // [-1,0,1], with the sign kept on the bn_t
+      callCuGetNarrowSample(  p->d_bn_coefs,
+                              degree,
+                              CRTPrimes.size());
+      callCRT(p->d_bn_coefs,
+          degree,
+          p->d_coefs,
+          CUDAFunctions::N,
+          CRTPrimes.size(),
+          0x0
+      );
+      p->status = CRTSTATE;
+      return;
     default:
       mod = 100;
     break;
@@ -19,9 +19,13 @@
 #define DISTRIBUTION_H
 
 #include <assert.h>
+#ifdef HOST_BACKEND
+#include <random>
+#else
 #include <cuda.h>
 #include <curand.h>
 #include <curand_kernel.h>
+#endif
 #include "../settings.h"
 #include "../aritmetic/polynomial.h"
  
@@ -42,8 +46,13 @@ class Distribution{
   int kind;
   float gaussian_std_deviation;
   int gaussian_bound;
+  unsigned long long seed = SEED;
+  #ifdef HOST_BACKEND
+  std::mt19937_64 gen;
+  #else
   curandGenerator_t gen;
   curandState *states;
+  #endif
 
   public:
   Distribution(kind_t kind, float std_dev, int bound){
@@ -52,6 +61,7 @@ class Distribution{
     this->gaussian_std_deviation = std_dev;
     this->gaussian_bound = bound;
 
+    #ifndef HOST_BACKEND
     curandStatus_t resultRand = curandCreateGenerator(&gen, 
                 CURAND_RNG_PSEUDO_DEFAULT);
     assert(resultRand == CURAND_STATUS_SUCCESS);
@@ -65,6 +75,7 @@ class Distribution{
     */
     cudaError_t result = cudaMalloc((void**)&states,MAX_DEGREE*sizeof(curandState));
     assert(result == cudaSuccess);
+    #endif
     call_setup_kernel();
 
 
@@ -74,6 +85,7 @@ class Distribution{
     assert(kind < KINDS_COUNT);
     this->kind = kind;
 
+    #ifndef HOST_BACKEND
     curandStatus_t resultRand = curandCreateGenerator(&gen, 
                 CURAND_RNG_PSEUDO_DEFAULT);
     assert(resultRand == CURAND_STATUS_SUCCESS);
@@ -87,12 +99,14 @@ class Distribution{
     */
     cudaError_t result = cudaMalloc((void**)&states,MAX_DEGREE*sizeof(curandState));
     assert(result == cudaSuccess);
+    #endif
     call_setup_kernel();
 
   }
   Distribution(){
     this->kind = UNIFORMLY;
 
+    #ifndef HOST_BACKEND
     curandStatus_t resultRand = curandCreateGenerator(&gen, 
                 CURAND_RNG_PSEUDO_DEFAULT);
     assert(resultRand == CURAND_STATUS_SUCCESS);
@@ -106,14 +120,34 @@ class Distribution{
     */
     cudaError_t result = cudaMalloc((void**)&states,MAX_DEGREE*sizeof(curandState));
     assert(result == cudaSuccess);
+    #endif
     call_setup_kernel();
 
   }
   void get_sample(poly_t *p, int degree);
   void generate_sample(poly_t *p,int mod,int degree);
+  #ifdef NTTMUL_TRANSFORM
+  /**
+   * get_sample() for every polynomial of a batch, with a single sampler call
+   * and a single CRT. Only DISCRETE_GAUSSIAN is supported.
+   * @param p      [output] left on CRTSTATE
+   * @param degree [input]
+   */
+  void get_batch_sample(poly_batch_t *p, int degree);
+  #endif
+  /**
+   * Restarts the sampler from another seed. Samplers on different threads
+   * should be given different seeds.
+   * @param seed [input]
+   */
+  void set_seed(unsigned long long seed);
+  float get_gaussian_std_deviation(){ return gaussian_std_deviation; }
+  int get_gaussian_bound(){ return gaussian_bound; }
 private:
   void callCuGetUniformSample(bn_t *coefs,int N, int NPrimes, int mod);
+  void callCuGetNarrowSample(bn_t *coefs,int N, int NPrimes);
   void callCuGetNormalSample(bn_t *array, int N, float mean, float stddev, int NPrimes);
+  void callCuGetNormalSampleBatch(bn_t *array, int N, int K, float mean, float stddev);
 __host__ void call_setup_kernel();
 
 };
@@ -0,0 +1,185 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_ARITHMETIC_H
+#define HOST_ARITHMETIC_H
+
+#include <stdint.h>
+
+/**
+ * Word-size prime used by the NTT of the host backend: 2^62 - 2^36 - 2^33 + 1.
+ *
+ * It is smaller than 2^62, so the lazy butterflies of host_ntt.cpp may keep
+ * values in [0,4p) without overflowing a word, and 2^33 divides p-1.
+ */
+#define HOST_NTT_PRIME (uint64_t)4611685941117976577ULL
+#define HOST_NTT_PRIMITIVE_ROOT (uint64_t)3
+
+/**
+ * A word-size modulus and its Barrett constant floor(2^128/p).
+ */
+typedef struct {
+  uint64_t p;
+  uint64_t ratio_hi;
+  uint64_t ratio_lo;
+} host_modulus_t;
+
+/**
+ * Computes the Barrett constant of p
+ * @param m output
+ * @param p an odd modulus, smaller than 2^62
+ */
+static inline void host_modulus_init(host_modulus_t *m, uint64_t p){
+  // Since p is odd, floor((2^128-1)/p) == floor(2^128/p)
+  const __uint128_t ratio = (~(__uint128_t)0) / p;
+  m->p = p;
+  m->ratio_hi = (uint64_t)(ratio >> 64);
+  m->ratio_lo = (uint64_t)ratio;
+}
+
+/**
+ * Barrett reduction of a 128 bits integer.
+ *
+ * The quotient is the high word of x*floor(2^128/p)/2^128, which is at most
+ * one unit below the real one for any x < 2^128.
+ * @param  x input
+ * @return   x mod p
+ */
+static inline uint64_t host_reduce128(__uint128_t x, const host_modulus_t *m){
+  const uint64_t x0 = (uint64_t)x;
+  const uint64_t x1 = (uint64_t)(x >> 64);
+
+  const __uint128_t a = ((__uint128_t)x0)*m->ratio_hi + ((((__uint128_t)x0)*m->ratio_lo) >> 64);
+  const __uint128_t b = ((__uint128_t)x1)*m->ratio_lo + (uint64_t)a;
+  const uint64_t q = x1*m->ratio_hi + (uint64_t)(a >> 64) + (uint64_t)(b >> 64);
+
+  const uint64_t r = x0 - q*m->p;
+  return r - (r >= m->p)*m->p;
+}
+
+/**
+ * Computes a*b mod p
+ */
+static inline uint64_t host_mulmod(uint64_t a, uint64_t b, const host_modulus_t *m){
+  return host_reduce128(((__uint128_t)a)*b,m);
+}
+
+/**
+ * Computes a+b mod p. Both operands must be smaller than p.
+ */
+static inline uint64_t host_addmod(uint64_t a, uint64_t b, uint64_t p){
+  const uint64_t res = a + b;
+  return res - (res >= p)*p;
+}
+
+/**
+ * Computes a-b mod p. Both operands must be smaller than p.
+ */
+static inline uint64_t host_submod(uint64_t a, uint64_t b, uint64_t p){
+  return (a - b) + (b > a)*p;
+}
+
+/**
+ * Computes a^e mod p
+ */
+static inline uint64_t host_powmod(uint64_t a, uint64_t e, const host_modulus_t *m){
+  uint64_t r = 1;
+  while(e > 0){
+    if(e & 1)
+      r = host_mulmod(r,a,m);
+    a = host_mulmod(a,a,m);
+    e >>= 1;
+  }
+  return r;
+}
+
+/**
+ * Precomputes the Shoup quotient of a constant w, floor(w*2^64/p).
+ * @param  w constant, smaller than p
+ */
+static inline uint64_t host_shoup(uint64_t w, uint64_t p){
+  return (uint64_t)((((__uint128_t)w) << 64) / p);
+}
+
+/**
+ * Computes x*w mod p without reducing the output, which lies in [0,2p).
+ *
+ * Works for any x < 2^64 as long as p < 2^63.
+ * @param  x      input
+ * @param  w      constant
+ * @param  wshoup host_shoup(w,p)
+ */
+static inline uint64_t host_mulmod_shoup_lazy(uint64_t x, uint64_t w, uint64_t wshoup, uint64_t p){
+  const uint64_t q = (uint64_t)((((__uint128_t)x)*wshoup) >> 64);
+  return x*w - q*p;
+}
+
+/**
+ * Mixed-radix digits of Garner's algorithm for one coefficient,
+ *
+ * 	v_i = (...((x_i - v_0)*p_0^(-1) - v_1)*p_1^(-1) - ...) mod p_i,
+ *
+ * so x = v_0 + v_1*p_0 + v_2*p_0*p_1 + ...
+ * @param v         output: NPolis digits, v_i on [0,p_i)
+ * @param x         input: residue i at x[i*stride]
+ * @param inv       input: inv[i*NPolis + j] = p_j^(-1) mod p_i
+ * @param inv_shoup input: the Shoup quotients of inv
+ * @return           v_{NPolis-1}
+ */
+static inline uint64_t host_garner_digits(uint64_t *v,
+                                      const uint64_t *x,
+                                      const int stride,
+                                      const int NPolis,
+                                      const host_modulus_t *moduli,
+                                      const uint64_t *inv,
+                                      const uint64_t *inv_shoup){
+  uint64_t t = 0;
+  for(int i = 0; i < NPolis; i++){
+    const host_modulus_t *mod = &moduli[i];
+    t = x[i*stride];
+    for(int j = 0; j < i; j++){
+      const uint64_t vj = (v[j] < mod->p? v[j] : host_reduce128(v[j],mod));
+      t = host_mulmod_shoup_lazy(host_submod(t,vj,mod->p), inv[i*NPolis + j], inv_shoup[i*NPolis + j], mod->p);
+      t -= (t >= mod->p)*mod->p;
+    }
+    v[i] = t;
+  }
+  return t;
+}
+
+/**
+ * Number of coefficients handled at once by the bn_matrix_t loops. Each tile
+ * owns whole words of the sign bitmap, so tiles may be processed in parallel.
+ */
+#define HOST_BN_MATRIX_TILE 64
+
+/**
+ * Returns the sign of the i-th number of a bn_matrix_t
+ */
+static inline int host_matrix_sign(const uint32_t *signs, int i){
+  return (signs[i >> 5] >> (i & 31)) & 1;
+}
+
+/**
+ * Sets the sign of the i-th number of a bn_matrix_t
+ */
+static inline void host_matrix_set_sign(uint32_t *signs, int i, int sign){
+  signs[i >> 5] = (signs[i >> 5] & ~(1U << (i & 31))) | (((uint32_t)sign) << (i & 31));
+}
+
+#endif
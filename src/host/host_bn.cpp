@@ -0,0 +1,623 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host implementation of the big-number launchers from cuda/cuda_bn.cu.
+ *
+ * The big-number arithmetic itself (bn_*_low, bn_mod_barrt, ...) is shared
+ * with the GPU. cuda_bn.cu is compiled as C++ and only its kernels and
+ * launchers are replaced by the functions below.
+ */
+#include "../cuda/cuda_bn.h"
+#include "host_tables.h"
+
+
+/**
+ * Reduces a by m using Barrett if, and only if, a >= m.
+ *
+ * bn_mod_barrt() only compares the lowest sm words of a and m before
+ * reducing, which is not enough when a has more words than m.
+ */
+static void host_mod_barrt(bn_t *a, const cuyasheint_t *m, int sm, const cuyasheint_t *u, int su){
+	bn_adjust_used(a);
+	if(a->used < sm)
+		return;
+	if(a->used == sm){
+		int i = sm-1;
+		while(i > 0 && a->dp[i] == m[i])
+			i--;
+		if(a->dp[i] < m[i])
+			return;
+	}
+	bn_mod_barrt(a, *a, m, sm, u, su);
+}
+
+__host__ int callBNGetDeg(bn_t *coefs, int N){
+	int deg = -1;
+
+	#pragma omp parallel for reduction(max:deg) schedule(static)
+	for(int cid = 0; cid < N; cid++){
+		coefs[cid].used = get_used_index(coefs[cid].dp,coefs[cid].alloc)+1;
+		if(!bn_is_zero(&coefs[cid]))
+			deg = max_d(deg,cid);
+	}
+	return deg;
+}
+
+__host__ void callCuModN(bn_t * c, bn_t * a,int NCoefs,
+		const cuyasheint_t * m, int sm, const cuyasheint_t * u, int su,
+		cudaStream_t stream){
+	const int used_m = get_used_index(m,sm)+1;
+	const int used_u = get_used_index(u,su)+1;
+
+	#pragma omp parallel for schedule(static)
+	for(int cid = 0; cid < NCoefs; cid++){
+		if(&c[cid] != &a[cid]){
+			bn_zero(&c[cid]);
+			for(int i = 0; i < a[cid].used; i++)
+				c[cid].dp[i] = a[cid].dp[i];
+			c[cid].used = a[cid].used;
+		}
+		host_mod_barrt(&c[cid],m,used_m,u,used_u);
+		bn_zero_non_used(&c[cid]);
+	}
+}
+
+/////////
+// CRT //
+/////////
+
+/**
+ * CRT primes are word-size, so each residue is computed by Horner's rule over
+ * the 64 bits words of the coefficient, with the Barrett constant of each
+ * prime.
+ *
+ * Most inputs (samples, keys, digits) have a single small word. Those are
+ * mapped straight to the residue, without a reduction.
+ *
+ * The work is split over (prime, tile) pairs, so each thread writes a
+ * contiguous block of one residual polynomial.
+ *
+ * @d_polyCRT - output: array of residual polynomials
+ * @coefs - input: array of coefficients
+ * @used_coefs - input: coefficients from used_coefs on are taken as zero
+ * @ N - input: qty of coefficients
+ * @NPolis - input: qty of primes/residual polynomials
+ */
+void callCRT(bn_t *coefs,const int used_coefs,cuyasheint_t *d_polyCRT,const int N, const int NPolis,cudaStream_t stream){
+	if(N*NPolis <= 0)
+		return;
+	const int used = min_d(max_d(used_coefs,0),N);
+
+	#pragma omp parallel for collapse(2) schedule(static)
+	for(int rid = 0; rid < NPolis; rid++)
+		for(int tile = 0; tile < N; tile += HOST_BN_MATRIX_TILE){
+			const host_modulus_t *mod = &host_crt->moduli[rid];
+			cuyasheint_t *residues = &d_polyCRT[rid*N];
+			const int end = min_d(tile + HOST_BN_MATRIX_TILE, used);
+
+			int cid = tile;
+			for(; cid < end; cid++){
+				const bn_t *x = &coefs[cid];
+				uint64_t r;
+				if(x->used <= 1){
+					// Fast path
+					r = (x->used == 1? x->dp[0] : 0);
+					if(r >= mod->p)
+						r = host_reduce128(r,mod);
+				}else{
+					r = 0;
+					for(int i = x->used-1; i >= 0; i--)
+						r = host_reduce128((((__uint128_t)r) << 64) | x->dp[i],mod);
+				}
+				if(x->sign == BN_NEG && r != 0)
+					r = mod->p - r;
+				residues[cid] = r;
+			}
+			for(; cid < min_d(tile + HOST_BN_MATRIX_TILE, N); cid++)
+				residues[cid] = 0;
+		}
+}
+
+/**
+ * Lifts a value on [0,M) to its balanced residue on (-M/2, M/2]
+ * @param  acc  input/output: at least M_used words, the output magnitude is
+ *              written to the lowest M_used words
+ * @param  used input: words used by acc
+ * @param  sign output: BN_POS or BN_NEG
+ * @return      words used by the output
+ */
+static int host_icrt_center(cuyasheint_t *acc, int used, int *sign){
+	*sign = BN_POS;
+
+	// If M - x < x, x is replaced by M - x and is negative
+	for(int i = used; i < host_crt->M_used; i++)
+		acc[i] = 0;
+	cuyasheint_t diff[STD_BNT_WORDS_ALLOC];
+	const int borrow = bn_subn_low(diff,host_crt->M,acc,host_crt->M_used);
+	assert(borrow == BN_POS);
+	int i = host_crt->M_used-1;
+	while(i > 0 && diff[i] == acc[i])
+		i--;
+	if(diff[i] < acc[i]){
+		for(i = 0; i < host_crt->M_used; i++)
+			acc[i] = diff[i];
+		*sign = BN_NEG;
+		return host_crt->M_used;
+	}
+	return used;
+}
+
+/**
+ * Reduces the ICRT accumulator by M
+ *
+ * The output is lifted to (-M/2, M/2].
+ * @param  acc  input/output: DSTD_BNT_WORDS_ALLOC words, the output
+ *              magnitude is written to the lowest M_used words
+ * @param  used input: words used by acc
+ * @param  sign output: BN_POS or BN_NEG
+ * @return      words used by the output
+ */
+static int host_icrt_reduce(cuyasheint_t *acc, int used, int *sign){
+	bn_t coef;
+	coef.alloc = DSTD_BNT_WORDS_ALLOC;
+	coef.used = used;
+	coef.sign = BN_POS;
+	coef.dp = acc;
+	host_mod_barrt(&coef,host_crt->M,host_crt->M_used,host_crt->u,host_crt->u_used);
+
+	return host_icrt_center(acc,coef.used,sign);
+}
+
+/**
+ * ICRT by Garner's algorithm
+ *
+ * The residues are turned into the mixed-radix digits v_i of x,
+ *
+ * 	x = v_0 + v_1*p_0 + v_2*p_0*p_1 + ... ,
+ *
+ * with v_i = (...((x_i - v_0)*p_0^(-1) - v_1)*p_1^(-1) - ...) mod p_i, all
+ * on word-size arithmetic. x is then rebuilt by Horner's rule. It is
+ * already on [0,M), so there is neither an intermediate Mpi*x buffer nor a
+ * reduction by M.
+ */
+static void host_icrt_garner(bn_t *coefs,cuyasheint_t *d_polyCRT,const int N, const int NPolis){
+	assert(NPolis > 0);
+	#pragma omp parallel for schedule(static)
+	for(int cid = 0; cid < N; cid++){
+		cuyasheint_t v[COPRIMES_BUCKET_SIZE];
+		const cuyasheint_t top = host_garner_digits(v, &d_polyCRT[cid], N, NPolis, host_crt->moduli, d_garner_inv, d_garner_inv_shoup);
+
+		// x = (...(v_{k-1}*p_{k-2} + v_{k-2})*p_{k-3} + ...)*p_0 + v_0
+		cuyasheint_t acc[STD_BNT_WORDS_ALLOC] = {0};
+		int used = 1;
+		acc[0] = top;
+		for(int i = NPolis-2; i >= 0; i--){
+			cuyasheint_t carry = v[i];
+			for(int w = 0; w < used; w++){
+				const __uint128_t r = ((__uint128_t)acc[w]) * CRTPrimes[i] + carry;
+				acc[w] = (cuyasheint_t)r;
+				carry = (cuyasheint_t)(r >> 64);
+			}
+			if(carry != 0){
+				assert(used < STD_BNT_WORDS_ALLOC);
+				acc[used++] = carry;
+			}
+		}
+
+		int sign;
+		const int coef_used = host_icrt_center(acc,used,&sign);
+
+		bn_zero(&coefs[cid]);
+		for(int i = 0; i < coef_used; i++)
+			coefs[cid].dp[i] = acc[i];
+		coefs[cid].used = coef_used;
+		coefs[cid].sign = sign;
+		bn_adjust_used(&coefs[cid]);
+	}
+}
+
+/**
+ * callICRT computes sum_i Mpi*( invMpi*(x_i) % pi) mod M for every
+ * coefficient.
+ *
+ * The output is the balanced residue on (-M/2, M/2], with the sign stored in
+ * the bn_t. So negative coefficients, as noise samples, differences folded
+ * on the residues or products reduced mod x^nphi + 1 by the negacyclic
+ * transform, come back as they are, with no fixup pass.
+ *
+ * With CUDAFunctions::icrt == ICRT_GARNER, host_icrt_garner() is used instead.
+ * @param coefs     output: An array of coefficients
+ * @param d_polyCRT input: The CRT residues
+ * @param N         input: Number of coefficients
+ * @param NPolis    input: Number of residues
+ */
+void callICRT(bn_t *coefs,cuyasheint_t *d_polyCRT,const int N, const int NPolis,cudaStream_t stream){
+	if(N <= 0)
+		return;
+	if(CUDAFunctions::icrt == ICRT_GARNER){
+		host_icrt_garner(coefs,d_polyCRT,N,NPolis);
+		return;
+	}
+
+	#pragma omp parallel for schedule(static)
+	for(int cid = 0; cid < N; cid++){
+		// The accumulator is bigger than a coefficient because the sum
+		// may be up to NPolis*M
+		cuyasheint_t acc[DSTD_BNT_WORDS_ALLOC] = {0};
+		int used = 0;
+
+		for(int rid = 0; rid < NPolis; rid++){
+			const cuyasheint_t x = host_mulmod(	host_crt->invMpis[rid],
+												d_polyCRT[cid + rid*N],
+												&host_crt->moduli[rid]);
+
+			// acc += Mpi * x
+			const cuyasheint_t *Mpi = &host_crt->Mpis[rid*STD_BNT_WORDS_ALLOC];
+			cuyasheint_t carry = 0;
+			int i;
+			for(i = 0; i < host_crt->Mpis_used[rid]; i++){
+				__uint128_t r = ((__uint128_t)Mpi[i]) * x + acc[i] + carry;
+				acc[i] = (cuyasheint_t)r;
+				carry = (cuyasheint_t)(r >> 64);
+			}
+			for(; carry != 0; i++){
+				acc[i] += carry;
+				carry = (acc[i] < carry);
+			}
+			used = max_d(used,i);
+		}
+
+		int sign;
+		const int coef_used = host_icrt_reduce(acc,used,&sign);
+
+		bn_zero(&coefs[cid]);
+		for(int i = 0; i < coef_used; i++)
+			coefs[cid].dp[i] = acc[i];
+		coefs[cid].used = coef_used;
+		coefs[cid].sign = sign;
+		bn_adjust_used(&coefs[cid]);
+	}
+}
+
+/**
+ * a[0..n] += x*b[0..n-1], the carry out of a[n] is dropped
+ */
+static inline void host_words_mac(cuyasheint_t *a, const cuyasheint_t *b, const int n, const cuyasheint_t x){
+	cuyasheint_t carry = 0;
+	for(int i = 0; i < n; i++){
+		const __uint128_t r = ((__uint128_t)b[i]) * x + a[i] + carry;
+		a[i] = (cuyasheint_t)r;
+		carry = (cuyasheint_t)(r >> 64);
+	}
+	a[n] += carry;
+	a[n+1] += (a[n] < carry);
+}
+
+/**
+ * Splits round(t*x/q) as sum_j xt_j*omega_j - v*Omega + rnd, see
+ * callRNSScaleRound(). Residue j of x is x[j*stride], and if fold is not zero
+ * x[j*stride] - x[j*stride + fold] is taken instead.
+ * @return rnd
+ */
+static inline __int128 host_rns_scale_split(cuyasheint_t *xt,
+											cuyasheint_t *v,
+											const cuyasheint_t *x,
+											const int stride,
+											const int fold,
+											const rns_scale_t *s,
+											const int NPolis){
+	const int fw = s->frac_words;
+	cuyasheint_t vacc[4] = {0};
+	cuyasheint_t F[RNS_SCALE_MAX_FRAC_WORDS+2] = {0};
+
+	for(int j = 0; j < NPolis; j++){
+		const host_modulus_t *mod = &host_crt->moduli[j];
+		cuyasheint_t xj = x[j*stride];
+		if(fold)
+			xj = host_submod(xj, x[j*stride + fold], mod->p);
+		xt[j] = host_mulmod(host_crt->invMpis[j], xj, mod);
+
+		host_words_mac(vacc, &s->d_pinv[j*2], 2, xt[j]);
+		host_words_mac(F, &s->d_theta[j*fw], fw, xt[j]);
+	}
+	// v = round(sum_j xt_j/pj), 2^128/pj was truncated
+	*v = vacc[2] + (vacc[1] >> 63);
+
+	// F -= v*Theta
+	cuyasheint_t vTheta[RNS_SCALE_MAX_FRAC_WORDS+2] = {0};
+	host_words_mac(vTheta, s->d_Theta, fw, *v);
+	cuyasheint_t borrow = 0;
+	for(int i = 0; i < fw+2; i++){
+		const cuyasheint_t d = F[i] - vTheta[i];
+		const cuyasheint_t b = (F[i] < vTheta[i]) | (d < borrow);
+		F[i] = d - borrow;
+		borrow = b;
+	}
+
+	// rnd = round(F/R), a signed two-word integer
+	return (__int128)((((__uint128_t)F[fw+1]) << 64) | F[fw]) + (F[fw-1] >> 63);
+}
+
+/**
+ * callRNSScaleRound computes round(t*x/q) straight on the residues of x.
+ *
+ * With xt_j = [x_j*invMpj]_pj, x = sum_j xt_j*Mpj - v*M for
+ * v = round(sum_j xt_j/pj). So
+ *
+ *   t*x/q = sum_j xt_j*(omega_j + theta_j/R) - v*(Omega + Theta/R)
+ *
+ * The integer parts are reduced mod each pi, while the fractional parts are
+ * summed on frac_words+2 words and rounded. Neither a bn_t nor M is ever
+ * built.
+ * @param d_polyCRT input/output: The CRT residues
+ * @param s         input: constants from rns_scale_setup()
+ * @param fold      input: if not zero, x[cid] - x[cid+fold] is rounded
+ * @param offset    input: adds K*q to the output
+ * @param N         input: Number of coefficients
+ * @param NPolis    input: Number of residues
+ */
+void callRNSScaleRound(	cuyasheint_t *d_polyCRT,
+						const rns_scale_t *s,
+						const int fold,
+						const bool offset,
+						const int N,
+						const int NPolis,
+						cudaStream_t stream){
+	assert(s->NPolis == NPolis);
+	const int n = (fold? fold : N);
+
+	#pragma omp parallel for schedule(static)
+	for(int cid = 0; cid < n; cid++){
+		cuyasheint_t xt[COPRIMES_BUCKET_SIZE];
+		cuyasheint_t v;
+		const __int128 rnd = host_rns_scale_split(xt, &v, &d_polyCRT[cid], N, fold, s, NPolis);
+		const bool neg = (rnd < 0);
+		const __uint128_t rnd_abs = (neg? -(__uint128_t)rnd : (__uint128_t)rnd);
+
+		for(int i = 0; i < NPolis; i++){
+			const host_modulus_t *mod = &host_crt->moduli[i];
+			const cuyasheint_t *omega = &s->d_omega[i*NPolis];
+			cuyasheint_t y = 0;
+			for(int j = 0; j < NPolis; j++)
+				y = host_addmod(y, host_mulmod(xt[j], omega[j], mod), mod->p);
+			y = host_submod(y, host_mulmod(v, s->d_Omega[i], mod), mod->p);
+
+			const cuyasheint_t r = host_reduce128(rnd_abs, mod);
+			y = (neg? host_submod(y, r, mod->p) : host_addmod(y, r, mod->p));
+			if(offset)
+				y = host_addmod(y, s->d_offset[i], mod->p);
+			d_polyCRT[cid + i*N] = y;
+		}
+	}
+
+	if(fold){
+		#pragma omp parallel for collapse(2) schedule(static)
+		for(int rid = 0; rid < NPolis; rid++)
+			for(int cid = fold; cid < N; cid++)
+				d_polyCRT[cid + rid*N] = 0;
+	}
+}
+
+#define HOST_RNS_TILE 256
+
+/**
+ * callRNSScaleRoundModT computes [round(t*x/q)]_t on the split of
+ * callRNSScaleRound(), with the integer parts taken mod t. Each thread takes
+ * whole tiles of HOST_RNS_TILE coefficients, so it streams through a
+ * contiguous block of every residue row.
+ * @param h_out     output: n coefficients per polynomial
+ * @param d_polyCRT input: the residues of K polynomials
+ * @param s         input: constants from rns_scale_setup()
+ * @param fold      input: if not zero, x[cid] - x[cid+fold] is rounded
+ * @param n         input: coefficients written per polynomial
+ * @param N         input: Number of coefficients per polynomial
+ * @param K         input: Number of polynomials
+ * @param NPolis    input: Number of residues
+ */
+void callRNSScaleRoundModT(	cuyasheint_t *h_out,
+							cuyasheint_t *d_polyCRT,
+							const rns_scale_t *s,
+							const int fold,
+							const int n,
+							const int N,
+							const int K,
+							const int NPolis,
+							cudaStream_t stream){
+	assert(s->NPolis == NPolis);
+	assert(s->t > 0);
+	assert(n <= N && (fold == 0 || n <= fold));
+	const __uint128_t t = s->t;
+	const int tiles = (n + HOST_RNS_TILE - 1)/HOST_RNS_TILE;
+
+	#pragma omp parallel for collapse(2) schedule(static)
+	for(int k = 0; k < K; k++)
+		for(int tile = 0; tile < tiles; tile++){
+			const int last = min_d(n, (tile+1)*HOST_RNS_TILE);
+			for(int cid = tile*HOST_RNS_TILE; cid < last; cid++){
+				cuyasheint_t xt[COPRIMES_BUCKET_SIZE];
+				cuyasheint_t v;
+				const __int128 rnd = host_rns_scale_split(xt, &v, &d_polyCRT[k*N + cid], K*N, fold, s, NPolis);
+
+				__uint128_t y = 0;
+				for(int j = 0; j < NPolis; j++)
+					y = (y + (__uint128_t)xt[j] * s->d_omega_t[j]) % t;
+				y = (y + t - ((__uint128_t)v * s->Omega_t) % t) % t;
+
+				const cuyasheint_t r = (cuyasheint_t)((rnd < 0? -(__uint128_t)rnd : (__uint128_t)rnd) % t);
+				y = (rnd < 0? y + t - r : y + r) % t;
+				h_out[k*n + cid] = (cuyasheint_t)y;
+			}
+		}
+}
+
+/**
+ * callRNSDecompDigit builds a digit of the RNS-digit decomposition straight
+ * from the residues of x.
+ *
+ * With y_j = [x_j*(P/pj)^(-1)]_pj, the digit of the group G is
+ * sum_{j in G} y_j*(P_G/pj), which is reduced mod each pi on word-size
+ * arithmetic. The first digit also takes -v*P_G, for v = round(sum_j y_j/pj),
+ * so the digits add up to x and not to x + v*P.
+ * @param d_digit   output: N*NPolis residues
+ * @param d_polyCRT input: N*NPolis residues of x, on [0,q)
+ * @param d         input: constants from rns_decomp_setup()
+ * @param digit     input: on [0, d->digits)
+ * @param N         input: Number of coefficients
+ * @param NPolis    input: Number of residues
+ */
+void callRNSDecompDigit(cuyasheint_t *d_digit,
+						const cuyasheint_t *d_polyCRT,
+						const rns_decomp_t *d,
+						const int digit,
+						const int N,
+						const int NPolis,
+						cudaStream_t stream){
+	assert(d->NPolis == NPolis);
+	assert(digit >= 0 && digit < d->digits);
+	const int L = d->L;
+	const int first = digit*d->group;
+	const int last = min_d(first + d->group, L);
+
+	#pragma omp parallel for schedule(static)
+	for(int cid = 0; cid < N; cid++){
+		cuyasheint_t y[COPRIMES_BUCKET_SIZE];
+		cuyasheint_t vacc[4] = {0};
+
+		// v is only needed by the first digit
+		for(int j = first; j < (first == 0? L : last); j++){
+			y[j] = host_mulmod(d->d_inv[j], d_polyCRT[cid + j*N], &host_crt->moduli[j]);
+			if(first == 0)
+				host_words_mac(vacc, &d->d_pinv[j*2], 2, y[j]);
+		}
+		const cuyasheint_t v = vacc[2] + (vacc[1] >> 63);
+
+		for(int i = 0; i < NPolis; i++){
+			const host_modulus_t *mod = &host_crt->moduli[i];
+			const cuyasheint_t *hat = &d->d_hat[i*L];
+			cuyasheint_t r = 0;
+			for(int j = first; j < last; j++)
+				r = host_addmod(r, host_mulmod(y[j], hat[j], mod), mod->p);
+			if(first == 0)
+				r = host_submod(r, host_mulmod(v, d->d_PG0[i], mod), mod->p);
+			d_digit[cid + i*N] = r;
+		}
+	}
+}
+
+///////////////
+// bn_matrix //
+///////////////
+
+/**
+ * Copies N coefficients to a limb matrix
+ * @param a      output
+ * @param coefs  input
+ * @param N      input: qty of coefficients
+ */
+void callBNToMatrix(bn_matrix_t *a, bn_t *coefs, const int N, cudaStream_t stream){
+	assert(a->N >= N);
+
+	#pragma omp parallel for schedule(static)
+	for(int tile = 0; tile < N; tile += HOST_BN_MATRIX_TILE){
+		const int end = min_d(tile + HOST_BN_MATRIX_TILE, N);
+		for(int cid = tile; cid < end; cid++){
+			const bn_t *x = &coefs[cid];
+			for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+				a->d_limbs[cid + i*a->N] = (i < x->used? x->dp[i] : 0);
+			host_matrix_set_sign(a->d_signs, cid, x->sign);
+		}
+	}
+}
+
+/**
+ * Copies the first N coefficients of a limb matrix to an array of bn_t
+ * @param coefs  output
+ * @param a      input
+ * @param N      input: qty of coefficients
+ */
+void callMatrixToBN(bn_t *coefs, bn_matrix_t *a, const int N, cudaStream_t stream){
+	assert(a->N >= N);
+
+	#pragma omp parallel for schedule(static)
+	for(int cid = 0; cid < N; cid++){
+		bn_t *x = &coefs[cid];
+		bn_zero(x);
+		for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+			x->dp[i] = a->d_limbs[cid + i*a->N];
+		x->used = STD_BNT_WORDS_ALLOC;
+		x->sign = host_matrix_sign(a->d_signs, cid);
+		bn_adjust_used(x);
+	}
+}
+
+/**
+ * callCRT() over a limb matrix
+ *
+ * Each tile is reduced one word at a time, from the highest word in use on
+ * the tile, so the inner loops run over consecutive coefficients.
+ * @param a         input: a->N coefficients
+ * @param d_polyCRT output: a->N*NPolis residues
+ * @param NPolis    input: qty of primes
+ */
+void callCRTMatrix(bn_matrix_t *a, cuyasheint_t *d_polyCRT, const int NPolis, cudaStream_t stream){
+	const int N = a->N;
+	if(N*NPolis <= 0)
+		return;
+
+	#pragma omp parallel for schedule(static)
+	for(int tile = 0; tile < N; tile += HOST_BN_MATRIX_TILE){
+		const int T = min_d(HOST_BN_MATRIX_TILE, N - tile);
+
+		// Highest word in use on this tile
+		int used = STD_BNT_WORDS_ALLOC;
+		for(; used > 0; used--){
+			const cuyasheint_t *limb = &a->d_limbs[tile + (used-1)*N];
+			cuyasheint_t any = 0;
+			for(int t = 0; t < T; t++)
+				any |= limb[t];
+			if(any != 0)
+				break;
+		}
+
+		for(int rid = 0; rid < NPolis; rid++){
+			const host_modulus_t *mod = &host_crt->moduli[rid];
+			cuyasheint_t *r = &d_polyCRT[tile + rid*N];
+
+			if(used <= 1){
+				// Fast path: a single word
+				const cuyasheint_t *limb = &a->d_limbs[tile];
+				for(int t = 0; t < T; t++){
+					const cuyasheint_t x = (used == 1? limb[t] : 0);
+					r[t] = (x < mod->p? x : host_reduce128(x, mod));
+				}
+			}else{
+				for(int t = 0; t < T; t++)
+					r[t] = 0;
+				for(int i = used-1; i >= 0; i--){
+					const cuyasheint_t *limb = &a->d_limbs[tile + i*N];
+					for(int t = 0; t < T; t++)
+						r[t] = host_reduce128((((__uint128_t)r[t]) << 64) | limb[t], mod);
+				}
+			}
+			for(int t = 0; t < T; t++)
+				if(host_matrix_sign(a->d_signs, tile + t) == BN_NEG && r[t] != 0)
+					r[t] = mod->p - r[t];
+		}
+	}
+}
@@ -0,0 +1,823 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host implementation of the coefficient-domain passes over a limb matrix:
+ * callICRTMatrix(), callMersenneModMatrix(), callModQMatrix() and
+ * callCiphertextMulAuxMatrix(), and of callPolynomialReduceFused(), which
+ * chains them on the stack.
+ *
+ * Each pass is a template on the words of M and q (see cuda/bn_fixed.h).
+ * bn_fixed_write_params() picks the instances once, for the parameters
+ * computed by bn_fixed_setup(): Mersenne folding if q = 2^nq - 1, or Barrett
+ * for any other q.
+ */
+#include "../cuda/cuda_bn.h"
+#include "../cuda/cuda_ciphertext.h"
+#include "host_tables.h"
+
+
+typedef void (*host_icrt_fn)(bn_matrix_t *a, const cuyasheint_t *d_polyCRT, const int NPolis);
+typedef void (*host_mersenne_fn)(bn_matrix_t *g, const int nq);
+typedef void (*host_round_fn)(bn_matrix_t *g);
+typedef void (*host_reduce_fn)(cuyasheint_t *d_polyCRT, const int fold, const int N, const int NPolis);
+
+/**
+ * Instances picked by bn_fixed_write_params()
+ */
+static struct {
+	host_icrt_fn icrt = NULL;
+	host_mersenne_fn mersenne = NULL;
+	host_mersenne_fn modq = NULL;
+	host_round_fn round = NULL;
+	host_reduce_fn reduce = NULL;
+} host_fixed;
+
+/**
+ * Gathers the first L rows of coefficient cid
+ */
+template<int L>
+static inline void host_matrix_load(bn_fixed<L> &x, const bn_matrix_t *g, int cid){
+	BN_FIXED_UNROLL
+	for(int i = 0; i < L; i++)
+		x.dp[i] = g->d_limbs[cid + i*g->N];
+}
+
+/**
+ * Lifts lane t of an ICRT output y on [0,M) to (-M/2, M/2], as a sign and a
+ * magnitude
+ */
+template<int LM>
+static inline void host_icrt_center_lane(	cuyasheint_t r[LM][HOST_BN_MATRIX_TILE],
+											cuyasheint_t negative[HOST_BN_MATRIX_TILE],
+											bn_fixed<LM> &y,
+											const bn_fixed<LM> &m,
+											const int t){
+	// If M - y < y the output is -(M - y)
+	bn_fixed<LM> d;
+	bn_fixed_sub<LM>(d, m, y);
+	negative[t] = -(cuyasheint_t)(bn_fixed_cmp<LM>(d, y) == CMP_LT);
+	bn_fixed_select<LM>(y, d, y, negative[t]);
+
+	BN_FIXED_UNROLL
+	for(int i = 0; i < LM; i++)
+		r[i][t] = y.dp[i];
+}
+
+/**
+ * host_icrt_tile() by Garner's algorithm. The digits are rebuilt by Horner's
+ * rule, which gives the coefficient on [0,M) with no reduction by M.
+ */
+template<int LM>
+static inline void host_icrt_garner_tile(	cuyasheint_t r[LM][HOST_BN_MATRIX_TILE],
+											cuyasheint_t negative[HOST_BN_MATRIX_TILE],
+											const cuyasheint_t *d_polyCRT,
+											const int N,
+											const int NPolis,
+											const int T,
+											const bn_fixed<LM> &m){
+	for(int t = 0; t < T; t++){
+		cuyasheint_t v[COPRIMES_BUCKET_SIZE];
+		const cuyasheint_t top = host_garner_digits(v, &d_polyCRT[t], N, NPolis, host_crt->moduli, d_garner_inv, d_garner_inv_shoup);
+
+		// y = (...(v_{k-1}*p_{k-2} + v_{k-2})*p_{k-3} + ...)*p_0 + v_0
+		bn_fixed<LM> y;
+		bn_fixed_zero(y);
+		y.dp[0] = top;
+		for(int i = NPolis-2; i >= 0; i--)
+			bn_fixed_muladd1<LM>(y, host_crt->moduli[i].p, v[i]);
+
+		host_icrt_center_lane<LM>(r, negative, y, m, t);
+	}
+}
+
+/**
+ * ICRT of a tile of T coefficients, for a M of LM words
+ *
+ * Each Mpi*x is below M, so the sum is below NPolis*M and a single extra word
+ * holds it. Mpi*x is accumulated word by word for the whole tile, and only the
+ * final reduction by M is done per coefficient. The output is the balanced
+ * residue on (-M/2, M/2], so negative coefficients come out as a sign and a
+ * magnitude.
+ *
+ * With CUDAFunctions::icrt == ICRT_GARNER, host_icrt_garner_tile() is used
+ * instead.
+ * @param r         output: LM rows of magnitudes
+ * @param negative  output: all ones where the coefficient is negative
+ * @param d_polyCRT input: residue rid of coefficient t at d_polyCRT[t + rid*N]
+ */
+template<int LM>
+static inline void host_icrt_tile(	cuyasheint_t r[LM][HOST_BN_MATRIX_TILE],
+									cuyasheint_t negative[HOST_BN_MATRIX_TILE],
+									const cuyasheint_t *d_polyCRT,
+									const int N,
+									const int NPolis,
+									const int T,
+									const bn_fixed<LM> &m,
+									const bn_fixed<LM+1> &mu){
+	if(CUDAFunctions::icrt == ICRT_GARNER){
+		host_icrt_garner_tile<LM>(r, negative, d_polyCRT, N, NPolis, T, m);
+		return;
+	}
+
+	cuyasheint_t acc[LM+1][HOST_BN_MATRIX_TILE] = {{0}};
+	cuyasheint_t x[HOST_BN_MATRIX_TILE];
+	cuyasheint_t carry[HOST_BN_MATRIX_TILE];
+
+	for(int rid = 0; rid < NPolis; rid++){
+		const cuyasheint_t *residues = &d_polyCRT[rid*N];
+		for(int t = 0; t < T; t++){
+			x[t] = host_mulmod(host_crt->invMpis[rid], residues[t], &host_crt->moduli[rid]);
+			carry[t] = 0;
+		}
+
+		// acc += Mpi * x
+		const cuyasheint_t *Mpi = &host_crt->Mpis[rid*STD_BNT_WORDS_ALLOC];
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LM; i++)
+			for(int t = 0; t < T; t++){
+				__uint128_t v = ((__uint128_t)Mpi[i]) * x[t] + acc[i][t] + carry[t];
+				acc[i][t] = (cuyasheint_t)v;
+				carry[t] = (cuyasheint_t)(v >> 64);
+			}
+		for(int t = 0; t < T; t++)
+			acc[LM][t] += carry[t];
+	}
+
+	////////////////////////////////////////////////
+	// Modular reduction by M //
+	////////////////////////////////////////////////
+	for(int t = 0; t < T; t++){
+		bn_fixed<LM+1> v;
+		BN_FIXED_UNROLL
+		for(int i = 0; i <= LM; i++)
+			v.dp[i] = acc[i][t];
+		bn_fixed<LM> y;
+		bn_fixed_barrett<LM>(y, v, m, mu);
+		host_icrt_center_lane<LM>(r, negative, y, m, t);
+	}
+}
+
+/**
+ * callICRTMatrix() for a M of LM words
+ */
+template<int LM>
+static void host_icrt_matrix(bn_matrix_t *a, const cuyasheint_t *d_polyCRT, const int NPolis){
+	const int N = a->N;
+	bn_fixed<LM> m;
+	bn_fixed<LM+1> mu;
+	for(int i = 0; i < LM; i++)
+		m.dp[i] = host_crt->M[i];
+	for(int i = 0; i <= LM; i++)
+		mu.dp[i] = bn_fixed_params.mu[i];
+
+	#pragma omp parallel for schedule(static)
+	for(int tile = 0; tile < N; tile += HOST_BN_MATRIX_TILE){
+		const int T = min_d(HOST_BN_MATRIX_TILE, N - tile);
+		cuyasheint_t r[LM][HOST_BN_MATRIX_TILE];
+		cuyasheint_t negative[HOST_BN_MATRIX_TILE];
+		host_icrt_tile<LM>(r, negative, &d_polyCRT[tile], N, NPolis, T, m, mu);
+
+		for(int i = 0; i < LM; i++)
+			memcpy(&a->d_limbs[tile + i*N], r[i], T*sizeof(cuyasheint_t));
+		for(int i = LM; i < STD_BNT_WORDS_ALLOC; i++)
+			memset(&a->d_limbs[tile + i*N], 0, T*sizeof(cuyasheint_t));
+		for(int t = 0; t < T; t++)
+			host_matrix_set_sign(a->d_signs, tile + t, (int)(negative[t] & BN_NEG));
+	}
+}
+
+/**
+ * CRT of a tile of T non-negative coefficients of L words
+ * @param d_polyCRT output: residue rid of coefficient t at d_polyCRT[t + rid*N]
+ * @param x         input: L rows
+ */
+template<int L>
+static inline void host_crt_tile(	cuyasheint_t *d_polyCRT,
+									const int N,
+									const int NPolis,
+									const cuyasheint_t x[L][HOST_BN_MATRIX_TILE],
+									const int T){
+	for(int rid = 0; rid < NPolis; rid++){
+		const host_modulus_t *mod = &host_crt->moduli[rid];
+		cuyasheint_t *r = &d_polyCRT[rid*N];
+		for(int t = 0; t < T; t++){
+			const cuyasheint_t top = x[L-1][t];
+			r[t] = (top < mod->p? top : host_reduce128(top, mod));
+		}
+		for(int i = L-2; i >= 0; i--)
+			for(int t = 0; t < T; t++)
+				r[t] = host_reduce128((((__uint128_t)r[t]) << 64) | x[i][t], mod);
+	}
+}
+
+////////////////////////////////////////////////////
+// Mersenne reduction, one SIMD lane per coefficient //
+////////////////////////////////////////////////////
+
+/**
+ * a += b on a tile, with a carry out of the last row
+ */
+static inline void host_lanes_add(cuyasheint_t *a, const cuyasheint_t *b, cuyasheint_t *carry, const int T){
+	#pragma omp simd
+	for(int t = 0; t < T; t++){
+		const cuyasheint_t s = a[t] + b[t];
+		const cuyasheint_t r = s + carry[t];
+		carry[t] = (s < a[t]) | (r < s);
+		a[t] = r;
+	}
+}
+
+/**
+ * Word i of (x >> shift) for a tile, where x has L rows of stride words.
+ * Rows past L read as zero.
+ */
+template<int L>
+static inline void host_lanes_shr_word(	cuyasheint_t *out,
+										const cuyasheint_t *x,
+										const int stride,
+										const int shift,
+										const int i,
+										const int T){
+	static const cuyasheint_t zero[HOST_BN_MATRIX_TILE] = {0};
+	const int w = shift / WORD + i;
+	const int b = shift % WORD;
+	const cuyasheint_t *lo = (w < L? &x[w*stride] : zero);
+	const cuyasheint_t *hi = (b && w+1 < L? &x[(w+1)*stride] : zero);
+	const int hb = (WORD - b) % WORD;
+	#pragma omp simd
+	for(int t = 0; t < T; t++)
+		out[t] = (lo[t] >> b) | (hi[t] << hb);
+}
+
+/**
+ * x mod q and floor(x/q) for q = 2^nq - 1, on a tile of T coefficients
+ *
+ * With x = sum_k c_k*2^(k*nq), for chunks c_k of nq bits, A = sum_k c_k is
+ * congruent to x and
+ *
+ *   floor(x/q) = sum_{j>0} (x >> j*nq) + floor(A/q)
+ *
+ * A is below 2^(nq+64), so for A = hi*2^nq + lo, s = hi + lo < 2q and
+ * floor(A/q) = hi + (s >= q). Everything is shifts and adds, so each row is
+ * processed for the whole tile at once and the compiler maps the lanes to
+ * AVX2/AVX-512 registers.
+ * @param r    output: LQ rows of x mod q
+ * @param quot output: LIN rows of floor(x/q), or NULL
+ * @param x    input: LIN rows, word i of coefficient t at x[t + i*stride]
+ * @param nq   input: 64*(LQ-1) < nq <= 64*LQ
+ */
+template<int LIN, int LQ>
+static inline void host_mersenne_lanes(	cuyasheint_t r[LQ][HOST_BN_MATRIX_TILE],
+										cuyasheint_t quot[][HOST_BN_MATRIX_TILE],
+										const cuyasheint_t *x,
+										const int stride,
+										const int T,
+										const int nq){
+	const cuyasheint_t top_mask = (nq % WORD? MASK(nq % WORD) : ~(cuyasheint_t)0);
+	const int chunks = (WORD*LIN + nq - 1) / nq;
+	cuyasheint_t c[HOST_BN_MATRIX_TILE];
+	cuyasheint_t carry[HOST_BN_MATRIX_TILE];
+
+	// A = sum_k c_k
+	cuyasheint_t acc[LQ+1][HOST_BN_MATRIX_TILE] = {{0}};
+	for(int k = 0; k < chunks; k++){
+		for(int t = 0; t < T; t++)
+			carry[t] = 0;
+		for(int i = 0; i < LQ; i++){
+			host_lanes_shr_word<LIN>(c, x, stride, k*nq, i, T);
+			if(i == LQ-1)
+				#pragma omp simd
+				for(int t = 0; t < T; t++)
+					c[t] &= top_mask;
+			host_lanes_add(acc[i], c, carry, T);
+		}
+		#pragma omp simd
+		for(int t = 0; t < T; t++)
+			acc[LQ][t] += carry[t];
+	}
+
+	// s = hi + lo and s1 = s + 1. s >= q iff bit nq of s1 is set.
+	const int hw = nq / WORD;
+	const int hb = nq % WORD;
+	cuyasheint_t hi[HOST_BN_MATRIX_TILE];
+	cuyasheint_t ge[HOST_BN_MATRIX_TILE];
+	host_lanes_shr_word<LQ+1>(hi, acc[0], HOST_BN_MATRIX_TILE, nq, 0, T);
+	cuyasheint_t s[LQ+1][HOST_BN_MATRIX_TILE];
+	cuyasheint_t s1[LQ+1][HOST_BN_MATRIX_TILE];
+	for(int t = 0; t < T; t++){
+		c[t] = hi[t];
+		carry[t] = 1;
+	}
+	for(int i = 0; i <= LQ; i++){
+		const cuyasheint_t mask = (i < LQ-1? ~(cuyasheint_t)0 : (i == LQ-1? top_mask : 0));
+		#pragma omp simd
+		for(int t = 0; t < T; t++){
+			const cuyasheint_t lo = acc[i][t] & mask;
+			s[i][t] = lo + c[t];
+			c[t] = (s[i][t] < lo);
+			s1[i][t] = s[i][t] + carry[t];
+			carry[t] = (s1[i][t] < carry[t]);
+		}
+	}
+	#pragma omp simd
+	for(int t = 0; t < T; t++)
+		ge[t] = (s1[hw][t] >> hb) & 1;
+
+	// r = s, or s - q = s1 - 2^nq
+	for(int i = 0; i < LQ; i++){
+		const cuyasheint_t mask = (i == LQ-1? top_mask : ~(cuyasheint_t)0);
+		#pragma omp simd
+		for(int t = 0; t < T; t++)
+			r[i][t] = (ge[t]? s1[i][t] & mask : s[i][t]);
+	}
+
+	if(quot == NULL)
+		return;
+
+	// quot = sum_{j>0} (x >> j*nq) + hi + ge
+	for(int i = 0; i < LIN; i++)
+		for(int t = 0; t < T; t++)
+			quot[i][t] = 0;
+	for(int j = 1; j < chunks; j++){
+		for(int t = 0; t < T; t++)
+			carry[t] = 0;
+		for(int i = 0; i < LIN; i++){
+			host_lanes_shr_word<LIN>(c, x, stride, j*nq, i, T);
+			host_lanes_add(quot[i], c, carry, T);
+		}
+	}
+	#pragma omp simd
+	for(int t = 0; t < T; t++)
+		carry[t] = hi[t] + ge[t];
+	for(int i = 0; i < LIN; i++)
+		#pragma omp simd
+		for(int t = 0; t < T; t++){
+			quot[i][t] += carry[t];
+			carry[t] = (quot[i][t] < carry[t]);
+		}
+}
+
+/**
+ * host_mersenne_lanes() for signed inputs: r = x mod q, for the magnitudes
+ * in x and the signs in negative (all ones where the input is negative)
+ */
+template<int LIN, int LQ>
+static inline void host_mersenne_signed_lanes(	cuyasheint_t r[LQ][HOST_BN_MATRIX_TILE],
+												const cuyasheint_t *x,
+												const int stride,
+												const cuyasheint_t negative[HOST_BN_MATRIX_TILE],
+												const int T,
+												const int nq){
+	const cuyasheint_t top_mask = (nq % WORD? MASK(nq % WORD) : ~(cuyasheint_t)0);
+	host_mersenne_lanes<LIN,LQ>(r, NULL, x, stride, T, nq);
+
+	// -r mod q is q - r, which for 0 < r < q is r xor q
+	cuyasheint_t flip[HOST_BN_MATRIX_TILE] = {0};
+	for(int i = 0; i < LQ; i++)
+		for(int t = 0; t < T; t++)
+			flip[t] |= r[i][t];
+	for(int t = 0; t < T; t++)
+		flip[t] = negative[t] & -(cuyasheint_t)(flip[t] != 0);
+	for(int i = 0; i < LQ; i++){
+		const cuyasheint_t q = (i == LQ-1? top_mask : ~(cuyasheint_t)0);
+		#pragma omp simd
+		for(int t = 0; t < T; t++)
+			r[i][t] ^= q & flip[t];
+	}
+}
+
+/**
+ * host_mersenne_signed_lanes() for any q, by Barrett. Each lane takes a full
+ * multiprecision product, so the tile is processed one coefficient at a time.
+ */
+template<int LIN, int LQ>
+static inline void host_barrett_signed_lanes(	cuyasheint_t r[LQ][HOST_BN_MATRIX_TILE],
+												const cuyasheint_t *x,
+												const int stride,
+												const cuyasheint_t negative[HOST_BN_MATRIX_TILE],
+												const int T){
+	bn_fixed<LQ> q;
+	bn_fixed<LIN> mu;
+	for(int i = 0; i < LQ; i++)
+		q.dp[i] = bn_fixed_params.q[i];
+	bn_fixed_qmu<LIN>(mu, bn_fixed_params.qmu);
+
+	for(int t = 0; t < T; t++){
+		bn_fixed<LIN> v;
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LIN; i++)
+			v.dp[i] = x[t + i*stride];
+		bn_fixed<LQ> y;
+		bn_fixed<LIN> quot;
+		bn_fixed_barrett_q<LIN,LQ>(y, quot, v, q, mu);
+
+		// -y mod q is q - y
+		cuyasheint_t nonzero = 0;
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LQ; i++)
+			nonzero |= y.dp[i];
+		bn_fixed<LQ> d;
+		bn_fixed_sub<LQ>(d, q, y);
+		bn_fixed_select<LQ>(y, d, y, negative[t] & -(cuyasheint_t)(nonzero != 0));
+
+		BN_FIXED_UNROLL
+		for(int i = 0; i < LQ; i++)
+			r[i][t] = y.dp[i];
+	}
+}
+
+/**
+ * host_barrett_signed_lanes() on the narrowest instance, from W words up,
+ * that holds the used rows of the tile
+ */
+template<int W, int LQ>
+struct host_barrett_width{
+	static void run(int used,
+					cuyasheint_t r[LQ][HOST_BN_MATRIX_TILE],
+					const cuyasheint_t *x,
+					const int stride,
+					const cuyasheint_t negative[HOST_BN_MATRIX_TILE],
+					const int T){
+		if(used <= W)
+			host_barrett_signed_lanes<W,LQ>(r, x, stride, negative, T);
+		else
+			host_barrett_width<W+1,LQ>::run(used, r, x, stride, negative, T);
+	}
+};
+template<int LQ>
+struct host_barrett_width<STD_BNT_WORDS_ALLOC,LQ>{
+	static void run(int used,
+					cuyasheint_t r[LQ][HOST_BN_MATRIX_TILE],
+					const cuyasheint_t *x,
+					const int stride,
+					const cuyasheint_t negative[HOST_BN_MATRIX_TILE],
+					const int T){
+		host_barrett_signed_lanes<STD_BNT_WORDS_ALLOC,LQ>(r, x, stride, negative, T);
+	}
+};
+
+/**
+ * Signed reduction of a tile by q: Mersenne folding, or Barrett if BARRETT
+ * is set
+ */
+template<int LIN, int LQ, bool BARRETT>
+static inline void host_modq_signed_lanes(	cuyasheint_t r[LQ][HOST_BN_MATRIX_TILE],
+											const cuyasheint_t *x,
+											const int stride,
+											const cuyasheint_t negative[HOST_BN_MATRIX_TILE],
+											const int T,
+											const int nq){
+	if(BARRETT)
+		host_barrett_signed_lanes<LIN,LQ>(r, x, stride, negative, T);
+	else
+		host_mersenne_signed_lanes<LIN,LQ>(r, x, stride, negative, T, nq);
+}
+
+/**
+ * callMersenneModMatrix() for a q of LQ words, or callModQMatrix() with
+ * BARRETT set. Coefficients may use every row of the matrix.
+ */
+template<int LQ, bool BARRETT>
+static void host_modq_matrix(bn_matrix_t *g, const int nq){
+	const int N = g->N;
+
+	#pragma omp parallel for schedule(static)
+	for(int tile = 0; tile < N; tile += HOST_BN_MATRIX_TILE){
+		const int T = min_d(HOST_BN_MATRIX_TILE, N - tile);
+		cuyasheint_t negative[HOST_BN_MATRIX_TILE];
+		for(int t = 0; t < T; t++)
+			negative[t] = -(cuyasheint_t)host_matrix_sign(g->d_signs, tile + t);
+		cuyasheint_t r[LQ][HOST_BN_MATRIX_TILE];
+		if(BARRETT){
+			// The cost of Barrett grows with the square of the words, so only
+			// the rows in use on this tile are taken
+			int used = STD_BNT_WORDS_ALLOC;
+			for(; used > LQ; used--){
+				const cuyasheint_t *limb = &g->d_limbs[tile + (used-1)*N];
+				cuyasheint_t any = 0;
+				for(int t = 0; t < T; t++)
+					any |= limb[t];
+				if(any != 0)
+					break;
+			}
+			host_barrett_width<LQ,LQ>::run(used, r, &g->d_limbs[tile], N, negative, T);
+		}else
+			host_mersenne_signed_lanes<STD_BNT_WORDS_ALLOC,LQ>(r, &g->d_limbs[tile], N, negative, T, nq);
+
+		for(int i = 0; i < LQ; i++)
+			memcpy(&g->d_limbs[tile + i*N], r[i], T*sizeof(cuyasheint_t));
+		for(int i = LQ; i < STD_BNT_WORDS_ALLOC; i++)
+			memset(&g->d_limbs[tile + i*N], 0, T*sizeof(cuyasheint_t));
+
+		// Every output is non-negative. A tile owns whole words of the bitmap.
+		for(int w = tile/32; w < BN_MATRIX_SIGN_WORDS(tile + T); w++)
+			g->d_signs[w] = 0;
+	}
+}
+
+/**
+ * callCiphertextMulAuxMatrix() for a M of LM words and a q of LQ words
+ *
+ * round(x/q) = floor(x/q) + (x mod q >= floor(q/2)), both taken from
+ * host_mersenne_lanes() at once. x mod q is below q, so it is at least
+ * floor(q/2) = 2^(nq-1) - 1 iff bit nq-1 of (x mod q) + 1 is set.
+ */
+template<int LM, int LQ>
+static void host_round_matrix(bn_matrix_t *g){
+	const int LIN = BN_FIXED_LIN(LM);
+	const int N = g->N;
+	const int nq = bn_fixed_params.nq;
+
+	#pragma omp parallel for schedule(static)
+	for(int tile = 0; tile < N; tile += HOST_BN_MATRIX_TILE){
+		// The sign is kept, so the magnitude is rounded
+		const int T = min_d(HOST_BN_MATRIX_TILE, N - tile);
+		cuyasheint_t r[LQ][HOST_BN_MATRIX_TILE];
+		cuyasheint_t quot[LIN][HOST_BN_MATRIX_TILE];
+		host_mersenne_lanes<LIN,LQ>(r, quot, &g->d_limbs[tile], N, T, nq);
+
+		cuyasheint_t carry[HOST_BN_MATRIX_TILE];
+		for(int t = 0; t < T; t++)
+			carry[t] = 1;
+		for(int i = 0; i < LQ; i++)
+			#pragma omp simd
+			for(int t = 0; t < T; t++){
+				r[i][t] += carry[t];
+				carry[t] = (r[i][t] < carry[t]);
+			}
+		const int bw = (nq - 1) / WORD;
+		const int bb = (nq - 1) % WORD;
+		#pragma omp simd
+		for(int t = 0; t < T; t++)
+			carry[t] = (r[bw][t] >> bb) & 1;
+
+		for(int i = 0; i < LIN; i++){
+			cuyasheint_t *row = &g->d_limbs[tile + i*N];
+			#pragma omp simd
+			for(int t = 0; t < T; t++){
+				row[t] = quot[i][t] + carry[t];
+				carry[t] = (row[t] < carry[t]);
+			}
+		}
+		for(int i = LIN; i < STD_BNT_WORDS_ALLOC; i++)
+			memset(&g->d_limbs[tile + i*N], 0, T*sizeof(cuyasheint_t));
+	}
+}
+
+/**
+ * callCiphertextMulAuxMatrix() for a M of LM words and any q of LQ words, by
+ * Barrett
+ */
+template<int LM, int LQ>
+static void host_barrett_round_matrix(bn_matrix_t *g){
+	const int LIN = BN_FIXED_LIN(LM);
+	const int N = g->N;
+	bn_fixed<LQ> q;
+	bn_fixed<LQ> qDiv2;
+	bn_fixed<LIN> mu;
+	for(int i = 0; i < LQ; i++){
+		q.dp[i] = bn_fixed_params.q[i];
+		qDiv2.dp[i] = bn_fixed_params.qDiv2[i];
+	}
+	bn_fixed_qmu<LIN>(mu, bn_fixed_params.qmu);
+
+	#pragma omp parallel for schedule(static)
+	for(int tile = 0; tile < N; tile += HOST_BN_MATRIX_TILE){
+		// The sign is kept, so the magnitude is rounded
+		const int T = min_d(HOST_BN_MATRIX_TILE, N - tile);
+		for(int t = 0; t < T; t++){
+			bn_fixed<LIN> x;
+			BN_FIXED_UNROLL
+			for(int i = 0; i < LIN; i++)
+				x.dp[i] = g->d_limbs[tile + t + i*N];
+			bn_fixed<LIN> quot;
+			bn_fixed_barrett_round<LIN,LQ>(quot, x, q, mu, qDiv2);
+			BN_FIXED_UNROLL
+			for(int i = 0; i < LIN; i++)
+				g->d_limbs[tile + t + i*N] = quot.dp[i];
+		}
+		for(int i = LIN; i < STD_BNT_WORDS_ALLOC; i++)
+			memset(&g->d_limbs[tile + i*N], 0, T*sizeof(cuyasheint_t));
+	}
+}
+
+/**
+ * callPolynomialReduceFused() for a M of LM words and a q of LQ words
+ *
+ * Each tile carries the coefficients i and i+fold, for T consecutive i, from
+ * the residues to the residues of (x[i] - x[i+fold]) mod q, so the
+ * coefficients never leave the stack.
+ *
+ * The difference is taken on the residues. Its magnitude is below M/2, so the
+ * balanced ICRT recovers it with its sign and there is no borrow to fix.
+ */
+template<int LM, int LQ, bool BARRETT>
+static void host_reduce_fused(cuyasheint_t *d_polyCRT, const int fold, const int N, const int NPolis){
+	const int nq = bn_fixed_params.nq;
+	bn_fixed<LM> m;
+	bn_fixed<LM+1> mu;
+	for(int i = 0; i < LM; i++)
+		m.dp[i] = host_crt->M[i];
+	for(int i = 0; i <= LM; i++)
+		mu.dp[i] = bn_fixed_params.mu[i];
+
+	// Without fold every coefficient is a tile lane on its own
+	const int block = (fold? 2*fold : N);
+	const int n = (fold? fold : N);
+	const int tiles = (n + HOST_BN_MATRIX_TILE - 1) / HOST_BN_MATRIX_TILE;
+	assert(N % block == 0);
+
+	#pragma omp parallel for schedule(static)
+	for(int job = 0; job < (N / block) * tiles; job++){
+		const int tile = (job / tiles) * block + (job % tiles) * HOST_BN_MATRIX_TILE;
+		const int T = min_d(HOST_BN_MATRIX_TILE, (job / tiles) * block + n - tile);
+
+		// x[i+fold] is folded into x[i]
+		if(fold)
+			for(int rid = 0; rid < NPolis; rid++){
+				cuyasheint_t *x = &d_polyCRT[tile + rid*N];
+				cuyasheint_t *y = &d_polyCRT[tile + fold + rid*N];
+				const uint64_t p = host_crt->moduli[rid].p;
+				#pragma omp simd
+				for(int t = 0; t < T; t++){
+					x[t] = host_submod(x[t], y[t], p);
+					y[t] = 0;
+				}
+			}
+
+		cuyasheint_t x[LM][HOST_BN_MATRIX_TILE];
+		cuyasheint_t negative[HOST_BN_MATRIX_TILE];
+		host_icrt_tile<LM>(x, negative, &d_polyCRT[tile], N, NPolis, T, m, mu);
+
+		cuyasheint_t r[LQ][HOST_BN_MATRIX_TILE];
+		host_modq_signed_lanes<LM,LQ,BARRETT>(r, &x[0][0], HOST_BN_MATRIX_TILE, negative, T, nq);
+		host_crt_tile<LQ>(&d_polyCRT[tile], N, NPolis, r, T);
+	}
+}
+
+/////////////////////////////////////////////////
+// Instances, from the widest down to one word //
+/////////////////////////////////////////////////
+template<int LM>
+struct host_icrt_instance{
+	static host_icrt_fn get(int lm){
+		return (lm == LM? host_icrt_matrix<LM> : host_icrt_instance<LM-1>::get(lm));
+	}
+};
+template<>
+struct host_icrt_instance<0>{
+	static host_icrt_fn get(int lm){ return NULL; }
+};
+
+template<int LQ, bool BARRETT>
+struct host_modq_instance{
+	static host_mersenne_fn get(int lq){
+		return (lq == LQ? host_modq_matrix<LQ,BARRETT> : host_modq_instance<LQ-1,BARRETT>::get(lq));
+	}
+};
+template<bool BARRETT>
+struct host_modq_instance<0,BARRETT>{
+	static host_mersenne_fn get(int lq){ return NULL; }
+};
+
+template<int LM, int LQ, bool BARRETT>
+struct host_round_instance{
+	static host_round_fn get(int lm, int lq){
+		if(lm != LM)
+			return host_round_instance<LM-1,LQ,BARRETT>::get(lm, lq);
+		if(lq != LQ)
+			return host_round_instance<LM,LQ-1,BARRETT>::get(lm, lq);
+		return (BARRETT? host_barrett_round_matrix<LM,LQ> : host_round_matrix<LM,LQ>);
+	}
+};
+template<int LQ, bool BARRETT>
+struct host_round_instance<0,LQ,BARRETT>{
+	static host_round_fn get(int lm, int lq){ return NULL; }
+};
+template<int LM, bool BARRETT>
+struct host_round_instance<LM,0,BARRETT>{
+	static host_round_fn get(int lm, int lq){ return NULL; }
+};
+
+template<int LM, int LQ, bool BARRETT>
+struct host_reduce_instance{
+	static host_reduce_fn get(int lm, int lq){
+		if(lm != LM)
+			return host_reduce_instance<LM-1,LQ,BARRETT>::get(lm, lq);
+		return (lq == LQ? host_reduce_fused<LM,LQ,BARRETT> : host_reduce_instance<LM,LQ-1,BARRETT>::get(lm, lq));
+	}
+};
+template<int LQ, bool BARRETT>
+struct host_reduce_instance<0,LQ,BARRETT>{
+	static host_reduce_fn get(int lm, int lq){ return NULL; }
+};
+template<int LM, bool BARRETT>
+struct host_reduce_instance<LM,0,BARRETT>{
+	static host_reduce_fn get(int lm, int lq){ return NULL; }
+};
+
+__host__ void bn_fixed_write_params(){
+	host_fixed.icrt = host_icrt_instance<STD_BNT_WORDS_ALLOC>::get(bn_fixed_params.LM);
+	host_fixed.mersenne = host_modq_instance<BN_FIXED_MAX_Q_WORDS,false>::get(bn_fixed_params.LQ);
+	if(bn_fixed_params.mersenne){
+		host_fixed.modq = host_fixed.mersenne;
+		host_fixed.round = host_round_instance<STD_BNT_WORDS_ALLOC,BN_FIXED_MAX_Q_WORDS,false>::get(bn_fixed_params.LM, bn_fixed_params.LQ);
+		host_fixed.reduce = host_reduce_instance<STD_BNT_WORDS_ALLOC,BN_FIXED_MAX_Q_WORDS,false>::get(bn_fixed_params.LM, bn_fixed_params.LQ);
+	}else{
+		host_fixed.modq = host_modq_instance<BN_FIXED_MAX_Q_WORDS,true>::get(bn_fixed_params.LQ);
+		host_fixed.round = host_round_instance<STD_BNT_WORDS_ALLOC,BN_FIXED_MAX_Q_WORDS,true>::get(bn_fixed_params.LM, bn_fixed_params.LQ);
+		host_fixed.reduce = host_reduce_instance<STD_BNT_WORDS_ALLOC,BN_FIXED_MAX_Q_WORDS,true>::get(bn_fixed_params.LM, bn_fixed_params.LQ);
+	}
+	assert(host_fixed.icrt && host_fixed.mersenne && host_fixed.modq && host_fixed.round && host_fixed.reduce);
+}
+
+///////////////
+// Launchers //
+///////////////
+
+/**
+ * callICRT() over a limb matrix
+ *
+ * Mpi*x is accumulated word by word for a whole tile. Only the final
+ * reduction by M is done per coefficient.
+ * @param a         output: a->N coefficients
+ * @param d_polyCRT input: a->N*NPolis residues
+ * @param NPolis    input: qty of primes
+ */
+void callICRTMatrix(bn_matrix_t *a, cuyasheint_t *d_polyCRT, const int NPolis, cudaStream_t stream){
+	if(a->N <= 0)
+		return;
+	if(host_fixed.icrt == NULL)
+		throw "callICRTMatrix: bn_fixed_setup() was not called";
+	host_fixed.icrt(a, d_polyCRT, NPolis);
+}
+
+/**
+ * callMersenneMod() over a limb matrix. The output is on [0,q).
+ * @param g      input/output
+ * @param nq     q = 2^nq - 1
+ * @param stream [description]
+ */
+__host__ void callMersenneModMatrix(bn_matrix_t *g, int nq, cudaStream_t stream){
+	host_mersenne_fn f = host_fixed.mersenne;
+	if(nq != bn_fixed_params.nq)
+		f = host_modq_instance<BN_FIXED_MAX_Q_WORDS,false>::get((nq + WORD - 1) / WORD);
+	if(f == NULL)
+		throw "callMersenneModMatrix: unsupported q";
+	f(g, nq);
+}
+
+/**
+ * Reduces a limb matrix by the q given to bn_fixed_setup(), whatever its
+ * shape. The output is on [0,q).
+ * @param g      input/output
+ * @param stream [description]
+ */
+__host__ void callModQMatrix(bn_matrix_t *g, cudaStream_t stream){
+	if(host_fixed.modq == NULL)
+		throw "callModQMatrix: bn_fixed_setup() was not called";
+	host_fixed.modq(g, bn_fixed_params.nq);
+}
+
+/**
+ * callCiphertextMulAux() over a limb matrix: every coefficient is replaced by
+ * round(g/q). Coefficients must be below M in absolute value.
+ * @param g      input/output
+ * @param nq     bits of the q given to bn_fixed_setup()
+ * @param stream [description]
+ */
+__host__ void callCiphertextMulAuxMatrix(bn_matrix_t *g, int nq, cudaStream_t stream){
+	assert(nq == bn_fixed_params.nq);
+	if(host_fixed.round == NULL)
+		throw "callCiphertextMulAuxMatrix: bn_fixed_setup() was not called";
+	host_fixed.round(g);
+}
+
+/**
+ * Each pair is reduced on the stack: the ICRT of a tile feeds the fold, the
+ * reduction by q and the CRT of the same tile.
+ */
+void callPolynomialReduceFused(cuyasheint_t *d_polyCRT, const int fold, const int N, const int NPolis, const int nq, cudaStream_t stream){
+	assert(nq == bn_fixed_params.nq);
+	if(N <= 0)
+		return;
+	if(host_fixed.reduce == NULL)
+		throw "callPolynomialReduceFused: bn_fixed_setup() was not called";
+	host_fixed.reduce(d_polyCRT, fold, N, NPolis);
+}
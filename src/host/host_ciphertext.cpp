@@ -0,0 +1,173 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host implementation of the launchers from cuda/cuda_ciphertext.cu.
+ *
+ * mersenneMod() and mersenneModDiv() are shared with the GPU.
+ */
+#include "../cuda/cuda_ciphertext.h"
+#include "host_arithmetic.h"
+
+extern void mersenneMod(bn_t *x, bn_t *q, int q_bits);
+extern void mersenneModDiv(bn_t *quot, bn_t *rem, bn_t *q, int q_bits);
+
+/**
+ * callCuWordecomp() for W = 2^WORDLENGTH, or for W = 2^w if WORDLENGTH == 0
+ */
+template<int WORDLENGTH>
+static void host_wordecomp(bn_t *d_P, bn_t *a, const int w, const int lwq, const int N){
+	#pragma omp parallel for collapse(2) schedule(static)
+	for(int did = 0; did < lwq; did++)
+		for(int cid = 0; cid < N; cid++){
+			bn_t *p = &d_P[cid + did*N];
+			bn_zero(p);
+			p->dp[0] = wordecomp_digit<WORDLENGTH>(a[cid].dp, 1, a[cid].alloc, w, did);
+			p->used = 1;
+		}
+}
+
+/**
+ * Computes WordDecomp for W = 2^WORDLENGTH
+ *
+ * This method receives lwq arrays of coefficients concatenated and decomposes
+ * each coefficient of a. Each coefficient of arrays in P stores a fraction of
+ * the related coefficient in a.
+ *
+ * @param WORDLENGTH log_2 W, on [1,64]
+ * @param P   A vector with N*(log_wq) elements
+ * @param a   [description]
+ * @param lwq [description]
+ */
+void callCuWordecomp(	cudaStream_t stream,
+						int WORDLENGTH,
+						bn_t *d_P,
+						bn_t *a,
+						int lwq,
+						int N ){
+	switch(WORDLENGTH){
+	case 16:
+		host_wordecomp<16>(d_P, a, WORDLENGTH, lwq, N);
+		break;
+	case 32:
+		host_wordecomp<32>(d_P, a, WORDLENGTH, lwq, N);
+		break;
+	case 64:
+		host_wordecomp<64>(d_P, a, WORDLENGTH, lwq, N);
+		break;
+	default:
+		if(WORDLENGTH < 1 || WORDLENGTH > 64)
+			throw "Unknown WORDLENGTH";
+		host_wordecomp<0>(d_P, a, WORDLENGTH, lwq, N);
+	}
+}
+
+/**
+ * Computes g/q and g%q and set "output" according the result
+ * This function works inplace.
+ * @param g      [description]
+ * @param q      [description]
+ * @param nq     [description]
+ * @param N      [description]
+ * @param stream [description]
+ */
+__host__ void callCiphertextMulAux(bn_t *g, bn_t q, int nq,int N, cudaStream_t stream){
+	bn_t qDiv2 = Yashe::qDiv2;
+
+	#pragma omp parallel for schedule(static)
+	for(int cid = 0; cid < N; cid++){
+		bn_t *coef = &g[cid];
+
+		bn_t coef_copy;
+		cuyasheint_t dp[STD_BNT_WORDS_ALLOC];
+		coef_copy.alloc = coef->alloc;
+		coef_copy.used = coef->used;
+		coef_copy.sign = coef->sign;
+		coef_copy.dp = dp;
+		bn_copy(&coef_copy, coef);
+
+		mersenneModDiv(coef, &coef_copy, &q, nq);
+
+		// Checks if g%q >= q/2.
+		if(bn_cmp_abs(&coef_copy,&qDiv2) != CMP_LT)
+			// If it is, add one.
+			bn_add1_low(coef->dp, coef->dp, 1, coef->used);
+	}
+}
+
+__host__ void callMersenneMod(bn_t *g, bn_t q,int nq, int N, cudaStream_t stream){
+	#pragma omp parallel for schedule(static)
+	for(int cid = 0; cid < N; cid++)
+		mersenneMod(&g[cid],&q,nq);
+}
+
+/**
+ * callCuWordecompMatrix() for W = 2^WORDLENGTH, or for W = 2^w if
+ * WORDLENGTH == 0
+ */
+template<int WORDLENGTH>
+static void host_wordecomp_matrix(cuyasheint_t *d_polyCRT, const bn_matrix_t *a, const int w, const int digit, const int NPolis){
+	const int N = a->N;
+
+	#pragma omp parallel for schedule(static)
+	for(int rid = 0; rid < NPolis; rid++){
+		const cuyasheint_t p = CRTPrimes[rid];
+		cuyasheint_t *residues = &d_polyCRT[rid*N];
+		for(int cid = 0; cid < N; cid++){
+			const cuyasheint_t d = wordecomp_digit<WORDLENGTH>(&a->d_limbs[cid], N, STD_BNT_WORDS_ALLOC, w, digit);
+			residues[cid] = (d < p? d : d % p);
+		}
+	}
+}
+
+/**
+ * Computes the digit-th word of WordDecomp for W = 2^WORDLENGTH straight
+ * into the CRT residues of a polynomial. a must be non-negative.
+ *
+ * Each digit has a single word, so its residues are obtained without a call
+ * to callCRT(). 16, 32 and 64 bits words have their own instances; any other
+ * length on [1,64] takes the generic one.
+ * @param stream     [description]
+ * @param WORDLENGTH input: log_2 W
+ * @param d_polyCRT  output: N*NPolis residues
+ * @param a          input
+ * @param digit      input
+ * @param NPolis     input: qty of primes
+ */
+void callCuWordecompMatrix( cudaStream_t stream,
+							int WORDLENGTH,
+							cuyasheint_t *d_polyCRT,
+							bn_matrix_t *a,
+							int digit,
+							int NPolis){
+	switch(WORDLENGTH){
+	case 16:
+		host_wordecomp_matrix<16>(d_polyCRT, a, WORDLENGTH, digit, NPolis);
+		break;
+	case 32:
+		host_wordecomp_matrix<32>(d_polyCRT, a, WORDLENGTH, digit, NPolis);
+		break;
+	case 64:
+		host_wordecomp_matrix<64>(d_polyCRT, a, WORDLENGTH, digit, NPolis);
+		break;
+	default:
+		if(WORDLENGTH < 1 || WORDLENGTH > 64)
+			throw "Unknown WORDLENGTH";
+		host_wordecomp_matrix<0>(d_polyCRT, a, WORDLENGTH, digit, NPolis);
+	}
+}
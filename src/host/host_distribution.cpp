@@ -0,0 +1,114 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host implementation of cuda/cuda_distribution.cu.
+ *
+ * Samples are drawn sequentially from a single std::mt19937_64, so the output
+ * doesn't depend on the number of threads.
+ */
+#include <cmath>
+#include <cstdlib>
+#include "../distribution/distribution.h"
+
+__host__ void Distribution::call_setup_kernel(){
+	gen.seed(seed);
+}
+
+__host__ void Distribution::set_seed(unsigned long long seed){
+	this->seed = seed;
+	call_setup_kernel();
+}
+
+__host__  void Distribution::callCuGetUniformSample(	bn_t *coefs,
+														int N,
+														int NPrimes,
+														int mod ){
+	assert(N <= MAX_DEGREE);
+	std::uniform_real_distribution<float> uniform(0.0,1.0);
+
+	for(int tid = 0; tid < N; tid++){
+		// This is not a "narrow" distribution, as defined in [Bos et al. 2013],
+		// [-1,0,1], but a binary distribution.
+		int value = llrintf(uniform(gen));
+		// This is our guarantee that the polynomial will assume the desired degree
+		value += (tid == N-1 && value == 0);
+		bn_zero(&coefs[tid]);
+		coefs[tid].dp[0] = value;
+		coefs[tid].used = 1;
+	}
+}
+
+__host__  void Distribution::callCuGetNarrowSample(	bn_t *coefs,
+														int N,
+														int NPrimes){
+	assert(N <= MAX_DEGREE);
+	std::uniform_int_distribution<int> narrow(-1,1);
+
+	for(int tid = 0; tid < N; tid++){
+		// The "narrow" distribution of [Bos et al. 2013], [-1,0,1]
+		int value = narrow(gen);
+		// This is our guarantee that the polynomial will assume the desired degree
+		value += (tid == N-1 && value == 0);
+		bn_zero(&coefs[tid]);
+		coefs[tid].dp[0] = abs(value);
+		coefs[tid].used = 1;
+		coefs[tid].sign = (value < 0? BN_NEG : BN_POS);
+	}
+}
+
+/**
+ * callCuGetNormalSample() for K polynomials of CUDAFunctions::N coefficients,
+ * the k-th one at coefs[k*CUDAFunctions::N]. Coefficients from N on are zero.
+ */
+__host__ void Distribution::callCuGetNormalSampleBatch(	bn_t *coefs,
+														int N,
+														int K,
+														float mean,
+														float stddev){
+	const int spacing = CUDAFunctions::N;
+	assert(N <= spacing);
+	std::normal_distribution<float> normal(0.0,1.0);
+
+	for(int k = 0; k < K; k++)
+		for(int tid = 0; tid < spacing; tid++){
+			const int value = (tid < N? llrintf(normal(gen)*stddev + mean) : 0);
+			bn_t *x = &coefs[tid + k*spacing];
+			bn_zero(x);
+			x->dp[0] = abs(value);
+			x->used = 1;
+			x->sign = (value < 0? BN_NEG : BN_POS);
+		}
+}
+
+__host__ void Distribution::callCuGetNormalSample(	bn_t *coefs,
+													int N,
+													float mean,
+													float stddev,
+													int NPrimes){
+	assert(N <= MAX_DEGREE);
+	std::normal_distribution<float> normal(0.0,1.0);
+
+	for(int tid = 0; tid < N; tid++){
+		int value = llrintf(normal(gen)*stddev + mean);
+		bn_zero(&coefs[tid]);
+		coefs[tid].dp[0] = abs(value);
+		coefs[tid].used = 1;
+		coefs[tid].sign = (value < 0? BN_NEG : BN_POS);
+	}
+}
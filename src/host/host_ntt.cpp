@@ -0,0 +1,399 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * NTT over word-size primes for the host backend.
+ *
+ * Butterflies follow D. Harvey, "Faster arithmetic for number-theoretic
+ * transforms" (2014): twiddles are multiplied through their precomputed Shoup
+ * quotients and reductions are postponed, so each butterfly costs two
+ * multiplications and a single conditional subtraction.
+ *
+ * Blocks with at least HOST_NTT_LANES butterflies are vectorized with
+ * AVX-512 or AVX2, according to the instruction set the library was compiled
+ * for. Neither has a 64x64->128 bits multiplication, so its high word is
+ * assembled from 32 bits products. The remaining stages run on the scalar
+ * path.
+ */
+#include <cassert>
+#include <cstdlib>
+#include "host_ntt.h"
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+#include <immintrin.h>
+#define HOST_NTT_LANES 8
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define HOST_NTT_LANES 4
+#else
+#define HOST_NTT_LANES 1
+#endif
+
+/**
+ * Reverses the lowest "bits" bits of x
+ */
+static int bit_reverse(int x, int bits){
+  int r = 0;
+  for(int i = 0; i < bits; i++, x >>= 1)
+    r = (r << 1) | (x & 1);
+  return r;
+}
+
+/**
+ * Builds the twiddle tables of a cyclic or negacyclic NTT
+ * @param root a primitive N-th (cyclic) or 2N-th (negacyclic) root of unity
+ */
+static void table_init(host_ntt_table_t *t, uint64_t p, uint64_t root, int N, bool negacyclic){
+  assert(p < (((uint64_t)1) << 62));
+  assert(N > 1 && (N & (N - 1)) == 0);
+
+  t->N = N;
+  host_modulus_init(&t->mod,p);
+
+  // The order of root is a power of 2, so its half power must be -1
+  const int order = (negacyclic? 2*N : N);
+  assert((p - 1) % order == 0);
+  assert(host_powmod(root,order/2,&t->mod) == p - 1);
+  const uint64_t rootInv = host_powmod(root,p - 2,&t->mod);
+
+  t->W = (uint64_t*)malloc(N*sizeof(uint64_t));
+  t->WShoup = (uint64_t*)malloc(N*sizeof(uint64_t));
+  t->WInv = (uint64_t*)malloc(N*sizeof(uint64_t));
+  t->WInvShoup = (uint64_t*)malloc(N*sizeof(uint64_t));
+  uint64_t *powers = (uint64_t*)malloc(N*sizeof(uint64_t));
+  uint64_t *powersInv = (uint64_t*)malloc(N*sizeof(uint64_t));
+  assert(t->W && t->WShoup && t->WInv && t->WInvShoup && powers && powersInv);
+
+  powers[0] = powersInv[0] = 1;
+  for(int i = 1; i < N; i++){
+    powers[i] = host_mulmod(powers[i-1],root,&t->mod);
+    powersInv[i] = host_mulmod(powersInv[i-1],rootInv,&t->mod);
+  }
+
+  int logN = 0;
+  while((1 << logN) < N)
+    logN++;
+
+  // Cyclic: block i of the stage with m blocks splits x^{2t} - w^{2ti'}
+  // with w^{ti'}, where t = N/(2m) and i' is the bit-reversal of i.
+  // Negacyclic: the first split of x^N + 1 uses psi^{N/2}, so the twist by
+  // psi is folded into every twiddle and block i uses psi^{(m+i)'}.
+  t->W[0] = t->WInv[0] = 1;
+  for(int m = 1, logm = 0; m < N; m <<= 1, logm++)
+    for(int i = 0; i < m; i++){
+      const int e = (negacyclic?
+                      bit_reverse(m + i,logN) :
+                      bit_reverse(i,logm)*(N/(2*m)));
+      t->W[m + i] = powers[e];
+      t->WInv[m + i] = powersInv[e];
+    }
+  for(int i = 0; i < N; i++){
+    t->WShoup[i] = host_shoup(t->W[i],p);
+    t->WInvShoup[i] = host_shoup(t->WInv[i],p);
+  }
+
+  t->NInv = host_powmod(N,p - 2,&t->mod);
+  t->NInvShoup = host_shoup(t->NInv,p);
+
+  free(powers);
+  free(powersInv);
+}
+
+void host_ntt_table_init(host_ntt_table_t *t, uint64_t p, uint64_t w, int N){
+  table_init(t,p,w,N,false);
+}
+
+void host_ntt_negacyclic_table_init(host_ntt_table_t *t, uint64_t p, uint64_t psi, int N){
+  table_init(t,p,psi,N,true);
+}
+
+void host_ntt_table_free(host_ntt_table_t *t){
+  free(t->W);
+  free(t->WShoup);
+  free(t->WInv);
+  free(t->WInvShoup);
+  t->W = t->WShoup = t->WInv = t->WInvShoup = NULL;
+  t->N = 0;
+}
+
+////////////
+// Scalar //
+////////////
+
+/**
+ * t lazy Cooley-Tukey butterflies (x, y) -> (x + wy, x - wy).
+ * Inputs and outputs lie in [0,4p).
+ */
+static inline void ct_block_scalar(uint64_t *x, uint64_t *y, int t, uint64_t W, uint64_t WShoup, uint64_t p){
+  const uint64_t twop = 2*p;
+  for(int j = 0; j < t; j++){
+    uint64_t X = x[j];
+    X -= (X >= twop)*twop;
+    const uint64_t T = host_mulmod_shoup_lazy(y[j],W,WShoup,p);
+    x[j] = X + T;
+    y[j] = X - T + twop;
+  }
+}
+
+/**
+ * t lazy Gentleman-Sande butterflies (x, y) -> (x + y, (x - y)w).
+ * Inputs and outputs lie in [0,2p).
+ */
+static inline void gs_block_scalar(uint64_t *x, uint64_t *y, int t, uint64_t W, uint64_t WShoup, uint64_t p){
+  const uint64_t twop = 2*p;
+  for(int j = 0; j < t; j++){
+    const uint64_t X = x[j];
+    const uint64_t Y = y[j];
+    uint64_t S = X + Y;
+    S -= (S >= twop)*twop;
+    y[j] = host_mulmod_shoup_lazy(X - Y + twop,W,WShoup,p);
+    x[j] = S;
+  }
+}
+
+/////////////
+// AVX-512 //
+/////////////
+#if HOST_NTT_LANES == 8
+
+/**
+ * The unmasked _mm512_srli_epi64, _mm512_mul_epu32 and _mm512_min_epu64 pass
+ * an undefined vector as the merge source, which GCC flags as used
+ * uninitialized. Their zero-masked forms, with every lane on, are the same
+ * instructions.
+ */
+#define ALL_LANES ((__mmask8)0xff)
+
+static inline __m512i srli32_epi64(__m512i a){
+  return _mm512_maskz_srli_epi64(ALL_LANES,a,32);
+}
+
+static inline __m512i mul_epu32(__m512i a, __m512i b){
+  return _mm512_maskz_mul_epu32(ALL_LANES,a,b);
+}
+
+static inline __m512i min_epu64(__m512i a, __m512i b){
+  return _mm512_maskz_min_epu64(ALL_LANES,a,b);
+}
+
+/**
+ * High word of the 64x64 bits product of each lane
+ */
+static inline __m512i mulhi_epu64(__m512i a, __m512i b){
+  const __m512i lo32 = _mm512_set1_epi64(0xffffffff);
+  const __m512i a_hi = srli32_epi64(a);
+  const __m512i b_hi = srli32_epi64(b);
+
+  const __m512i lolo = mul_epu32(a,b);
+  const __m512i lohi = mul_epu32(a,b_hi);
+  const __m512i hilo = mul_epu32(a_hi,b);
+  const __m512i hihi = mul_epu32(a_hi,b_hi);
+
+  const __m512i cross = _mm512_add_epi64(
+    _mm512_add_epi64(srli32_epi64(lolo),_mm512_and_si512(lohi,lo32)),
+    _mm512_and_si512(hilo,lo32));
+  return _mm512_add_epi64(
+    _mm512_add_epi64(hihi,srli32_epi64(lohi)),
+    _mm512_add_epi64(srli32_epi64(hilo),srli32_epi64(cross)));
+}
+
+static inline void ct_block(uint64_t *x, uint64_t *y, int t, uint64_t W, uint64_t WShoup, uint64_t p){
+  const __m512i vp = _mm512_set1_epi64(p);
+  const __m512i v2p = _mm512_set1_epi64(2*p);
+  const __m512i vW = _mm512_set1_epi64(W);
+  const __m512i vWShoup = _mm512_set1_epi64(WShoup);
+
+  for(int j = 0; j < t; j += HOST_NTT_LANES){
+    __m512i X = _mm512_loadu_si512((const void*)(x + j));
+    const __m512i Y = _mm512_loadu_si512((const void*)(y + j));
+
+    // If X >= 2p, X - 2p doesn't wrap and is the smallest one
+    X = min_epu64(X,_mm512_sub_epi64(X,v2p));
+    const __m512i Q = mulhi_epu64(Y,vWShoup);
+    const __m512i T = _mm512_sub_epi64(_mm512_mullo_epi64(Y,vW),_mm512_mullo_epi64(Q,vp));
+
+    _mm512_storeu_si512((void*)(x + j),_mm512_add_epi64(X,T));
+    _mm512_storeu_si512((void*)(y + j),_mm512_add_epi64(_mm512_sub_epi64(X,T),v2p));
+  }
+}
+
+static inline void gs_block(uint64_t *x, uint64_t *y, int t, uint64_t W, uint64_t WShoup, uint64_t p){
+  const __m512i vp = _mm512_set1_epi64(p);
+  const __m512i v2p = _mm512_set1_epi64(2*p);
+  const __m512i vW = _mm512_set1_epi64(W);
+  const __m512i vWShoup = _mm512_set1_epi64(WShoup);
+
+  for(int j = 0; j < t; j += HOST_NTT_LANES){
+    const __m512i X = _mm512_loadu_si512((const void*)(x + j));
+    const __m512i Y = _mm512_loadu_si512((const void*)(y + j));
+
+    __m512i S = _mm512_add_epi64(X,Y);
+    S = min_epu64(S,_mm512_sub_epi64(S,v2p));
+    const __m512i D = _mm512_add_epi64(_mm512_sub_epi64(X,Y),v2p);
+    const __m512i Q = mulhi_epu64(D,vWShoup);
+
+    _mm512_storeu_si512((void*)(x + j),S);
+    _mm512_storeu_si512((void*)(y + j),
+      _mm512_sub_epi64(_mm512_mullo_epi64(D,vW),_mm512_mullo_epi64(Q,vp)));
+  }
+}
+
+//////////
+// AVX2 //
+//////////
+#elif HOST_NTT_LANES == 4
+
+/**
+ * High word of the 64x64 bits product of each lane
+ */
+static inline __m256i mulhi_epu64(__m256i a, __m256i b){
+  const __m256i lo32 = _mm256_set1_epi64x(0xffffffff);
+  const __m256i a_hi = _mm256_srli_epi64(a,32);
+  const __m256i b_hi = _mm256_srli_epi64(b,32);
+
+  const __m256i lolo = _mm256_mul_epu32(a,b);
+  const __m256i lohi = _mm256_mul_epu32(a,b_hi);
+  const __m256i hilo = _mm256_mul_epu32(a_hi,b);
+  const __m256i hihi = _mm256_mul_epu32(a_hi,b_hi);
+
+  const __m256i cross = _mm256_add_epi64(
+    _mm256_add_epi64(_mm256_srli_epi64(lolo,32),_mm256_and_si256(lohi,lo32)),
+    _mm256_and_si256(hilo,lo32));
+  return _mm256_add_epi64(
+    _mm256_add_epi64(hihi,_mm256_srli_epi64(lohi,32)),
+    _mm256_add_epi64(_mm256_srli_epi64(hilo,32),_mm256_srli_epi64(cross,32)));
+}
+
+/**
+ * Low word of the 64x64 bits product of each lane
+ */
+static inline __m256i mullo_epu64(__m256i a, __m256i b){
+  const __m256i cross = _mm256_add_epi64(
+    _mm256_mul_epu32(a,_mm256_srli_epi64(b,32)),
+    _mm256_mul_epu32(_mm256_srli_epi64(a,32),b));
+  return _mm256_add_epi64(_mm256_mul_epu32(a,b),_mm256_slli_epi64(cross,32));
+}
+
+/**
+ * Subtracts m from each lane of x that is greater than or equal to m.
+ * AVX2 only compares signed integers, so both sides are shifted by 2^63.
+ */
+static inline __m256i sub_if_geq(__m256i x, __m256i m){
+  const __m256i sign = _mm256_set1_epi64x(0x8000000000000000ULL);
+  const __m256i lt = _mm256_cmpgt_epi64(_mm256_xor_si256(m,sign),_mm256_xor_si256(x,sign));
+  return _mm256_sub_epi64(x,_mm256_andnot_si256(lt,m));
+}
+
+static inline void ct_block(uint64_t *x, uint64_t *y, int t, uint64_t W, uint64_t WShoup, uint64_t p){
+  const __m256i vp = _mm256_set1_epi64x(p);
+  const __m256i v2p = _mm256_set1_epi64x(2*p);
+  const __m256i vW = _mm256_set1_epi64x(W);
+  const __m256i vWShoup = _mm256_set1_epi64x(WShoup);
+
+  for(int j = 0; j < t; j += HOST_NTT_LANES){
+    __m256i X = _mm256_loadu_si256((const __m256i*)(x + j));
+    const __m256i Y = _mm256_loadu_si256((const __m256i*)(y + j));
+
+    X = sub_if_geq(X,v2p);
+    const __m256i Q = mulhi_epu64(Y,vWShoup);
+    const __m256i T = _mm256_sub_epi64(mullo_epu64(Y,vW),mullo_epu64(Q,vp));
+
+    _mm256_storeu_si256((__m256i*)(x + j),_mm256_add_epi64(X,T));
+    _mm256_storeu_si256((__m256i*)(y + j),_mm256_add_epi64(_mm256_sub_epi64(X,T),v2p));
+  }
+}
+
+static inline void gs_block(uint64_t *x, uint64_t *y, int t, uint64_t W, uint64_t WShoup, uint64_t p){
+  const __m256i vp = _mm256_set1_epi64x(p);
+  const __m256i v2p = _mm256_set1_epi64x(2*p);
+  const __m256i vW = _mm256_set1_epi64x(W);
+  const __m256i vWShoup = _mm256_set1_epi64x(WShoup);
+
+  for(int j = 0; j < t; j += HOST_NTT_LANES){
+    const __m256i X = _mm256_loadu_si256((const __m256i*)(x + j));
+    const __m256i Y = _mm256_loadu_si256((const __m256i*)(y + j));
+
+    const __m256i S = sub_if_geq(_mm256_add_epi64(X,Y),v2p);
+    const __m256i D = _mm256_add_epi64(_mm256_sub_epi64(X,Y),v2p);
+    const __m256i Q = mulhi_epu64(D,vWShoup);
+
+    _mm256_storeu_si256((__m256i*)(x + j),S);
+    _mm256_storeu_si256((__m256i*)(y + j),
+      _mm256_sub_epi64(mullo_epu64(D,vW),mullo_epu64(Q,vp)));
+  }
+}
+
+#else
+
+static inline void ct_block(uint64_t *x, uint64_t *y, int t, uint64_t W, uint64_t WShoup, uint64_t p){
+  ct_block_scalar(x,y,t,W,WShoup,p);
+}
+
+static inline void gs_block(uint64_t *x, uint64_t *y, int t, uint64_t W, uint64_t WShoup, uint64_t p){
+  gs_block_scalar(x,y,t,W,WShoup,p);
+}
+
+#endif
+
+//////////////////
+// Transforms //
+//////////////////
+
+void host_ntt_forward(uint64_t *a, const host_ntt_table_t *t){
+  const int N = t->N;
+  const uint64_t p = t->mod.p;
+  const uint64_t twop = 2*p;
+
+  for(int m = 1, half = N/2; m < N; m <<= 1, half >>= 1)
+    for(int i = 0; i < m; i++){
+      uint64_t *x = a + 2*i*half;
+      if(half >= HOST_NTT_LANES)
+        ct_block(x,x + half,half,t->W[m + i],t->WShoup[m + i],p);
+      else
+        ct_block_scalar(x,x + half,half,t->W[m + i],t->WShoup[m + i],p);
+    }
+
+  // [0,4p) -> [0,p)
+  #pragma omp simd
+  for(int i = 0; i < N; i++){
+    uint64_t x = a[i];
+    x -= (x >= twop)*twop;
+    a[i] = x - (x >= p)*p;
+  }
+}
+
+void host_ntt_inverse(uint64_t *a, const host_ntt_table_t *t){
+  const int N = t->N;
+  const uint64_t p = t->mod.p;
+
+  for(int m = N/2, half = 1; m >= 1; m >>= 1, half <<= 1)
+    for(int i = 0; i < m; i++){
+      uint64_t *x = a + 2*i*half;
+      if(half >= HOST_NTT_LANES)
+        gs_block(x,x + half,half,t->WInv[m + i],t->WInvShoup[m + i],p);
+      else
+        gs_block_scalar(x,x + half,half,t->WInv[m + i],t->WInvShoup[m + i],p);
+    }
+
+  // Scales by N^{-1}: [0,2p) -> [0,p)
+  #pragma omp simd
+  for(int i = 0; i < N; i++){
+    const uint64_t x = host_mulmod_shoup_lazy(a[i],t->NInv,t->NInvShoup,p);
+    a[i] = x - (x >= p)*p;
+  }
+}
@@ -0,0 +1,86 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_NTT_H
+#define HOST_NTT_H
+
+#include "host_arithmetic.h"
+
+/**
+ * Precomputed data of a length-N NTT over a word-size prime p < 2^62.
+ *
+ * Twiddles are stored per stage. The stage with m blocks uses W[m..2m-1],
+ * so every block reads a single constant and butterflies inside a block are
+ * contiguous. Each twiddle comes with its Shoup quotient.
+ */
+typedef struct {
+  int N;
+  host_modulus_t mod;
+  uint64_t *W;
+  uint64_t *WShoup;
+  uint64_t *WInv;
+  uint64_t *WInvShoup;
+  uint64_t NInv;
+  uint64_t NInvShoup;
+} host_ntt_table_t;
+
+/**
+ * Builds the twiddle tables of a NTT of length N over p
+ * @param t output
+ * @param p a prime smaller than 2^62 such that N divides p-1
+ * @param w a primitive N-th root of unity mod p
+ * @param N transform length, a power of 2
+ */
+void host_ntt_table_init(host_ntt_table_t *t, uint64_t p, uint64_t w, int N);
+
+/**
+ * Builds the twiddle tables of a negacyclic NTT of length N over p.
+ *
+ * The transforms computed with these tables evaluate at the odd powers of
+ * psi, so pointwise products are products mod x^N + 1.
+ * @param t   output
+ * @param p   a prime smaller than 2^62 such that 2N divides p-1
+ * @param psi a primitive 2N-th root of unity mod p
+ * @param N   transform length, a power of 2
+ */
+void host_ntt_negacyclic_table_init(host_ntt_table_t *t, uint64_t p, uint64_t psi, int N);
+
+/**
+ * Releases the memory held by t
+ */
+void host_ntt_table_free(host_ntt_table_t *t);
+
+/**
+ * Forward NTT, in place. Cyclic or negacyclic according to the table.
+ *
+ * Harvey's lazy Cooley-Tukey butterflies keep the values in [0,4p) between
+ * stages. The input must be smaller than 4p, the output is reduced to [0,p)
+ * and left in bit-reversed order.
+ */
+void host_ntt_forward(uint64_t *a, const host_ntt_table_t *t);
+
+/**
+ * Inverse NTT, in place, scaled by N^{-1}.
+ *
+ * Receives a vector in bit-reversed order, as returned by host_ntt_forward(),
+ * and returns it in the natural order, reduced to [0,p). The lazy
+ * Gentleman-Sande butterflies keep the values in [0,2p).
+ */
+void host_ntt_inverse(uint64_t *a, const host_ntt_table_t *t);
+
+#endif
@@ -0,0 +1,677 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host implementation of CUDAFunctions.
+ *
+ * This file replaces cuda/operators.cu when cuYASHE is built with
+ * HOST_BACKEND. Every launcher keeps the semantics of the related kernel, but
+ * runs over the host memory returned by host_runtime.h. Work is split between
+ * threads with OpenMP, one CRT residue (or one coefficient) per iteration.
+ *
+ * CRT primes are word-size and NTT-friendly (CRT_NTT_PRIMES), so each residue
+ * is transformed, and operated on TRANSSTATE, modulo its own prime.
+ */
+#include "../cuda/operators.h"
+#include <stdexcept>
+#include "host_tables.h"
+
+int CUDAFunctions::transform = NTTMUL;
+int CUDAFunctions::icrt = ICRT_ACCUMULATE;
+
+cuyasheint_t CUDAFunctions::wN = 0;
+cuyasheint_t *CUDAFunctions::d_W = NULL;
+cuyasheint_t *CUDAFunctions::d_WInv = NULL;
+Complex *CUDAFunctions::d_mulComplexA = NULL;
+Complex *CUDAFunctions::d_mulComplexB = NULL;
+Complex *CUDAFunctions::d_mulComplexC = NULL;
+cufftHandle CUDAFunctions::plan;
+int CUDAFunctions::N = 0;
+
+const crt_tables_t *host_crt = NULL;
+// Tables written by write_crt_primes() and init() that no ParamContext has
+// taken over yet
+static crt_tables_t *own_tables = NULL;
+
+static void free_tables(crt_tables_t *tables){
+  for(unsigned int rid = 0; rid < tables->ntt.size(); rid++)
+    host_ntt_table_free(&tables->ntt[rid]);
+  delete tables;
+}
+
+/**
+ * Returns the tables write_crt_primes() and init() may modify. The tables of
+ * a ParamContext are never modified, they are copied into a new set first.
+ */
+static crt_tables_t* writable_tables(){
+  if(own_tables == NULL){
+    own_tables = new crt_tables_t;
+    if(host_crt != NULL){
+      *own_tables = *host_crt;
+      // The twiddles of the context stay with the context
+      own_tables->ntt.clear();
+    }else{
+      memset(own_tables->primes,0,sizeof(own_tables->primes));
+      memset(own_tables->moduli,0,sizeof(own_tables->moduli));
+      own_tables->N = 0;
+      own_tables->transform = CUDAFunctions::transform;
+    }
+    host_crt = own_tables;
+  }
+  return own_tables;
+}
+
+///////////////////////////////////////
+/// ADD
+///////////////////////////////////////
+
+__host__ void CUDAFunctions::callPolynomialAddSub(cuyasheint_t *c,cuyasheint_t *a,cuyasheint_t *b,int size,int OP,cudaStream_t stream){
+  // This method expects that both arrays are aligned
+  const int N = CUDAFunctions::N;
+  assert(size % N == 0);
+  callPolynomialAddSubBatch(c,a,b,N,size/N,1,OP,stream);
+}
+
+/**
+ * Adds or subtracts K polynomials at once.
+ *
+ * The residue rid of the k-th polynomial is stored at (rid*K + k)*N, so every
+ * residue is a contiguous array of K*N elements mod the same prime.
+ */
+__host__ void CUDAFunctions::callPolynomialAddSubBatch( cuyasheint_t *c,
+                                                        cuyasheint_t *a,
+                                                        cuyasheint_t *b,
+                                                        const int N,
+                                                        const int NPolis,
+                                                        const int K,
+                                                        int OP,
+                                                        cudaStream_t stream){
+  const int L = K*N;
+  if(OP == ADD){
+    #pragma omp parallel for collapse(2) schedule(static)
+    for(int rid = 0; rid < NPolis; rid++)
+      for(int cid = 0; cid < L; cid++)
+        c[cid + rid*L] = host_addmod(a[cid + rid*L],b[cid + rid*L],host_crt->primes[rid]);
+  }else{
+    #pragma omp parallel for collapse(2) schedule(static)
+    for(int rid = 0; rid < NPolis; rid++)
+      for(int cid = 0; cid < L; cid++)
+        c[cid + rid*L] = host_submod(a[cid + rid*L],b[cid + rid*L],host_crt->primes[rid]);
+  }
+}
+
+__host__ void CUDAFunctions::callPolynomialAddSubInPlace(cudaStream_t stream,cuyasheint_t *a,cuyasheint_t *b,int size,int OP){
+  callPolynomialAddSub(a,a,b,size,OP,stream);
+}
+
+/////////
+// NTT //
+/////////
+
+/**
+ * Builds the twiddle tables of every residue, if CUDAFunctions::N and the
+ * CRT primes are both set.
+ *
+ * With NEGACYCLIC_NTTMUL the transform has length N/2 and works mod
+ * x^{N/2} + 1, where N/2 = nphi.
+ */
+static void update_ntt_tables(){
+  const int N = CUDAFunctions::N;
+  if(N == 0)
+    return;
+
+  crt_tables_t *tables = writable_tables();
+  for(unsigned int rid = 0; rid < tables->ntt.size(); rid++)
+    host_ntt_table_free(&tables->ntt[rid]);
+  tables->ntt.resize(CRTRoots.size());
+
+  for(unsigned int rid = 0; rid < CRTRoots.size(); rid++){
+    // CRTRoots[rid] has order 2N, so its square is a primitive N-th root.
+    // That is the root of the cyclic transform of length N and the twist of
+    // the negacyclic one of length N/2.
+    const host_modulus_t *mod = &tables->moduli[rid];
+    const uint64_t root = host_mulmod(CRTRoots[rid],CRTRoots[rid],mod);
+    if(CUDAFunctions::transform == NEGACYCLIC_NTTMUL)
+      host_ntt_negacyclic_table_init(&tables->ntt[rid],mod->p,root,N/2);
+    else
+      host_ntt_table_init(&tables->ntt[rid],mod->p,root,N);
+  }
+  tables->N = N;
+  tables->transform = CUDAFunctions::transform;
+
+  CUDAFunctions::d_W = (tables->ntt.size() > 0? tables->ntt[0].W : NULL);
+  CUDAFunctions::d_WInv = (tables->ntt.size() > 0? tables->ntt[0].WInv : NULL);
+}
+
+__host__ cuyasheint_t* CUDAFunctions::applyNTT( cuyasheint_t *d_a,
+                                                const int N,
+                                                const int NPolis,
+                                                int type,
+                                                cudaStream_t stream){
+  return applyNTTBatch(d_a,N,NPolis,1,type,stream);
+}
+
+/**
+ * Transforms K polynomials at once. The layout is the same of
+ * callPolynomialAddSubBatch(), so consecutive transforms share the twiddle
+ * table of their prime.
+ */
+__host__ cuyasheint_t* CUDAFunctions::applyNTTBatch(cuyasheint_t *d_a,
+                                                    const int N,
+                                                    const int NPolis,
+                                                    const int K,
+                                                    int type,
+                                                    cudaStream_t stream){
+  // The twiddles are only built by init(), never on the way
+  if(host_crt == NULL || N != host_crt->N || CUDAFunctions::transform != host_crt->transform)
+    throw std::runtime_error("applyNTTBatch: no twiddles for this degree and transform, call CUDAFunctions::init() first");
+  assert(is_power_of(N,2));
+  assert(NPolis <= (int)host_crt->ntt.size());
+  const host_ntt_table_t *ntt_tables = &host_crt->ntt[0];
+
+  // Transforms are computed in place, one residue per thread.
+  // The forward transform leaves the residues in bit-reversed order. Since
+  // every operation on TRANSSTATE is pointwise, we don't reorder them.
+  if(CUDAFunctions::transform == NEGACYCLIC_NTTMUL){
+    // Only the lower half of each residue is transformed. The upper half is
+    // folded into it, since x^{N/2} = -1, and stays zeroed on TRANSSTATE.
+    const int half = N/2;
+    #pragma omp parallel for schedule(static)
+    for(int bid = 0; bid < NPolis*K; bid++){
+      const int rid = bid/K;
+      cuyasheint_t *a = d_a + bid*N;
+      if(type == FORWARD){
+        const uint64_t p = ntt_tables[rid].mod.p;
+        #pragma omp simd
+        for(int cid = 0; cid < half; cid++){
+          a[cid] = host_submod(a[cid],a[cid + half],p);
+          a[cid + half] = 0;
+        }
+        host_ntt_forward(a, &ntt_tables[rid]);
+      }else
+        host_ntt_inverse(a, &ntt_tables[rid]);
+    }
+  }else{
+    #pragma omp parallel for schedule(static)
+    for(int bid = 0; bid < NPolis*K; bid++)
+      if(type == FORWARD)
+        host_ntt_forward(d_a + bid*N, &ntt_tables[bid/K]);
+      else
+        host_ntt_inverse(d_a + bid*N, &ntt_tables[bid/K]);
+  }
+
+  return d_a;
+}
+
+__host__ void CUDAFunctions::callNTT(const int N, const int NPolis,int RADIX, cuyasheint_t* dataI, cuyasheint_t* dataO,const int type){
+  memcpy(dataO,dataI,N*NPolis*sizeof(cuyasheint_t));
+  applyNTT(dataO,N,NPolis,type,NULL);
+}
+
+__host__ void CUDAFunctions::executeNTTScale(   cuyasheint_t *d_result,
+                                                const int size,
+                                                const int N,
+                                                cudaStream_t stream){
+  #pragma omp parallel for simd schedule(static)
+  for(int i = 0; i < size; i++)
+    d_result[i] /= N;
+}
+
+__host__ void CUDAFunctions::executePolynomialMul(cuyasheint_t *c,
+                                                  cuyasheint_t *a,
+                                                  cuyasheint_t *b,
+                                                  const int size,
+                                                  cudaStream_t stream){
+  callPolynomialMul(c,a,b,size,stream);
+}
+
+__host__ void CUDAFunctions::executePolynomialAdd(cuyasheint_t *c,
+                                                  cuyasheint_t *a,
+                                                  cuyasheint_t *b,
+                                                  const int size,
+                                                  cudaStream_t stream){
+  // Like polynomialNTTAdd, this is computed in-place on a
+  callPolynomialAddSub(a,a,b,size,ADD,stream);
+}
+
+/**
+ * Returns true if a is power of b
+ * @param  a [description]
+ * @param  b [description]
+ * @return   [description]
+ */
+__host__ bool is_power_of(uint64_t a, uint64_t b){
+  assert(b > 1);
+
+  uint64_t n = a;
+  while (n % b == 0)
+    n /= b;
+  return (n==1);
+}
+
+__host__ cuyasheint_t* CUDAFunctions::callPolynomialMul(cuyasheint_t *output,
+                                                        cuyasheint_t *a,
+                                                        cuyasheint_t *b,
+                                                        const int size,
+                                                        cudaStream_t stream){
+  assert((N>0)&&((N & (N - 1)) == 0));//Check if N is power of 2
+  assert(size % N == 0);
+
+  callPolynomialMulBatch(output,a,b,N,size/N,1,stream);
+  return output;
+}
+
+/**
+ * Multiplies K polynomials at once, pointwise. The layout is the same of
+ * callPolynomialAddSubBatch().
+ */
+__host__ void CUDAFunctions::callPolynomialMulBatch(cuyasheint_t *c,
+                                                    cuyasheint_t *a,
+                                                    cuyasheint_t *b,
+                                                    const int N,
+                                                    const int NPolis,
+                                                    const int K,
+                                                    cudaStream_t stream){
+  assert(N == CUDAFunctions::N);
+  const int L = K*N;
+
+  #pragma omp parallel for collapse(2) schedule(static)
+  for(int rid = 0; rid < NPolis; rid++)
+    for(int cid = 0; cid < L; cid++)
+      c[cid + rid*L] = host_mulmod(a[cid + rid*L],b[cid + rid*L],&host_crt->moduli[rid]);
+}
+
+/**
+ * Computes c[k] = sum_{j<n} a[j][k]*x[j] for a batch of K polynomials,
+ * pointwise. Each x[j] is a single polynomial, with the layout of
+ * callPolynomialMul(), applied to every polynomial of the batch.
+ * @param c output: K polynomials
+ * @param a n batches of K polynomials
+ * @param x n polynomials
+ * @param n number of products
+ */
+__host__ void CUDAFunctions::callPolynomialMulShared(cuyasheint_t *c,
+                                                    cuyasheint_t **a,
+                                                    cuyasheint_t **x,
+                                                    const int n,
+                                                    const int N,
+                                                    const int NPolis,
+                                                    const int K,
+                                                    cudaStream_t stream){
+  assert(N == CUDAFunctions::N);
+  assert(n <= (1 << (127 - 2*CRTPRIMESIZE)));
+  const int L = K*N;
+
+  #pragma omp parallel for collapse(2) schedule(static)
+  for(int rid = 0; rid < NPolis; rid++)
+    for(int k = 0; k < K; k++){
+      const host_modulus_t *mod = &host_crt->moduli[rid];
+      cuyasheint_t *ck = &c[k*N + rid*L];
+      #pragma omp simd
+      for(int cid = 0; cid < N; cid++){
+        __uint128_t acc = 0;
+        for(int j = 0; j < n; j++)
+          acc += ((__uint128_t)a[j][k*N + cid + rid*L])*x[j][cid + rid*N];
+        ck[cid] = host_reduce128(acc,mod);
+      }
+    }
+}
+
+/**
+ * Computes c = (accumulate? c : 0) + sum_{j<k} a[j]*b[j], pointwise.
+ *
+ * Products are summed in 128 bits and reduced once per point. Residues are
+ * smaller than 2^CRTPRIMESIZE, so up to 2^(127 - 2*CRTPRIMESIZE) products
+ * fit in the accumulator before it has to be folded.
+ * @param c          output
+ * @param a          k arrays of residues
+ * @param b          k arrays of residues
+ * @param k          number of products
+ * @param size       N*NPolis
+ * @param accumulate add the products to c
+ */
+__host__ void CUDAFunctions::callPolynomialMulAcc(cuyasheint_t *c,
+                                                  cuyasheint_t **a,
+                                                  cuyasheint_t **b,
+                                                  const int k,
+                                                  const int size,
+                                                  const bool accumulate,
+                                                  cudaStream_t stream){
+  const int N = CUDAFunctions::N;
+  assert(size % N == 0);
+  assert(2*CRTPRIMESIZE < 127);
+  const int lazy_terms = 1 << (127 - 2*CRTPRIMESIZE);
+
+  #pragma omp parallel for collapse(2) schedule(static)
+  for(int rid = 0; rid < size/N; rid++)
+    for(int cid = 0; cid < N; cid++){
+      const int i = cid + rid*N;
+      const host_modulus_t *mod = &host_crt->moduli[rid];
+
+      __uint128_t acc = (accumulate? c[i] : 0);
+      for(int j = 0; j < k; j++){
+        acc += ((__uint128_t)a[j][i])*b[j][i];
+        if((j+1) % lazy_terms == 0)
+          acc = host_reduce128(acc,mod);
+      }
+      c[i] = host_reduce128(acc,mod);
+    }
+}
+
+/**
+ * Operations between polynomials and integers on TRANSSTATE.
+ *
+ * Each residue is the transform of a polynomial mod p_i, so the operand
+ * is reduced by the related CRT prime before being applied to every point.
+ */
+__host__ void CUDAFunctions::callPolynomialOPInteger(
+                                                      const int opcode,
+                                                      cudaStream_t stream,
+                                                      cuyasheint_t *b,
+                                                      cuyasheint_t *a,
+                                                      cuyasheint_t integer_array,
+                                                      const int N,
+                                                      const int NPolis)
+{
+  // The upper half of the negacyclic transform must stay zeroed. MUL keeps
+  // it zeroed by itself and may also be applied over CRT residues.
+  const int npoints = (CUDAFunctions::transform == NEGACYCLIC_NTTMUL && opcode != MUL? N/2 : N);
+
+  #pragma omp parallel for schedule(static)
+  for(int rid = 0; rid < NPolis; rid++){
+    const host_modulus_t mod = host_crt->moduli[rid];
+    const cuyasheint_t operand = integer_array % mod.p;
+    cuyasheint_t *output = b + rid*N;
+    const cuyasheint_t *input = a + rid*N;
+
+    switch(opcode)
+    {
+    case ADD:
+      for(int cid = 0; cid < npoints; cid++)
+        output[cid] = host_addmod(input[cid],operand,mod.p);
+      break;
+    case SUB:
+      for(int cid = 0; cid < npoints; cid++)
+        output[cid] = host_submod(input[cid],operand,mod.p);
+      break;
+    case MUL:
+      for(int cid = 0; cid < npoints; cid++)
+        output[cid] = host_mulmod(input[cid],operand,&mod);
+      break;
+    default:
+      //This case shouldn't be used.
+      assert(1 == 0);
+      break;
+    }
+    for(int cid = npoints; cid < N; cid++)
+      output[cid] = 0;
+  }
+}
+
+__host__ void CUDAFunctions::callPolynomialOPIntegerInplace(   const int opcode,
+                                                              cudaStream_t stream,
+                                                              cuyasheint_t *a,
+                                                              cuyasheint_t integer,
+                                                              const int N,
+                                                              const int NPolis){
+  callPolynomialOPInteger(opcode,stream,a,a,integer,N,NPolis);
+}
+
+__host__ void CUDAFunctions::callPolynomialOPDigit( const int opcode,
+                                                    cudaStream_t stream,
+                                                    bn_t *b,
+                                                    bn_t *a,
+                                                    bn_t digit,
+                                                    const int N){
+  // This method applies a 0-degree operation over all coeficients
+  switch(opcode)
+  {
+  case ADD:
+    {
+      int nwords = max_d(a[0].used,digit.used);
+      cuyasheint_t carry = bn_addn_low(b[0].dp, a[0].dp, digit.dp,nwords);
+      b[0].used = nwords;
+
+      /* Equivalent to "If has a carry, add as last word" */
+      b[0].dp[b[0].used] = carry;
+      b[0].used += (carry > 0);
+    }
+    break;
+  case MUL:
+    assert(digit.alloc >= STD_BNT_WORDS_ALLOC);
+    #pragma omp parallel for schedule(static)
+    for(int cid = 0; cid < N; cid++){
+      assert(a[cid].alloc >= STD_BNT_WORDS_ALLOC);
+      // The product is computed on a double-size buffer and only the words
+      // that fit in b are kept.
+      cuyasheint_t r[DSTD_BNT_WORDS_ALLOC];
+      bn_muln_low(r, a[cid].dp, digit.dp, STD_BNT_WORDS_ALLOC);
+      for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+        b[cid].dp[i] = r[i];
+      b[cid].used = STD_BNT_WORDS_ALLOC;
+      b[cid].sign = a[cid].sign;
+      bn_adjust_used(&b[cid]);
+    }
+    break;
+  default:
+    //This case shouldn't be used.
+    assert(1 == 0);
+    break;
+  }
+}
+
+/**
+ * [CUDAFunctions::init description]
+ * @param N The target polynomial degree
+ */
+__host__ void CUDAFunctions::init(int M){
+  int N = 2*M;
+  CUDAFunctions::N = N;
+
+  std::cout << "CUDAFunctions initializing  = " << N << std::endl;
+
+  update_ntt_tables();
+}
+
+/**
+ * a[i] - a[i+half+1] on the residues, for each block of N coefficients of
+ * a. The difference is left as a residue on [0,p), so a negative coefficient
+ * is only told apart by the balanced ICRT and needs no fixup here.
+ * @param d_polyCRT input/output: residue rid of coefficient cid at
+ *                  d_polyCRT[cid + rid*stride]
+ * @param half      input: nphi - 1
+ * @param N         input: coefficients per polynomial
+ * @param stride    input: coefficients per residue row
+ * @param NPolis    input: number of residues
+ */
+__host__ void CUDAFunctions::callPolynomialReductionCRT( cuyasheint_t *d_polyCRT,
+                                                          const int half,
+                                                          const int N,
+                                                          const int stride,
+                                                          const int NPolis){
+  const int n = N-half-1;
+  assert(stride % N == 0);
+
+  const int blocks = stride/N;
+
+  #pragma omp parallel for schedule(static)
+  for(int job = 0; job < NPolis*blocks; job++){
+    const int rid = job / blocks;
+    const uint64_t p = host_crt->moduli[rid].p;
+    cuyasheint_t *x = &d_polyCRT[(job % blocks)*N + rid*stride];
+    #pragma omp simd
+    for(int cid = 0; cid < n; cid++){
+      x[cid] = host_submod(x[cid], x[cid + half + 1], p);
+      x[cid + half + 1] = 0;
+    }
+  }
+}
+
+/**
+ * a[cid] - a[cid+half+1] over a limb matrix, for each block of N
+ * coefficients of a. a[cid] - a[cid+half+1] is computed as a[cid] +
+ * ~a[cid+half+1] + 1 if both have the same sign, or as the sum of the
+ * magnitudes otherwise, so there are no branches on the inner loops.
+ */
+__host__ void CUDAFunctions::callPolynomialReductionCoefsMatrix(bn_matrix_t *a,
+                                                                const int half,
+                                                                const int N ){
+  const int stride = a->N;
+  const int n = N-half-1;
+  assert(stride % N == 0);
+
+  for(int base = 0; base < stride; base += N){
+    #pragma omp parallel for schedule(static)
+    for(int tile = 0; tile < n; tile += HOST_BN_MATRIX_TILE){
+      const int T = min_d(HOST_BN_MATRIX_TILE, n - tile);
+      cuyasheint_t *x = &a->d_limbs[base + tile];
+      cuyasheint_t *y = &a->d_limbs[base + tile + half + 1];
+      cuyasheint_t flip[HOST_BN_MATRIX_TILE];
+      cuyasheint_t carry[HOST_BN_MATRIX_TILE];
+      int sign[HOST_BN_MATRIX_TILE];
+
+      for(int t = 0; t < T; t++){
+        sign[t] = host_matrix_sign(a->d_signs, base + tile + t);
+        const bool same = (sign[t] == host_matrix_sign(a->d_signs, base + tile + t + half + 1));
+        flip[t] = (same? ~(cuyasheint_t)0 : 0);
+        carry[t] = (same? 1 : 0);
+      }
+
+      for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+        for(int t = 0; t < T; t++){
+          const cuyasheint_t s = x[t + i*stride] + (y[t + i*stride] ^ flip[t]);
+          const cuyasheint_t r = s + carry[t];
+          carry[t] = (s < x[t + i*stride]) | (r < s);
+          x[t + i*stride] = r;
+          y[t + i*stride] = 0;
+        }
+
+      // A subtraction without carry out borrowed, so the output is the
+      // two's complement of the magnitude
+      for(int t = 0; t < T; t++){
+        const bool borrow = (flip[t] != 0 && carry[t] == 0);
+        flip[t] = (borrow? ~(cuyasheint_t)0 : 0);
+        carry[t] = (borrow? 1 : 0);
+        host_matrix_set_sign(a->d_signs, base + tile + t, sign[t] ^ borrow);
+      }
+      for(int i = 0; i < STD_BNT_WORDS_ALLOC; i++)
+        for(int t = 0; t < T; t++){
+          const cuyasheint_t r = (x[t + i*stride] ^ flip[t]) + carry[t];
+          carry[t] = (r < carry[t]);
+          x[t + i*stride] = r;
+        }
+    }
+
+    // The upper coefficients may share words of the bitmap with other tiles
+    for(int cid = half+1; cid < N; cid++)
+      host_matrix_set_sign(a->d_signs, base + cid, BN_POS);
+  }
+}
+
+/**
+ * On the host the CRT constants are regular global arrays
+ */
+__host__ void  CUDAFunctions::write_crt_primes(){
+
+  #ifdef VERBOSE
+  std::cout << "primes: "<< std::endl;
+  for(unsigned int i = 0; i < CRTPrimes.size();i++)
+    std::cout << CRTPrimes[i] << " ";
+  std::cout << std::endl;
+  #endif
+
+  if(CRTPrimes.size() >= COPRIMES_BUCKET_SIZE)
+    throw "Too many primes.";
+
+  /////////////////
+  // Copy primes //
+  /////////////////
+  crt_tables_t *tables = writable_tables();
+  memcpy(tables->primes,&CRTPrimes[0],CRTPrimes.size()*sizeof(cuyasheint_t));
+  for(unsigned int i = 0; i < CRTPrimes.size();i++)
+    host_modulus_init(&tables->moduli[i],CRTPrimes[i]);
+
+  ////////////
+  // Copy M //
+  ////////////
+  bn_t h_M;
+  get_words_host(&h_M,CRTProduct);
+  assert(h_M.used <= STD_BNT_WORDS_ALLOC);
+  memset(tables->M,0,STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
+  memcpy(tables->M,h_M.dp,h_M.used*sizeof(cuyasheint_t));
+  tables->M_used = h_M.used;
+
+  ////////////
+  // Copy u //
+  ////////////
+  bn_t h_u;
+  h_u.alloc = 0;
+  get_words_host(&h_u,reciprocal_of(CRTProduct));
+  assert(h_u.used <= STD_BNT_WORDS_ALLOC);
+  memset(tables->u,0,STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
+  memcpy(tables->u,h_u.dp,h_u.used*sizeof(cuyasheint_t));
+  tables->u_used = h_u.used;
+  free(h_u.dp);
+
+  //////////////
+  // Copy Mpi //
+  //////////////
+  memset(tables->Mpis,0,STD_BNT_WORDS_ALLOC*COPRIMES_BUCKET_SIZE*sizeof(cuyasheint_t));
+  for(unsigned int i = 0; i < CRTPrimes.size();i++){
+    bn_t h_Mpi;
+    get_words_host(&h_Mpi,CRTMpi[i]);
+    assert(h_Mpi.used <= STD_BNT_WORDS_ALLOC);
+    memcpy(&tables->Mpis[i*STD_BNT_WORDS_ALLOC],h_Mpi.dp,h_Mpi.used*sizeof(cuyasheint_t));
+    tables->Mpis_used[i] = h_Mpi.used;
+    free(h_Mpi.dp);
+  }
+
+  /////////////////
+  // Copy InvMpi //
+  /////////////////
+  memcpy(tables->invMpis,&CRTInvMpi[0],CRTPrimes.size()*sizeof(cuyasheint_t));
+
+  free(h_M.dp);
+
+  update_ntt_tables();
+}
+
+/**
+ * Hands the tables of the current primes and degree over to the caller. The
+ * next call to write_crt_primes() or init() starts a new set.
+ */
+__host__ crt_tables_t* CUDAFunctions::export_tables(){
+  crt_tables_t *tables = writable_tables();
+  own_tables = NULL;
+  return tables;
+}
+
+/**
+ * Makes the tables taken by export_tables() the current ones. Nothing is
+ * copied or recomputed.
+ */
+__host__ void CUDAFunctions::import_tables(const crt_tables_t *tables){
+  if(own_tables != NULL && own_tables != tables)
+    free_tables(own_tables);
+  own_tables = NULL;
+
+  host_crt = tables;
+  CUDAFunctions::N = tables->N;
+  CUDAFunctions::d_W = (tables->ntt.size() > 0? tables->ntt[0].W : NULL);
+  CUDAFunctions::d_WInv = (tables->ntt.size() > 0? tables->ntt[0].WInv : NULL);
+}
@@ -0,0 +1,131 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_RUNTIME_H
+#define HOST_RUNTIME_H
+
+/**
+ * The host backend runs the whole poly_t/cipher_t stack without the CUDA
+ * toolkit. Instead of duplicating every function that touches "device"
+ * memory, this header maps the small subset of the CUDA runtime used by
+ * cuYASHE to plain host memory. So, on the host backend, d_coefs, d_bn_coefs
+ * and friends are regular host pointers.
+ *
+ * Kernels are not emulated. Each kernel launcher (callCRT, callICRT,
+ * CUDAFunctions::*, ...) has a multithreaded host implementation in src/host.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+///////////////////////
+// Qualifiers //
+///////////////////////
+#define __host__
+#define __device__
+#define __global__
+#define __constant__
+#define __shared__
+
+///////////////////////
+// Types //
+///////////////////////
+struct double2 {
+	double x;
+	double y;
+};
+
+typedef void* cudaStream_t;
+
+enum cudaError_t {
+	cudaSuccess = 0,
+	cudaErrorMemoryAllocation = 2
+};
+
+enum cudaMemcpyKind {
+	cudaMemcpyHostToHost = 0,
+	cudaMemcpyHostToDevice = 1,
+	cudaMemcpyDeviceToHost = 2,
+	cudaMemcpyDeviceToDevice = 3,
+	cudaMemcpyDefault = 4
+};
+
+///////////////////////
+// Memory //
+///////////////////////
+inline cudaError_t cudaMalloc(void **ptr, size_t size){
+	*ptr = malloc(size);
+	return (*ptr != NULL || size == 0? cudaSuccess : cudaErrorMemoryAllocation);
+}
+
+inline cudaError_t cudaFree(void *ptr){
+	free(ptr);
+	return cudaSuccess;
+}
+
+inline cudaError_t cudaMemcpy(void *dst, const void *src, size_t count, cudaMemcpyKind kind){
+	memmove(dst,src,count);
+	return cudaSuccess;
+}
+
+inline cudaError_t cudaMemcpyAsync(void *dst, const void *src, size_t count, cudaMemcpyKind kind, cudaStream_t stream = 0){
+	return cudaMemcpy(dst,src,count,kind);
+}
+
+inline cudaError_t cudaMemset(void *ptr, int value, size_t count){
+	memset(ptr,value,count);
+	return cudaSuccess;
+}
+
+inline cudaError_t cudaMemsetAsync(void *ptr, int value, size_t count, cudaStream_t stream = 0){
+	return cudaMemset(ptr,value,count);
+}
+
+///////////////////////
+// Device management //
+///////////////////////
+inline cudaError_t cudaDeviceSynchronize(){
+	return cudaSuccess;
+}
+
+inline cudaError_t cudaDeviceReset(){
+	return cudaSuccess;
+}
+
+inline cudaError_t cudaGetLastError(){
+	return cudaSuccess;
+}
+
+inline const char* cudaGetErrorString(cudaError_t error){
+	return (error == cudaSuccess? "no error" : "host allocation failed");
+}
+
+///////////////////////
+// Intrinsics //
+///////////////////////
+// Used by the __host__ __device__ big-number routines shared with the GPU
+inline uint64_t __umul64hi(uint64_t a, uint64_t b){
+	return (uint64_t)((((__uint128_t)a) * ((__uint128_t)b)) >> 64);
+}
+
+inline int __clz(int x){
+	return (x == 0? 32 : __builtin_clz((unsigned int)x));
+}
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * cuYASHE
+ * Copyright (C) 2015-2016 cuYASHE Authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_TABLES_H
+#define HOST_TABLES_H
+
+#include <vector>
+#include "../cuda/operators.h"
+#include "host_ntt.h"
+
+/**
+ * Constants of a set of CRT primes and the twiddles of one degree and
+ * transform. On the GPU the constants live on constant memory, here they are
+ * regular arrays read through host_crt.
+ *
+ * write_crt_primes() and CUDAFunctions::init() fill a set of tables of their
+ * own. export_tables() hands it over to a ParamContext, and import_tables()
+ * makes host_crt point to the tables of the context, so nothing is copied on
+ * a switch.
+ */
+struct crt_tables_st{
+  int N;
+  int transform;
+  cuyasheint_t primes[COPRIMES_BUCKET_SIZE];
+  host_modulus_t moduli[COPRIMES_BUCKET_SIZE];
+  cuyasheint_t M[STD_BNT_WORDS_ALLOC];
+  int M_used;
+  cuyasheint_t u[STD_BNT_WORDS_ALLOC];
+  int u_used;
+  cuyasheint_t Mpis[STD_BNT_WORDS_ALLOC*COPRIMES_BUCKET_SIZE];
+  int Mpis_used[COPRIMES_BUCKET_SIZE];
+  cuyasheint_t invMpis[COPRIMES_BUCKET_SIZE];
+  std::vector<host_ntt_table_t> ntt;
+};
+
+// Tables of the current primes and degree
+extern const crt_tables_t *host_crt;
+
+#endif
@@ -65,7 +65,7 @@ bool Log_Writer::loginit(LogLevel l, const  char *filelocation, bool append, boo
     m_issync = issync; 
 	if(strlen(filelocation) >= (sizeof(m_filelocation) -1))
 	{
-		fprintf(stderr, "the path of log file is too long:%d limit:%d\n", strlen(filelocation), sizeof(m_filelocation) -1);
+		fprintf(stderr, "the path of log file is too long:%zu limit:%zu\n", strlen(filelocation), sizeof(m_filelocation) -1);
 		exit(0);
 	}
 	//本地存储filelocation  以防止在栈上的非法调用调用
@@ -20,7 +20,11 @@
 #define SETTINGS_H
 
 #include <cstdint>
+#ifdef HOST_BACKEND
+#include "host/host_runtime.h"
+#else
 #include <cuda_runtime.h>
+#endif
 
 ///////////////////////
 // cuYASHE's integer //
@@ -41,18 +45,41 @@ typedef struct bn_st{
 	cuyasheint_t *dp = NULL;
 } bn_t;
 
+// Structure-of-arrays layout for N big numbers of STD_BNT_WORDS_ALLOC words.
+// 
+// Word j of the i-th number is stored at d_limbs[i + j*N], so a pass over
+// one word of every number is a unit-stride load. Numbers are kept in
+// sign-magnitude form and the sign of the i-th number is the bit i%32 of
+// d_signs[i/32] (1 for BN_NEG).
+typedef struct bn_matrix_st{
+	int N = 0;
+	cuyasheint_t *d_limbs = NULL;
+	uint32_t *d_signs = NULL;
+} bn_matrix_t;
+#define BN_MATRIX_SIGN_WORDS(N) (((N)+31)/32)
+
 // default block x size
 #define ADDBLOCKXDIM 32
 
 // This define the default transform for polynomial multiplication
+#ifdef HOST_BACKEND
+// There is no cuFFT on the host, so it always multiplies through the NTT
+#define NTTMUL_TRANSFORM
+#else
 // #define NTTMUL_TRANSFORM
 #define CUFFTMUL_TRANSFORM
+#endif
 
 
 #ifdef CUFFTMUL_TRANSFORM
 #define CRTPRIMESIZE 13 
 #define COPRIMES_BUCKET_SIZE 200                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                     //
 extern const uint32_t COPRIMES_BUCKET[];
+#elif defined(HOST_BACKEND)
+// Word-size primes p = 1 mod 2N, generated at runtime by gen_crt_primes()
+#define CRT_NTT_PRIMES
+#define CRTPRIMESIZE 60
+#define COPRIMES_BUCKET_SIZE 200
 #else
 #define CRTPRIMESIZE 10 
 #define COPRIMES_BUCKET_SIZE 200                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                           //
@@ -69,8 +96,17 @@ extern const uint32_t COPRIMES_BUCKET[];
 #define DSTD_BNT_WORDS_ALLOC 20 // Up to  bits big integers
 
 enum add_mode_t {ADD,SUB,MUL,DIV,MOD};
-enum transforms {NTTMUL, CUFFTMUL};
+// NEGACYCLIC_NTTMUL is only available on the host backend
+enum transforms {NTTMUL, CUFFTMUL, NEGACYCLIC_NTTMUL};
 enum ntt_mode_t {INVERSE,FORWARD};
+// ICRT_ACCUMULATE sums Mpi*(invMpi*x_i mod pi) and reduces it by M.
+// ICRT_GARNER builds the mixed-radix digits of Garner's algorithm.
+// The mode applies to callICRT(), callICRTMatrix() and the fused
+// reductions, i.e. to poly_icrt(), poly_reduce() and cipher_mul().
+enum icrt_modes {ICRT_ACCUMULATE, ICRT_GARNER};
+// KEYSWITCH_WORDECOMP splits the coefficients in words of w bits.
+// KEYSWITCH_RNS takes digits from groups of CRT residues, see rns_decomp_t.
+enum keyswitch_modes {KEYSWITCH_WORDECOMP, KEYSWITCH_RNS};
 
 #include <time.h>
 
@@ -25,10 +25,16 @@
 #include "../distribution/distribution.h"
 #include "../yashe/yashe.h"
 #include "../yashe/ciphertext.h"
+#include "../aritmetic/param_context.h"
+#ifdef HOST_BACKEND
+#include "../host/host_ntt.h"
+#endif
 
 
 #include <time.h>
 #include <stdlib.h>
+#include <omp.h>
+#include <thread>
 
 
 #define NTESTS 100
@@ -133,7 +139,6 @@ struct YasheSuite
 
         poly_set_coeff(&Yashe::t,0,to_ZZ(t));
         Yashe::w = 32;
-        Yashe::lwq = floor(NTL::log(q)/NTL::log(to_ZZ(NTL::power2_ZZ(Yashe::w))))+1;
 
         cipher->generate_keys();
     }
@@ -143,6 +148,50 @@ struct YasheSuite
         BOOST_TEST_MESSAGE("teardown mass");
         cudaDeviceReset();
     }
+
+    /**
+     * Encrypts i and j, multiplies them and decrypts the product
+     * @param  y           context to encrypt and decrypt with
+     * @param  i           [input]
+     * @param  j           [input]
+     * @return             the decryption, mod t
+     */
+    ZZ mul_decrypt(Yashe *y, const ZZ &i, const ZZ &j){
+        poly_t mi;
+        poly_init(&mi);
+        poly_set_coeff(&mi,0,i);
+
+        poly_t mj;
+        poly_init(&mj);
+        poly_set_coeff(&mj,0,j);
+
+        cipher_t ci;
+        cipher_init(&ci);
+        y->encrypt(&ci,mi);
+
+        cipher_t cj;
+        cipher_init(&cj);
+        y->encrypt(&cj,mj);
+
+        cipher_t cz;
+        cipher_init(&cz);
+        cipher_mul(&cz,&ci,&cj,y->keys.get());
+        // The product is keyswitched, so it decrypts with f
+        BOOST_REQUIRE(!cz.aftermul);
+
+        poly_t m_decrypted;
+        poly_init(&m_decrypted);
+        y->decrypt(&m_decrypted,cz);
+        const ZZ m = poly_get_coeff(&m_decrypted, 0) % to_ZZ(t);
+
+        poly_free(&mi);
+        poly_free(&mj);
+        poly_free(&m_decrypted);
+        cipher_free(&ci);
+        cipher_free(&cj);
+        cipher_free(&cz);
+        return m;
+    }
 };
 
 
@@ -197,7 +246,6 @@ struct BigYasheSuite
 
         poly_set_coeff(&Yashe::t,0,to_ZZ(t));
         Yashe::w = 32;
-        Yashe::lwq = floor(NTL::log(q)/NTL::log(to_ZZ(NTL::power2_ZZ(Yashe::w))))+1;
 
         cipher->generate_keys();
     }
@@ -285,6 +333,55 @@ BOOST_AUTO_TEST_CASE(add)
 
 }
 
+BOOST_AUTO_TEST_CASE(addsub_domains)
+{
+    poly_t a,b,c,d;
+    poly_init(&a);
+    poly_init(&b);
+    poly_init(&c);
+    poly_init(&d);
+
+    dist.generate_sample(&a, 50, OP_DEGREE);
+    dist.generate_sample(&b, 50, OP_DEGREE);
+    std::vector<ZZ> x(OP_DEGREE), y(OP_DEGREE);
+    for(int i = 0; i < OP_DEGREE; i++){
+        x[i] = poly_get_coeff(&a,i);
+        y[i] = poly_get_coeff(&b,i);
+    }
+
+    // Two CRT operands are added without being transformed
+    poly_crt(&a);
+    poly_crt(&b);
+    poly_add(&c, &a, &b);
+    BOOST_CHECK_EQUAL(a.status, CRTSTATE);
+    BOOST_CHECK_EQUAL(b.status, CRTSTATE);
+    BOOST_CHECK_EQUAL(c.status, CRTSTATE);
+
+    // An accumulator keeps its state
+    poly_elevate(&b);
+    poly_add(&c, &c, &b);
+    BOOST_CHECK_EQUAL(c.status, CRTSTATE);
+    poly_sub(&c, &c, &a);
+    BOOST_CHECK_EQUAL(c.status, CRTSTATE);
+
+    // On a tie TRANSSTATE is preferred
+    poly_elevate(&b);
+    poly_sub(&d, &c, &b);
+    BOOST_CHECK_EQUAL(d.status, TRANSSTATE);
+    poly_add(&d, &d, &a);
+
+    // Compare: c = 2b, d = a + b
+    for(int i = 0; i < OP_DEGREE; i++){
+        BOOST_CHECK_EQUAL(poly_get_coeff(&c,i), 2*y[i]);
+        BOOST_CHECK_EQUAL(poly_get_coeff(&d,i), x[i] + y[i]);
+    }
+
+    poly_free(&a);
+    poly_free(&b);
+    poly_free(&c);
+    poly_free(&d);
+}
+
 BOOST_AUTO_TEST_CASE(mul)
 {  
     ZZ_pEX ntl_a;
@@ -373,6 +470,559 @@ BOOST_AUTO_TEST_CASE(add_mul)
     poly_free(&c);
 }
 
+BOOST_AUTO_TEST_CASE(dot)
+{
+    const int k = 4;
+    poly_t a[k];
+    poly_t b[k];
+    poly_t c;
+    poly_t expected;
+    poly_t aux;
+
+    // Init
+    poly_init(&c);
+    poly_init(&expected);
+    poly_init(&aux);
+    for(int i = 0; i < k; i++){
+        poly_init(&a[i]);
+        poly_init(&b[i]);
+        dist.generate_sample(&a[i],5,OP_DEGREE);
+        dist.generate_sample(&b[i],5,OP_DEGREE);
+    }
+
+    // c = sum a[i]*b[i]
+    poly_dot(&c,a,b,k);
+    for(int i = 0; i < k; i++){
+        poly_mul(&aux,&a[i],&b[i]);
+        poly_add(&expected,&expected,&aux);
+    }
+
+    // c += sum a[i]*b[i]
+    poly_mul_acc(&c,a,b,k);
+    poly_add(&expected,&expected,&expected);
+
+    // Verify
+    BOOST_CHECK_EQUAL(poly_get_deg(&c),poly_get_deg(&expected));
+    for(int i = 0; i < 2*OP_DEGREE; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&c,i) , poly_get_coeff(&expected,i));
+
+    for(int i = 0; i < k; i++){
+        poly_free(&a[i]);
+        poly_free(&b[i]);
+    }
+    poly_free(&c);
+    poly_free(&expected);
+    poly_free(&aux);
+}
+
+BOOST_AUTO_TEST_CASE(batch)
+{
+    const int K = 5;
+    poly_t a[K], b[K], c, d;
+    poly_batch_t A, B, C;
+
+    // Init
+    poly_init(&c);
+    poly_init(&d);
+    poly_batch_init(&A,K);
+    poly_batch_init(&B,K);
+    poly_batch_init(&C,K);
+    for(int k = 0; k < K; k++){
+        poly_init(&a[k]);
+        poly_init(&b[k]);
+        dist.generate_sample(&a[k],50,OP_DEGREE);
+        dist.generate_sample(&b[k],50,OP_DEGREE);
+        poly_batch_set(&A,k,&a[k]);
+        poly_batch_set(&B,k,&b[k]);
+    }
+
+    // C = A*B + A, reduced
+    poly_batch_mul(&C,&A,&B);
+    poly_batch_add(&C,&C,&A);
+    poly_batch_reduce(&C,OP_DEGREE,Q,NTL::NumBits(q));
+
+    // Verify
+    for(int k = 0; k < K; k++){
+        poly_mul(&c,&a[k],&b[k]);
+        poly_add(&c,&c,&a[k]);
+        poly_reduce(&c,OP_DEGREE,Q,NTL::NumBits(q));
+
+        poly_batch_get(&d,&C,k);
+        for(int i = 0; i < 2*OP_DEGREE; i++)
+            BOOST_CHECK_EQUAL(poly_get_coeff(&d,i) , poly_get_coeff(&c,i));
+    }
+
+    for(int k = 0; k < K; k++){
+        poly_free(&a[k]);
+        poly_free(&b[k]);
+    }
+    poly_free(&c);
+    poly_free(&d);
+    poly_batch_free(&A);
+    poly_batch_free(&B);
+    poly_batch_free(&C);
+}
+
+BOOST_AUTO_TEST_CASE(limb_matrix)
+{
+    const int nq = NTL::NumBits(q);
+    const int N = CUDAFunctions::N;
+    poly_t a, b;
+    poly_init(&a);
+    poly_init(&b);
+    for(int i = 0; i < OP_DEGREE; i++)
+        poly_set_coeff(&a,i,NTL::RandomBnd(q*q));
+
+    // From CRTSTATE, the coefficients are recomputed by callICRTMatrix()
+    poly_add(&b,&a,&a);
+    poly_mersenne_reduction(&b,Q,nq);
+    for(int i = 0; i < OP_DEGREE; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&b,i) , (2*poly_get_coeff(&a,i)) % q);
+
+    // From HOSTSTATE, they are copied by callBNToMatrix()
+    std::vector<ZZ> coefs(OP_DEGREE);
+    for(int i = 0; i < OP_DEGREE; i++)
+        coefs[i] = poly_get_coeff(&a,i) % q;
+    poly_mersenne_reduction(&a,Q,nq);
+    for(int i = 0; i < OP_DEGREE; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , coefs[i]);
+
+    // WordDecomp
+    bn_matrix_t g;
+    bn_matrix_init(&g,N);
+    poly_icrt(&a);
+    callBNToMatrix(&g,a.d_bn_coefs,N,NULL);
+    cuyasheint_t *d_residues;
+    cudaError_t result = cudaMalloc((void**)&d_residues,N*CRTPrimes.size()*sizeof(cuyasheint_t));
+    assert(result == cudaSuccess);
+    cuyasheint_t *h_residues = (cuyasheint_t*)malloc(N*sizeof(cuyasheint_t));
+    for(int digit = 0; digit < (nq+31)/32; digit++){
+        callCuWordecompMatrix(NULL,32,d_residues,&g,digit,CRTPrimes.size());
+        result = cudaMemcpy(h_residues,d_residues,N*sizeof(cuyasheint_t),cudaMemcpyDeviceToHost);
+        assert(result == cudaSuccess);
+        for(int i = 0; i < OP_DEGREE; i++)
+            BOOST_CHECK_EQUAL(to_ZZ(h_residues[i]) , ((coefs[i] >> (32*digit)) % (to_ZZ(1) << 32)) % CRTPrimes[0]);
+    }
+    free(h_residues);
+    cudaFree(d_residues);
+    bn_matrix_free(&g);
+
+    poly_free(&a);
+    poly_free(&b);
+}
+
+BOOST_AUTO_TEST_CASE(fixed_width_rounding)
+{
+    const int nq = NTL::NumBits(q);
+    const int N = CUDAFunctions::N;
+    poly_t a;
+    poly_init(&a);
+    std::vector<ZZ> coefs(OP_DEGREE);
+    for(int i = 0; i < OP_DEGREE; i++){
+        coefs[i] = NTL::RandomBnd(CRTProduct/2);
+        poly_set_coeff(&a,i,coefs[i]);
+    }
+    poly_elevate(&a);
+
+    // round(x/q), computed by callCiphertextMulAuxMatrix()
+    bn_matrix_t g;
+    bn_matrix_init(&g,N);
+    callBNToMatrix(&g,a.d_bn_coefs,N,NULL);
+    callCiphertextMulAuxMatrix(&g,nq,NULL);
+    callCRTMatrix(&g,a.d_coefs,CRTPrimes.size(),NULL);
+    a.status = CRTSTATE;
+    bn_matrix_free(&g);
+
+    for(int i = 0; i < OP_DEGREE; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , coefs[i]/q + (coefs[i]%q >= q/2? 1 : 0));
+
+    poly_free(&a);
+}
+
+BOOST_AUTO_TEST_CASE(crt_small_coefs)
+{
+    const int N = CUDAFunctions::N;
+    const int used = OP_DEGREE/2;
+    poly_t a;
+    poly_init(&a);
+    for(int i = 0; i < OP_DEGREE; i++)
+        poly_set_coeff(&a,i,to_ZZ((i%2? -1 : 1)*(i%7)));
+    poly_set_coeff(&a,1,q*q);
+    poly_elevate(&a);
+
+    // Coefficients from used on are taken as zero
+    callCRT(a.d_bn_coefs,used,a.d_coefs,N,CRTPrimes.size(),NULL);
+    cuyasheint_t *h_residues = (cuyasheint_t*)malloc(N*CRTPrimes.size()*sizeof(cuyasheint_t));
+    cudaError_t result = cudaMemcpy(h_residues,a.d_coefs,N*CRTPrimes.size()*sizeof(cuyasheint_t),cudaMemcpyDeviceToHost);
+    assert(result == cudaSuccess);
+    for(unsigned int rid = 0; rid < CRTPrimes.size(); rid++)
+        for(int i = 0; i < OP_DEGREE; i++){
+            const ZZ p = to_ZZ(CRTPrimes[rid]);
+            ZZ expected = (i < used? (i == 1? q*q : to_ZZ((i%2? -1 : 1)*(i%7))) : to_ZZ(0));
+            BOOST_CHECK_EQUAL(to_ZZ(h_residues[i + rid*N]) , ((expected % p) + p) % p);
+        }
+    free(h_residues);
+
+    poly_free(&a);
+}
+
+BOOST_AUTO_TEST_CASE(icrt_garner)
+{
+    poly_t a;
+    poly_init(&a);
+    std::vector<ZZ> coefs(OP_DEGREE);
+    for(int i = 0; i < OP_DEGREE; i++){
+        coefs[i] = NTL::RandomBnd(CRTProduct) - CRTProduct/2;
+        poly_set_coeff(&a,i,coefs[i]);
+    }
+    poly_elevate(&a);
+
+    CUDAFunctions::icrt = ICRT_GARNER;
+    poly_demote(&a);
+    CUDAFunctions::icrt = ICRT_ACCUMULATE;
+    for(int i = 0; i < OP_DEGREE; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , coefs[i]);
+
+    poly_free(&a);
+}
+
+BOOST_AUTO_TEST_CASE(rns_scale_round)
+{
+    const ZZ t = to_ZZ(1024);
+    const ZZ K = t*OP_DEGREE + 1;
+    rns_scale_t s;
+    rns_scale_setup(&s,t,q,OP_DEGREE);
+
+    poly_t a;
+    poly_init(&a);
+    std::vector<ZZ> coefs(OP_DEGREE);
+    for(int i = 0; i < OP_DEGREE; i++){
+        coefs[i] = NTL::RandomBnd(2*q*q) - q*q;
+        poly_set_coeff(&a,i,coefs[i]);
+    }
+    poly_elevate(&a);
+
+    callRNSScaleRound(a.d_coefs,&s,0,true,CUDAFunctions::N,CRTPrimes.size(),NULL);
+    a.status = CRTSTATE;
+    for(int i = 0; i < OP_DEGREE; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , (2*t*coefs[i] + q)/(2*q) + K*q);
+
+    poly_free(&a);
+    rns_scale_free(&s);
+}
+
+BOOST_AUTO_TEST_CASE(param_context_cache)
+{
+    // a*b, without reduction, must match the schoolbook product on any
+    // context
+    auto check_mul = [](int degree){
+        poly_t a, b, c;
+        poly_init(&a);
+        poly_init(&b);
+        poly_init(&c);
+        std::vector<ZZ> va(degree), vb(degree);
+        for(int i = 0; i < degree; i++){
+            va[i] = NTL::RandomBnd(to_ZZ(1024));
+            vb[i] = NTL::RandomBnd(to_ZZ(1024));
+            poly_set_coeff(&a,i,va[i]);
+            poly_set_coeff(&b,i,vb[i]);
+        }
+        poly_mul(&c,&a,&b);
+        for(int k = 0; k < 2*degree-1; k++){
+            ZZ expected = to_ZZ(0);
+            for(int i = max_d(0,k-degree+1); i <= min_d(k,degree-1); i++)
+                expected += va[i]*vb[k-i];
+            BOOST_CHECK_EQUAL(poly_get_coeff(&c,k) , expected);
+        }
+        poly_free(&a);
+        poly_free(&b);
+        poly_free(&c);
+    };
+
+    param_context_t *original = param_context_current();
+    param_context_t *small = param_context_get(OP_DEGREE,q,to_ZZ(1024));
+    check_mul(OP_DEGREE);
+    param_context_t *big = param_context_get(2*OP_DEGREE,q,to_ZZ(1024));
+    BOOST_CHECK(big != small);
+    BOOST_CHECK_EQUAL(CUDAFunctions::N , 4*small->nphi);
+    check_mul(big->nphi);
+
+    // The reciprocals are computed once, with the context
+    bn_t uq = reciprocal_get(&big->reciprocals,RECIPROCAL_Q);
+    std::vector<cuyasheint_t> words(uq.used);
+    cudaMemcpy(&words[0],uq.dp,uq.used*sizeof(cuyasheint_t),cudaMemcpyDeviceToHost);
+    uq.dp = &words[0];
+    BOOST_CHECK_EQUAL(get_ZZ(&uq) , reciprocal_of(q));
+    BOOST_CHECK(big->reciprocals.modulus[RECIPROCAL_M] == CRTProduct);
+
+    // Cache hit
+    BOOST_CHECK(param_context_get(small->nphi,q,to_ZZ(1024)) == small);
+    BOOST_CHECK(param_context_current() == small);
+    BOOST_CHECK_EQUAL(CUDAFunctions::N , 2*small->nphi);
+    BOOST_CHECK(CRTPrimes == small->CRTPrimes);
+    check_mul(small->nphi);
+
+    param_context_switch(big);
+    check_mul(big->nphi);
+
+    // small has the parameters of the fixture, so its globals are written
+    // back before the original context is restored
+    param_context_switch(small);
+    param_context_switch(original);
+    BOOST_CHECK(param_context_current() == original);
+}
+
+BOOST_AUTO_TEST_CASE(mersenne_lanes)
+{
+    // A partial tile, a q that fills its top word and a negative input
+    const int N = CUDAFunctions::N;
+    for(int nq = 89; nq <= 128; nq += 39){
+        const ZZ mq = NTL::power2_ZZ(nq) - 1;
+        poly_t a;
+        poly_init(&a);
+        std::vector<ZZ> coefs(N);
+        for(int i = 0; i < N - 3; i++){
+            coefs[i] = NTL::RandomBnd(CRTProduct/2) * (i % 2? -1 : 1);
+            poly_set_coeff(&a,i,coefs[i]);
+        }
+        poly_elevate(&a);
+
+        bn_matrix_t g;
+        bn_matrix_init(&g,N);
+        callBNToMatrix(&g,a.d_bn_coefs,N,NULL);
+        callMersenneModMatrix(&g,nq,NULL);
+        callCRTMatrix(&g,a.d_coefs,CRTPrimes.size(),NULL);
+        a.status = CRTSTATE;
+        bn_matrix_free(&g);
+
+        for(int i = 0; i < N; i++)
+            BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , ((coefs[i] % mq) + mq) % mq);
+        poly_free(&a);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(reduce_fused)
+{
+    // poly_reduce() from the residues takes the fused pass, whose ICRT
+    // follows CUDAFunctions::icrt
+    const int nphi = OP_DEGREE;
+    const int nq = NTL::NumBits(q);
+    const int modes[] = {ICRT_ACCUMULATE, ICRT_GARNER};
+    for(int mode : modes){
+        poly_t a;
+        poly_init(&a);
+        std::vector<ZZ> coefs(2*nphi);
+        for(int i = 0; i < 2*nphi; i++){
+            coefs[i] = NTL::RandomBnd(CRTProduct/4);
+            poly_set_coeff(&a,i,coefs[i]);
+        }
+        poly_elevate(&a);
+        BOOST_REQUIRE(a.status == CRTSTATE);
+        BOOST_REQUIRE(nq == bn_fixed_params.nq);
+
+        CUDAFunctions::icrt = mode;
+        poly_reduce(&a,nphi,Q,nq);
+        CUDAFunctions::icrt = ICRT_ACCUMULATE;
+        for(int i = 0; i < nphi; i++)
+            BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , (((coefs[i] - coefs[i+nphi]) % q) + q) % q);
+        for(int i = nphi; i < 2*nphi; i++)
+            BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , to_ZZ(0));
+        poly_free(&a);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(wordecomp_bases)
+{
+    // Every digit of WordDecomp, for the specialized and the generic bases
+    const int N = CUDAFunctions::N;
+    poly_t a, b;
+    poly_init(&a);
+    poly_init(&b);
+    std::vector<ZZ> coefs(N);
+    for(int i = 0; i < N; i++){
+        coefs[i] = NTL::RandomBnd(q);
+        poly_set_coeff(&a,i,coefs[i]);
+    }
+    poly_elevate(&a);
+    bn_matrix_t g;
+    bn_matrix_init(&g,N);
+    callBNToMatrix(&g,a.d_bn_coefs,N,NULL);
+
+    const int wordlengths[] = {13, 16, 24, 32, 64};
+    for(int w : wordlengths){
+        const int lwq = (NTL::NumBits(q) + w - 1)/w;
+        for(int digit = 0; digit < lwq; digit++){
+            callCuWordecompMatrix(NULL,w,b.d_coefs,&g,digit,CRTPrimes.size());
+            b.status = CRTSTATE;
+            for(int i = 0; i < N; i++)
+                BOOST_CHECK_EQUAL(poly_get_coeff(&b,i) , (coefs[i] / NTL::power2_ZZ(w*digit)) % NTL::power2_ZZ(w));
+        }
+    }
+    bn_matrix_free(&g);
+    poly_free(&a);
+    poly_free(&b);
+}
+
+BOOST_AUTO_TEST_CASE(rns_decomp)
+{
+    // The RNS digits recompose the coefficients through P/P_G
+    const int N = CUDAFunctions::N;
+    poly_t a, b;
+    poly_init(&a);
+    poly_init(&b);
+    std::vector<ZZ> coefs(N);
+    for(int i = 0; i < N; i++){
+        coefs[i] = NTL::RandomBnd(q);
+        poly_set_coeff(&a,i,coefs[i]);
+    }
+    poly_elevate(&a);
+
+    const int groups[] = {1, 2};
+    for(int group : groups){
+        rns_decomp_t d;
+        rns_decomp_setup(&d, q, group);
+        BOOST_REQUIRE(d.digits == (d.L + group - 1)/group);
+
+        ZZ P = to_ZZ(1);
+        for(int j = 0; j < d.L; j++)
+            P *= CRTPrimes[j];
+
+        std::vector<ZZ> acc(N, to_ZZ(0));
+        for(int digit = 0; digit < d.digits; digit++){
+            ZZ PG = to_ZZ(1);
+            for(int j = digit*group; j < std::min((digit+1)*group, d.L); j++)
+                PG *= CRTPrimes[j];
+
+            callRNSDecompDigit(b.d_coefs,a.d_coefs,&d,digit,N,CRTPrimes.size(),NULL);
+            b.status = CRTSTATE;
+            for(int i = 0; i < N; i++)
+                acc[i] += poly_get_coeff(&b,i) * (P / PG);
+        }
+        for(int i = 0; i < N; i++)
+            BOOST_CHECK_EQUAL(acc[i] , coefs[i]);
+        rns_decomp_free(&d);
+    }
+    poly_free(&a);
+    poly_free(&b);
+}
+
+BOOST_AUTO_TEST_CASE(balanced_residues)
+{
+    // Negative coefficients go through the CRT, the ICRT and the reduction
+    // as they are
+    const int nphi = OP_DEGREE;
+    poly_t a;
+    poly_init(&a);
+    std::vector<ZZ> coefs(2*nphi);
+    for(int i = 0; i < 2*nphi; i++){
+        coefs[i] = NTL::RandomBnd(CRTProduct/4) * (i % 3? -1 : 1);
+        poly_set_coeff(&a,i,coefs[i]);
+    }
+    poly_elevate(&a);
+    poly_demote(&a);
+    for(int i = 0; i < 2*nphi; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , coefs[i]);
+
+    poly_cyclotomic_reduction(&a,nphi);
+    for(int i = 0; i < nphi; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , coefs[i] - coefs[i+nphi]);
+    for(int i = nphi; i < 2*nphi; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , to_ZZ(0));
+
+    // From HOSTSTATE, coefficients beyond M/2 are folded on the limb matrix
+    poly_clear(&a);
+    for(int i = 0; i < 2*nphi; i++){
+        coefs[i] = CRTProduct/2 + NTL::RandomBnd(CRTProduct/4);
+        poly_set_coeff(&a,i,coefs[i]);
+    }
+    poly_cyclotomic_reduction(&a,nphi);
+    for(int i = 0; i < nphi; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , coefs[i] - coefs[i+nphi]);
+    poly_free(&a);
+
+    // Noise samples keep their sign
+    Distribution xerr = Distribution(DISCRETE_GAUSSIAN, 8*0.4, 8*6);
+    poly_t e;
+    poly_init(&e);
+    xerr.get_sample(&e,nphi-1);
+    bool negative = false;
+    for(int i = 0; i < nphi-1; i++){
+        const ZZ c = poly_get_coeff(&e,i);
+        BOOST_CHECK(NTL::abs(c) <= 8*6);
+        negative |= (c < 0);
+    }
+    BOOST_CHECK(negative);
+    poly_free(&e);
+}
+
+BOOST_AUTO_TEST_CASE(barrett_reduce)
+{
+    // A q of the same size that is not a Mersenne number takes the Barrett
+    // passes
+    const int N = CUDAFunctions::N;
+    const int nphi = N/2;
+    const int nq = NTL::NumBits(q);
+    ZZ q2 = NTL::power2_ZZ(nq-1) + NTL::RandomBnd(NTL::power2_ZZ(nq-1)) + 1;
+    bn_fixed_setup(q2);
+    BOOST_REQUIRE(!bn_fixed_params.mersenne);
+    BOOST_REQUIRE(bn_fixed_has_q(q2) && !bn_fixed_has_q(q));
+
+    // Mod q, with negative inputs
+    std::vector<ZZ> coefs(N);
+    poly_t a;
+    poly_init(&a);
+    for(int i = 0; i < N; i++){
+        coefs[i] = NTL::RandomBnd(CRTProduct/2) * (i % 2? -1 : 1);
+        poly_set_coeff(&a,i,coefs[i]);
+    }
+    poly_elevate(&a);
+    bn_matrix_t g;
+    bn_matrix_init(&g,N);
+    callBNToMatrix(&g,a.d_bn_coefs,N,NULL);
+    callModQMatrix(&g,NULL);
+    callCRTMatrix(&g,a.d_coefs,CRTPrimes.size(),NULL);
+    a.status = CRTSTATE;
+    for(int i = 0; i < N; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , ((coefs[i] % q2) + q2) % q2);
+
+    // round(x/q) keeps the sign
+    for(int i = 0; i < N; i++)
+        poly_set_coeff(&a,i,coefs[i]);
+    poly_elevate(&a);
+    callBNToMatrix(&g,a.d_bn_coefs,N,NULL);
+    callCiphertextMulAuxMatrix(&g,nq,NULL);
+    callCRTMatrix(&g,a.d_coefs,CRTPrimes.size(),NULL);
+    a.status = CRTSTATE;
+    for(int i = 0; i < N; i++){
+        const ZZ x = NTL::abs(coefs[i]);
+        ZZ expected = x / q2 + (x % q2 >= q2/2? 1 : 0);
+        if(coefs[i] < 0)
+            expected = -expected;
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) % CRTProduct , expected % CRTProduct);
+    }
+    bn_matrix_free(&g);
+
+    // poly_reduce() from the residues reduces by the q of bn_fixed_setup()
+    bn_t Q2;
+    get_words(&Q2,q2);
+    for(int i = 0; i < N; i++){
+        coefs[i] = NTL::RandomBnd(CRTProduct/4);
+        poly_set_coeff(&a,i,coefs[i]);
+    }
+    poly_elevate(&a);
+    poly_reduce(&a,nphi,Q2,nq);
+    for(int i = 0; i < nphi; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , (((coefs[i] - coefs[i+nphi]) % q2) + q2) % q2);
+    bn_fixed_setup(q);
+    for(int i = 0; i < N; i++)
+        poly_set_coeff(&a,i,coefs[i]);
+    poly_elevate(&a);
+    poly_reduce(&a,nphi,Q,nq);
+    for(int i = 0; i < nphi; i++)
+        BOOST_CHECK_EQUAL(poly_get_coeff(&a,i) , (((coefs[i] - coefs[i+nphi]) % q) + q) % q);
+    poly_free(&a);
+}
+
 BOOST_AUTO_TEST_CASE(simpleReduce)
 {
     for(int count = 0; count < NTESTS; count++){
@@ -568,8 +1218,6 @@ BOOST_AUTO_TEST_CASE(simple_mul)
     poly_init(&mj);
     poly_set_coeff(&mj,0,to_ZZ(j));
 
-    log_debug("f: " + poly_print(&cipher->f));
-    log_debug("h: " + poly_print(&cipher->h));
 
     // Encrypt
     // 
@@ -588,7 +1236,7 @@ BOOST_AUTO_TEST_CASE(simple_mul)
     // 
     cipher_t cz;
     cipher_init(&cz);
-    cipher_mul(&cz,&ci,&cj);
+    cipher_mul(&cz,&ci,&cj,cipher->keys.get());
 
     poly_t m_decrypted;
     poly_init(&m_decrypted);
@@ -635,7 +1283,7 @@ BOOST_AUTO_TEST_CASE(mul)
         // 
         cipher_t cz;
         cipher_init(&cz);
-        cipher_mul(&cz,&ci,&cj);
+        cipher_mul(&cz,&ci,&cj,cipher->keys.get());
 
         poly_t m_decrypted;
         poly_init(&m_decrypted);
@@ -680,4 +1328,458 @@ BOOST_AUTO_TEST_CASE(encryptdecrypt)
     }
 }
 
-BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
+BOOST_AUTO_TEST_CASE(encrypt_batch)
+{
+    // Every ciphertext of a batch decrypts on its own, and multiplies
+    const int K = 5;
+    std::vector<poly_t> m(K);
+    std::vector<cipher_t> c(K);
+    std::vector<ZZ> values(K);
+    for(int k = 0; k < K; k++){
+        values[k] = to_ZZ(NTL::RandomWord() % 1024);
+        poly_init(&m[k]);
+        poly_set_coeff(&m[k],0,values[k]);
+        cipher_init(&c[k]);
+    }
+    cipher->encrypt_batch(&c[0],&m[0],K);
+
+    // decrypt() transforms the residues of its operand, so the product is
+    // taken first
+    cipher_t cz;
+    cipher_init(&cz);
+    cipher_mul(&cz,&c[0],&c[1],cipher->keys.get());
+    poly_t m_decrypted;
+    poly_init(&m_decrypted);
+    cipher->decrypt(&m_decrypted,cz);
+    BOOST_CHECK_EQUAL(values[0]*values[1] % t , poly_get_coeff(&m_decrypted, 0) % t);
+
+    for(int k = 0; k < K; k++){
+        cipher->decrypt(&m_decrypted,c[k]);
+        BOOST_CHECK_EQUAL(values[k] % t , poly_get_coeff(&m_decrypted, 0) % t);
+    }
+
+    poly_free(&m_decrypted);
+    cipher_free(&cz);
+    for(int k = 0; k < K; k++){
+        poly_free(&m[k]);
+        cipher_free(&c[k]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(decrypt_batch)
+{
+    // Fresh ciphertexts and a product, on the same batch, decrypt as with
+    // decrypt()
+    const int K = 4;
+    std::vector<poly_t> m(K);
+    std::vector<cipher_t> c(K+1);
+    std::vector<ZZ> a(K), b(K);
+    for(int k = 0; k < K; k++){
+        a[k] = to_ZZ(NTL::RandomWord() % 1024);
+        b[k] = to_ZZ(NTL::RandomWord() % 1024);
+        poly_init(&m[k]);
+        poly_set_coeff(&m[k],0,a[k]);
+        poly_set_coeff(&m[k],1,b[k]);
+        cipher_init(&c[k]);
+    }
+    cipher_init(&c[K]);
+    cipher->encrypt_batch(&c[0],&m[0],K);
+    cipher_mul(&c[K],&c[0],&c[1],cipher->keys.get());
+
+    std::vector<cuyasheint_t> m_decrypted((K+1)*Yashe::nphi);
+    cipher->decrypt_batch(&m_decrypted[0],&c[0],K+1);
+
+    for(int k = 0; k <= K; k++){
+        std::vector<ZZ> expected(Yashe::nphi, to_ZZ(0));
+        if(k < K){
+            expected[0] = a[k] % t;
+            expected[1] = b[k] % t;
+        }else{
+            expected[0] = (a[0]*a[1]) % t;
+            expected[1] = (a[0]*b[1] + a[1]*b[0]) % t;
+            expected[2] = (b[0]*b[1]) % t;
+        }
+        for(int i = 0; i < Yashe::nphi; i++)
+            BOOST_CHECK_EQUAL(expected[i], to_ZZ(m_decrypted[k*Yashe::nphi + i]));
+    }
+
+    for(int k = 0; k < K; k++)
+        poly_free(&m[k]);
+    for(int k = 0; k <= K; k++)
+        cipher_free(&c[k]);
+}
+
+BOOST_AUTO_TEST_CASE(decrypt_batch_mixed)
+{
+    // Ciphertexts on every status, with and without aftermul, on the same
+    // batch. They decrypt as with decrypt() and are left as they were.
+    const int K = 6;
+    const int states[K] = {HOSTSTATE, CRTSTATE, TRANSSTATE, CRTSTATE, TRANSSTATE, HOSTSTATE};
+    const bool aftermul[K] = {false, false, false, true, true, true};
+    std::vector<poly_t> m(K);
+    std::vector<cipher_t> c(K);
+    for(int k = 0; k < K; k++){
+        poly_init(&m[k]);
+        poly_set_coeff(&m[k],0,to_ZZ(NTL::RandomWord() % 1024));
+        cipher_init(&c[k]);
+    }
+    cipher->encrypt_batch(&c[0],&m[0],K);
+    for(int k = 0; k < K; k++){
+        while(c[k].p.status < states[k])
+            poly_elevate(&c[k].p);
+        while(c[k].p.status > states[k])
+            poly_demote(&c[k].p);
+        // The product of c by ff is not a message, but both decryptions
+        // must still agree on it
+        c[k].aftermul = aftermul[k];
+    }
+
+    std::vector<cuyasheint_t> m_decrypted(K*Yashe::nphi), m_again(K*Yashe::nphi);
+    cipher->decrypt_batch(&m_decrypted[0],&c[0],K);
+    for(int k = 0; k < K; k++)
+        BOOST_CHECK_EQUAL(c[k].p.status, states[k]);
+    cipher->decrypt_batch(&m_again[0],&c[0],K);
+    BOOST_CHECK(m_decrypted == m_again);
+
+    // decrypt() transforms the residues of its operand, so it goes last
+    poly_t mk;
+    poly_init(&mk);
+    for(int k = 0; k < K; k++){
+        cipher->decrypt(&mk,c[k]);
+        for(int i = 0; i < Yashe::nphi; i++)
+            BOOST_CHECK_EQUAL(poly_get_coeff(&mk,i) % t, to_ZZ(m_decrypted[k*Yashe::nphi + i]));
+        if(!aftermul[k])
+            BOOST_CHECK_EQUAL(poly_get_coeff(&m[k],0) % t, to_ZZ(m_decrypted[k*Yashe::nphi]));
+    }
+
+    poly_free(&mk);
+    for(int k = 0; k < K; k++){
+        poly_free(&m[k]);
+        cipher_free(&c[k]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mul_prime_q)
+{
+    // A prime q of nq bits in place of 2^nq - 1
+    ZZ q2 = NTL::power2_ZZ(Yashe::nq-1) + NTL::RandomBnd(NTL::power2_ZZ(Yashe::nq-1));
+    q2 += 1 - (q2 % 2);
+    while(!NTL::ProbPrime(q2))
+        q2 += 2;
+    ZZ_p::init(q2);
+    ZZ_pX NTL_Phi;
+    for(int i = 0; i <= poly_get_deg(&phi);i++)
+      NTL::SetCoeff(NTL_Phi,i,conv<ZZ_p>(poly_get_coeff(&phi,i)));
+    ZZ_pE::init(NTL_Phi);
+    // A q of any other size is rejected rather than replaced
+    Yashe::q = q2/2;
+    BOOST_CHECK_THROW(cipher->generate_keys(), std::runtime_error);
+    Yashe::q = q2;
+    cipher->generate_keys();
+    BOOST_REQUIRE(Yashe::q == q2);
+    BOOST_REQUIRE(!bn_fixed_params.mersenne);
+
+    for(int n = 0; n < NTESTS; n++){
+        const ZZ i = NTL::RandomBnd(to_ZZ(t));
+        const ZZ j = NTL::RandomBnd(to_ZZ(t));
+        BOOST_CHECK_EQUAL( i*j % (t) , mul_decrypt(cipher,i,j));
+    }
+
+    // Back to the fixture's q = 2^nq - 1: NTL's moduli, the keys and the
+    // fixed-width passes
+    ZZ_p::init(q);
+    ZZ_pX NTL_Phi_q;
+    for(int i = 0; i <= poly_get_deg(&phi);i++)
+      NTL::SetCoeff(NTL_Phi_q,i,conv<ZZ_p>(poly_get_coeff(&phi,i)));
+    ZZ_pE::init(NTL_Phi_q);
+    Yashe::q = q;
+    cipher->generate_keys();
+    BOOST_CHECK(ZZ_p::modulus() == q);
+    BOOST_CHECK(bn_fixed_has_q(q) && bn_fixed_params.mersenne);
+}
+
+BOOST_AUTO_TEST_CASE(mul_word_bases)
+{
+    // Keyswitching with other WordDecomp bases
+    const int wordlengths[] = {16, 24, 64};
+    for(int w : wordlengths){
+        Yashe::w = w;
+        cipher->generate_keys();
+        BOOST_REQUIRE(cipher->keys->lwq == (Yashe::nq + w - 1)/w);
+
+        // The product only decrypts through the keyswitch, so a wrong
+        // W-shift on gamma is caught
+        for(int n = 0; n < NTESTS; n++){
+            const ZZ i = NTL::RandomBnd(to_ZZ(t));
+            const ZZ j = NTL::RandomBnd(to_ZZ(t));
+            BOOST_CHECK_EQUAL( i*j % (t) , mul_decrypt(cipher,i,j));
+        }
+    }
+    Yashe::w = 32;
+}
+
+BOOST_AUTO_TEST_CASE(mul_rns_keyswitch)
+{
+    // Keyswitching with RNS digits of one prime
+    Yashe::keyswitch = KEYSWITCH_RNS;
+    Yashe::rns_group = 1;
+    cipher->generate_keys();
+    BOOST_REQUIRE(cipher->keys->rho.size() == (unsigned int)cipher->keys->decomp.digits);
+    for(int n = 0; n < NTESTS; n++){
+        const ZZ i = NTL::RandomBnd(to_ZZ(t));
+        const ZZ j = NTL::RandomBnd(to_ZZ(t));
+        BOOST_CHECK_EQUAL( i*j % (t) , mul_decrypt(cipher,i,j));
+    }
+
+    // The noise of the keyswitch grows with P_G. Digits of two primes are
+    // too big for a 127-bit q, so the group is rejected and the keys of the
+    // previous call are kept.
+    Yashe::rns_group = 2;
+    BOOST_CHECK_THROW(cipher->generate_keys(), std::runtime_error);
+    BOOST_CHECK_EQUAL(cipher->keys->decomp.group, 1);
+    BOOST_CHECK_EQUAL(cipher->keys->rho.size(), (unsigned int)cipher->keys->decomp.digits);
+    Yashe::keyswitch = KEYSWITCH_WORDECOMP;
+    Yashe::rns_group = 1;
+    cipher->generate_keys();
+}
+
+BOOST_AUTO_TEST_CASE(pool_steady_state)
+{
+    // Once the working set is allocated, encrypt/mul/decrypt should be served
+    // by the pool without new system allocations
+    pool_stats_t before;
+    for(int n = 0; n < 4; n++){
+        if(n == 1)
+            before = pool_get_stats();
+
+        const ZZ i = NTL::RandomBnd(to_ZZ(t));
+        const ZZ j = NTL::RandomBnd(to_ZZ(t));
+        BOOST_CHECK_EQUAL( i*j % (t) , mul_decrypt(cipher,i,j));
+    }
+    pool_stats_t after = pool_get_stats();
+
+    BOOST_CHECK_EQUAL(before.system_allocs, after.system_allocs);
+    BOOST_CHECK_EQUAL(before.live_blocks, after.live_blocks);
+}
+
+BOOST_AUTO_TEST_CASE(pool_cross_thread)
+{
+    // A block freed by another thread is cached there, and handed back to
+    // the other threads once it exits
+    const size_t size = 12345*sizeof(cuyasheint_t);
+    const pool_stats_t before = pool_get_stats();
+    void *ptr = pool_malloc(size);
+    std::thread worker([ptr](){ pool_free(ptr); });
+    worker.join();
+
+    pool_stats_t after = pool_get_stats();
+    BOOST_CHECK_EQUAL(before.live_blocks, after.live_blocks);
+    BOOST_CHECK_EQUAL(before.cached_blocks + 1, after.cached_blocks);
+
+    void *again = pool_malloc(size);
+    BOOST_CHECK(again == ptr);
+    pool_free(again);
+    after = pool_get_stats();
+    BOOST_CHECK_EQUAL(before.system_allocs + 1, after.system_allocs);
+    BOOST_CHECK_EQUAL(before.hits + 1, after.hits);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_mul)
+{
+    // Worker contexts share the keys, so each thread may encrypt, multiply
+    // and decrypt on its own. Checks are made after the threads join.
+    const int T = 4;
+    std::vector<ZZ> expected(T), decrypted(T);
+    #pragma omp parallel for num_threads(T) schedule(static,1)
+    for(int k = 0; k < T; k++){
+        Yashe worker(*cipher, SEED + 2*k + 2);
+        worker.init_workspace(1);
+
+        const ZZ i = to_ZZ(3*k + 1) % to_ZZ(t);
+        const ZZ j = to_ZZ(5*k + 2) % to_ZZ(t);
+        expected[k] = i*j % to_ZZ(t);
+        decrypted[k] = mul_decrypt(&worker,i,j);
+        if(omp_get_thread_num() != 0)
+            keyswitch_workspace_free(&Yashe::workspace);
+    }
+    for(int k = 0; k < T; k++)
+        BOOST_CHECK_EQUAL(expected[k] , decrypted[k]);
+}
+
+BOOST_AUTO_TEST_CASE(worker_keeps_keys)
+{
+    // A worker holds the key set it was built with, so it still decrypts
+    // once the owner generates new keys
+    Yashe worker(*cipher, SEED + 1);
+    const ZZ i = NTL::RandomBnd(to_ZZ(t));
+    const ZZ j = NTL::RandomBnd(to_ZZ(t));
+
+    cipher->generate_keys();
+    BOOST_REQUIRE(worker.keys != cipher->keys);
+    BOOST_CHECK_EQUAL( i*j % (t) , mul_decrypt(&worker,i,j));
+    BOOST_CHECK_EQUAL( i*j % (t) , mul_decrypt(cipher,i,j));
+}
+
+BOOST_AUTO_TEST_CASE(mul_workspace)
+{
+    // A multiplication takes its keyswitch buffers from the workspace, so it
+    // draws fewer blocks from the pool than one without it
+    const ZZ i = NTL::RandomBnd(to_ZZ(t));
+    const ZZ j = NTL::RandomBnd(to_ZZ(t));
+
+    poly_t mi;
+    poly_init(&mi);
+    poly_set_coeff(&mi,0,i);
+
+    poly_t mj;
+    poly_init(&mj);
+    poly_set_coeff(&mj,0,j);
+
+    cipher_t ci;
+    cipher_init(&ci);
+    cipher->encrypt(&ci,mi);
+
+    cipher_t cj;
+    cipher_init(&cj);
+    cipher->encrypt(&cj,mj);
+
+    keyswitch_workspace_init(&Yashe::workspace, cipher->keys->lwq, 2);
+    uint64_t hits[2];
+    for(int n = 0; n < 2; n++){
+        if(n == 1)
+            keyswitch_workspace_free(&Yashe::workspace);
+
+        cipher_t cz;
+        cipher_init(&cz);
+        const pool_stats_t before = pool_get_stats();
+        cipher_mul(&cz,&ci,&cj,cipher->keys.get());
+        hits[n] = pool_get_stats().hits - before.hits;
+
+        poly_t m_decrypted;
+        poly_init(&m_decrypted);
+        cipher->decrypt(&m_decrypted,cz);
+        BOOST_CHECK_EQUAL( i*j % (t) , poly_get_coeff(&m_decrypted, 0)% to_ZZ(t));
+
+        poly_free(&m_decrypted);
+        cipher_free(&cz);
+    }
+    BOOST_CHECK_LT(hits[0], hits[1]);
+    keyswitch_workspace_init(&Yashe::workspace, cipher->keys->lwq, 1);
+
+    poly_free(&mi);
+    poly_free(&mj);
+    cipher_free(&ci);
+    cipher_free(&cj);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#ifdef HOST_BACKEND
+BOOST_AUTO_TEST_SUITE(HostFixture)
+
+BOOST_AUTO_TEST_CASE(ntt)
+{
+    const uint64_t p = HOST_NTT_PRIME;
+    host_modulus_t mod;
+    host_modulus_init(&mod,p);
+
+    // Small lengths only run the scalar butterflies
+    for(int N = 2; N <= 1024; N <<= 1){
+        host_ntt_table_t table;
+        const uint64_t w = host_powmod(HOST_NTT_PRIMITIVE_ROOT,(p-1)/N,&mod);
+        host_ntt_table_init(&table,p,w,N);
+
+        std::vector<uint64_t> a(N), b(N), expected(N,0);
+        for(int i = 0; i < N; i++){
+            // The forward transform accepts inputs up to 4p
+            a[i] = (((uint64_t)rand() << 32) | rand()) % (4*p);
+            b[i] = (((uint64_t)rand() << 32) | rand()) % p;
+        }
+        for(int i = 0; i < N; i++)
+            for(int j = 0; j < N; j++)
+                expected[(i+j)%N] = host_addmod(expected[(i+j)%N], host_mulmod(a[i]%p,b[j],&mod), p);
+
+        host_ntt_forward(&a[0],&table);
+        host_ntt_forward(&b[0],&table);
+        for(int i = 0; i < N; i++){
+            BOOST_REQUIRE(a[i] < p);
+            a[i] = host_mulmod(a[i],b[i],&mod);
+        }
+        host_ntt_inverse(&a[0],&table);
+
+        for(int i = 0; i < N; i++)
+            BOOST_CHECK_EQUAL(a[i] , expected[i]);
+
+        host_ntt_table_free(&table);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(negacyclic_mul)
+{
+    const int nphi = 32;
+    const int mersenne_n = 127;
+    const ZZ q = NTL::power2_ZZ(mersenne_n) - 1;
+    bn_t Q;
+    get_words(&Q,q);
+
+    CUDAFunctions::transform = NEGACYCLIC_NTTMUL;
+    gen_crt_primes(q,nphi);
+    CUDAFunctions::init(nphi);
+
+    for(int ntest = 0; ntest < NTESTS; ntest++){
+        poly_t a, b, c;
+        poly_init(&a);
+        poly_init(&b);
+        poly_init(&c);
+
+        // Coefficient nphi of a is wrapped by the transform
+        std::vector<ZZ> A(nphi+1), B(nphi);
+        for(int i = 0; i <= nphi; i++){
+            A[i] = NTL::RandomBnd(q);
+            poly_set_coeff(&a,i,A[i]);
+        }
+        for(int i = 0; i < nphi; i++){
+            B[i] = NTL::RandomBnd(q);
+            poly_set_coeff(&b,i,B[i]);
+        }
+
+        poly_mul(&c,&a,&b);
+        poly_reduce(&c,nphi,Q,mersenne_n);
+
+        // With no product, the CRTSTATE residues are folded by poly_reduce()
+        poly_t d;
+        poly_init(&d);
+        for(int i = 0; i <= nphi; i++)
+            poly_set_coeff(&d,i,A[i]);
+        poly_elevate(&d);
+        poly_reduce(&d,nphi,Q,mersenne_n);
+
+        // Schoolbook product mod x^nphi + 1
+        std::vector<ZZ> expected(nphi,to_ZZ(0));
+        A[0] -= A[nphi];
+        for(int i = 0; i < nphi; i++)
+            BOOST_CHECK_EQUAL(poly_get_coeff(&d,i) , A[i] % q);
+        poly_free(&d);
+        for(int i = 0; i < nphi; i++)
+            for(int j = 0; j < nphi; j++)
+                if(i + j < nphi)
+                    expected[i+j] += A[i]*B[j];
+                else
+                    expected[i+j-nphi] -= A[i]*B[j];
+
+        for(int i = 0; i < nphi; i++)
+            BOOST_CHECK_EQUAL(poly_get_coeff(&c,i) , expected[i] % q);
+        BOOST_CHECK(poly_get_deg(&c) < nphi);
+
+        poly_free(&a);
+        poly_free(&b);
+        poly_free(&c);
+    }
+
+    // The twiddles are rebuilt for the cyclic transform
+    CUDAFunctions::transform = NTTMUL;
+    CUDAFunctions::init(nphi);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif
@@ -18,8 +18,6 @@
 
 #include "ciphertext.h"
 
-void cipher_keyswitch(cipher_t *cmul, cipher_t c);
-
 ///////////////////////////////////////////////////
 ///
 void cipher_init(cipher_t *a){
@@ -29,52 +27,55 @@ void cipher_init(cipher_t *a){
 
 /**
  * [cipher_init_keyswitch description]
+ * @param a    [description]
+ * @param keys input: the buffers fit its evaluation key
+ */
+void cipher_init_keyswitch(cipher_t *a, const yashe_keys_t *keys){
+	// Allocates one polynomial per word or per RNS digit
+	const int digits = keys->digits();
+	a->P.resize(digits);
+	for(int i = 0; i < digits; i++)
+		poly_init(&a->P[i]);
+}
+
+/**
+ * Releases the buffers allocated by cipher_init_keyswitch()
  * @param a [description]
  */
-void cipher_init_keyswitch(cipher_t *a){
-	cudaError_t result;
-	int size = CUDAFunctions::N*Yashe::lwq;
-
-	// Big-number array
-	bn_t *h_bn_coefs;
-	h_bn_coefs = (bn_t*)malloc(size*sizeof(bn_t));
-	cuyasheint_t *d_bn_coefs_dp;
-	result = cudaMalloc((void**)&d_bn_coefs_dp,size*STD_BNT_WORDS_ALLOC*sizeof(cuyasheint_t));
-	assert( result == cudaSuccess);
-	
+void cipher_free_keyswitch(cipher_t *a){
+	if(a->P.size() == 0)
+		return;
 
-	// Init on host
-	for(int i = 0; i < size; i++){
-		h_bn_coefs[i].alloc = STD_BNT_WORDS_ALLOC;
-		h_bn_coefs[i].used = 0;
-		h_bn_coefs[i].sign = BN_POS;
-		h_bn_coefs[i].dp = d_bn_coefs_dp + i*STD_BNT_WORDS_ALLOC;
-	}
+	for(unsigned int i = 0; i < a->P.size(); i++)
+		poly_free(&a->P[i]);
+	a->P.clear();
+}
 
-	// Copy to device	
-	result = cudaMalloc((void**)&a->d_bn_coefs,size*sizeof(bn_t));
-	assert ( result == cudaSuccess);
-	result = cudaMemcpyAsync(a->d_bn_coefs,h_bn_coefs,size*sizeof(bn_t),cudaMemcpyHostToDevice);
-	assert( result == cudaSuccess);
-
-	// Allocates lwq polynomials
-	// a->P = (poly_t*) malloc (Yashe::lwq*sizeof(poly_t));
-	a->P.resize(Yashe::lwq);
-	for(int i = 0; i < Yashe::lwq; i++){
-		// After initialization, it frees d_bn_coefs and sets it again with consecutive
-		// memory addresses
-		// 
-		poly_init(&a->P[i]);
-		cudaError_t result = cudaFree(a->P[i].d_bn_coefs);
-		assert(result == cudaSuccess);
+void keyswitch_workspace_init(keyswitch_workspace_t *ws, int digits, int K){
+	assert(digits > 0 && K > 0);
+	keyswitch_workspace_free(ws);
 
-		a->P[i].d_bn_coefs = a->d_bn_coefs + i*CUDAFunctions::N;
-	}
+	ws->K = K;
+	ws->digits = digits;
+	ws->P.resize(K*digits);
+	for(int i = 0; i < K*digits; i++)
+		poly_init(&ws->P[i]);
+	bn_matrix_init(&ws->g, K*CUDAFunctions::N);
+}
 
+void keyswitch_workspace_free(keyswitch_workspace_t *ws){
+	for(unsigned int i = 0; i < ws->P.size(); i++)
+		poly_free(&ws->P[i]);
+	ws->P.clear();
+	if(ws->g.N > 0)
+		bn_matrix_free(&ws->g);
+	ws->K = 0;
+	ws->digits = 0;
 }
 
 void cipher_free(cipher_t *a){
 	poly_free(&a->p);
+	cipher_free_keyswitch(a);
 }
 
 void cipher_add(cipher_t *c, cipher_t *a,cipher_t *b){
@@ -82,80 +83,112 @@ void cipher_add(cipher_t *c, cipher_t *a,cipher_t *b){
 	c->level += 1;
 }
 
-void cipher_mul(cipher_t *c,cipher_t *a,cipher_t *b){
+void cipher_mul(cipher_t *c,cipher_t *a,cipher_t *b,const yashe_keys_t *keys){
 
 	// g = c1*c2
 	poly_mul(&c->p, &a->p, &b->p);
 	// poly_mersenne(&c->p,Yashe::Q,Yashe::nq);
 	// log_debug("c1*c2: " + poly_print(&c->p));
-	// g = t*c1*c2
-	poly_mul(&c->p,&c->p,&Yashe::t);
-	// log_debug("t*c1*c2: "+poly_print(&c->p));
-	// log_debug("t*c1*c2 in R: "+poly_print(&c->p));
-
-	// g = approx( g/q )
-	poly_icrt(&c->p);
-	poly_cyclotomic_reduction(&c->p, Yashe::nphi);
-	callCiphertextMulAux(	c->p.d_bn_coefs,
-							Yashe::Q,
-							Yashe::nq,
-							CUDAFunctions::N,
-							NULL );
-	callMersenneMod(c->p.d_bn_coefs, Yashe::Q, Yashe::nq, CUDAFunctions::N, NULL);
+
+	// g = approx( t*g/q )
+	// t is folded into the scale, so the residues are rounded in place and
+	// only the Mersenne reduction needs a limb matrix
+	// A negacyclic product is already reduced by x^nphi + 1
+	const bool folded = (CUDAFunctions::transform == NEGACYCLIC_NTTMUL &&
+						c->p.status == TRANSSTATE);
+	if(c->p.status == TRANSSTATE)
+		poly_demote(&c->p);
+	callRNSScaleRound(	c->p.d_coefs,
+						&keys->scale,
+						(folded? 0 : Yashe::nphi),
+						true,
+						CUDAFunctions::N,
+						CRTPrimes.size(),
+						NULL);
+
+	// The limb matrix is the first N coefficients of the workspace, if there
+	// is one. The ICRT writes every limb, so it isn't cleared.
+	const bool owner = (Yashe::workspace.K == 0);
+	bn_matrix_t g;
+	if(owner)
+		bn_matrix_init(&g, CUDAFunctions::N);
+	else{
+		g = Yashe::workspace.g;
+		g.N = CUDAFunctions::N;
+	}
+	callICRTMatrix(&g, c->p.d_coefs, CRTPrimes.size(), NULL);
+	callModQMatrix(&g, NULL);
 	
-	cipher_keyswitch(c, *c);
-		callCRT(c->p.d_bn_coefs,
-		CUDAFunctions::N,
-		c->p.d_coefs,
-		CUDAFunctions::N,
-		CRTPrimes.size(),
-		0x0	);
-	c->p.status = CRTSTATE;
+	// The keyswitch output replaces c, so it decrypts with f
+	cipher_keyswitch(c, *c, &g, keys);
+	if(owner)
+		bn_matrix_free(&g);
+	poly_reduce(&c->p, Yashe::nphi, Yashe::Q, Yashe::nq);
 	c->level = std::max(a->level,b->level) + 1;	
-	c->aftermul = true;
+	c->aftermul = false;
 	// log_debug("c_mul: "+poly_print(&c->p));
 }
 
-void cipher_keyswitch(cipher_t *cmul, cipher_t c){
-
-	// keyswitch auxiliar variable not initialized
-	if(c.P.size() == 0)
-		cipher_init_keyswitch(&c);
+/**
+ * [cipher_keyswitch description]
+ * @param cmul [description]
+ * @param c    [description]
+ * @param g    input: the coefficients of c, on [0,q)
+ * @param keys input: the evaluation key is taken from it
+ */
+void cipher_keyswitch(cipher_t *cmul, cipher_t c, bn_matrix_t *g, const yashe_keys_t *keys){
+
+	// Digits are written to the auxiliar buffers of c, if it has any, or to
+	// the workspace of the evaluation key. Without either, c is a copy, so
+	// the buffers allocated here are released before returning.
+	const int digits = keys->digits();
+	const bool owner = (c.P.size() == 0 && Yashe::workspace.digits != digits);
+	if(owner)
+		cipher_init_keyswitch(&c, keys);
+	poly_t *P = (c.P.size() > 0? &c.P[0] : &Yashe::workspace.P[0]);
+
+	if(keys->keyswitch == KEYSWITCH_RNS){
+		// RNS digits are taken from the residues of the coefficients on [0,q)
+		callCRTMatrix(g, c.p.d_coefs, CRTPrimes.size(), NULL);
+		c.p.status = CRTSTATE;
+
+		for(int i = 0; i < digits; i++){
+			callRNSDecompDigit(	P[i].d_coefs,
+								c.p.d_coefs,
+								&keys->decomp,
+								i,
+								CUDAFunctions::N,
+								CRTPrimes.size(),
+								NULL);
+			P[i].status = CRTSTATE;
+		}
+
+		poly_dot(&cmul->p, P, yashe_keys_t::read(keys->rho[0]), digits);
+		c.aftermul = false;
+
+		if(owner)
+			cipher_free_keyswitch(&c);
+		return;
+	}
 
 	// WordDecomp
-	callCuWordecomp(	NULL,
-						Yashe::w,
-						c.d_bn_coefs, // Array of lwq polynomial
-						c.p.d_bn_coefs, // operand
-						Yashe::lwq,
-						CUDAFunctions::N);
-	for(int i = 0; i < Yashe::lwq; i++){
-		callCRT(c.P.at(i).d_bn_coefs,
-			CUDAFunctions::N,
-			c.P.at(i).d_coefs,
-			CUDAFunctions::N,
-			CRTPrimes.size(),
-			0x0	);
-		c.P.at(i).status = CRTSTATE;
-	}
-	
-	callCRT(c.p.d_bn_coefs,
-		CUDAFunctions::N,
-		c.p.d_coefs,
-		CUDAFunctions::N,
-		CRTPrimes.size(),
-		0x0	);
-	c.p.status = CRTSTATE;
-
-	// Each polynomial in c.P will be multiplied with a polynomial in evk and
-	// added to cmul
-	
-	for ( int i = 0; i < Yashe::lwq; i++){
-		poly_mul(&c.P.at(i), &c.P.at(i), &Yashe::gamma.at(i));
-		poly_add(&cmul->p,&cmul->p,&c.P.at(i));
+	// Each word is written straight to the residues of P[i]
+	for(int i = 0; i < digits; i++){
+		callCuWordecompMatrix(	NULL,
+								Yashe::w,
+								P[i].d_coefs,
+								g, // operand
+								i,
+								CRTPrimes.size());
+		P[i].status = CRTSTATE;
 	}
 
-	c.aftermul = false;
+	// Each polynomial in P will be multiplied with a polynomial in evk and
+	// the products summed on cmul
+	poly_dot(&cmul->p, P, yashe_keys_t::read(keys->gamma[0]), digits);
 
+	c.aftermul = false;
 
+	if(owner)
+		cipher_free_keyswitch(&c);
 }
@@ -33,9 +33,31 @@ void cipher_init(cipher_t *a);
 
 /**
  * [cipher_init_keyswitch description]
+ * @param a    [description]
+ * @param keys input: the buffers fit its evaluation key
+ */
+void cipher_init_keyswitch(cipher_t *a, const yashe_keys_t *keys);
+
+/**
+ * [cipher_free_keyswitch description]
  * @param a [description]
  */
-void cipher_init_keyswitch(cipher_t *a);
+void cipher_free_keyswitch(cipher_t *a);
+
+/**
+ * Allocates the buffers of the keyswitch of K ciphertexts. Buffers already
+ * on ws are released first.
+ * @param ws     output
+ * @param digits input: words or RNS digits per ciphertext
+ * @param K      input: qty of ciphertexts
+ */
+void keyswitch_workspace_init(keyswitch_workspace_t *ws, int digits, int K);
+
+/**
+ * Releases the buffers allocated by keyswitch_workspace_init()
+ * @param ws [description]
+ */
+void keyswitch_workspace_free(keyswitch_workspace_t *ws);
 
 /**
  * [cipher_free description]
@@ -53,11 +75,22 @@ void cipher_add(cipher_t *c, cipher_t *a,cipher_t *b);
 
 /**
  * [cipher_mul description]
- * @param c [description]
- * @param a [description]
- * @param b [description]
+ * @param c    [description]
+ * @param a    [description]
+ * @param b    [description]
+ * @param keys input: the keys a and b were encrypted with
+ */
+void cipher_mul(cipher_t *c,cipher_t *a,cipher_t *b,const yashe_keys_t *keys);
+
+/**
+ * Writes the keyswitch of c, from the key f*f to f, to cmul, on TRANSSTATE
+ * and not reduced by q. It is the last step of cipher_mul(). cmul may be c.
+ * @param cmul [output]
+ * @param c    [input]
+ * @param g    input: the coefficients of c, on [0,q)
+ * @param keys input: the evaluation key is taken from it
  */
-void cipher_mul(cipher_t *c,cipher_t *a,cipher_t *b);
+void cipher_keyswitch(cipher_t *cmul, cipher_t c, bn_matrix_t *g, const yashe_keys_t *keys);
 
 /**
  * [cipher_convert description]
@@ -17,6 +17,7 @@
  */
 
 #include "yashe.h"
+#include "../aritmetic/param_context.h"
 
 int Yashe::nphi;
 int Yashe::nq;
@@ -25,16 +26,10 @@ bn_t Yashe::UQ;
 bn_t Yashe::qDiv2;
 ZZ Yashe::q = ZZ(0);
 poly_t Yashe::t;
-poly_t Yashe::delta;
 int Yashe::w = 32;
-int Yashe::lwq = 0;
-std::vector<poly_t> Yashe::gamma;
-poly_t Yashe::h;
-poly_t Yashe::f;
-poly_t Yashe::ff;
-poly_t Yashe::tf;
-poly_t Yashe::tff;
-poly_t Yashe::mdelta;
+int Yashe::keyswitch = KEYSWITCH_WORDECOMP;
+int Yashe::rns_group = 1;
+thread_local keyswitch_workspace_t Yashe::workspace;
 ZZ Yashe::WDMasking = ZZ(0);
 std::vector<poly_t> Yashe::P;
 
@@ -58,15 +53,47 @@ std::vector<poly_t> Yashe::P;
 // }
 
 
+/**
+ * Builds a new set of keys. The set held before is left as it is, for the
+ * contexts that share it.
+ */
 void Yashe::generate_keys(){
   log_debug("generate_keys:");
+  std::shared_ptr<yashe_keys_t> k = std::make_shared<yashe_keys_t>();
+  poly_t &h = k->h;
+  poly_t &f = k->f;
+  poly_t &ff = k->ff;
+  poly_t &tff = k->tff;
+  poly_t &delta = k->delta;
+  std::vector<poly_t> &gamma = k->gamma;
+
   /////////
   // q/t //
   /////////
-  q = (NTL::power2_ZZ(nq)-1);
+  // q defaults to 2^nq - 1. Any other q of nq bits takes the Barrett passes.
+  if(q == 0)
+    q = (NTL::power2_ZZ(nq)-1);
+  else if(NTL::NumBits(q) != nq)
+    throw std::runtime_error("Yashe::q has " + std::to_string(NTL::NumBits(q)) + " bits, but Yashe::nq is " + std::to_string(nq));
+  if(!bn_fixed_has_q(q))
+    bn_fixed_setup(q);
+  // WordDecomp base W = 2^w. lwq, and so the evk size and the number of
+  // keyswitch products, follows from it.
+  if(w < 1 || w > 64)
+    throw "Yashe::w must be on [1,64]";
+  const int lwq = (nq + w - 1)/w;
+  k->keyswitch = keyswitch;
+  k->lwq = lwq;
+  if(keyswitch == KEYSWITCH_RNS)
+    check_rns_group(&k->decomp);
   get_words(&Yashe::Q,q);
   get_words(&Yashe::qDiv2,q/2);
-  Yashe::UQ = get_reciprocal(q);
+  param_context_t *ctx = param_context_current();
+  if(ctx && ctx->q == q)
+    Yashe::UQ = reciprocal_get(&ctx->reciprocals, RECIPROCAL_Q);
+  else
+    Yashe::UQ = get_reciprocal(q);
+  rns_scale_setup(&k->scale, poly_get_coeff(&t,0), q, nphi);
 
   // Using delta as a polynomial results in a much faster multiplication on encryption.
   
@@ -133,6 +160,7 @@ void Yashe::generate_keys(){
       ////////////////////////
       ////////////////////////
 
+      poly_free(&test);
       log_debug("fInv computed.");
       break;
     } catch (exception& e)
@@ -140,6 +168,7 @@ void Yashe::generate_keys(){
       log_warn("f has no modular inverse: ");
       log_warn(e.what());
       std::cout << "f has no modular inverse: " << e.what()<< std::endl;
+      poly_free(&fInv);
     }
   }
   // log_debug("f: " + poly_print(&f));
@@ -163,24 +192,30 @@ void Yashe::generate_keys(){
   poly_reduce(&h, nphi, Yashe::Q,nq);
   while(h.status != TRANSSTATE)
     poly_elevate(&h);
+  poly_free(&fInv);
 
   // log_debug("h: " + poly_print(&h));
 
+  if(keyswitch == KEYSWITCH_RNS){
+    generate_rns_keys(k.get());
+    freeze_keys(k);
+    return;
+  }
+
   ///////////////////
   // Compute gamma //
   ///////////////////
   gamma.resize(lwq);
 
-  poly_t W;
-  poly_init(&W);
-  poly_set_coeff(&W,0,NTL::power2_ZZ(32));
-
   for(int i = 0 ; i < lwq; i ++){
     poly_init(&gamma[i]);
 
-    // W-shifts
-    for(int j = 0; j < i;j ++)
-      poly_mul(&gamma[i],&gamma[i],&W);
+    // f*[W^i]_q, the W-shift word i is recomposed by
+    poly_t W;
+    poly_init(&W);
+    poly_set_coeff(&W,0,NTL::power2_ZZ(w*i) % q);
+    poly_mul(&gamma[i],&f,&W);
+    poly_free(&W);
       
     // samples
     poly_t e,s;
@@ -194,13 +229,124 @@ void Yashe::generate_keys(){
     poly_init(&hs);
     poly_mul(&hs,&h,&s);
 
-    // gamma = h*s + e
+    // gamma = f*W^i + h*s + e
     poly_add(&gamma.at(i), &gamma.at(i),&e);
     poly_add(&gamma.at(i), &gamma.at(i),&hs);
     poly_reduce(&gamma.at(i), nphi, Yashe::Q,nq);
 
+    poly_free(&e);
+    poly_free(&s);
+    poly_free(&hs);
+  }
+  freeze_keys(k);
+}
+
+/**
+ * Leaves every key read by encrypt(), decrypt() and cipher_mul() on
+ * TRANSSTATE, so they are never elevated again, makes k the keys of this
+ * context and allocates the workspace of this thread.
+ */
+void Yashe::freeze_keys(std::shared_ptr<yashe_keys_t> k){
+  poly_t *polys[] = {&k->h, &k->f, &k->ff, &k->delta};
+  for(poly_t *p : polys)
+    while(p->status != TRANSSTATE)
+      poly_elevate(p);
+
+  std::vector<poly_t> &evk = (k->keyswitch == KEYSWITCH_RNS? k->rho : k->gamma);
+  for(unsigned int i = 0; i < evk.size(); i++)
+    while(evk[i].status != TRANSSTATE)
+      poly_elevate(&evk[i]);
+
+  keys = k;
+  init_workspace(std::max(workspace.K, 1));
+}
+
+void Yashe::init_workspace(int K){
+  keyswitch_workspace_init(&workspace, keys->digits(), K);
+}
+
+/**
+ * Sets the RNS digits of rns_group up, if a keyswitch with them still
+ * decrypts.
+ *
+ * The keyswitch adds f*sum_G D_G*e_G + t*g*sum_G D_G*s_G to f*c. With
+ * |D_G| < L*P_G, ||f|| = t+1 and ||g|| = 1, that is below
+ * digits*nphi^2*L*P_G*B*(2t+1), which must stay under q/(2t) for
+ * round(t*[f*c]_q/q) to be the message.
+ */
+void Yashe::check_rns_group(rns_decomp_t *out){
+  rns_decomp_t d;
+  rns_decomp_setup(&d, q, rns_group);
+
+  ZZ PG = to_ZZ(0);
+  for(int i = 0; i < d.digits; i++){
+    ZZ P = to_ZZ(1);
+    for(int j = i*d.group; j < std::min((i+1)*d.group, d.L); j++)
+      P *= to_ZZ(CRTPrimes[j]);
+    PG = std::max(PG, P);
+  }
+  const ZZ T = poly_get_coeff(&t,0);
+  const ZZ noise = d.digits * to_ZZ(nphi) * to_ZZ(nphi) * d.L * PG * xerr.get_gaussian_bound() * (2*T + 1);
+  if(2*T*noise >= q){
+    rns_decomp_free(&d);
+    throw std::runtime_error("Yashe::rns_group = " + std::to_string(rns_group) + " gives digits too big for q to decrypt the keyswitch");
+  }
+
+  *out = d;
+}
+
+/**
+ * Computes rho, the evaluation key of KEYSWITCH_RNS.
+ *
+ * There is one key per RNS digit instead of one per word. Each is built as
+ * gamma, f*(P/P_G) + h*s + e, as the digits of rns_decomp_t recompose the
+ * coefficients through P/P_G instead of w^i.
+ */
+void Yashe::generate_rns_keys(yashe_keys_t *k){
+  const rns_decomp_t &decomp = k->decomp;
+  std::vector<poly_t> &rho = k->rho;
+  poly_t &h = k->h;
+  poly_t &f = k->f;
+  rho.resize(decomp.digits);
+
+  // P, the product of the decomposition basis
+  ZZ P = to_ZZ(1);
+  for(int j = 0; j < decomp.L; j++)
+    P *= to_ZZ(CRTPrimes[j]);
+
+  for(int i = 0 ; i < decomp.digits; i++){
+    poly_init(&rho[i]);
+
+    // f*[P/P_G]_q
+    ZZ PG = to_ZZ(1);
+    for(int j = i*decomp.group; j < std::min((i+1)*decomp.group, decomp.L); j++)
+      PG *= to_ZZ(CRTPrimes[j]);
+    poly_t PGq;
+    poly_init(&PGq);
+    poly_set_coeff(&PGq,0,(P/PG) % q);
+    poly_mul(&rho[i],&f,&PGq);
+
+    poly_t e,s;
+    poly_init(&e);
+    poly_init(&s);
+    xerr.get_sample(&e,nphi-1);
+    xerr.get_sample(&s,nphi-1);
+
+    // rho = f*(P/P_G) + h*s + e
+    poly_t hs;
+    poly_init(&hs);
+    poly_mul(&hs,&h,&s);
+    poly_add(&rho.at(i), &rho.at(i),&e);
+    poly_add(&rho.at(i), &rho.at(i),&hs);
+    poly_reduce(&rho.at(i), nphi, Yashe::Q,nq);
+
+    poly_free(&PGq);
+    poly_free(&e);
+    poly_free(&s);
+    poly_free(&hs);
   }
 }
+
 void Yashe::encrypt(cipher_t *c, poly_t m){
   log_notice("Encrypt");
 
@@ -216,7 +362,7 @@ void Yashe::encrypt(cipher_t *c, poly_t m){
 
 	// 
   // start = get_cycles();
-	poly_mul(&mdelta,&m,&delta);
+	poly_mul(&mdelta,&m,yashe_keys_t::read(keys->delta));
 
   // end = get_cycles();
   // std::cout << "poly_biginteger_mul in " + std::to_string(end-start) + " cycles" << std::endl;
@@ -233,7 +379,7 @@ void Yashe::encrypt(cipher_t *c, poly_t m){
 	
   //
   // start = get_cycles();
-	poly_mul(&ps,&ps,&h);
+	poly_mul(&ps,&ps,yashe_keys_t::read(keys->h));
 
   // end = get_cycles();
   // std::cout << "poly_mul in " + std::to_string(end-start) + " cycles" << std::endl;
@@ -264,22 +410,63 @@ void Yashe::encrypt(cipher_t *c, poly_t m){
   return;
 }
 
+#ifdef NTTMUL_TRANSFORM
+void Yashe::encrypt_batch(cipher_t *c, poly_t *m, int K){
+  log_notice("Encrypt batch");
+
+  poly_batch_t mb, sb, eb;
+  poly_batch_init(&mb,K);
+  poly_batch_init(&sb,K);
+  poly_batch_init(&eb,K);
+
+  // Sample, one call for every s and one for every e
+  xerr.get_batch_sample(&sb,nphi-1);
+  xerr.get_batch_sample(&eb,nphi-1);
+
+  // The messages are copied on their residues and transformed with s.
+  // poly_batch_load() brings a copy of each one to CRTSTATE if needed.
+  mb.status = CRTSTATE;
+  for(int k = 0; k < K; k++)
+    poly_batch_load(&mb,k,&m[k]);
+
+  // m*delta + s*h
+  poly_batch_t *a[] = {&mb, &sb};
+  poly_t *x[] = {yashe_keys_t::read(keys->delta), yashe_keys_t::read(keys->h)};
+  poly_batch_mul_shared(&mb,a,x,2);
+
+  // e is added back on CRTSTATE, so it is never transformed
+  poly_batch_demote(&mb);
+  poly_batch_add(&mb,&mb,&eb);
+  poly_batch_reduce(&mb, nphi, Yashe::Q,nq);
+
+  for(int k = 0; k < K; k++)
+    poly_batch_store(&c[k].p,&mb,k);
+
+  poly_batch_free(&mb);
+  poly_batch_free(&sb);
+  poly_batch_free(&eb);
+}
+#else
+void Yashe::encrypt_batch(cipher_t *c, poly_t *m, int K){
+  // There are no batches on the cuFFT transform
+  for(int k = 0; k < K; k++)
+    encrypt(&c[k],m[k]);
+}
+#endif
+
 void Yashe::decrypt(poly_t *m, cipher_t c){
   log_notice("Decrypt");
   // uint64_t start,end,total_start,total_end;
   // total_start = get_cycles();
 
   if(c.aftermul)
-    poly_mul(m, &ff, &c.p);
+    poly_mul(m, yashe_keys_t::read(keys->ff), &c.p);
   else
-    poly_mul(m, &f, &c.p);
+    poly_mul(m, yashe_keys_t::read(keys->f), &c.p);
   // log_debug("[c*f]: " + poly_print(m));
   poly_reduce(m, nphi, Yashe::Q,nq);
   // log_debug("[c*f]_q \\in R: " + poly_print(m));
 
-  poly_mul(m, m, &t);
-  // log_debug("[c*f]_q \\in R * t: " + poly_print(m));
-
   // division by q to the nearest
    
   // start = get_cycles();
@@ -292,17 +479,86 @@ void Yashe::decrypt(poly_t *m, cipher_t c){
   //     poly_set_coeff(m,i,coeff/q);
   // }
   // poly_demote(m); // CRT
-  poly_icrt(m);
-  callCiphertextMulAux(m->d_bn_coefs, Yashe::Q, nq, CUDAFunctions::N, NULL);
-  callCRT(m->d_bn_coefs,
-          CUDAFunctions::N,
-          m->d_coefs,
-          CUDAFunctions::N,
-          CRTPrimes.size(),
-          0x0
-    );
+  // t*[c*f]_q/q is rounded straight on the residues
+  if(m->status == TRANSSTATE)
+    poly_demote(m);
+  callRNSScaleRound(m->d_coefs, &keys->scale, 0, false, CUDAFunctions::N, CRTPrimes.size(), NULL);
   m->status = CRTSTATE;
   // end = get_cycles();
   // std::cout << "decrypt last step in " + std::to_string(end-start) + " cycles" << std::endl;
   return;
 }
+
+#ifdef NTTMUL_TRANSFORM
+void Yashe::decrypt_batch(cuyasheint_t *m, cipher_t *c, int K){
+  log_notice("Decrypt batch");
+  const int N = CUDAFunctions::N;
+  const bool negacyclic = (CUDAFunctions::transform == NEGACYCLIC_NTTMUL);
+  assert(negacyclic || N == 2*nphi);
+  if(keys->scale.t == 0)
+    throw std::runtime_error("decrypt_batch: t does not fit on a word");
+
+  // Ciphertexts on TRANSSTATE are loaded as they are and the others on
+  // CRTSTATE, so none of them is transformed back and forth
+  const int states[] = {CRTSTATE, TRANSSTATE};
+  for(int aftermul = 0; aftermul <= 1; aftermul++)
+  for(int state : states){
+    std::vector<int> group;
+    for(int k = 0; k < K; k++)
+      if(c[k].aftermul == (aftermul != 0) &&
+         (c[k].p.status == TRANSSTATE) == (state == TRANSSTATE))
+        group.push_back(k);
+    const int G = group.size();
+    if(G == 0)
+      continue;
+
+    poly_batch_t b;
+    poly_batch_init(&b,G);
+    b.status = state;
+    for(int g = 0; g < G; g++)
+      poly_batch_load(&b,g,&c[group[g]].p);
+
+    // c*f or c*ff
+    poly_batch_t *a[] = {&b};
+    poly_t *x[] = {yashe_keys_t::read(aftermul? keys->ff : keys->f)};
+    poly_batch_mul_shared(&b,a,x,1);
+    poly_batch_demote(&b);
+
+    // [round(t*[c*f]/q)]_t, whose reduction mod q is dropped as it only adds
+    // multiples of t. If there is a single group, it is written in place.
+    std::vector<cuyasheint_t> out;
+    cuyasheint_t *h_out = m;
+    if(G < K){
+      out.resize(G*nphi);
+      h_out = &out[0];
+    }
+    callRNSScaleRoundModT(  h_out,
+                            b.d_coefs,
+                            &keys->scale,
+                            (negacyclic? 0 : nphi),
+                            nphi,
+                            N,
+                            G,
+                            CRTPrimes.size(),
+                            NULL);
+    if(G < K)
+      for(int g = 0; g < G; g++)
+        std::copy(&out[g*nphi], &out[(g+1)*nphi], &m[group[g]*nphi]);
+
+    poly_batch_free(&b);
+  }
+}
+#else
+void Yashe::decrypt_batch(cuyasheint_t *m, cipher_t *c, int K){
+  // There are no batches on the cuFFT transform
+  const ZZ T = poly_get_coeff(&t,0);
+  poly_t mk;
+  poly_init(&mk);
+  for(int k = 0; k < K; k++){
+    decrypt(&mk,c[k]);
+    for(int i = 0; i < nphi; i++)
+      m[k*nphi + i] = conv<cuyasheint_t>(poly_get_coeff(&mk,i) % T);
+  }
+  poly_free(&mk);
+}
+#endif
@@ -18,6 +18,7 @@
 #ifndef YASHE_H
 #define YASHE_H
 
+#include <memory>
 #include <NTL/ZZ.h>
 #include "../settings.h"
 #include "../aritmetic/polynomial.h"
@@ -29,11 +30,90 @@ struct ciphertext {
   int level = 0; // depth
   bool aftermul = false;
   std::vector<poly_t> P; // auxiliar array used on keyswitch/worddecomp
-  bn_t *d_bn_coefs; // auxiliar array used on keyswitch/worddecomp
 } typedef cipher_t;
 
+/**
+ * Buffers of the keyswitch, kept across multiplications.
+ *
+ * cipher_mul() needs a limb matrix of N coefficients and one polynomial per
+ * digit. generate_keys() allocates them once for K ciphertexts, so a
+ * multiplication doesn't allocate anything.
+ */
+struct keyswitch_workspace {
+  int K = 0; // ciphertexts
+  int digits = 0; // words or RNS digits of each ciphertext
+  std::vector<poly_t> P; // digit i of the k-th ciphertext at P[k*digits + i]
+  bn_matrix_t g; // K*N coefficients
+} typedef keyswitch_workspace_t;
+
+/**
+ * Keys of a Yashe context and the constants built with them.
+ *
+ * generate_keys() fills a new set and leaves every key on TRANSSTATE. It is
+ * never written afterwards, so contexts sharing it may read it from
+ * concurrent threads. A later generate_keys() builds another set, and the
+ * old one is released with the last context that holds it.
+ */
+struct yashe_keys {
+  poly_t h; // public key
+  poly_t f; // secret key
+  poly_t ff; // f*f
+  poly_t tff; // t*f*f
+  poly_t delta; // q/t
+  rns_scale_t scale; // round(t*x/q) on the CRT residues
+  int keyswitch = KEYSWITCH_WORDECOMP; // Yashe::keyswitch when generated
+  int lwq = 0; // log_w q, words of gamma
+  rns_decomp_t decomp; // RNS digits of rho
+  std::vector<poly_t> gamma; // evk of KEYSWITCH_WORDECOMP, one per word
+  std::vector<poly_t> rho; // evk of KEYSWITCH_RNS, one per digit
+
+  yashe_keys(){
+    poly_t *keys[] = {&h, &f, &ff, &tff, &delta};
+    for(poly_t *k : keys)
+      poly_init(k);
+  }
+  ~yashe_keys(){
+    poly_t *keys[] = {&h, &f, &ff, &tff, &delta};
+    for(poly_t *k : keys)
+      poly_free(k);
+    for(unsigned int i = 0; i < gamma.size(); i++)
+      poly_free(&gamma[i]);
+    for(unsigned int i = 0; i < rho.size(); i++)
+      poly_free(&rho[i]);
+    rns_scale_free(&scale);
+    rns_decomp_free(&decomp);
+  }
+  yashe_keys(const yashe_keys&) = delete;
+  yashe_keys& operator=(const yashe_keys&) = delete;
+
+  /**
+   * @return the words or RNS digits of the evaluation key
+   */
+  int digits() const{
+    return (keyswitch == KEYSWITCH_RNS? decomp.digits : lwq);
+  }
+  /**
+   * The poly_*() functions take their operands as non-const, as they may
+   * elevate them. The keys are already on TRANSSTATE, so they are only read.
+   */
+  static poly_t* read(const poly_t &k){
+    assert(k.status == TRANSSTATE);
+    return const_cast<poly_t*>(&k);
+  }
+} typedef yashe_keys_t;
+
 #include "ciphertext.h"
 
+/**
+ * The parameters are static and shared by every instance. The keys are
+ * held by each instance, on an immutable yashe_keys_t that generate_keys()
+ * replaces as a whole.
+ *
+ * Instances built with Yashe(owner, seed) share the keys of owner and have
+ * samplers and sample buffers of their own, so they may encrypt, multiply
+ * and decrypt on concurrent threads, one instance per thread. A
+ * generate_keys() on the owner doesn't touch the keys they hold.
+ */
 class Yashe{
   private:
     Distribution xkey;
@@ -42,25 +122,22 @@ class Yashe{
     poly_t e;
     poly_t fl;
     poly_t g;
+    poly_t mdelta;
+    void freeze_keys(std::shared_ptr<yashe_keys_t> k);
 
   public:
     static int nphi; // R_q degree
     static int nq; //
-    static ZZ q; // 
+    static ZZ q; // 2^nq - 1, unless set to another nq-bits q
     static bn_t Q; // 
     static bn_t UQ; // 
     static bn_t qDiv2; // q/2
     static poly_t t; //
-    static poly_t delta; // q/t
-    static int w; // 
-    static std::vector<poly_t> gamma; //
-    static poly_t h; // 
-    static poly_t f; // 
-    static poly_t ff; //
-    static poly_t tf; //
-    static poly_t tff; //
-    static poly_t mdelta; //
-    static int lwq; // log_w q
+    static int w; // log_2 of the WordDecomp base, on [1,64]
+    static int keyswitch; // KEYSWITCH_WORDECOMP or KEYSWITCH_RNS
+    static int rns_group; // CRT primes per digit with KEYSWITCH_RNS, see check_rns_group()
+    static thread_local keyswitch_workspace_t workspace; // see init_workspace()
+    std::shared_ptr<const yashe_keys_t> keys; // set by generate_keys()
     static ZZ WDMasking;
     static std::vector<poly_t> P;
 
@@ -81,39 +158,126 @@ class Yashe{
       poly_init(&fl);
       poly_init(&g);
       //
-      poly_init(&h); 
-      poly_init(&f); 
-      poly_init(&ff);
-      poly_init(&tf);
-      poly_init(&tff);
-      poly_init(&delta);
       poly_init(&mdelta);
       poly_init(&t);
 
     };
+    /**
+     * Context of a worker thread. The keys of owner are shared, and only the
+     * samplers, started from seed, and the sample buffers are new.
+     * @param owner [input] context whose keys and Gaussian parameters are
+     *              taken
+     * @param seed  [input] the samplers take seed and seed + 1, so it should
+     *              be two apart for each thread
+     */
+    Yashe(Yashe &owner, unsigned long long seed) :
+      xkey(NARROW),
+      xerr( DISCRETE_GAUSSIAN,
+            owner.xerr.get_gaussian_std_deviation(),
+            owner.xerr.get_gaussian_bound()),
+      keys(owner.keys){
+      xkey.set_seed(seed);
+      xerr.set_seed(seed + 1);
+
+      poly_init(&ps);
+      poly_init(&e);
+      poly_init(&fl);
+      poly_init(&g);
+      poly_init(&mdelta);
+    };
     Yashe(float gaussian_std_deviation, int gaussian_bound){
       xkey = Distribution(NARROW);
       xerr = Distribution(DISCRETE_GAUSSIAN,gaussian_std_deviation, gaussian_bound);
+
+      poly_init(&ps);
+      poly_init(&e);
+      poly_init(&fl);
+      poly_init(&g);
+      poly_init(&mdelta);
+    };
+    // The sample buffers belong to a single instance
+    Yashe(const Yashe&) = delete;
+    Yashe& operator=(const Yashe&) = delete;
+    /**
+     * Releases the sample buffers. The keys go with the last context that
+     * holds them.
+     */
+    ~Yashe(){
+      poly_free(&ps);
+      poly_free(&e);
+      poly_free(&fl);
+      poly_free(&g);
+      poly_free(&mdelta);
     };
     void generate_keys();
+    /**
+     * Allocates the keyswitch workspace of the calling thread, for K
+     * ciphertexts and the evaluation key of this context. generate_keys()
+     * does it on its own thread, and worker threads should call it before
+     * their first multiplication.
+     * @param K [input]
+     */
+    void init_workspace(int K);
+    /**
+     * Throws std::runtime_error if the RNS digits of rns_group primes are
+     * too big for a keyswitched product to decrypt. Called by
+     * generate_keys() with KEYSWITCH_RNS, before any key is replaced.
+     * @param d [output] the RNS digits, if they are accepted
+     */
+    void check_rns_group(rns_decomp_t *d);
+    void generate_rns_keys(yashe_keys_t *k);
     void encrypt(cipher_t *c, poly_t m);
+    /**
+     * encrypt() for K messages at once. On the NTT transforms, s and e are
+     * drawn for every message by one sampler call each, m*delta + s*h is
+     * computed by one pass over the batch and the reduction is fused over
+     * the whole batch. On cuFFT, each message is encrypted by encrypt().
+     * @param c [output] K ciphertexts
+     * @param m [input/output] K messages. Their values are kept, but the
+     *          NTT transforms bring each one to CRTSTATE in place.
+     * @param K [input]
+     */
+    void encrypt_batch(cipher_t *c, poly_t *m, int K);
     void decrypt(poly_t *m, cipher_t c);
-    void export_keys(std::map<std::string,std::vector<ZZ>> keys){
+    /**
+     * decrypt() for K ciphertexts at once. The ciphertexts are grouped by
+     * aftermul and status, and each group is multiplied by its key in one
+     * pass. The ciphertexts themselves are left as they are. The
+     * folding, scaling and rounding are then fused over the group and the
+     * messages are written straight as integers, with no ZZ on the way. On
+     * cuFFT, each ciphertext is decrypted by decrypt().
+     * @param m [output] K*nphi coefficients, the i-th one of the k-th message
+     *          at m[k*nphi + i], on [0,t)
+     * @param c [input] K ciphertexts
+     * @param K [input]
+     */
+    void decrypt_batch(cuyasheint_t *m, cipher_t *c, int K);
+    void export_keys(std::map<std::string,std::vector<ZZ>> out){
+      // The keys are shared, so they are brought to the host on copies
+      poly_t one, k;
+      poly_init(&one);
+      poly_init(&k);
+      poly_set_coeff(&one,0,to_ZZ(1));
 
       ////////////////
       // Public key //
       ////////////////
-      while(h.status != HOSTSTATE)
-        poly_demote(&h);
+      poly_mul(&k, &one, yashe_keys_t::read(keys->h));
+      while(k.status != HOSTSTATE)
+        poly_demote(&k);
 
-      keys["pk"] = h.coefs;
+      out["pk"] = k.coefs;
 
       ////////////////
       // Secret key //
       ////////////////
-      while(f.status != HOSTSTATE)
-        poly_demote(&f);
-      keys["sk"] = f.coefs;
+      poly_mul(&k, &one, yashe_keys_t::read(keys->f));
+      while(k.status != HOSTSTATE)
+        poly_demote(&k);
+      out["sk"] = k.coefs;
+
+      poly_free(&one);
+      poly_free(&k);
 
       /////////
       // EVK //
@@ -123,19 +287,26 @@ class Yashe{
         // keys["evk"].insert( keys["evk"].end(), gamma.at(i).begin(), gamma.at(i).end() );      
     }
 
-    void import_keys(std::map<std::string,std::vector<ZZ>> keys){
+    void import_keys(std::map<std::string,std::vector<ZZ>> in){
+      std::shared_ptr<yashe_keys_t> k = std::make_shared<yashe_keys_t>();
 
       ////////////////
       // Public key //
       ////////////////
-      for(unsigned int i = 0; i < keys["pk"].size();i ++)
-        poly_set_coeff(&h, i, keys["pk"].at(i));
+      for(unsigned int i = 0; i < in["pk"].size();i ++)
+        poly_set_coeff(&k->h, i, in["pk"].at(i));
 
       ////////////////
       // Secret key //
       ////////////////
-      for(unsigned int i = 0; i < keys["sk"].size();i ++)
-        poly_set_coeff(&f, i, keys["sk"].at(i));
+      for(unsigned int i = 0; i < in["sk"].size();i ++)
+        poly_set_coeff(&k->f, i, in["sk"].at(i));
+
+      while(k->h.status != TRANSSTATE)
+        poly_elevate(&k->h);
+      while(k->f.status != TRANSSTATE)
+        poly_elevate(&k->f);
+      keys = k;
 
       /////////
       // EVK //